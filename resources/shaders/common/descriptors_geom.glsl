@@ -14,3 +14,7 @@ layout(std430, set = 0, binding = 0) readonly buffer SectionBuffer {
 layout(std430, set = 0, binding = 1) readonly buffer InstanceBuffer {
     Instance uInstanceBuffer[];
 };
+
+layout(std430, set = 0, binding = 5) readonly buffer PreviousInstanceBuffer {
+    Instance uPreviousInstanceBuffer[];
+};
@@ -0,0 +1,13 @@
+#version 460
+
+layout (location = 0) in vec4 in_position_cs;
+layout (location = 1) in vec4 in_previous_position_cs;
+
+layout (location = 0) out vec2 out_velocity;
+
+void main() {
+    // Screen space motion in uv units from the previous to the current frame, the viewport flips y
+    vec2 ndc = in_position_cs.xy / in_position_cs.w;
+    vec2 previous_ndc = in_previous_position_cs.xy / in_previous_position_cs.w;
+    out_velocity = (ndc - previous_ndc) * vec2(0.5, -0.5);
+}
@@ -6,6 +6,15 @@
 
 layout (location = 0) in vec3 in_position;
 
+#ifdef VELOCITY
+layout (location = 0) out vec4 out_position_cs;
+layout (location = 1) out vec4 out_previous_position_cs;
+
+layout (set = 1, binding = 0) uniform VelocityUniforms {
+    mat4 previousViewProjection;
+} uVelocity;
+#endif
+
 layout (push_constant) uniform ShaderPushConstants
 {
     mat4 view;
@@ -18,4 +27,10 @@ void main() {
 
     vec4 position_ws = instance.transform * vec4(in_position, 1.0);
     gl_Position = cParams.projection * cParams.view * position_ws;
-}
\ No newline at end of file
+
+#ifdef VELOCITY
+    Instance previous_instance = uPreviousInstanceBuffer[section.instance];
+    out_position_cs = gl_Position;
+    out_previous_position_cs = uVelocity.previousViewProjection * previous_instance.transform * vec4(in_position, 1.0);
+#endif
+}
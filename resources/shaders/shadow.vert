@@ -1,5 +1,9 @@
 #version 460
 
+#ifdef LAYERED
+#extension GL_ARB_shader_viewport_layer_array : require
+#endif
+
 layout(location = 0) in vec3 in_position;
 layout(location = 1) in vec3 in_normal;
 
@@ -9,7 +13,8 @@ layout (push_constant) uniform ShaderParamConstants
 {
     mat4 projectionView;
     float extrusionBias;
-    float pad0;
+    // Array layer of the cascade, only used when all cascades are rendered in one pass
+    uint layer;
     float pad1;
     float pad2;
 } cParams;
@@ -19,4 +24,7 @@ void main() {
     Instance instance = uInstanceBuffer[section.instance];
 
     gl_Position = cParams.projectionView * instance.transform * vec4(in_position + in_normal * cParams.extrusionBias, 1.0);
+#ifdef LAYERED
+    gl_Layer = int(cParams.layer);
+#endif
 }
\ No newline at end of file
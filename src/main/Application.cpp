@@ -2,8 +2,12 @@
 
 #include <GLFW/glfw3.h>
 #include <algorithm>
+#include <charconv>
+#include <format>
+#include <sstream>
 #include <glm/gtc/type_ptr.inl>
 #include <glm/gtx/fast_trigonometry.hpp>
+#include <tracy/Tracy.hpp>
 #include <vulkan/vulkan.hpp>
 
 #include "RenderSystem.h"
@@ -13,7 +17,9 @@
 #include "backend/VulkanContext.h"
 #include "blob/HenonHeiles.h"
 #include "blob/System.h"
+#include "debug/Benchmark.h"
 #include "debug/Performance.h"
+#include "debug/QualityGovernor.h"
 #include "debug/SettingsGui.h"
 #include "entity/Camera.h"
 #include "entity/Cubemap.h"
@@ -40,8 +46,14 @@ Application::Application() {
     initAudio();
     initVariableAnimations();
     mDebugFrameTimes = std::make_unique<FrameTimes>();
+    mQualityGovernor = std::make_unique<QualityGovernor>();
     mInstanceAnimationSampler = std::make_unique<InstanceAnimationSampler>(mScene->cpu());
     mRenderSystem->recreate(mSettings);
+    initBenchmark();
+    initFrameCapture();
+
+    if (globals::HeadlessFrames > 0)
+        return;
 
     if (!globals::Debug) {
         auto monitor = glfwGetPrimaryMonitor();
@@ -57,10 +69,19 @@ Application::Application() {
 Application::~Application() = default;
 
 void Application::run() {
+    int remaining_headless_frames = globals::HeadlessFrames;
     while (!mCtx->window().shouldClose()) {
+        if (globals::HeadlessFrames > 0 && remaining_headless_frames-- == 0)
+            break;
+        if (mBenchmark && mBenchmark->finished())
+            break;
+
         mRenderSystem->advance(mSettings);
         mInput->update();
-        processInput();
+        // Input would make benchmark runs diverge
+        if (!mBenchmark)
+            processInput();
+        updateQualityGovernor();
         advanceAnimationTime();
         updateDebugCamera();
         updateAnimatedCamera();
@@ -70,6 +91,7 @@ void Application::run() {
         updateAnimatedLights();
 
         mRenderSystem->begin();
+        requestFrameCapture(globals::HeadlessFrames > 0 && remaining_headless_frames == 0);
         mRenderSystem->imGuiBackend().beginFrame();
 
         drawGui();
@@ -91,9 +113,17 @@ void Application::run() {
         });
 
         mRenderSystem->submit(mSettings);
+        FrameMark;
+
+        if (mBenchmark)
+            recordBenchmarkFrame();
     }
 
+    if (mBenchmark)
+        mBenchmark->writeReport();
+
     mCtx->device().waitIdle();
+    mRenderSystem->frameCapture().flush();
 }
 
 void Application::initContext() {
@@ -103,9 +133,12 @@ void Application::initContext() {
         .title = TITLE,
         .resizable = true,
         .visible = false,
-    })));
+    }, globals::HeadlessFrames > 0)));
     mSettings.rendering.asyncCompute = mCtx->computeQueue.queue != VK_NULL_HANDLE;
 
+    if (globals::HeadlessFrames > 0)
+        return;
+
     Logger::info("Using present mode: " + vk::to_string(mCtx->swapchain().presentMode()));
 
     mCtx->window().centerOnScreen();
@@ -119,6 +152,7 @@ void Application::initInput() {
 }
 
 void Application::initScene() {
+    ZoneScoped;
     scene::Loader scene_loader{
         mCtx->allocator(), mCtx->device(), mCtx->physicalDevice(), mCtx->transferQueue, mCtx->mainQueue,
     };
@@ -132,9 +166,7 @@ void Application::initScene() {
 
     Logger::info("Loading scene from file: " + scene_filename);
     mScene = std::make_unique<scene::Scene>(std::move(scene_loader.load(scene_filename)));
-    mSunShadowCascade = std::make_unique<ShadowCascade>(
-            mCtx->device(), mCtx->allocator(), mSettings.shadowCascade.resolution, Settings::SHADOW_CASCADE_COUNT
-    );
+    recreateShadowCascade();
     mSkyboxDay = std::make_unique<Cubemap>(
             mCtx->allocator(), mCtx->device(), mCtx->transferQueue, mCtx->mainQueue,
             Cubemap::makeSkyboxImageFilenames(SKYBOX_DAY)
@@ -196,6 +228,7 @@ void Application::initVariableAnimations() {
 }
 
 void Application::processInput() {
+    ZoneScoped;
     if (mInput->isKeyPress(GLFW_KEY_F5))
         reloadRenderSystem();
 
@@ -218,7 +251,7 @@ void Application::processInput() {
     }
 
     if (mInput->isKeyPress(GLFW_KEY_P)) {
-        if (mSettings.animation.time <= 0.0 || mSettings.animation.time >= 140.0) {
+        if (mSettings.animation.time <= 0.0 || mSettings.animation.time >= ANIMATION_DURATION) {
             mSettings.animation.time = 0;
             mSettings.animation.pause = false;
             mSettings.camera.debugCamera = false;
@@ -236,19 +269,134 @@ void Application::processInput() {
         ImGui::GetIO().ConfigFlags &= ~ImGuiConfigFlags_NoMouse;
 }
 
+void Application::initBenchmark() {
+    // ReSharper disable once CppDeprecatedEntity
+    const char *env_benchmark = std::getenv("BENCHMARK");
+    if (env_benchmark == nullptr)
+        return;
+
+    mBenchmark = std::make_unique<Benchmark>(ANIMATION_DURATION, env_benchmark);
+    mSettings.animation.time = 0;
+    mSettings.animation.pause = false;
+    mSettings.animation.playbackSpeed = 1.0f;
+    mSettings.camera.debugCamera = false;
+    mSettings.showGui = false;
+    // Both react to the measured frame time, which would make the rendered work differ between runs
+    mSettings.governor.enabled = false;
+    mSettings.dynamicResolution.enabled = false;
+    mTimeline->reset();
+}
+
+void Application::initFrameCapture() {
+    // ReSharper disable once CppDeprecatedEntity
+    const char *env_frames = std::getenv("CAPTURE_FRAMES");
+    // ReSharper disable once CppDeprecatedEntity
+    const char *env_directory = std::getenv("CAPTURE_DIR");
+    // ReSharper disable once CppDeprecatedEntity
+    const char *env_headless = std::getenv("HEADLESS_CAPTURE");
+
+    if (env_frames != nullptr) {
+        std::stringstream frames(env_frames);
+        std::string frame;
+        while (std::getline(frames, frame, ',')) {
+            uint64_t value = 0;
+            auto [end, error] = std::from_chars(frame.data(), frame.data() + frame.size(), value);
+            if (error != std::errc() || end != frame.data() + frame.size()) {
+                Logger::warning(std::format("Ignoring invalid frame '{}' in CAPTURE_FRAMES", frame));
+                continue;
+            }
+            mCaptureFrames.push_back(value);
+        }
+        std::ranges::sort(mCaptureFrames);
+    }
+    mCaptureDirectory = env_directory != nullptr ? env_directory : "captures";
+    if (env_headless != nullptr && globals::HeadlessFrames > 0)
+        mHeadlessCapturePath = env_headless;
+
+    bool requested = !mCaptureFrames.empty() || !mHeadlessCapturePath.empty();
+    if (requested && !mCtx->swapchain().readable())
+        Logger::warning("Swapchain images can not be read back, frame captures are disabled");
+}
+
+void Application::requestFrameCapture(bool last_frame) {
+    if (!mCtx->swapchain().readable())
+        return;
+
+    // Benchmark frames show the same content in every run, which makes their captures comparable
+    uint64_t frame = mBenchmark ? mBenchmark->frame() : mRenderSystem->frameNumber();
+    if (std::ranges::binary_search(mCaptureFrames, frame))
+        mRenderSystem->frameCapture().request(mCaptureDirectory / std::format("frame_{:05}.png", frame));
+    else if (last_frame && !mHeadlessCapturePath.empty())
+        mRenderSystem->frameCapture().request(mHeadlessCapturePath);
+}
+
+void Application::recordBenchmarkFrame() {
+    const auto &timings = mRenderSystem->timings();
+    mBenchmark->record("cpu_frame", timings.total);
+    mBenchmark->record("cpu_record", timings.record);
+    mBenchmark->record("cpu_submit", timings.submit);
+    mBenchmark->record("cpu_wait", timings.fence);
+
+    // GPU times arrive a few frames late, each resolved frame is recorded once
+    const auto &profiler = mRenderSystem->gpuProfiler();
+    if (profiler.lastResolvedFrame() && profiler.lastResolvedFrame() != mLastBenchmarkGpuFrame) {
+        mLastBenchmarkGpuFrame = profiler.lastResolvedFrame();
+        mBenchmark->record("gpu_frame", profiler.lastFrameTime());
+    }
+    mBenchmark->endFrame();
+}
+
+void Application::updateQualityGovernor() {
+    ZoneScoped;
+    QualityGovernor::Reload reload;
+    // Dynamic resolution reacts to the same GPU frame time, it owns the budget while enabled
+    if (mSettings.governor.enabled && !mSettings.dynamicResolution.enabled) {
+        // Only frames resolved since the last call carry new information
+        const auto &profiler = mRenderSystem->gpuProfiler();
+        if (!profiler.lastResolvedFrame() || profiler.lastResolvedFrame() == mLastGovernorGpuFrame)
+            return;
+        mLastGovernorGpuFrame = profiler.lastResolvedFrame();
+        reload = mQualityGovernor->update(mSettings, profiler.lastFrameTime(), profiler.passStats());
+    } else {
+        reload = mQualityGovernor->reset(mSettings);
+        mLastGovernorGpuFrame.reset();
+    }
+
+    if (reload & QualityGovernor::Reload::ShadowMaps)
+        recreateShadowCascade();
+    // Shadow maps are referenced by cached descriptor sets, so they need a render system reload as well
+    if (reload != QualityGovernor::Reload::None)
+        reloadRenderSystem();
+}
+
+void Application::recreateShadowCascade() {
+    mCtx->device().waitIdle();
+    mSunShadowCascade = std::make_unique<ShadowCascade>(
+            mCtx->device(), mCtx->allocator(), mSettings.shadowCascade.resolution, Settings::SHADOW_CASCADE_COUNT,
+            mSettings.shadowCascade.layered && globals::ShaderOutputLayer
+    );
+}
+
+float Application::timeDelta() const {
+    return mBenchmark ? mBenchmark->timeDelta() : mInput->timeDelta();
+}
+
 void Application::advanceAnimationTime() {
+    ZoneScoped;
     if (!mSettings.animation.pause) {
-        float dt = mInput->timeDelta() * mSettings.animation.playbackSpeed;
+        float dt = timeDelta() * mSettings.animation.playbackSpeed;
         mSettings.animation.time += dt;
     }
 }
 
 void Application::updateAnimatedCamera() {
+    ZoneScoped;
     const glm::mat4 anim_cam_transform = mInstanceAnimationSampler->sampleNamedTransform("Camera", mSettings.animation.time);
     mAnimatedCamera->updateBasedOnTransform(anim_cam_transform);
 }
 
 void Application::updateBlob() {
+    ZoneScoped;
     if (!mSettings.animation.animateBlobNode)
         return;
 
@@ -259,7 +407,7 @@ void Application::updateBlob() {
     float time = mSettings.animation.time;
     glm::vec3 center = mInstanceAnimationSampler->sampleNamedTranslation("Blob", time);
 
-    mBlobChaos->update(std::min(mInput->timeDelta() * mSettings.blob.animationSpeed, 1.0f / 30.0f));
+    mBlobChaos->update(std::min(timeDelta() * mSettings.blob.animationSpeed, 1.0f / 30.0f));
     for (size_t i = 0; i < balls.size(); i++) {
         auto &ball = balls[i];
         ball.baseRadius = mSettings.blob.baseRadius;
@@ -273,6 +421,7 @@ void Application::updateBlob() {
 }
 
 void Application::updateAudio() {
+    ZoneScoped;
     const Camera &camera = activeCamera();
 
     mAudio->system->setVolume(mSettings.audio.masterVolume);
@@ -298,6 +447,7 @@ void Application::updateAudio() {
 }
 
 void Application::updateAnimatedVariables() {
+    ZoneScoped;
     if (mSettings.animation.animateVariables)
         mVariableAnimationController.update(mSettings.animation.time);
 
@@ -316,13 +466,14 @@ void Application::updateAnimatedVariables() {
         for (size_t i = 0; i < scene::Loader::DYNAMIC_LIGHTS_RESERVATION; i++) {
             size_t offset = mScene->cpu().lights.size() - scene::Loader::DYNAMIC_LIGHTS_RESERVATION;
             auto &light = mScene->cpu().lights[offset + i];
-            light.position.y += (std::max(light.position.y, 0.0f) * 0.5f + 3.0f) * mInput->timeDelta();
+            light.position.y += (std::max(light.position.y, 0.0f) * 0.5f + 3.0f) * timeDelta();
             light.position.y = std::fmodf(light.position.y, 40.0f);
         }
     }
 }
 
 void Application::updateAnimatedLights() {
+    ZoneScoped;
     for (const auto &[animation_name, light_index]: mScene->cpu().named_light_animations) {
         UberLightBlock &uberLight = mScene->cpu().lights[light_index];
         const glm::mat4 transform = mInstanceAnimationSampler->sampleNamedTransform(animation_name, mSettings.animation.time);
@@ -337,6 +488,7 @@ void Application::updateAnimatedLights() {
 }
 
 void Application::drawGui() {
+    ZoneScoped;
     auto cpuRenderTimings = mRenderSystem->timings();
     mDebugFrameTimes->lines.emplace_back("Fence", static_cast<float>(cpuRenderTimings.fence));
     mDebugFrameTimes->lines.emplace_back("Advance", static_cast<float>(cpuRenderTimings.advance));
@@ -344,8 +496,26 @@ void Application::drawGui() {
     mDebugFrameTimes->lines.emplace_back("Submit", static_cast<float>(cpuRenderTimings.submit));
     mDebugFrameTimes->lines.emplace_back("Present", static_cast<float>(cpuRenderTimings.present));
     mDebugFrameTimes->lines.emplace_back("Total", static_cast<float>(cpuRenderTimings.total));
+    auto transientBufferStats = mRenderSystem->transientBufferStats();
+    mDebugFrameTimes->lines.emplace_back("Transient MB", static_cast<float>(transientBufferStats.lastFrameUsed) / (1024.0f * 1024.0f));
+    mDebugFrameTimes->lines.emplace_back("Transient Peak MB", static_cast<float>(transientBufferStats.highWaterMark) / (1024.0f * 1024.0f));
+    if (mSettings.governor.enabled && !mSettings.dynamicResolution.enabled)
+        mDebugFrameTimes->lines.emplace_back("Quality Level", static_cast<float>(mQualityGovernor->level()));
+    if (mSettings.dynamicResolution.enabled)
+        mDebugFrameTimes->lines.emplace_back("Render Scale", mRenderSystem->renderScale());
+    if (mSettings.rendering.enableFrustumCulling && mSettings.rendering.occlusionCulling) {
+        const auto &cullingStats = mRenderSystem->cullingStats();
+        mDebugFrameTimes->lines.emplace_back("Sections Drawn", static_cast<float>(cullingStats.firstPhase + cullingStats.secondPhase));
+        mDebugFrameTimes->lines.emplace_back("Sections Occluded", static_cast<float>(cullingStats.occluded - cullingStats.secondPhase));
+        mDebugFrameTimes->lines.emplace_back("Second Phase", static_cast<float>(cullingStats.secondPhase));
+    }
+    mDebugFrameTimes->gpuPasses = mRenderSystem->gpuProfiler().passStats();
     mDebugFrameTimes->update(mInput->timeDelta());
     mDebugFrameTimes->draw();
+    if (mDebugFrameTimes->exportGpuTrace) {
+        mDebugFrameTimes->exportGpuTrace = false;
+        mRenderSystem->gpuProfiler().writeChromeTrace("gpu_trace.json");
+    }
 
     mSettingsGui->draw(mSettings);
 }
@@ -359,22 +529,32 @@ void Application::updateViewport() {
 }
 
 void Application::updateSunShadowCascades() {
+    ZoneScoped;
     const Camera &camera = activeCamera();
 
     mSunShadowCascade->lambda = mSettings.shadowCascade.lambda;
     mSunShadowCascade->distance = mSettings.shadowCascade.distance;
-    mSunShadowCascade->update(camera.fov(), camera.aspect(), camera.viewMatrix(), -mSettings.sun.direction());
+    mSunShadowCascade->casterCulling = mSettings.shadowCascade.casterCulling;
+    mSunShadowCascade->setCacheStatic(mCtx->device(), mCtx->allocator(), mSettings.shadowCascade.cacheStatic);
+    mSunShadowCascade->fitToDepth = mSettings.shadowCascade.fitToDepth;
+    mSunShadowCascade->update(
+            camera.fov(), camera.aspect(), camera.viewMatrix(), -mSettings.sun.direction(),
+            mRenderSystem->visibleDepthRange()
+    );
 
     for (size_t i = 0; i < mSettings.shadowCascades.size(); i++)
         mSettings.shadowCascades[i].applyTo(mSunShadowCascade->cascades()[i]);
 }
 
 void Application::updateGpuData() {
+    ZoneScoped;
     std::vector<glm::mat4> animated_instance_transforms =
             mInstanceAnimationSampler->sampleAnimatedInstanceTransforms(mSettings.animation.time);
 
-    if (!animated_instance_transforms.empty())
+    if (!animated_instance_transforms.empty()) {
         mRenderSystem->updateInstanceTransforms(mScene->gpu(), animated_instance_transforms);
+        mScene->cpu().instance_bvh.refit(animated_instance_transforms);
+    }
 
     mRenderSystem->updateLights(mScene->gpu(), mScene->cpu().lights);
 }
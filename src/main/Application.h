@@ -1,9 +1,12 @@
 #pragma once
 
 #include <array>
+#include <filesystem>
 #include <glm/glm.hpp>
 #include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
 #include "SceneAnimation.h"
 #include "animation/InstanceAnimationSampler.h"
@@ -24,6 +27,8 @@ class ShadowCascade;
 class RenderSystem;
 class SettingsGui;
 struct FrameTimes;
+class Benchmark;
+class QualityGovernor;
 namespace glfw {
     class Input;
 }
@@ -50,6 +55,7 @@ private:
     static constexpr float NEAR_PLANE{0.001f};
     static constexpr glm::vec3 DEFAULT_CAMERA_POSITION{0.0f, 1.0f, 5.0f};
     static constexpr glm::vec3 DEFAULT_BLOB_POSITION{0.0f, 2.0f, 0.0f};
+    static constexpr float ANIMATION_DURATION{140.0f};
     static constexpr char TITLE[]{"City Lights"};
     static constexpr char DEFAULT_SCENE_FILENAME[]{"resources/scenes/city_scene.glb"};
     static constexpr char  SKYBOX_DAY[] = "resources/skybox/evening_road_01_puresky_2k";
@@ -69,6 +75,14 @@ private:
     std::unique_ptr<ShadowCascade> mSunShadowCascade;
 
     std::unique_ptr<FrameTimes> mDebugFrameTimes;
+    std::unique_ptr<Benchmark> mBenchmark;
+    std::unique_ptr<QualityGovernor> mQualityGovernor;
+    std::optional<uint64_t> mLastGovernorGpuFrame;
+    std::optional<uint64_t> mLastBenchmarkGpuFrame;
+    // Sorted frame numbers to capture, of the benchmark if one runs
+    std::vector<uint64_t> mCaptureFrames;
+    std::filesystem::path mCaptureDirectory;
+    std::filesystem::path mHeadlessCapturePath;
 
     std::unique_ptr<blob::System> mBlobSystem;
     std::unique_ptr<HenonHeiles> mBlobChaos;
@@ -95,6 +109,8 @@ private:
     void initCameras();
     void initAudio();
     void initVariableAnimations();
+    void initBenchmark();
+    void initFrameCapture();
 
     void processInput();
     void advanceAnimationTime();
@@ -110,6 +126,13 @@ private:
     void reloadRenderSystem();
     void updateDebugCamera();
     void updateMouseCapture();
+    void recordBenchmarkFrame();
+    void updateQualityGovernor();
+    void recreateShadowCascade();
+    void requestFrameCapture(bool last_frame);
+
+    /// <summary>Time step of the animation, fixed while benchmarking.</summary>
+    [[nodiscard]] float timeDelta() const;
 
     const Camera &activeCamera() const;
 };
@@ -1,16 +1,19 @@
 #include "RenderSystem.h"
 
+#include <algorithm>
+#include <cmath>
+#include <tracy/Tracy.hpp>
+
 #include "backend/Swapchain.h"
 #include "blob/System.h"
 #include "debug/Annotation.h"
+#include "entity/Camera.h"
 #include "entity/ShadowCaster.h"
 #include "scene/Scene.h"
 #include "util/globals.h"
 #include "util/math.h"
 
 void RenderSystem::PerFrameObjects::reset(const vk::Device &device) {
-    device.resetFences(*inFlightFence);
-
     earlyGraphicsCommands.reset();
     mainGraphicsCommands.reset();
     independentGraphicsCommands.reset();
@@ -19,6 +22,7 @@ void RenderSystem::PerFrameObjects::reset(const vk::Device &device) {
 
     descriptorAllocator.reset();
     transientBufferAllocator.reset();
+    uploadHeap.reset();
 }
 
 void RenderSystem::PerFrameObjects::setDebugLabels(const vk::Device &device, int frame) {
@@ -27,13 +31,14 @@ void RenderSystem::PerFrameObjects::setDebugLabels(const vk::Device &device, int
     util::setDebugName(device, independentGraphicsCommands, std::format("independent_graphics_{}", frame));
     util::setDebugName(device, asyncComputeCommands, std::format("async_compute_{}", frame));
     util::setDebugName(device, nonAsyncComputeCommands, std::format("non_async_compute_{}", frame));
-    util::setDebugName(device, *inFlightFence, std::format("in_flight_{}", frame));
     util::setDebugName(device, *imageAvailableSemaphore, std::format("image_available_{}", frame));
-    util::setDebugName(device, *asyncComputeFinishedSemaphore, std::format("async_compute_finished_{}", frame));
-    util::setDebugName(device, *earlyGraphicsFinishedSemaphore, std::format("early_graphics_finished{}", frame));
 }
 
-RenderSystem::RenderSystem(VulkanContext *context) : mContext(context) {
+RenderSystem::RenderSystem(VulkanContext *context)
+    : mContext(context), mDeletionQueue(context->device(), context->allocator()),
+      mGraphicsTimeline(context->device()), mComputeTimeline(context->device()) {
+    util::setDebugName(context->device(), vk::Semaphore(mGraphicsTimeline), "graphics_timeline");
+    util::setDebugName(context->device(), vk::Semaphore(mComputeTimeline), "compute_timeline");
     mImguiBackend = std::make_unique<ImGuiBackend>(
             context->instance(), context->device(), context->physicalDevice(), context->window(), context->swapchain(),
             context->mainQueue, context->swapchain().depthFormat()
@@ -46,6 +51,11 @@ RenderSystem::RenderSystem(VulkanContext *context) : mContext(context) {
         .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
         .queueFamilyIndex = context->computeQueue,
     });
+    mGpuProfiler = std::make_unique<GpuProfiler>(
+            context->device(), context->physicalDevice(), context->mainQueue.family, context->computeQueue.family
+    );
+    mGpuProfiler->initTracy(*context, *mGraphicsCommandPool, *mComputeCommandPool);
+    mFrameCapture = std::make_unique<FrameCapture>(context->device(), context->allocator());
     mStaticDescriptorAllocator = UniqueDescriptorAllocator(context->device());
 
     mShaderLoader = ShaderLoader();
@@ -60,29 +70,43 @@ RenderSystem::RenderSystem(VulkanContext *context) : mContext(context) {
     mSkyboxRenderer = std::make_unique<SkyboxRenderer>(context->device());
     mFrustumCuller = std::make_unique<FrustumCuller>(context->device());
     mSSAORenderer = std::make_unique<SSAORenderer>(context->device(), context->allocator(), context->mainQueue);
-    mDepthPrePassRenderer = std::make_unique<DepthPrePassRenderer>();
+    mDepthPrePassRenderer = std::make_unique<DepthPrePassRenderer>(context->device());
+    mDepthPyramid = std::make_unique<DepthPyramid>(context->device());
+    mDepthReduction = std::make_unique<DepthReduction>(context->device());
     mLightRenderer = std::make_unique<LightRenderer>(context->device());
     mFogRenderer = std::make_unique<FogRenderer>(context->device());
     mFogLightRenderer = std::make_unique<FogLightRenderer>(context->device());
     mBloomRenderer = std::make_unique<BloomRenderer>(context->device());
+    mTaaRenderer = std::make_unique<TaaRenderer>(context->device());
 }
 
 void RenderSystem::recreate(const Settings &settings) {
+    ZoneScoped;
     const auto &swapchain = mContext->swapchain();
     const auto &device = mContext->device();
 
+    // Cached descriptor sets may reference resources that are recreated below. The device is idle at this point.
+    if (mPerFrameObjects.initialized()) {
+        for (size_t i = 0; i < mPerFrameObjects.size(); i++)
+            mPerFrameObjects.get(i).descriptorAllocator.clearCache();
+    }
+
     vk::Extent2D screen_extent = mContext->swapchain().area().extent;
     vk::Extent2D screen_half_extent = {screen_extent.width / 2, screen_extent.height / 2};
 
+    // TAA replaces MSAA
+    mTaa = settings.rendering.taa;
+    mTaaHistoryValid = false;
+    int msaa = mTaa ? 1 : settings.rendering.msaa;
     vk::SampleCountFlagBits msaa_samples = vk::SampleCountFlagBits::e1;
-    if (settings.rendering.msaa == 2)
+    if (msaa == 2)
         msaa_samples = vk::SampleCountFlagBits::e2;
-    else if (settings.rendering.msaa == 4)
+    else if (msaa == 4)
         msaa_samples = vk::SampleCountFlagBits::e4;
-    else if (settings.rendering.msaa == 8)
+    else if (msaa == 8)
         msaa_samples = vk::SampleCountFlagBits::e8;
 
-    mHdrColorAttachment = ImageWithView::create(
+    mHdrColorAttachment = ResizableImage::create(
             device, mContext->allocator(),
             {
                 .format = vk::Format::eR16G16B16A16Sfloat,
@@ -93,12 +117,11 @@ void RenderSystem::recreate(const Settings &settings) {
                 .usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled |
                          vk::ImageUsageFlagBits::eTransferSrc,
                 .device = vma::MemoryUsage::eGpuOnly,
-            }
+            },
+            "hdr_color_attachment"
     );
-    util::setDebugName(device, *mHdrColorAttachment.image, "hdr_color_attachment_image");
-    util::setDebugName(device, *mHdrColorAttachment.view, "hdr_color_attachment_image_view");
     if (msaa_samples != vk::SampleCountFlagBits::e1) {
-        mHdrColorResolveImage = ImageWithView::create(
+        mHdrColorResolveImage = ResizableImage::create(
                 device, mContext->allocator(),
                 {
                     .format = vk::Format::eR16G16B16A16Sfloat,
@@ -108,14 +131,13 @@ void RenderSystem::recreate(const Settings &settings) {
                     .usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled |
                              vk::ImageUsageFlagBits::eStorage,
                     .device = vma::MemoryUsage::eGpuOnly,
-                }
+                },
+                "hdr_color_resolve"
         );
-        util::setDebugName(device, *mHdrColorResolveImage.image, "hdr_color_resolve_image");
-        util::setDebugName(device, *mHdrColorResolveImage.view, "hdr_color_resolve_image_view");
     } else {
         mHdrColorResolveImage = {};
     }
-    mHdrDepthAttachment = ImageWithView::create(
+    mHdrDepthAttachment = ResizableImage::create(
             device, mContext->allocator(),
             {
                 .format = vk::Format::eD32Sfloat,
@@ -126,14 +148,49 @@ void RenderSystem::recreate(const Settings &settings) {
                 .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled |
                          vk::ImageUsageFlagBits::eTransferSrc,
                 .device = vma::MemoryUsage::eGpuOnly,
-            }
+            },
+            "hdr_depth_attachment"
     );
-    util::setDebugName(device, *mHdrDepthAttachment.image, "hdr_depth_attachment_image");
-    util::setDebugName(device, *mHdrDepthAttachment.view, "hdr_depth_attachment_image_view");
     mHdrFramebuffer = Framebuffer(mContext->swapchain().area());
     mHdrFramebuffer.depthAttachment = ImageViewPair(mHdrDepthAttachment);
     mHdrFramebuffer.colorAttachments = {ImageViewPair(mHdrColorAttachment)};
 
+    if (mTaa) {
+        mVelocityImage = ResizableImage::create(
+                device, mContext->allocator(),
+                {
+                    .format = vk::Format::eR16G16Sfloat,
+                    .aspects = vk::ImageAspectFlagBits::eColor,
+                    .width = screen_extent.width,
+                    .height = screen_extent.height,
+                    .usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled,
+                    .device = vma::MemoryUsage::eGpuOnly,
+                },
+                "velocity"
+        );
+        for (size_t i = 0; i < mTaaHistoryImages.size(); i++) {
+            mTaaHistoryImages[i] = ResizableImage::create(
+                    device, mContext->allocator(),
+                    {
+                        .format = vk::Format::eR16G16B16A16Sfloat,
+                        .aspects = vk::ImageAspectFlagBits::eColor,
+                        .width = screen_extent.width,
+                        .height = screen_extent.height,
+                        .usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+                        .device = vma::MemoryUsage::eGpuOnly,
+                    },
+                    std::format("taa_history_{}", i)
+            );
+        }
+        mVelocityFramebuffer = Framebuffer(mContext->swapchain().area());
+        mVelocityFramebuffer.depthAttachment = ImageViewPair(mHdrDepthAttachment);
+        mVelocityFramebuffer.colorAttachments = {ImageViewPair(mVelocityImage)};
+    } else {
+        mVelocityImage = {};
+        mTaaHistoryImages = {};
+        mVelocityFramebuffer = {};
+    }
+
     mStoredHdrColorImage = ImageWithView::create(
             device, mContext->allocator(),
             {
@@ -148,8 +205,9 @@ void RenderSystem::recreate(const Settings &settings) {
     util::setDebugName(device, *mStoredHdrColorImage.image, "stored_hdr_color_image");
     util::setDebugName(device, *mStoredHdrColorImage.view, "stored_hdr_color_image_view");
 
-    auto ao_size = settings.ssao.halfResolution ? screen_half_extent : screen_extent;
-    mSsaoIntermediaryImage = ImageWithView::create(
+    mSsaoHalfResolution = settings.ssao.halfResolution;
+    auto ao_size = mSsaoHalfResolution ? screen_half_extent : screen_extent;
+    mSsaoIntermediaryImage = ResizableImage::create(
             device, mContext->allocator(),
             {
                 .format = settings.ssao.bentNormals ? vk::Format::eR8G8B8A8Unorm : vk::Format::eR8Unorm,
@@ -158,12 +216,11 @@ void RenderSystem::recreate(const Settings &settings) {
                 .height = ao_size.height,
                 .usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
                 .device = vma::MemoryUsage::eGpuOnly,
-            }
+            },
+            "ao_intermediary"
     );
-    util::setDebugName(device, *mSsaoIntermediaryImage.image, "ao_intermediary_image");
-    util::setDebugName(device, *mSsaoIntermediaryImage.view, "ao_intermediary_image_view");
 
-    mSsaoResultImage = ImageWithView::create(
+    mSsaoResultImage = ResizableImage::create(
             device, mContext->allocator(),
             {
                 .format = settings.ssao.bentNormals ? vk::Format::eR8G8B8A8Unorm : vk::Format::eR8Unorm,
@@ -173,12 +230,11 @@ void RenderSystem::recreate(const Settings &settings) {
                 .usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
                 .device = vma::MemoryUsage::eGpuOnly,
                 .sharedQueues = {mContext->mainQueue, mContext->computeQueue},
-            }
+            },
+            "ao_result"
     );
-    util::setDebugName(device, *mSsaoResultImage.image, "ao_result_image");
-    util::setDebugName(device, *mSsaoResultImage.view, "ao_result_image_view");
 
-    mComputeDepthCopyImage = ImageWithView::create(
+    mComputeDepthCopyImage = ResizableImage::create(
             device, mContext->allocator(),
             {
                 .format = mHdrFramebuffer.depthFormat(),
@@ -189,10 +245,9 @@ void RenderSystem::recreate(const Settings &settings) {
                          vk::ImageUsageFlagBits::eDepthStencilAttachment,
                 .device = vma::MemoryUsage::eGpuOnly,
                 .sharedQueues = {mContext->mainQueue, mContext->computeQueue},
-            }
+            },
+            "compute_depth_copy"
     );
-    util::setDebugName(device, *mComputeDepthCopyImage.image, "compute_depth_copy_image");
-    util::setDebugName(device, *mComputeDepthCopyImage.view, "compute_depth_copy_image_view");
 
     // I don't really like that recrate has to be called explicitly.
     // I'd prefer an implicit solution, but I couldn't think of a good one right now.
@@ -203,11 +258,15 @@ void RenderSystem::recreate(const Settings &settings) {
     mSkyboxRenderer->recreate(device, mShaderLoader, mHdrFramebuffer);
     mFrustumCuller->recreate(device, mShaderLoader);
     mSSAORenderer->recreate(device, mShaderLoader, settings.ssao.slices, settings.ssao.samples, settings.ssao.bentNormals);
-    mDepthPrePassRenderer->recreate(device, mShaderLoader, mHdrFramebuffer);
+    mDepthPrePassRenderer->recreate(device, mShaderLoader, mTaa ? mVelocityFramebuffer : mHdrFramebuffer);
+    mDepthPyramid->recreate(device, mShaderLoader, mHdrFramebuffer.depthAttachment.image().info.samples);
+    mDepthPyramid->resize(device, mContext->allocator(), screen_extent, mDeletionQueue);
+    mDepthReduction->recreate(device, mShaderLoader);
     mLightRenderer->recreate(device, mShaderLoader);
     mFogRenderer->recreate(device, mShaderLoader, mContext->allocator(), screen_half_extent);
     mFogLightRenderer->recreate(device, mShaderLoader);
     mBloomRenderer->recreate(device, mContext->allocator(), mShaderLoader, screen_extent);
+    mTaaRenderer->recreate(device, mShaderLoader);
 
     // These have to match the max frames in flight count
     if (!mPerFrameObjects.initialized()) {
@@ -225,13 +284,36 @@ void RenderSystem::recreate(const Settings &settings) {
                 .independentGraphicsCommands = graphics_cmd_bufs[2],
                 .asyncComputeCommands = compute_cmd_bufs[0],
                 .nonAsyncComputeCommands = graphics_cmd_bufs[3],
-                .earlyGraphicsFinishedSemaphore = device.createSemaphoreUnique({}),
-                .asyncComputeFinishedSemaphore = device.createSemaphoreUnique({}),
                 .imageAvailableSemaphore = device.createSemaphoreUnique({}),
-                .inFlightFence = device.createFenceUnique({.flags = vk::FenceCreateFlagBits::eSignaled}),
-                .descriptorAllocator = UniqueDescriptorAllocator(device),
+                .descriptorAllocator =
+                        UniqueDescriptorAllocator(device, mContext->physicalDevice(), mContext->allocator()),
                 .transientBufferAllocator = UniqueTransientBufferAllocator(mContext->device(), mContext->allocator()),
+                .uploadHeap = UniqueUploadHeap(mContext->device(), mContext->allocator()),
+                .cullingStats = Buffer::create(
+                        mContext->allocator(),
+                        {
+                            .size = sizeof(FrustumCuller::Stats),
+                            .usage = vk::BufferUsageFlagBits::eTransferDst,
+                            .flags = vma::AllocationCreateFlagBits::eHostAccessRandom |
+                                     vma::AllocationCreateFlagBits::eMapped,
+                            .requiredProperties = vk::MemoryPropertyFlagBits::eHostVisible,
+                            .preferredProperties = vk::MemoryPropertyFlagBits::eHostCached,
+                        }
+                ),
+                .depthRange = Buffer::create(
+                        mContext->allocator(),
+                        {
+                            .size = sizeof(DepthReduction::Result),
+                            .usage = vk::BufferUsageFlagBits::eTransferDst,
+                            .flags = vma::AllocationCreateFlagBits::eHostAccessRandom |
+                                     vma::AllocationCreateFlagBits::eMapped,
+                            .requiredProperties = vk::MemoryPropertyFlagBits::eHostVisible,
+                            .preferredProperties = vk::MemoryPropertyFlagBits::eHostCached,
+                        }
+                ),
             };
+            util::setDebugName(device, *result.cullingStats.buffer, std::format("culling_stats_{}", i));
+            util::setDebugName(device, *result.depthRange.buffer, std::format("depth_range_{}", i));
             result.setDebugLabels(device, i);
             return result;
         });
@@ -278,80 +360,145 @@ void RenderSystem::recreate(const Settings &settings) {
                 });
     util::setDebugName(device, *mFogFroxelLightIndicesBuffer.buffer, "light_froxel_indices");
 
-
-    mInstanceTransformUpdates.create(globals::MaxFramesInFlight, [&] {
-        return Buffer{}; // initially empty; will be allocated on demand
-    });
-    mLightUpdates.create(globals::MaxFramesInFlight, [&] {
-        return Buffer{};
-    });
+    // The render targets were created at full resolution, keep the current scale
+    if (mRenderScale < 1.0f)
+        resizeRenderTargets(renderExtent(mRenderScale));
 }
 
-void RenderSystem::updateInstanceTransforms(const scene::GpuData &gpu_scene_data, std::span<const glm::mat4> updated_transforms) {
-    if (updated_transforms.empty())
+void RenderSystem::updateRenderScale(const Settings &settings) {
+    float scale = mRenderScale;
+    if (!settings.dynamicResolution.enabled) {
+        scale = 1.0f;
+    } else {
+        auto resolved_frame = mGpuProfiler->lastResolvedFrame();
+        if (resolved_frame && resolved_frame != mLastRenderScaleGpuFrame && *resolved_frame >= mRenderScaleFrame) {
+            mLastRenderScaleGpuFrame = resolved_frame;
+            mRenderScaleFrameTimeSum += mGpuProfiler->lastFrameTime();
+            mRenderScaleFrameCount++;
+        }
+
+        if (mRenderScaleFrameCount >= RenderScaleWindow) {
+            double frame_time = mRenderScaleFrameTimeSum / mRenderScaleFrameCount;
+            mRenderScaleFrameTimeSum = 0;
+            mRenderScaleFrameCount = 0;
+            if (frame_time > 0) {
+                // GPU time is roughly proportional to the pixel count, which is quadratic in the scale
+                float ideal = mRenderScale * static_cast<float>(std::sqrt(settings.dynamicResolution.targetFrameTime / frame_time));
+                ideal = std::round(ideal / RenderScaleStep) * RenderScaleStep;
+                scale = std::clamp(ideal, std::min(settings.dynamicResolution.minScale, 1.0f), 1.0f);
+            }
+        }
+    }
+
+    if (scale == mRenderScale)
         return;
 
-    vk::CommandBuffer &cmd = mPerFrameObjects.get().earlyGraphicsCommands;
-    util::ScopedCommandLabel dbg_cmd_label_region(cmd, "Instance Transform Update");
+    mRenderScale = scale;
+    mRenderScaleFrame = mFrameNumber;
+    mRenderScaleFrameTimeSum = 0;
+    mRenderScaleFrameCount = 0;
+    resizeRenderTargets(renderExtent(scale));
+}
 
-    Buffer &staging_buffer = mInstanceTransformUpdates.get();
-    const size_t required_size = updated_transforms.size() * sizeof(InstanceBlock);
+vk::Extent2D RenderSystem::renderExtent(float scale) const {
+    vk::Extent2D screen_extent = mContext->swapchain().area().extent;
+    if (scale >= 1.0f)
+        return screen_extent;
+    // Even extents keep the half resolution passes aligned to the full resolution ones
+    auto scaled = [scale](uint32_t size) {
+        return std::max(static_cast<uint32_t>(static_cast<float>(size) * scale) & ~1u, 2u);
+    };
+    return {scaled(screen_extent.width), scaled(screen_extent.height)};
+}
 
-    if (!staging_buffer || staging_buffer.size < required_size)
-        staging_buffer = Buffer::create(
-                mContext->allocator(),
-                {
-                    .size = required_size,
-                    .usage = vk::BufferUsageFlagBits::eTransferSrc,
-                    .flags = vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
-                    .device = vma::MemoryUsage::eAuto,
-                    .requiredProperties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-                }
-        );
+void RenderSystem::resizeRenderTargets(vk::Extent2D extent) {
+    ZoneScoped;
+    const auto &device = mContext->device();
+    const auto &allocator = mContext->allocator();
+    vk::Extent2D half_extent = {extent.width / 2, extent.height / 2};
+
+    mHdrColorAttachment.resize(device, allocator, extent, mDeletionQueue);
+    if (mHdrColorResolveImage)
+        mHdrColorResolveImage.resize(device, allocator, extent, mDeletionQueue);
+    mHdrDepthAttachment.resize(device, allocator, extent, mDeletionQueue);
+    mComputeDepthCopyImage.resize(device, allocator, extent, mDeletionQueue);
+    auto ao_size = mSsaoHalfResolution ? half_extent : extent;
+    mSsaoIntermediaryImage.resize(device, allocator, ao_size, mDeletionQueue);
+    mSsaoResultImage.resize(device, allocator, ao_size, mDeletionQueue);
+    mFogRenderer->resize(device, allocator, half_extent, mDeletionQueue);
+    mDepthPyramid->resize(device, allocator, extent, mDeletionQueue);
+
+    mHdrFramebuffer = Framebuffer(extent);
+    mHdrFramebuffer.depthAttachment = ImageViewPair(mHdrDepthAttachment);
+    mHdrFramebuffer.colorAttachments = {ImageViewPair(mHdrColorAttachment)};
 
-    std::memcpy(staging_buffer.persistentMapping, updated_transforms.data(), required_size);
+    if (mTaa) {
+        mVelocityImage.resize(device, allocator, extent, mDeletionQueue);
+        for (auto &history: mTaaHistoryImages)
+            history.resize(device, allocator, extent, mDeletionQueue);
+        mVelocityFramebuffer = Framebuffer(extent);
+        mVelocityFramebuffer.depthAttachment = ImageViewPair(mHdrDepthAttachment);
+        mVelocityFramebuffer.colorAttachments = {ImageViewPair(mVelocityImage)};
+        mTaaHistoryValid = false;
+    }
 
-    vk::DeviceSize dstOffset = gpu_scene_data.instances.size - updated_transforms.size() * sizeof(glm::mat4);
-    vk::BufferCopy copy_region{0, dstOffset, required_size};
-    gpu_scene_data.instances.barrier(cmd, BufferResourceAccess::TransferWrite);
-    cmd.copyBuffer(staging_buffer, gpu_scene_data.instances, 1, &copy_region);
+    // Cached descriptor sets may reference the released views. The current frame slot has finished on the GPU,
+    // the others are cleared once they come around again, before the released views are destroyed.
+    mPerFrameObjects.get().descriptorAllocator.clearCache();
+    mStaleDescriptorCaches = mPerFrameObjects.size() - 1;
+    mRenderTargetsResized = true;
 }
 
-void RenderSystem::updateLights(const scene::GpuData &gpu_scene_data, std::span<const UberLightBlock> updated_lights) {
-    if (updated_lights.empty())
+void RenderSystem::updateInstanceTransforms(const scene::GpuData &gpu_scene_data, std::span<const glm::mat4> updated_transforms) {
+    ZoneScoped;
+    if (updated_transforms.empty())
         return;
 
-    vk::CommandBuffer &cmd = mPerFrameObjects.get().earlyGraphicsCommands;
-    util::ScopedCommandLabel dbg_cmd_label_region(cmd, "Light Update");
-
-    Buffer &staging_buffer = mLightUpdates.get();
-    const size_t required_size = updated_lights.size() * sizeof(UberLightBlock);
-
-    if (!staging_buffer || staging_buffer.size < required_size)
-        staging_buffer = Buffer::create(
-                mContext->allocator(),
-                {
-                    .size = required_size,
-                    .usage = vk::BufferUsageFlagBits::eTransferSrc,
-                    .flags = vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
-                    .device = vma::MemoryUsage::eAuto,
-                    .requiredProperties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+    vk::DeviceSize dst_offset = gpu_scene_data.instances.size - updated_transforms.size() * sizeof(glm::mat4);
+
+    // Keep the transforms of the last frame for motion vectors. Animated instances are updated every frame,
+    // so only the updated range at the end of the buffer can differ. Without TAA no velocities are rendered.
+    // Enabling TAA recreates the render system, which invalidates the history, and the copy below already
+    // holds the transforms of the previous frame in the first frame after that.
+    if (mTaa) {
+        const auto &cmd_buf = mPerFrameObjects.get().earlyGraphicsCommands;
+        gpu_scene_data.instances.barrier(cmd_buf, BufferResourceAccess::TransferRead);
+        gpu_scene_data.previousInstances.barrier(cmd_buf, BufferResourceAccess::TransferWrite);
+        cmd_buf.copyBuffer(
+                gpu_scene_data.instances, gpu_scene_data.previousInstances,
+                vk::BufferCopy{
+                    .srcOffset = dst_offset, .dstOffset = dst_offset, .size = gpu_scene_data.instances.size - dst_offset
                 }
         );
+        gpu_scene_data.previousInstances.barrier(cmd_buf, BufferResourceAccess::GraphicsShaderStorageRead);
+    }
 
-    std::memcpy(staging_buffer.persistentMapping, updated_lights.data(), required_size);
+    // Recorded together with other uploads at the start of the frame
+    mPerFrameObjects.get().uploadHeap.upload(
+            updated_transforms.data(), updated_transforms.size() * sizeof(InstanceBlock), gpu_scene_data.instances, dst_offset
+    );
+}
 
-    vk::BufferCopy copy_region{0, 0, required_size};
-    gpu_scene_data.uberLights.barrier(cmd, BufferResourceAccess::TransferWrite);
-    cmd.copyBuffer(staging_buffer, gpu_scene_data.uberLights, 1, &copy_region);
-    gpu_scene_data.uberLights.barrier(cmd, BufferResourceAccess{.stage = vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader, .access = vk::AccessFlagBits2::eShaderRead});
+void RenderSystem::updateLights(const scene::GpuData &gpu_scene_data, std::span<const UberLightBlock> updated_lights) {
+    ZoneScoped;
+    if (updated_lights.empty())
+        return;
 
+    mPerFrameObjects.get().uploadHeap.upload(
+            updated_lights, gpu_scene_data.uberLights, 0,
+            BufferResourceAccess{
+                .stage = vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader,
+                .access = vk::AccessFlagBits2::eShaderRead
+            }
+    );
 }
 
 void RenderSystem::draw(const RenderData &rd) {
-    const auto &frame_objects = mPerFrameObjects.get();
+    ZoneScoped;
+    auto &frame_objects = mPerFrameObjects.get();
     const auto &desc_alloc = frame_objects.descriptorAllocator;
     const auto &buf_alloc = frame_objects.transientBufferAllocator;
+    const auto &upload_heap = frame_objects.uploadHeap;
     const auto &swapchain = mContext->swapchain();
 
     const auto &cmd_buf_compute = rd.settings.rendering.asyncCompute ? frame_objects.asyncComputeCommands
@@ -359,32 +506,97 @@ void RenderSystem::draw(const RenderData &rd) {
 
     auto time_record_start = std::chrono::high_resolution_clock::now();
 
+    updateRenderScale(rd.settings);
+
+    // Every pass renders with the jittered copy, the camera of the application stays untouched
+    Camera camera = rd.camera;
+    if (mTaa) {
+        auto phase = static_cast<uint32_t>(mFrameNumber % TaaJitterPhases) + 1;
+        vk::Extent2D extent = mHdrFramebuffer.extent();
+        camera.setJitter({
+            (2.0f * util::halton(phase, 2) - 1.0f) / static_cast<float>(extent.width),
+            (2.0f * util::halton(phase, 3) - 1.0f) / static_cast<float>(extent.height),
+        });
+    }
+    glm::mat4 view_projection = camera.unjitteredProjectionMatrix() * camera.viewMatrix();
+    // Jittered like the current frame, so that only the motion remains
+    glm::mat4 previous_view_projection = camera.jitterMatrix() * mPreviousViewProjection.value_or(view_projection);
+
     // Framebuffer needs to be synced to swapchain, so get it explicitly
     Framebuffer &swapchain_fb = mSwapchainFramebuffers.get(swapchain.activeImageIndex());
 
+    // Culled once by the depth prepass and reused by the PBR pass
+    FrustumCuller::CulledDrawCommands main_view_commands;
+
     // Early graphics
     {
         const auto &cmd_buf = frame_objects.earlyGraphicsCommands;
         util::ScopedCommandLabel dbg_cmd_label_region(cmd_buf, "Early Graphics");
 
+        if (mRenderTargetsResized) {
+            // Resized render targets alias the memory of the previous ones, which earlier frames may still access
+            vk::MemoryBarrier2 alias_barrier = {
+                .srcStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+                .srcAccessMask = vk::AccessFlagBits2::eMemoryWrite,
+                .dstStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+                .dstAccessMask = vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite,
+            };
+            cmd_buf.pipelineBarrier2(vk::DependencyInfo().setMemoryBarriers(alias_barrier));
+            mRenderTargetsResized = false;
+        }
+
+        dbg_cmd_label_region.swap("Uploads");
+        upload_heap.flush(cmd_buf);
+
         dbg_cmd_label_region.swap("Depth PrePass");
 
         // Depth pre-pass
+        mFrustumCuller->hierarchical = rd.settings.rendering.hierarchicalCulling;
         mDepthPrePassRenderer->enableCulling = rd.settings.rendering.enableFrustumCulling;
         mDepthPrePassRenderer->pauseCulling = rd.settings.rendering.pauseFrustumCulling;
-        mDepthPrePassRenderer->execute(
-                mContext->device(), desc_alloc, buf_alloc, cmd_buf, mHdrFramebuffer, mComputeDepthCopyImage, rd.camera,
-                rd.gltfScene, *mFrustumCuller
+        mDepthPrePassRenderer->enableOcclusionCulling = rd.settings.rendering.occlusionCulling;
+        main_view_commands = mDepthPrePassRenderer->execute(
+                mContext->device(), desc_alloc, buf_alloc, cmd_buf, mTaa ? mVelocityFramebuffer : mHdrFramebuffer,
+                mComputeDepthCopyImage, camera, previous_view_projection, rd.gltfScene, *mFrustumCuller,
+                mDepthPyramid.get(), &frame_objects.cullingStats
         );
+        frame_objects.cullingStatsPending =
+                rd.settings.rendering.enableFrustumCulling && rd.settings.rendering.occlusionCulling;
+        mCullingStats.total = rd.gltfScene.drawCommandCount;
+
+        // Read back a few frames later to fit the shadow cascades, without waiting for this frame
+        frame_objects.depthRangePending = rd.settings.shadowCascade.fitToDepth;
+        if (frame_objects.depthRangePending) {
+            dbg_cmd_label_region.swap("Depth Reduction");
+            mDepthReduction->execute(
+                    mContext->device(), desc_alloc, buf_alloc, cmd_buf, mComputeDepthCopyImage, camera.nearPlane(),
+                    frame_objects.depthRange
+            );
+        } else {
+            mVisibleDepthRange.reset();
+        }
+
+        if (frame_objects.cullingStatsPending || frame_objects.depthRangePending) {
+            // Makes the readbacks visible to the host once the frame's timeline value is reached
+            vk::MemoryBarrier2 host_barrier = {
+                .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+                .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+                .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+                .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+            };
+            cmd_buf.pipelineBarrier2(vk::DependencyInfo().setMemoryBarriers(host_barrier));
+        }
 
         dbg_cmd_label_region.swap("Blob System Update");
-        rd.blobSystem.update(mContext->allocator(), mContext->device(), cmd_buf);
+        rd.blobSystem.update(mContext->allocator(), mContext->device(), cmd_buf, upload_heap, mDeletionQueue);
     }
 
     // Async compute
     {
         const auto &cmd_buf_early_graphics = frame_objects.earlyGraphicsCommands;
         cmd_buf_compute.begin(vk::CommandBufferBeginInfo{});
+        if (rd.settings.rendering.asyncCompute)
+            mGpuProfiler->collect(cmd_buf_compute, GpuProfiler::Queue::Compute);
         util::ScopedCommandLabel dbg_cmd_label_region(cmd_buf_compute, "Async Compute");
 
         if (rd.settings.ssao.update) {
@@ -402,8 +614,8 @@ void RenderSystem::draw(const RenderData &rd) {
             mSSAORenderer->bias = rd.settings.ssao.bias;
             mSSAORenderer->filterSharpness = rd.settings.ssao.filterSharpness;
             mSSAORenderer->execute(
-                    mContext->device(), desc_alloc, cmd_buf_compute, rd.camera.projectionMatrix(),
-                    rd.camera.nearPlane(), mComputeDepthCopyImage, mSsaoIntermediaryImage, mSsaoResultImage
+                    mContext->device(), desc_alloc, cmd_buf_compute, camera.projectionMatrix(),
+                    camera.nearPlane(), mComputeDepthCopyImage, mSsaoIntermediaryImage, mSsaoResultImage
             );
         }
 
@@ -413,8 +625,8 @@ void RenderSystem::draw(const RenderData &rd) {
         }
         mLightRenderer->lightRangeFactor = rd.settings.rendering.lightRangeFactor;
         mLightRenderer->execute(
-                mContext->device(), desc_alloc, cmd_buf_compute, rd.gltfScene, rd.camera.projectionMatrix(),
-                rd.camera.viewMatrix(), rd.camera.nearPlane(), mComputeDepthCopyImage, mTileLightIndicesBuffer
+                mContext->device(), desc_alloc, cmd_buf_compute, rd.gltfScene, camera.projectionMatrix(),
+                camera.viewMatrix(), camera.nearPlane(), mComputeDepthCopyImage, mTileLightIndicesBuffer
         );
     }
 
@@ -426,18 +638,14 @@ void RenderSystem::draw(const RenderData &rd) {
         // Shadow pass
         if (rd.settings.shadowCascade.update) {
             util::ScopedCommandLabel dbg_cmd_label_region(cmd_buf, "Shadow Pass");
-            const ShadowCaster *inner = nullptr;
-            for (auto &caster: rd.sunShadowCasterCascade.cascades()) {
-                // Objects contained in the inner cascade are culled form the outer cascade
-                mShadowRenderer->execute(
-                        mContext->device(), desc_alloc, buf_alloc, cmd_buf, rd.gltfScene, *mFrustumCuller, caster, inner
-                );
-                inner = &caster;
-            }
+            mShadowRenderer->execute(
+                    mContext->device(), desc_alloc, buf_alloc, upload_heap, cmd_buf, rd.gltfScene, *mFrustumCuller,
+                    rd.sunShadowCasterCascade
+            );
         }
 
         util::ScopedCommandLabel dbg_cmd_label_region(cmd_buf, "Blob Pass");
-        mBlobRenderer->compute(mContext->device(), cmd_buf, rd.blobSystem, rd.timestamp);
+        mBlobRenderer->compute(mContext->device(), cmd_buf, upload_heap, rd.blobSystem, rd.timestamp);
     }
 
     // Main Graphics
@@ -449,18 +657,16 @@ void RenderSystem::draw(const RenderData &rd) {
 
         // Main render pass
         dbg_cmd_label_region.swap("PBR Scene Pass");
-        mPbrSceneRenderer->enableCulling = rd.settings.rendering.enableFrustumCulling;
-        mPbrSceneRenderer->pauseCulling = rd.settings.rendering.pauseFrustumCulling;
         mPbrSceneRenderer->execute(
-                mContext->device(), desc_alloc, buf_alloc, cmd_buf, mHdrFramebuffer, rd.camera, rd.gltfScene,
-                *mFrustumCuller, rd.sunLight, rd.sunShadowCasterCascade.cascades(), mSsaoResultImage,
+                mContext->device(), desc_alloc, upload_heap, cmd_buf, mHdrFramebuffer, camera, rd.gltfScene,
+                main_view_commands, rd.sunLight, rd.sunShadowCasterCascade, mSsaoResultImage,
                 mTileLightIndicesBuffer, rd.settings
         );
 
         // Skybox render pass (render late to reduce overdraw)
         dbg_cmd_label_region.swap("Skybox Pass");
         mSkyboxRenderer->execute(
-                mContext->device(), desc_alloc, cmd_buf, mHdrFramebuffer, rd.camera, rd.skyboxDay, rd.skyboxNight,
+                mContext->device(), desc_alloc, cmd_buf, mHdrFramebuffer, camera, rd.skyboxDay, rd.skyboxNight,
                 rd.settings.sky.exposure, rd.settings.sky.dayNightBlend, rd.settings.sky.tint, rd.settings.sky.rotation
         );
 
@@ -470,7 +676,7 @@ void RenderSystem::draw(const RenderData &rd) {
 
             storeHdrColorImage(cmd_buf);
 
-            mBlobRenderer->draw(mContext->device(), cmd_buf, mHdrFramebuffer, mStoredHdrColorImage, rd.camera, rd.sunLight, rd.settings.rendering.ambient, rd.blobSystem);
+            mBlobRenderer->draw(mContext->device(), cmd_buf, mHdrFramebuffer, mStoredHdrColorImage, camera, rd.sunLight, rd.settings.rendering.ambient, rd.blobSystem);
         }
 
         // MSAA Resolve
@@ -484,7 +690,7 @@ void RenderSystem::draw(const RenderData &rd) {
         // Fog render pass
         dbg_cmd_label_region.swap("Fog Light Pass");
 
-        mFogLightRenderer->execute(mContext->device(), desc_alloc, cmd_buf, rd.gltfScene.uberLights, rd.camera.projectionMatrix(), rd.camera.viewMatrix(), rd.camera.nearPlane(), mFogFroxelLightIndicesBuffer);
+        mFogLightRenderer->execute(mContext->device(), desc_alloc, cmd_buf, rd.gltfScene.uberLights, camera.projectionMatrix(), camera.viewMatrix(), camera.nearPlane(), mFogFroxelLightIndicesBuffer);
 
         dbg_cmd_label_region.swap("Fog Pass");
         mFogRenderer->samples = rd.settings.fog.samples;
@@ -493,12 +699,27 @@ void RenderSystem::draw(const RenderData &rd) {
         mFogRenderer->g = rd.settings.fog.g;
         mFogRenderer->heightFalloff = rd.settings.fog.heightFalloff;
         mFogRenderer->execute(
-                mContext->device(), desc_alloc, buf_alloc, cmd_buf, mHdrFramebuffer.depthAttachment,
+                mContext->device(), desc_alloc, upload_heap, cmd_buf, mHdrFramebuffer.depthAttachment,
                 resolved_hdr_color_image, rd.sunLight, rd.settings.rendering.ambient, rd.settings.fog.color,
-                rd.sunShadowCasterCascade.cascades(), rd.camera.viewMatrix(), rd.camera.projectionMatrix(),
-                rd.camera.nearPlane(), mFrameNumber, rd.gltfScene.uberLights, mFogFroxelLightIndicesBuffer
+                rd.sunShadowCasterCascade, camera.viewMatrix(), camera.projectionMatrix(),
+                camera.nearPlane(), mFrameNumber, rd.gltfScene.uberLights, mFogFroxelLightIndicesBuffer
         );
 
+        // Temporal anti-aliasing
+        const ImageWithView *scene_color_image = &resolved_hdr_color_image;
+        if (mTaa) {
+            dbg_cmd_label_region.swap("TAA Pass");
+            const auto &history = mTaaHistoryImages[(mFrameNumber + 1) % mTaaHistoryImages.size()];
+            const auto &output = mTaaHistoryImages[mFrameNumber % mTaaHistoryImages.size()];
+            glm::mat4 reprojection = previous_view_projection * glm::inverse(camera.viewProjectionMatrix());
+            mTaaRenderer->execute(
+                    mContext->device(), desc_alloc, cmd_buf, resolved_hdr_color_image, history, mVelocityImage,
+                    mHdrDepthAttachment, output, reprojection, rd.settings.rendering.taaFeedback, mTaaHistoryValid
+            );
+            mTaaHistoryValid = true;
+            scene_color_image = &output;
+        }
+
         // Bloom pass
         {
             dbg_cmd_label_region.swap("Bloom Pass");
@@ -507,15 +728,15 @@ void RenderSystem::draw(const RenderData &rd) {
 
             for (int i = 0; i < mBloomRenderer->factors.size(); i++)
                 mBloomRenderer->factors[i] = rd.settings.bloom.factors[i];
-            mBloomRenderer->execute(mContext->device(), desc_alloc, cmd_buf, resolved_hdr_color_image);
+            mBloomRenderer->execute(mContext->device(), desc_alloc, cmd_buf, *scene_color_image);
         }
 
         // Post-processing pass
         dbg_cmd_label_region.swap("Post-Process Pass");
 
         mFinalizeRenderer->execute(
-                mContext->device(), desc_alloc, cmd_buf, resolved_hdr_color_image, swapchain_fb.colorAttachments[0],
-                mBloomRenderer->result(), rd.settings.agx
+                mContext->device(), desc_alloc, cmd_buf, *scene_color_image, swapchain_fb.colorAttachments[0],
+                mBloomRenderer->result(), rd.settings.agx, rd.settings.dynamicResolution.sharpness
         );
 
         // ImGui render pass
@@ -539,35 +760,44 @@ void RenderSystem::draw(const RenderData &rd) {
             ImGui::Render();
         }
 
-        swapchain_fb.colorAttachments[0].image().barrier(cmd_buf, ImageResourceAccess::PresentSrc);
+        if (swapchain.readable())
+            mFrameCapture->record(cmd_buf, swapchain_fb.colorAttachments[0].image());
+
+        // Offscreen images are never presented, but may be read back
+        swapchain_fb.colorAttachments[0].image().barrier(
+                cmd_buf, swapchain.headless() ? ImageResourceAccess::TransferRead : ImageResourceAccess::PresentSrc
+        );
     }
 
+    mPreviousViewProjection = view_projection;
+
     auto time_record_end = std::chrono::high_resolution_clock::now();
     mTimings.record = std::chrono::duration<double, std::milli>(time_record_end - time_record_start).count();
 
     // Submit early graphics work
+    uint64_t early_graphics_value = mGraphicsTimeline.next();
     {
         frame_objects.earlyGraphicsCommands.end();
-        std::array signal = {*frame_objects.earlyGraphicsFinishedSemaphore};
-        auto submit_info = vk::SubmitInfo().setCommandBuffers(frame_objects.earlyGraphicsCommands);
-        if (rd.settings.rendering.asyncCompute) {
-            submit_info.setSignalSemaphores(signal);
-        }
-        mContext->mainQueue->submit(submit_info);
+        vk::CommandBufferSubmitInfo cmd_info = {.commandBuffer = frame_objects.earlyGraphicsCommands};
+        vk::SemaphoreSubmitInfo signal = mGraphicsTimeline.signalInfo(early_graphics_value);
+        mContext->mainQueue->submit2(vk::SubmitInfo2().setCommandBufferInfos(cmd_info).setSignalSemaphoreInfos(signal));
     }
 
     // Submit async compute
     {
         cmd_buf_compute.end();
-        vk::PipelineStageFlags wait_mask = vk::PipelineStageFlagBits::eComputeShader;
-        std::array wait = {*frame_objects.earlyGraphicsFinishedSemaphore};
-        std::array signal = {*frame_objects.asyncComputeFinishedSemaphore};
-        auto submit_info = vk::SubmitInfo().setCommandBuffers(cmd_buf_compute);
+        vk::CommandBufferSubmitInfo cmd_info = {.commandBuffer = cmd_buf_compute};
         if (rd.settings.rendering.asyncCompute) {
-            submit_info.setWaitSemaphores(wait).setWaitDstStageMask(wait_mask).setSignalSemaphores(signal);
-            mContext->computeQueue->submit(submit_info);
+            vk::SemaphoreSubmitInfo wait =
+                    mGraphicsTimeline.waitInfo(early_graphics_value, vk::PipelineStageFlagBits2::eComputeShader);
+            vk::SemaphoreSubmitInfo signal = mComputeTimeline.signalInfo(mComputeTimeline.next());
+            mContext->computeQueue->submit2(
+                    vk::SubmitInfo2().setWaitSemaphoreInfos(wait).setCommandBufferInfos(cmd_info).setSignalSemaphoreInfos(
+                            signal
+                    )
+            );
         } else {
-            mContext->mainQueue->submit(submit_info);
+            mContext->mainQueue->submit2(vk::SubmitInfo2().setCommandBufferInfos(cmd_info));
         }
     }
 
@@ -576,7 +806,8 @@ void RenderSystem::draw(const RenderData &rd) {
         frame_objects.independentGraphicsCommands.end();
         // Don't need to wait because submission is on the same queue as early graphics
         // For the same reason it doesn't need to signal for the main graphics
-        mContext->mainQueue->submit(vk::SubmitInfo().setCommandBuffers(frame_objects.independentGraphicsCommands));
+        vk::CommandBufferSubmitInfo cmd_info = {.commandBuffer = frame_objects.independentGraphicsCommands};
+        mContext->mainQueue->submit2(vk::SubmitInfo2().setCommandBufferInfos(cmd_info));
     }
 
     auto time_submit_end = std::chrono::high_resolution_clock::now();
@@ -584,13 +815,17 @@ void RenderSystem::draw(const RenderData &rd) {
 }
 
 void RenderSystem::advance(const Settings &settings) {
+    ZoneScoped;
     auto &swapchain = mContext->swapchain();
     auto &frame_objects = mPerFrameObjects.next();
 
     auto time_fence_start = std::chrono::high_resolution_clock::now();
     mBeginTime = time_fence_start;
 
-    while (mContext->device().waitForFences(*frame_objects.inFlightFence, true, UINT64_MAX) == vk::Result::eTimeout) {
+    // Blocks in the driver instead of spinning; the value is 0 for slots that were never submitted
+    {
+        ZoneScopedN("Wait for frame slot");
+        mGraphicsTimeline.wait(frame_objects.finishedValue);
     }
 
     auto time_fence_end = std::chrono::high_resolution_clock::now();
@@ -603,20 +838,53 @@ void RenderSystem::advance(const Settings &settings) {
 
     auto time_advance_end = std::chrono::high_resolution_clock::now();
     mTimings.advance = std::chrono::duration<double, std::milli>(time_advance_end - time_fence_end).count();
-
-    mInstanceTransformUpdates.next();
-    mLightUpdates.next();
 }
 
 void RenderSystem::begin() {
+    ZoneScoped;
     mPerFrameObjects.get().reset(mContext->device());
+    mDeletionQueue.beginFrame(mPerFrameObjects.index());
+    if (mStaleDescriptorCaches > 0) {
+        mPerFrameObjects.get().descriptorAllocator.clearCache();
+        mStaleDescriptorCaches--;
+    }
+
+    auto &frame_objects = mPerFrameObjects.get();
+    if (frame_objects.cullingStatsPending) {
+        mContext->allocator().invalidateAllocation(*frame_objects.cullingStats.allocation, 0, vk::WholeSize);
+        const auto *stats = static_cast<const uint32_t *>(frame_objects.cullingStats.persistentMapping);
+        // The total is not written by the GPU
+        mCullingStats.firstPhase = stats[0];
+        mCullingStats.occluded = stats[1];
+        mCullingStats.secondPhase = stats[2];
+        frame_objects.cullingStatsPending = false;
+    }
+    if (frame_objects.depthRangePending) {
+        mContext->allocator().invalidateAllocation(*frame_objects.depthRange.allocation, 0, vk::WholeSize);
+        const auto *range = static_cast<const DepthReduction::Result *>(frame_objects.depthRange.persistentMapping);
+        // The minimum stays NaN if nothing but sky was visible
+        if (range->minViewDepth <= range->maxViewDepth)
+            mVisibleDepthRange = glm::vec2(range->minViewDepth, range->maxViewDepth);
+        else
+            mVisibleDepthRange.reset();
+        frame_objects.depthRangePending = false;
+    }
+    mGpuProfiler->beginFrame(mPerFrameObjects.index(), mFrameNumber);
+    mFrameCapture->beginFrame(mPerFrameObjects.index());
+    mGpuProfiler->track(frame_objects.earlyGraphicsCommands, GpuProfiler::Queue::Graphics);
+    mGpuProfiler->track(frame_objects.mainGraphicsCommands, GpuProfiler::Queue::Graphics);
+    mGpuProfiler->track(frame_objects.independentGraphicsCommands, GpuProfiler::Queue::Graphics);
+    mGpuProfiler->track(frame_objects.nonAsyncComputeCommands, GpuProfiler::Queue::Graphics);
+    mGpuProfiler->track(frame_objects.asyncComputeCommands, GpuProfiler::Queue::Compute);
 
     // the main graphics commands are used elsewhere, so begin them early
-    mPerFrameObjects.get().earlyGraphicsCommands.begin(vk::CommandBufferBeginInfo{});
+    frame_objects.earlyGraphicsCommands.begin(vk::CommandBufferBeginInfo{});
+    mGpuProfiler->collect(frame_objects.earlyGraphicsCommands, GpuProfiler::Queue::Graphics);
 }
 
 void RenderSystem::submit(const Settings &settings) {
-    const auto &frame_objects = mPerFrameObjects.get();
+    ZoneScoped;
+    auto &frame_objects = mPerFrameObjects.get();
     // These must correspond to the active swapchain image index, because the semaphore only becomes unsignaled
     // once the swapchain image is released (and acquired)
     // https://docs.vulkan.org/guide/latest/swapchain_semaphore_reuse.html
@@ -625,19 +893,39 @@ void RenderSystem::submit(const Settings &settings) {
     auto time_submit_start = std::chrono::high_resolution_clock::now();
 
     frame_objects.mainGraphicsCommands.end();
-    util::static_vector<vk::Semaphore, 2> wait_semaphores = {*frame_objects.imageAvailableSemaphore};
-    util::static_vector<vk::PipelineStageFlags, 2> wait_masks = {vk::PipelineStageFlagBits::eColorAttachmentOutput};
+    // Headless swapchains neither signal image availability nor wait for rendering to finish
+    bool headless = mContext->swapchain().headless();
+    util::static_vector<vk::SemaphoreSubmitInfo, 2> wait_infos;
+    if (!headless) {
+        wait_infos.push_back(vk::SemaphoreSubmitInfo{
+            .semaphore = *frame_objects.imageAvailableSemaphore,
+            .stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+        });
+    }
     if (settings.rendering.asyncCompute) {
-        wait_semaphores.push_back(*frame_objects.asyncComputeFinishedSemaphore);
-        wait_masks.push_back(vk::PipelineStageFlagBits::eComputeShader); // I'm really not sure about this one
+        // The main graphics commands consume the async compute results from the compute shader stage onwards
+        wait_infos.push_back(
+                mComputeTimeline.waitInfo(mComputeTimeline.value(), vk::PipelineStageFlagBits2::eComputeShader)
+        );
+    }
+    frame_objects.finishedValue = mGraphicsTimeline.next();
+    util::static_vector<vk::SemaphoreSubmitInfo, 2> signal_infos = {
+        mGraphicsTimeline.signalInfo(frame_objects.finishedValue)
+    };
+    if (!headless) {
+        signal_infos.push_back(vk::SemaphoreSubmitInfo{
+            .semaphore = *render_finished_semaphore,
+            .stageMask = vk::PipelineStageFlagBits2::eAllCommands,
+        });
     }
-    auto submit_info = vk::SubmitInfo()
-                               .setCommandBuffers(frame_objects.mainGraphicsCommands)
-                               .setWaitSemaphores(wait_semaphores)
-                               .setWaitDstStageMask(wait_masks)
-                               .setSignalSemaphores(*render_finished_semaphore);
+    vk::CommandBufferSubmitInfo cmd_info = {.commandBuffer = frame_objects.mainGraphicsCommands};
 
-    mContext->mainQueue->submit({submit_info}, *frame_objects.inFlightFence);
+    mContext->mainQueue->submit2(
+            vk::SubmitInfo2()
+                    .setWaitSemaphoreInfos(wait_infos)
+                    .setCommandBufferInfos(cmd_info)
+                    .setSignalSemaphoreInfos(signal_infos)
+    );
 
     auto time_submit_end = std::chrono::high_resolution_clock::now();
     mTimings.submit += std::chrono::duration<double, std::milli>(time_submit_end - time_submit_start).count();
@@ -1,14 +1,23 @@
 #pragma once
 
+#include <array>
+#include <optional>
+
+#include "backend/DeletionQueue.h"
 #include "backend/Descriptors.h"
 #include "backend/Framebuffer.h"
 #include "backend/ShaderCompiler.h"
+#include "backend/TimelineSemaphore.h"
 #include "backend/VulkanContext.h"
+#include "debug/FrameCapture.h"
+#include "debug/GpuProfiler.h"
 #include "entity/Cubemap.h"
 #include "imgui/ImGui.h"
 #include "renderer/BlobRenderer.h"
 #include "renderer/BloomRenderer.h"
 #include "renderer/DepthPrePassRenderer.h"
+#include "renderer/DepthPyramid.h"
+#include "renderer/DepthReduction.h"
 #include "renderer/FinalizeRenderer.h"
 #include "renderer/FogLightRenderer.h"
 #include "renderer/FogRenderer.h"
@@ -17,6 +26,7 @@
 #include "renderer/SSAORenderer.h"
 #include "renderer/ShadowRenderer.h"
 #include "renderer/SkyboxRenderer.h"
+#include "renderer/TaaRenderer.h"
 #include "util/PerFrame.h"
 
 
@@ -44,14 +54,21 @@ class RenderSystem {
         vk::CommandBuffer asyncComputeCommands;
         vk::CommandBuffer nonAsyncComputeCommands;
 
-        vk::UniqueSemaphore earlyGraphicsFinishedSemaphore;
-        vk::UniqueSemaphore asyncComputeFinishedSemaphore;
         vk::UniqueSemaphore imageAvailableSemaphore;
 
-        vk::UniqueFence inFlightFence;
+        // Graphics timeline value signaled once all work of this frame slot completed
+        uint64_t finishedValue = 0;
 
         UniqueDescriptorAllocator descriptorAllocator;
         UniqueTransientBufferAllocator transientBufferAllocator;
+        UniqueUploadHeap uploadHeap;
+
+        // Host visible, holds FrustumCuller::Stats once the frame has finished
+        Buffer cullingStats;
+        bool cullingStatsPending = false;
+        // Host visible, holds the DepthReduction::Result of the depth prepass once the frame has finished
+        Buffer depthRange;
+        bool depthRangePending = false;
 
         void reset(const vk::Device& device);
         void setDebugLabels(const vk::Device& device, int frame);
@@ -68,9 +85,17 @@ class RenderSystem {
 
     VulkanContext *mContext;
 
+    // Resources released while recording are destroyed once their frame slot comes around again
+    DeletionQueue mDeletionQueue;
+
     vk::UniqueCommandPool mGraphicsCommandPool;
     vk::UniqueCommandPool mComputeCommandPool;
 
+    // Signaled twice per frame, after early graphics and after main graphics
+    TimelineSemaphore mGraphicsTimeline;
+    // Signaled once per frame after async compute
+    TimelineSemaphore mComputeTimeline;
+
     // Per frame in flight
     util::PerFrame<PerFrameObjects> mPerFrameObjects;
     // Per swapchain image
@@ -78,21 +103,29 @@ class RenderSystem {
     // Per swapchain image
     util::PerFrame<Framebuffer> mSwapchainFramebuffers;
 
-    util::PerFrame<Buffer> mInstanceTransformUpdates;
-    util::PerFrame<Buffer> mLightUpdates;
-
     // This descriptor allocator is never reset
     UniqueDescriptorAllocator mStaticDescriptorAllocator;
     ShaderLoader mShaderLoader;
 
+    // Render targets at the scene resolution are allocated for the swapchain extent and resized within that memory
     Framebuffer mHdrFramebuffer;
-    ImageWithView mHdrColorAttachment;
-    ImageWithView mHdrDepthAttachment;
+    ResizableImage mHdrColorAttachment;
+    ResizableImage mHdrDepthAttachment;
     ImageWithView mStoredHdrColorImage;
-    ImageWithView mSsaoIntermediaryImage;
-    ImageWithView mSsaoResultImage;
-    ImageWithView mHdrColorResolveImage;
-    ImageWithView mComputeDepthCopyImage;
+    ResizableImage mSsaoIntermediaryImage;
+    ResizableImage mSsaoResultImage;
+    ResizableImage mHdrColorResolveImage;
+    ResizableImage mComputeDepthCopyImage;
+    bool mSsaoHalfResolution = true;
+    // Temporal anti-aliasing, the depth prepass writes velocities into a second framebuffer
+    bool mTaa = false;
+    Framebuffer mVelocityFramebuffer;
+    ResizableImage mVelocityImage;
+    // Ping-ponged, the resolve of one frame is the history of the next
+    std::array<ResizableImage, 2> mTaaHistoryImages;
+    bool mTaaHistoryValid = false;
+    // Unjittered view projection of the previous frame
+    std::optional<glm::mat4> mPreviousViewProjection;
     Buffer mTileLightIndicesBuffer;
     Buffer mFogFroxelLightIndicesBuffer;
 
@@ -106,16 +139,43 @@ class RenderSystem {
     std::unique_ptr<FrustumCuller> mFrustumCuller;
     std::unique_ptr<SSAORenderer> mSSAORenderer;
     std::unique_ptr<DepthPrePassRenderer> mDepthPrePassRenderer;
+    std::unique_ptr<DepthPyramid> mDepthPyramid;
+    std::unique_ptr<DepthReduction> mDepthReduction;
     std::unique_ptr<LightRenderer> mLightRenderer;
     std::unique_ptr<FogRenderer> mFogRenderer;
     std::unique_ptr<FogLightRenderer> mFogLightRenderer;
     std::unique_ptr<BloomRenderer> mBloomRenderer;
+    std::unique_ptr<TaaRenderer> mTaaRenderer;
 
     std::chrono::time_point<std::chrono::steady_clock> mBeginTime;
     Timings mTimings;
+    std::unique_ptr<GpuProfiler> mGpuProfiler;
+    std::unique_ptr<FrameCapture> mFrameCapture;
 
     uint64_t mFrameNumber = 0;
 
+    // Of the most recent frame that finished on the GPU
+    FrustumCuller::Stats mCullingStats;
+    std::optional<glm::vec2> mVisibleDepthRange;
+
+    // Dynamic resolution
+    float mRenderScale = 1.0f;
+    // GPU frame times are only considered from this frame on, the frames before were rendered at another scale
+    uint64_t mRenderScaleFrame = 0;
+    std::optional<uint64_t> mLastRenderScaleGpuFrame;
+    double mRenderScaleFrameTimeSum = 0;
+    uint32_t mRenderScaleFrameCount = 0;
+    bool mRenderTargetsResized = false;
+    // Frame slots whose cached descriptor sets may still reference render targets from before a resize
+    size_t mStaleDescriptorCaches = 0;
+
+    // Length of the Halton(2, 3) jitter sequence
+    static constexpr uint32_t TaaJitterPhases = 8;
+
+    static constexpr float RenderScaleStep = 0.05f;
+    // Resolved GPU frames averaged before the render scale is adjusted
+    static constexpr uint32_t RenderScaleWindow = 10;
+
 public:
     explicit RenderSystem(VulkanContext *context);
 
@@ -136,6 +196,8 @@ public:
     [[nodiscard]] const DescriptorAllocator &staticDescriptorAllocator() const { return mStaticDescriptorAllocator; }
     [[nodiscard]] DescriptorAllocator &staticDescriptorAllocator() { return mStaticDescriptorAllocator; }
 
+    [[nodiscard]] DeletionQueue &deletionQueue() { return mDeletionQueue; }
+
     [[nodiscard]] const ShaderLoader &shaderLoader() const { return mShaderLoader; }
     [[nodiscard]] ShaderLoader &shaderLoader() { return mShaderLoader; }
 
@@ -144,8 +206,43 @@ public:
 
     [[nodiscard]] const Timings &timings() const { return mTimings; }
 
+    [[nodiscard]] const GpuProfiler &gpuProfiler() const { return *mGpuProfiler; }
+
+    [[nodiscard]] FrameCapture &frameCapture() { return *mFrameCapture; }
+
+    /// <summary>Occlusion culling statistics of the main view, a few frames old.</summary>
+    [[nodiscard]] const FrustumCuller::Stats &cullingStats() const { return mCullingStats; }
+
+    /// <summary>
+    /// Nearest and farthest view depth of the geometry in the depth prepass, a few frames old.
+    /// Empty if only sky was visible or the reduction is disabled by shadowCascade.fitToDepth.
+    /// </summary>
+    [[nodiscard]] std::optional<glm::vec2> visibleDepthRange() const { return mVisibleDepthRange; }
+
+    /// <summary>Scale of the scene resolution relative to the output resolution.</summary>
+    [[nodiscard]] float renderScale() const { return mRenderScale; }
+
+    /// <summary>Number of frames submitted so far.</summary>
+    [[nodiscard]] uint64_t frameNumber() const { return mFrameNumber; }
+
+    /// <summary>The graphics timeline, which other submissions may wait on.</summary>
+    [[nodiscard]] const TimelineSemaphore &graphicsTimeline() const { return mGraphicsTimeline; }
+
+    /// <summary>The graphics timeline value signaled once the current frame has finished on the GPU.</summary>
+    [[nodiscard]] uint64_t frameFinishedValue() const { return mPerFrameObjects.get().finishedValue; }
+
+    /// <summary>Transient buffer usage of the current frame's allocator.</summary>
+    [[nodiscard]] TransientBufferAllocatorStats transientBufferStats() const {
+        return mPerFrameObjects.get().transientBufferAllocator.stats();
+    }
+
 private:
 
+    /// <summary>Adjusts the render scale to the GPU frame time and resizes the render targets if it changed.</summary>
+    void updateRenderScale(const Settings &settings);
+    [[nodiscard]] vk::Extent2D renderExtent(float scale) const;
+    void resizeRenderTargets(vk::Extent2D extent);
+
     void resolveHdrColorImage(const vk::CommandBuffer &cmd_buf) const;
     void storeHdrColorImage(const vk::CommandBuffer& cmd_buf) const;
 };
@@ -0,0 +1,74 @@
+#include "BarrierBatch.h"
+
+#include "../util/globals.h"
+#include "Buffer.h"
+#include "Image.h"
+
+namespace {
+    bool overlaps(uint32_t a_begin, uint32_t a_count, uint32_t b_begin, uint32_t b_count) {
+        // Remaining counts reach until the end of the resource
+        uint64_t a_end = a_count == vk::RemainingMipLevels ? UINT64_MAX : uint64_t(a_begin) + a_count;
+        uint64_t b_end = b_count == vk::RemainingMipLevels ? UINT64_MAX : uint64_t(b_begin) + b_count;
+        return a_begin < b_end && b_begin < a_end;
+    }
+} // namespace
+
+BarrierBatch &BarrierBatch::add(const ImageBase &image, const ImageResourceAccess &begin, const ImageResourceAccess &end) {
+    return add(image.makeBarrier(vk::Image(image), image.getResourceRange(), begin, end));
+}
+
+BarrierBatch &BarrierBatch::add(const BufferBase &buffer, const BufferResourceAccess &begin, const BufferResourceAccess &end) {
+    return add(buffer.makeBarrier(vk::Buffer(buffer), buffer.rangeOffset(), buffer.rangeSize(), begin, end));
+}
+
+BarrierBatch &BarrierBatch::add(const vk::ImageMemoryBarrier2 &barrier) {
+    if (globals::Debug)
+        validateNotPending(barrier);
+    if (mImageBarriers.full())
+        flush();
+    mImageBarriers.push_back(barrier);
+    return *this;
+}
+
+BarrierBatch &BarrierBatch::add(const vk::BufferMemoryBarrier2 &barrier) {
+    if (globals::Debug)
+        validateNotPending(barrier);
+    if (mBufferBarriers.full())
+        flush();
+    mBufferBarriers.push_back(barrier);
+    return *this;
+}
+
+void BarrierBatch::flush() {
+    if (empty())
+        return;
+
+    mCmdBuf.pipelineBarrier2({
+        .bufferMemoryBarrierCount = static_cast<uint32_t>(mBufferBarriers.size()),
+        .pBufferMemoryBarriers = mBufferBarriers.data(),
+        .imageMemoryBarrierCount = static_cast<uint32_t>(mImageBarriers.size()),
+        .pImageMemoryBarriers = mImageBarriers.data(),
+    });
+    mImageBarriers.clear();
+    mBufferBarriers.clear();
+}
+
+void BarrierBatch::validateNotPending(const vk::ImageMemoryBarrier2 &barrier) const {
+    const auto &range = barrier.subresourceRange;
+    for (const auto &pending: mImageBarriers) {
+        const auto &pending_range = pending.subresourceRange;
+        bool conflict = pending.image == barrier.image && (pending_range.aspectMask & range.aspectMask) &&
+                        overlaps(pending_range.baseMipLevel, pending_range.levelCount, range.baseMipLevel, range.levelCount) &&
+                        overlaps(pending_range.baseArrayLayer, pending_range.layerCount, range.baseArrayLayer, range.layerCount);
+        assert(!conflict && "Image subresource transitioned twice in one barrier batch");
+    }
+}
+
+void BarrierBatch::validateNotPending(const vk::BufferMemoryBarrier2 &barrier) const {
+    for (const auto &pending: mBufferBarriers) {
+        uint64_t pending_end = pending.size == vk::WholeSize ? UINT64_MAX : pending.offset + pending.size;
+        uint64_t end = barrier.size == vk::WholeSize ? UINT64_MAX : barrier.offset + barrier.size;
+        bool conflict = pending.buffer == barrier.buffer && pending.offset < end && barrier.offset < pending_end;
+        assert(!conflict && "Buffer range transitioned twice in one barrier batch");
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include "../util/static_vector.h"
+#include "BufferResource.h"
+#include "ImageResource.h"
+
+struct ImageBase;
+struct BufferBase;
+
+/// <summary>
+/// Collects image and buffer barriers and records them with a single vkCmdPipelineBarrier2.
+/// The tracked resource state advances when a barrier is added, so the resources must not be accessed before the batch is flushed.
+/// Flushes automatically when full and when destroyed.
+/// </summary>
+/// <remarks>
+/// Barriers within one dependency are not ordered relative to each other, so the same subresource may only be transitioned
+/// once per flush. This is validated in debug builds.
+/// </remarks>
+class BarrierBatch {
+public:
+    explicit BarrierBatch(const vk::CommandBuffer &cmd_buf) : mCmdBuf(cmd_buf) {}
+    ~BarrierBatch() { flush(); }
+
+    BarrierBatch(const BarrierBatch &other) = delete;
+    BarrierBatch &operator=(const BarrierBatch &other) = delete;
+
+    /// <summary>
+    /// Adds a barrier for the whole image, see ImageBase::barrier.
+    /// </summary>
+    BarrierBatch &add(const ImageBase &image, const ImageResourceAccess &begin, const ImageResourceAccess &end);
+    BarrierBatch &add(const ImageBase &image, const ImageResourceAccess &single) { return add(image, single, single); }
+
+    /// <summary>
+    /// Adds a barrier for the buffer's range, see BufferBase::barrier.
+    /// </summary>
+    BarrierBatch &add(const BufferBase &buffer, const BufferResourceAccess &begin, const BufferResourceAccess &end);
+    BarrierBatch &add(const BufferBase &buffer, const BufferResourceAccess &single) { return add(buffer, single, single); }
+
+    /// <summary>
+    /// Adds a barrier whose state is tracked externally, e.g. per mip level.
+    /// </summary>
+    BarrierBatch &add(const vk::ImageMemoryBarrier2 &barrier);
+    BarrierBatch &add(const vk::BufferMemoryBarrier2 &barrier);
+
+    /// <summary>
+    /// Records all pending barriers. Does nothing if there are none.
+    /// </summary>
+    void flush();
+
+    [[nodiscard]] bool empty() const { return mImageBarriers.size() == 0 && mBufferBarriers.size() == 0; }
+
+private:
+    void validateNotPending(const vk::ImageMemoryBarrier2 &barrier) const;
+    void validateNotPending(const vk::BufferMemoryBarrier2 &barrier) const;
+
+    vk::CommandBuffer mCmdBuf;
+    util::static_vector<vk::ImageMemoryBarrier2, 16> mImageBarriers;
+    util::static_vector<vk::BufferMemoryBarrier2, 8> mBufferBarriers;
+};
@@ -1,12 +1,15 @@
 #include "Buffer.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "../debug/Annotation.h"
 #include "../util/Logger.h"
 #include "../util/math.h"
 
 
 void BufferBase::barrier(const vk::CommandBuffer &cmd_buf, const BufferResourceAccess &begin, const BufferResourceAccess &end) const {
-    BufferResource::barrier(*this, 0, vk::WholeSize, cmd_buf, begin, end);
+    BufferResource::barrier(*this, rangeOffset(), rangeSize(), cmd_buf, begin, end);
 }
 
 void BufferBase::barrier(const vk::CommandBuffer &cmd_buf, const BufferResourceAccess &single) const {
@@ -51,7 +54,11 @@ struct TransientBufferAllocatorImpl {
     vma::Allocation mBackingAlloc;
     vk::DeviceSize mTotalSize;
     vk::DeviceSize mCurrentOffset = 0;
-    std::vector<vk::Buffer> mAliases;
+    uint32_t mAllocationCount = 0;
+    // Bytes requested by oversized allocations since the last reset
+    vk::DeviceSize mDedicatedSize = 0;
+
+    TransientBufferAllocatorStats mStats;
 
     struct Dedicated {
         vk::Buffer buffer;
@@ -64,23 +71,20 @@ struct TransientBufferAllocatorImpl {
 
         vk::BufferCreateInfo bufInfo = {};
         bufInfo.size = capacity;
-        // Usage flags only need to ensure VMA picks a compatible memory type (Device Local)
-        bufInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+        bufInfo.usage = TransientBufferAllocator::SupportedUsage;
 
         vma::AllocationCreateInfo allocInfo = {};
         allocInfo.usage = vma::MemoryUsage::eAuto;
         allocInfo.requiredFlags = vk::MemoryPropertyFlagBits::eDeviceLocal;
-        allocInfo.flags = vma::AllocationCreateFlagBits::eCanAlias;
 
         std::tie(mBackingBuffer, mBackingAlloc) = mAllocator.createBuffer(bufInfo, allocInfo);
         allocator.setAllocationName(mBackingAlloc, "transient_buffer_allocator_backing_allocation");
         util::setDebugName(mDevice, mBackingBuffer, "transient_buffer_allocator_backing_buffer");
-        mAliases.reserve(64);
+
+        mStats.capacity = capacity;
     }
 
     ~TransientBufferAllocatorImpl() {
-        for (auto buf: mAliases)
-            mAllocator.destroyBuffer(buf, nullptr);
         for (auto &d: mDedicated)
             mAllocator.destroyBuffer(d.buffer, d.alloc);
         mAllocator.destroyBuffer(mBackingBuffer, mBackingAlloc);
@@ -89,9 +93,12 @@ struct TransientBufferAllocatorImpl {
 
 UnmanagedBuffer TransientBufferAllocator::allocate(vk::DeviceSize size, vk::BufferUsageFlags usage) const {
     assert(mImpl);
+    assert((usage & ~SupportedUsage) == vk::BufferUsageFlags{} && "Usage not supported by transient buffers");
 
+    // Covers minUniformBufferOffsetAlignment and minStorageBufferOffsetAlignment on all devices
     vk::DeviceSize align = 256;
     vk::DeviceSize alignedOffset = util::alignOffset(mImpl->mCurrentOffset, align);
+    mImpl->mAllocationCount++;
 
     // Handle oversized allocations or full ring buffer by creating a dedicated buffer
     if (alignedOffset + size > mImpl->mTotalSize) {
@@ -109,31 +116,33 @@ UnmanagedBuffer TransientBufferAllocator::allocate(vk::DeviceSize size, vk::Buff
 
         auto [buf, alloc] = mImpl->mAllocator.createBuffer(bufInfo, allocInfo);
         mImpl->mDedicated.push_back({buf, alloc});
+        mImpl->mDedicatedSize += size;
+        mImpl->mStats.oversizedAllocations++;
         util::setDebugName(mImpl->mDevice, buf, "transient_buffer_dedicated_buffer");
         return UnmanagedBuffer(buf, size);
     }
 
-    // Create a lightweight alias into the pre-allocated backing buffer
-    vk::BufferCreateInfo info = {};
-    info.size = size;
-    info.usage = usage;
-
-    vk::Buffer alias = mImpl->mAllocator.createAliasingBuffer2(mImpl->mBackingAlloc, alignedOffset, info);
-    util::setDebugName(mImpl->mDevice, alias, "transient_buffer_aliased_buffer");
-
-    mImpl->mAliases.push_back(alias);
+    // Just hand out a range of the backing buffer, no Vulkan objects are created
     mImpl->mCurrentOffset = alignedOffset + size;
-    return UnmanagedBuffer(alias, size);
+    return UnmanagedBuffer(mImpl->mBackingBuffer, size, alignedOffset);
+}
+
+TransientBufferAllocatorStats TransientBufferAllocator::stats() const {
+    assert(mImpl);
+    return mImpl->mStats;
 }
 
 void TransientBufferAllocator::reset() {
     assert(mImpl);
 
-    for (auto buf: mImpl->mAliases) {
-        mImpl->mAllocator.destroyBuffer(buf, nullptr);
-    }
-    mImpl->mAliases.clear();
+    auto &stats = mImpl->mStats;
+    stats.lastFrameUsed = mImpl->mCurrentOffset + mImpl->mDedicatedSize;
+    stats.lastFrameAllocations = mImpl->mAllocationCount;
+    stats.highWaterMark = std::max(stats.highWaterMark, stats.lastFrameUsed);
+
     mImpl->mCurrentOffset = 0;
+    mImpl->mAllocationCount = 0;
+    mImpl->mDedicatedSize = 0;
 
     for (auto &d: mImpl->mDedicated) {
         mImpl->mAllocator.destroyBuffer(d.buffer, d.alloc);
@@ -160,3 +169,189 @@ UniqueTransientBufferAllocator &UniqueTransientBufferAllocator::operator=(Unique
     }
     return *this;
 }
+
+struct UploadHeapImpl {
+    vk::Device mDevice;
+    vma::Allocator mAllocator;
+
+    vk::Buffer mBuffer;
+    vma::Allocation mAlloc;
+    std::byte *mMapping = nullptr;
+    vk::DeviceSize mTotalSize;
+    vk::DeviceSize mCurrentOffset = 0;
+    bool mDeviceLocal = false;
+
+    struct Dedicated {
+        vk::Buffer buffer;
+        vma::Allocation alloc;
+    };
+    std::vector<Dedicated> mDedicated;
+
+    struct PendingCopy {
+        const BufferBase *dst;
+        vk::Buffer src;
+        vk::BufferCopy region;
+        std::optional<BufferResourceAccess> dstAccess;
+    };
+    std::vector<PendingCopy> mPending;
+    std::vector<vk::BufferCopy> mRegionScratch;
+
+    static constexpr vk::BufferUsageFlags Usage = vk::BufferUsageFlagBits::eTransferSrc |
+                                                  vk::BufferUsageFlagBits::eUniformBuffer |
+                                                  vk::BufferUsageFlagBits::eStorageBuffer;
+
+    UploadHeapImpl(const vk::Device &device, const vma::Allocator &allocator, vk::DeviceSize capacity)
+        : mDevice(device), mAllocator(allocator), mTotalSize(capacity) {
+        vma::AllocationInfo alloc_info;
+        std::tie(mBuffer, mAlloc) = createMapped(capacity, alloc_info);
+        mMapping = static_cast<std::byte *>(alloc_info.pMappedData);
+
+        auto properties = mAllocator.getAllocationMemoryProperties(mAlloc);
+        mDeviceLocal = static_cast<bool>(properties & vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+        allocator.setAllocationName(mAlloc, "upload_heap_allocation");
+        util::setDebugName(mDevice, mBuffer, "upload_heap_buffer");
+    }
+
+    ~UploadHeapImpl() {
+        for (auto &d: mDedicated)
+            mAllocator.destroyBuffer(d.buffer, d.alloc);
+        mAllocator.destroyBuffer(mBuffer, mAlloc);
+    }
+
+    std::pair<vk::Buffer, vma::Allocation> createMapped(vk::DeviceSize size, vma::AllocationInfo &alloc_info) const {
+        // Prefer device-local host-visible memory (ReBAR), VMA falls back to host memory if there is none
+        return mAllocator.createBuffer(
+                {.size = size, .usage = Usage},
+                {
+                    .flags = vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
+                    .usage = vma::MemoryUsage::eAuto,
+                    .requiredFlags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                    .preferredFlags = vk::MemoryPropertyFlagBits::eDeviceLocal,
+                },
+                alloc_info
+        );
+    }
+};
+
+UnmanagedBuffer UploadHeap::allocate(vk::DeviceSize size) const {
+    assert(mImpl);
+
+    // Covers minUniformBufferOffsetAlignment, minStorageBufferOffsetAlignment and copy alignment on all devices
+    vk::DeviceSize align = 256;
+    vk::DeviceSize alignedOffset = util::alignOffset(mImpl->mCurrentOffset, align);
+
+    if (alignedOffset + size > mImpl->mTotalSize) {
+        Logger::warning(std::format(
+                "Oversized upload heap allocation: {} kB over {} kB limit.",
+                util::divCeil(alignedOffset + size - mImpl->mTotalSize, 1024), mImpl->mTotalSize / 1024
+        ));
+        vma::AllocationInfo alloc_info;
+        auto [buf, alloc] = mImpl->createMapped(size, alloc_info);
+        mImpl->mDedicated.push_back({buf, alloc});
+        util::setDebugName(mImpl->mDevice, buf, "upload_heap_dedicated_buffer");
+
+        UnmanagedBuffer result(buf, size);
+        result.persistentMapping = alloc_info.pMappedData;
+        return result;
+    }
+
+    mImpl->mCurrentOffset = alignedOffset + size;
+    UnmanagedBuffer result(mImpl->mBuffer, size, alignedOffset);
+    result.persistentMapping = mImpl->mMapping + alignedOffset;
+    return result;
+}
+
+UnmanagedBuffer UploadHeap::write(const void *data, vk::DeviceSize size) const {
+    UnmanagedBuffer result = allocate(size);
+    std::memcpy(result.persistentMapping, data, size);
+    return result;
+}
+
+void UploadHeap::upload(
+        const void *data,
+        vk::DeviceSize size,
+        const BufferBase &dst,
+        vk::DeviceSize dst_offset,
+        std::optional<BufferResourceAccess> dst_access
+) const {
+    assert(mImpl);
+    if (size == 0)
+        return;
+
+    UnmanagedBuffer src = write(data, size);
+    mImpl->mPending.push_back({
+        .dst = &dst,
+        .src = src.buffer,
+        .region = {.srcOffset = src.offset, .dstOffset = dst_offset, .size = size},
+        .dstAccess = dst_access,
+    });
+}
+
+void UploadHeap::flush(const vk::CommandBuffer &cmd_buf) const {
+    assert(mImpl);
+    auto &pending = mImpl->mPending;
+    if (pending.empty())
+        return;
+
+    // Group by destination and source, so each pair needs one barrier and one copy command
+    std::ranges::stable_sort(pending, [](const auto &a, const auto &b) {
+        vk::Buffer a_dst = *a.dst, b_dst = *b.dst;
+        return a_dst != b_dst ? a_dst < b_dst : a.src < b.src;
+    });
+
+    auto &regions = mImpl->mRegionScratch;
+    for (size_t begin = 0; begin < pending.size();) {
+        const BufferBase &dst = *pending[begin].dst;
+        vk::Buffer src = pending[begin].src;
+        std::optional<BufferResourceAccess> dst_access;
+
+        regions.clear();
+        size_t end = begin;
+        for (; end < pending.size() && vk::Buffer(*pending[end].dst) == vk::Buffer(dst) && pending[end].src == src; end++) {
+            regions.push_back(pending[end].region);
+            if (pending[end].dstAccess)
+                dst_access = pending[end].dstAccess;
+        }
+
+        dst.barrier(cmd_buf, BufferResourceAccess::TransferWrite);
+        cmd_buf.copyBuffer(src, dst, regions);
+        if (dst_access)
+            dst.barrier(cmd_buf, *dst_access);
+
+        begin = end;
+    }
+    pending.clear();
+}
+
+bool UploadHeap::isDeviceLocal() const {
+    assert(mImpl);
+    return mImpl->mDeviceLocal;
+}
+
+void UploadHeap::reset() {
+    assert(mImpl);
+    assert(mImpl->mPending.empty() && "Upload heap reset with unflushed copies");
+
+    mImpl->mCurrentOffset = 0;
+    for (auto &d: mImpl->mDedicated) {
+        mImpl->mAllocator.destroyBuffer(d.buffer, d.alloc);
+    }
+    mImpl->mDedicated.clear();
+}
+
+UniqueUploadHeap::UniqueUploadHeap(const vk::Device &device, const vma::Allocator &allocator, vk::DeviceSize capacity) {
+    mImpl = new UploadHeapImpl(device, allocator, capacity);
+}
+
+UniqueUploadHeap::~UniqueUploadHeap() { delete mImpl; }
+
+UniqueUploadHeap::UniqueUploadHeap(UniqueUploadHeap &&other) noexcept { mImpl = std::exchange(other.mImpl, nullptr); }
+
+UniqueUploadHeap &UniqueUploadHeap::operator=(UniqueUploadHeap &&other) noexcept {
+    if (this != &other) {
+        delete mImpl;
+        mImpl = std::exchange(other.mImpl, nullptr);
+    }
+    return *this;
+}
@@ -1,4 +1,6 @@
 #pragma once
+#include <optional>
+
 #include "BufferResource.h"
 #include "StagingBuffer.h"
 
@@ -49,10 +51,27 @@ struct BufferBase : protected BufferResource {
     /// <param name="src_queue">The index of the source queue family.</param>
     /// <param name="dst_queue">The index of the destination queue family.</param>
     void transfer(vk::CommandBuffer src_cmd_buf, vk::CommandBuffer dst_cmd_buf, uint32_t src_queue, uint32_t dst_queue) const;
+
+protected:
+    /// <summary>
+    /// The offset of this buffer's range within the underlying vk::Buffer.
+    /// </summary>
+    [[nodiscard]] virtual vk::DeviceSize rangeOffset() const { return 0; }
+
+    /// <summary>
+    /// The size of this buffer's range used for barriers. Covers the whole buffer by default.
+    /// </summary>
+    [[nodiscard]] virtual vk::DeviceSize rangeSize() const { return vk::WholeSize; }
+
+    friend class BarrierBatch;
 };
 
+/// <summary>
+/// A non-owning range of a Vulkan buffer. Offsets passed to Vulkan commands and descriptors must include offset.
+/// </summary>
 struct UnmanagedBuffer : BufferBase {
     vk::Buffer buffer = {};
+    vk::DeviceSize offset = 0;
 
     UnmanagedBuffer() = default;
     /// <summary>
@@ -60,12 +79,23 @@ struct UnmanagedBuffer : BufferBase {
     /// </summary>
     /// <param name="buffer">A vulkan buffer handle.</param>
     /// <param name="size">The size, in bytes, of the buffer.</param>
-    UnmanagedBuffer(vk::Buffer buffer, size_t size) : BufferBase(size), buffer(buffer) {}
+    /// <param name="offset">The offset, in bytes, of the range within the buffer.</param>
+    UnmanagedBuffer(vk::Buffer buffer, size_t size, vk::DeviceSize offset = 0)
+        : BufferBase(size), buffer(buffer), offset(offset) {}
 
     operator vk::Buffer() const override { // NOLINT(*-explicit-constructor)
         return buffer;
     }
     explicit operator bool() const override { return buffer; }
+
+    /// <summary>
+    /// Descriptor info covering exactly this range.
+    /// </summary>
+    [[nodiscard]] vk::DescriptorBufferInfo descriptorInfo() const { return {.buffer = buffer, .offset = offset, .range = size}; }
+
+protected:
+    [[nodiscard]] vk::DeviceSize rangeOffset() const override { return offset; }
+    [[nodiscard]] vk::DeviceSize rangeSize() const override { return size; }
 };
 
 
@@ -109,21 +139,47 @@ struct Buffer : BufferBase {
 
 struct TransientBufferAllocatorImpl;
 
+/// <summary>
+/// Usage statistics of a TransientBufferAllocator, used for tuning its capacity.
+/// </summary>
+struct TransientBufferAllocatorStats {
+    vk::DeviceSize capacity = 0;
+    /// <summary>Bytes used between the last two resets.</summary>
+    vk::DeviceSize lastFrameUsed = 0;
+    /// <summary>Allocations made between the last two resets.</summary>
+    uint32_t lastFrameAllocations = 0;
+    /// <summary>Largest number of bytes ever used between two resets, including oversized requests.</summary>
+    vk::DeviceSize highWaterMark = 0;
+    /// <summary>Number of requests that didn't fit and fell back to a dedicated buffer.</summary>
+    uint32_t oversizedAllocations = 0;
+};
+
 /// <summary>
 /// A lightweight handle to a linear buffer allocator.
-/// Allocations are valid for the current frame only.
+/// Allocations are ranges of one persistent buffer and are valid for the current frame only.
 /// Copies are cheap and reference the same underlying memory pool.
 /// </summary>
 class TransientBufferAllocator {
 public:
+    /// <summary>
+    /// The usages supported by transient allocations.
+    /// </summary>
+    static constexpr vk::BufferUsageFlags SupportedUsage =
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eUniformBuffer |
+            vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eVertexBuffer |
+            vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferSrc |
+            vk::BufferUsageFlagBits::eTransferDst;
+
     TransientBufferAllocator() = default;
 
     /// <summary>
-    /// Allocates a buffer.
-    /// Valid for usage with offset=0 and size=VK_WHOLE_SIZE.
+    /// Allocates a range of the frame's backing buffer, aligned to 256 bytes.
+    /// The returned buffer's offset has to be applied to all commands and descriptors.
     /// </summary>
     [[nodiscard]] UnmanagedBuffer allocate(vk::DeviceSize size, vk::BufferUsageFlags usage) const;
 
+    [[nodiscard]] TransientBufferAllocatorStats stats() const;
+
     /// <summary>
     /// Invalidates all buffers allocated since the last reset.
     /// </summary>
@@ -151,3 +207,94 @@ public:
     UniqueTransientBufferAllocator(UniqueTransientBufferAllocator &&other) noexcept;
     UniqueTransientBufferAllocator &operator=(UniqueTransientBufferAllocator &&other) noexcept;
 };
+
+struct UploadHeapImpl;
+
+/// <summary>
+/// A lightweight handle to a persistently mapped, linear per-frame upload heap.
+/// The heap is placed in device-local host-visible memory (ReBAR) when the device exposes it, and in host memory otherwise.
+/// Ranges can either be bound directly as uniform or storage buffers, or be copied into device-local buffers.
+/// Allocations are valid for the current frame only. Copies are cheap and reference the same underlying memory.
+/// </summary>
+class UploadHeap {
+public:
+    UploadHeap() = default;
+
+    /// <summary>
+    /// Allocates a mapped range of the heap, aligned to 256 bytes.
+    /// The returned buffer's persistentMapping points to the start of the range.
+    /// </summary>
+    [[nodiscard]] UnmanagedBuffer allocate(vk::DeviceSize size) const;
+
+    /// <summary>
+    /// Writes a block of data into the heap. The result can be bound directly, no barriers are required.
+    /// </summary>
+    [[nodiscard]] UnmanagedBuffer write(const void *data, vk::DeviceSize size) const;
+
+    template<std::ranges::contiguous_range R>
+    [[nodiscard]] UnmanagedBuffer write(R &&data) const {
+        using T = std::ranges::range_value_t<R>;
+        return write(std::ranges::data(data), std::ranges::size(data) * sizeof(T));
+    }
+
+    /// <summary>
+    /// Writes a block of data into the heap and queues a copy into dst. Copies are recorded on flush.
+    /// </summary>
+    /// <param name="data">A pointer to the data to upload.</param>
+    /// <param name="size">The size of the data in bytes.</param>
+    /// <param name="dst">The destination buffer. It must support TRANSFER_DST usage and outlive the next flush.</param>
+    /// <param name="dst_offset">The offset in dst to copy to.</param>
+    /// <param name="dst_access">The access state dst is transitioned to after the copy, if any.</param>
+    void upload(
+            const void *data,
+            vk::DeviceSize size,
+            const BufferBase &dst,
+            vk::DeviceSize dst_offset = 0,
+            std::optional<BufferResourceAccess> dst_access = std::nullopt
+    ) const;
+
+    template<std::ranges::contiguous_range R>
+    void upload(
+            R &&data,
+            const BufferBase &dst,
+            vk::DeviceSize dst_offset = 0,
+            std::optional<BufferResourceAccess> dst_access = std::nullopt
+    ) const {
+        using T = std::ranges::range_value_t<R>;
+        upload(std::ranges::data(data), std::ranges::size(data) * sizeof(T), dst, dst_offset, dst_access);
+    }
+
+    /// <summary>
+    /// Records all queued copies, batched into one copy command per destination buffer.
+    /// </summary>
+    void flush(const vk::CommandBuffer &cmd_buf) const;
+
+    /// <summary>
+    /// Whether the heap lives in device-local memory. Directly bound ranges are read from VRAM in that case.
+    /// </summary>
+    [[nodiscard]] bool isDeviceLocal() const;
+
+    /// <summary>
+    /// Invalidates all ranges allocated since the last reset. Queued copies must have been flushed.
+    /// </summary>
+    void reset();
+
+    operator bool() const { return mImpl != nullptr; }
+
+protected:
+    UploadHeapImpl *mImpl = nullptr;
+    friend class UniqueUploadHeap;
+};
+
+/// <summary>
+/// RAII Owner for the upload heap implementation.
+/// </summary>
+class UniqueUploadHeap : public UploadHeap {
+public:
+    UniqueUploadHeap() = default;
+    UniqueUploadHeap(const vk::Device &device, const vma::Allocator &allocator, vk::DeviceSize capacity = 16 * 1024 * 1024);
+    ~UniqueUploadHeap();
+
+    UniqueUploadHeap(UniqueUploadHeap &&other) noexcept;
+    UniqueUploadHeap &operator=(UniqueUploadHeap &&other) noexcept;
+};
@@ -81,6 +81,16 @@ void BufferResource::barrier(
         const vk::CommandBuffer &cmd_buf,
         const BufferResourceAccess &begin,
         const BufferResourceAccess &end
+) const {
+    vk::BufferMemoryBarrier2 barrier = makeBarrier(buffer, offset, size, begin, end);
+    cmd_buf.pipelineBarrier2({
+        .bufferMemoryBarrierCount = 1,
+        .pBufferMemoryBarriers = &barrier,
+    });
+}
+
+vk::BufferMemoryBarrier2 BufferResource::makeBarrier(
+        vk::Buffer buffer, size_t offset, size_t size, const BufferResourceAccess &begin, const BufferResourceAccess &end
 ) const {
     vk::BufferMemoryBarrier2 barrier{
         .srcStageMask = mPrevAccess.stage,
@@ -94,11 +104,8 @@ void BufferResource::barrier(
         .size = size,
     };
 
-    cmd_buf.pipelineBarrier2({
-        .bufferMemoryBarrierCount = 1,
-        .pBufferMemoryBarriers = &barrier,
-    });
     mPrevAccess = end;
+    return barrier;
 }
 
 void BufferResource::transfer(
@@ -60,6 +60,14 @@ protected:
             const BufferResourceAccess &end
     ) const;
 
+    /// <summary>
+    /// Creates a buffer memory barrier and advances the tracked state, without recording it.
+    /// The caller is responsible for recording the barrier before the buffer is accessed.
+    /// </summary>
+    [[nodiscard]] vk::BufferMemoryBarrier2 makeBarrier(
+            vk::Buffer buffer, size_t offset, size_t size, const BufferResourceAccess &begin, const BufferResourceAccess &end
+    ) const;
+
     /// <summary>
     /// Transfers ownership of the buffer between queue families.
     /// It does NOT perform any memory barriers. Execution ordering must be handled with a semaphore.
@@ -0,0 +1,102 @@
+#include "DeletionQueue.h"
+
+#include <format>
+
+#include "../util/Logger.h"
+#include "../util/globals.h"
+#include "Buffer.h"
+#include "Image.h"
+
+namespace {
+    template<typename Handle>
+    Handle fromRaw(uint64_t handle) {
+        return Handle(reinterpret_cast<typename Handle::CType>(handle));
+    }
+} // namespace
+
+DeletionQueue::DeletionQueue(const vk::Device &device, const vma::Allocator &allocator)
+    : mDevice(device), mAllocator(allocator) {
+    mEntries.create(globals::MaxFramesInFlight, [] {
+        std::vector<Entry> entries;
+        entries.reserve(64);
+        return entries;
+    });
+}
+
+DeletionQueue::~DeletionQueue() {
+    if (mEntries.initialized())
+        flush();
+}
+
+void DeletionQueue::beginFrame(uint32_t frame_index) {
+    assert(frame_index < mEntries.size());
+    while (mEntries.index() != static_cast<int32_t>(frame_index))
+        mEntries.next();
+    destroy(mEntries.get());
+}
+
+void DeletionQueue::flush() {
+    for (size_t i = 0; i < mEntries.size(); i++)
+        destroy(mEntries.get(i));
+}
+
+void DeletionQueue::release(Buffer &&buffer) {
+    vma::Allocation allocation = buffer.allocation.release();
+    push(buffer.buffer.release(), allocation);
+    buffer.size = 0;
+    buffer.persistentMapping = nullptr;
+}
+
+void DeletionQueue::release(Image &&image) {
+    vma::Allocation allocation = image.allocation.release();
+    push(image.image.release(), allocation);
+}
+
+void DeletionQueue::release(ImageWithView &&image) {
+    release(std::move(image.view));
+    release(static_cast<Image &&>(image));
+}
+
+void DeletionQueue::release(vk::UniqueImageView &&view) { push(view.release()); }
+
+void DeletionQueue::release(vk::UniqueSampler &&sampler) { push(sampler.release()); }
+
+void DeletionQueue::release(vk::UniquePipeline &&pipeline) { push(pipeline.release()); }
+
+void DeletionQueue::release(vk::UniqueDescriptorPool &&pool) { push(pool.release()); }
+
+size_t DeletionQueue::pending() const {
+    size_t count = 0;
+    for (size_t i = 0; i < mEntries.size(); i++)
+        count += mEntries.get(i).size();
+    return count;
+}
+
+void DeletionQueue::destroy(std::vector<Entry> &entries) const {
+    for (const auto &entry: entries) {
+        switch (entry.type) {
+            case vk::ObjectType::eBuffer:
+                mAllocator.destroyBuffer(fromRaw<vk::Buffer>(entry.handle), entry.allocation);
+                break;
+            case vk::ObjectType::eImage:
+                mAllocator.destroyImage(fromRaw<vk::Image>(entry.handle), entry.allocation);
+                break;
+            case vk::ObjectType::eImageView:
+                mDevice.destroyImageView(fromRaw<vk::ImageView>(entry.handle));
+                break;
+            case vk::ObjectType::eSampler:
+                mDevice.destroySampler(fromRaw<vk::Sampler>(entry.handle));
+                break;
+            case vk::ObjectType::ePipeline:
+                mDevice.destroyPipeline(fromRaw<vk::Pipeline>(entry.handle));
+                break;
+            case vk::ObjectType::eDescriptorPool:
+                mDevice.destroyDescriptorPool(fromRaw<vk::DescriptorPool>(entry.handle));
+                break;
+            default:
+                Logger::fatal(std::format("Unsupported object type in deletion queue: {}", vk::to_string(entry.type)));
+        }
+    }
+    // Keeps the capacity, so steady state releases never allocate
+    entries.clear();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+#include <vulkan-memory-allocator-hpp/vk_mem_alloc.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "../util/PerFrame.h"
+
+struct Buffer;
+struct Image;
+struct ImageWithView;
+
+/// <summary>
+/// Defers the destruction of GPU resources until no frame in flight can still reference them.
+/// Resources released while recording a frame are destroyed once the same frame slot is reused, after its fence was waited.
+/// Entries are plain handles kept in per-frame vectors that retain their capacity, so releasing doesn't allocate.
+/// </summary>
+class DeletionQueue {
+public:
+    DeletionQueue() = default;
+    DeletionQueue(const vk::Device &device, const vma::Allocator &allocator);
+
+    /// <summary>
+    /// Destroys all pending resources. The device has to be idle.
+    /// </summary>
+    ~DeletionQueue();
+
+    DeletionQueue(const DeletionQueue &other) = delete;
+    DeletionQueue &operator=(const DeletionQueue &other) = delete;
+
+    /// <summary>
+    /// Selects the frame slot new releases are recorded to and destroys the resources released the last time it was used.
+    /// Must be called after the fence of that frame slot has been waited.
+    /// </summary>
+    /// <param name="frame_index">The index of the frame in flight.</param>
+    void beginFrame(uint32_t frame_index);
+
+    /// <summary>
+    /// Destroys all pending resources immediately. The device has to be idle.
+    /// </summary>
+    void flush();
+
+    void release(Buffer &&buffer);
+    void release(Image &&image);
+    void release(ImageWithView &&image);
+    void release(vk::UniqueImageView &&view);
+    void release(vk::UniqueSampler &&sampler);
+    void release(vk::UniquePipeline &&pipeline);
+    void release(vk::UniqueDescriptorPool &&pool);
+
+    /// <summary>
+    /// Number of resources waiting for destruction.
+    /// </summary>
+    [[nodiscard]] size_t pending() const;
+
+private:
+    struct Entry {
+        vk::ObjectType type;
+        uint64_t handle;
+        vma::Allocation allocation;
+    };
+
+    template<typename Handle>
+    void push(Handle handle, vma::Allocation allocation = nullptr) {
+        if (!handle)
+            return;
+        mEntries.get().push_back({
+            .type = Handle::objectType,
+            .handle = reinterpret_cast<uint64_t>(static_cast<typename Handle::CType>(handle)),
+            .allocation = allocation,
+        });
+    }
+
+    void destroy(std::vector<Entry> &entries) const;
+
+    vk::Device mDevice;
+    vma::Allocator mAllocator;
+    util::PerFrame<std::vector<Entry>> mEntries;
+};
@@ -1,5 +1,18 @@
 #include "Descriptors.h"
 
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../debug/Annotation.h"
+#include "../util/Logger.h"
+#include "../util/math.h"
+#include "Buffer.h"
+
 void DescriptorSetLayout::create(const vk::Device &device, vk::DescriptorSetLayoutCreateFlags flags, std::span<const Binding> bindings) {
     std::vector<vk::DescriptorSetLayoutBinding> layout_bindings;
     std::vector<vk::DescriptorBindingFlags> binding_flags;
@@ -21,16 +34,201 @@ void DescriptorSetLayout::create(const vk::Device &device, vk::DescriptorSetLayo
     };
 
     mHandle = device.createDescriptorSetLayoutUnique(chain.get());
+    mDescriptorBuffer = static_cast<bool>(flags & vk::DescriptorSetLayoutCreateFlagBits::eDescriptorBufferEXT);
 }
 
 struct DescriptorAllocatorImpl {
+    struct CachedSet {
+        vk::DescriptorSet set;
+        vk::DescriptorPool pool;
+        bool used;
+    };
+
     vk::Device mDevice;
     vk::DescriptorPool mCurrentPool;
+    // Pools that ran full since the last reset
     std::vector<vk::DescriptorPool> mUsedPools;
+    // Pools that have been reset and can be reused without creating new ones
+    std::vector<vk::DescriptorPool> mFreePools;
+
+    // Cached sets are allocated from separate pools that survive reset(), so they can be freed individually
+    std::vector<vk::DescriptorPool> mCachePools;
+    std::unordered_map<std::string, CachedSet> mCache;
+    std::string mKeyScratch;
+
+    struct DescriptorBufferBlock {
+        Buffer buffer;
+        vk::DeviceAddress address;
+    };
+
+    struct BufferLayoutInfo {
+        vk::DeviceSize size;
+        // Indexed by binding, lazily queried
+        std::vector<vk::DeviceSize> bindingOffsets;
+    };
+
+    static constexpr vk::BufferUsageFlags DescriptorBufferUsage = vk::BufferUsageFlagBits::eSamplerDescriptorBufferEXT |
+                                                                  vk::BufferUsageFlagBits::eResourceDescriptorBufferEXT |
+                                                                  vk::BufferUsageFlagBits::eShaderDeviceAddress;
+
+    // Descriptor buffer state. Only used if descriptor buffers are enabled.
+    vma::Allocator mAllocator;
+    vk::PhysicalDeviceDescriptorBufferPropertiesEXT mBufferProperties;
+    vk::DeviceSize mBufferCapacity = 0;
+    std::vector<DescriptorBufferBlock> mBufferBlocks;
+    uint32_t mBufferBlockIndex = 0;
+    vk::DeviceSize mBufferOffset = 0;
+    std::unordered_map<VkDescriptorSetLayout, BufferLayoutInfo> mBufferLayouts;
+    // Block currently bound to each command buffer since the last reset
+    std::vector<std::pair<vk::CommandBuffer, uint32_t>> mBoundBufferBlocks;
 
     explicit DescriptorAllocatorImpl(vk::Device device) : mDevice(device) {}
 
-    [[nodiscard]] vk::DescriptorPool createPool() const {
+    DescriptorAllocatorImpl(
+            vk::Device device, vk::PhysicalDevice physical_device, const vma::Allocator &allocator, vk::DeviceSize capacity
+    )
+        : mDevice(device), mAllocator(allocator), mBufferCapacity(capacity) {
+        auto properties = physical_device.getProperties2<
+                vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorBufferPropertiesEXT>();
+        mBufferProperties = properties.get<vk::PhysicalDeviceDescriptorBufferPropertiesEXT>();
+        mBufferBlocks.push_back(createBufferBlock());
+    }
+
+    [[nodiscard]] DescriptorBufferBlock createBufferBlock() const {
+        Buffer buffer = Buffer::create(
+                mAllocator,
+                {
+                    .size = mBufferCapacity,
+                    .usage = DescriptorBufferUsage,
+                    .flags = vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
+                    .requiredProperties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                    .preferredProperties = vk::MemoryPropertyFlagBits::eDeviceLocal,
+                }
+        );
+        util::setDebugName(mDevice, vk::Buffer(buffer), "descriptor_buffer");
+        vk::DeviceAddress address = mDevice.getBufferAddress({.buffer = buffer});
+        return {std::move(buffer), address};
+    }
+
+    [[nodiscard]] BufferLayoutInfo &bufferLayoutInfo(vk::DescriptorSetLayout layout) {
+        auto [it, inserted] = mBufferLayouts.try_emplace(layout);
+        if (inserted) {
+            it->second.size = mDevice.getDescriptorSetLayoutSizeEXT(layout);
+        }
+        return it->second;
+    }
+
+    [[nodiscard]] vk::DeviceSize bindingOffset(vk::DescriptorSetLayout layout, uint32_t binding) {
+        auto &offsets = bufferLayoutInfo(layout).bindingOffsets;
+        if (binding >= offsets.size()) {
+            offsets.resize(binding + 1, vk::WholeSize);
+        }
+        if (offsets[binding] == vk::WholeSize) {
+            offsets[binding] = mDevice.getDescriptorSetLayoutBindingOffsetEXT(layout, binding);
+        }
+        return offsets[binding];
+    }
+
+    [[nodiscard]] size_t descriptorSize(vk::DescriptorType type) const {
+        switch (type) {
+            case vk::DescriptorType::eSampler:
+                return mBufferProperties.samplerDescriptorSize;
+            case vk::DescriptorType::eCombinedImageSampler:
+                return mBufferProperties.combinedImageSamplerDescriptorSize;
+            case vk::DescriptorType::eSampledImage:
+                return mBufferProperties.sampledImageDescriptorSize;
+            case vk::DescriptorType::eStorageImage:
+                return mBufferProperties.storageImageDescriptorSize;
+            default:
+                Logger::fatal(std::format("Descriptor type {} is not supported in descriptor buffers", vk::to_string(type)));
+        }
+    }
+
+    [[nodiscard]] DescriptorSet allocateFromBuffer(vk::DescriptorSetLayout layout) {
+        vk::DeviceSize size = bufferLayoutInfo(layout).size;
+        vk::DeviceSize offset = util::alignOffset(mBufferOffset, mBufferProperties.descriptorBufferOffsetAlignment);
+
+        if (offset + size > mBufferCapacity) {
+            // Blocks are never shrunk, so this only happens while the working set grows
+            mBufferBlockIndex++;
+            if (mBufferBlockIndex >= mBufferBlocks.size()) {
+                Logger::warning(std::format("Descriptor buffer full, adding another {} kB block", mBufferCapacity / 1024));
+                mBufferBlocks.push_back(createBufferBlock());
+            }
+            offset = 0;
+        }
+        mBufferOffset = offset + size;
+
+        DescriptorSet set;
+        set.mBufferLayout = layout;
+        set.mBufferIndex = mBufferBlockIndex;
+        set.mBufferOffset = offset;
+        return set;
+    }
+
+    void writeToBuffer(const DescriptorSet &set, vk::ArrayProxy<const vk::WriteDescriptorSet> writes) {
+        auto *base = static_cast<std::byte *>(mBufferBlocks[set.mBufferIndex].buffer.persistentMapping) + set.mBufferOffset;
+
+        for (const auto &write: writes) {
+            std::byte *binding_data = base + bindingOffset(set.mBufferLayout, write.dstBinding);
+
+            if (write.descriptorType == vk::DescriptorType::eInlineUniformBlock) {
+                // Inline uniform block data is stored as is. dstArrayElement is the byte offset.
+                auto block = static_cast<const vk::WriteDescriptorSetInlineUniformBlock *>(write.pNext);
+                assert(block && block->sType == vk::StructureType::eWriteDescriptorSetInlineUniformBlock);
+                std::memcpy(binding_data + write.dstArrayElement, block->pData, block->dataSize);
+                continue;
+            }
+
+            size_t size = descriptorSize(write.descriptorType);
+            for (uint32_t i = 0; i < write.descriptorCount; i++) {
+                vk::DescriptorGetInfoEXT get_info = {.type = write.descriptorType};
+                switch (write.descriptorType) {
+                    case vk::DescriptorType::eSampler:
+                        get_info.data.pSampler = &write.pImageInfo[i].sampler;
+                        break;
+                    case vk::DescriptorType::eCombinedImageSampler:
+                        get_info.data.pCombinedImageSampler = &write.pImageInfo[i];
+                        break;
+                    case vk::DescriptorType::eSampledImage:
+                        get_info.data.pSampledImage = &write.pImageInfo[i];
+                        break;
+                    case vk::DescriptorType::eStorageImage:
+                        get_info.data.pStorageImage = &write.pImageInfo[i];
+                        break;
+                    default:
+                        std::unreachable(); // rejected by descriptorSize()
+                }
+                mDevice.getDescriptorEXT(get_info, size, binding_data + (write.dstArrayElement + i) * size);
+            }
+        }
+    }
+
+    void bindBuffer(
+            const vk::CommandBuffer &cmd_buf,
+            vk::PipelineBindPoint bind_point,
+            vk::PipelineLayout pipeline_layout,
+            uint32_t first_set,
+            const DescriptorSet &set
+    ) {
+        // Rebinding descriptor buffers can be expensive, so only do it when the block changes
+        auto it = std::ranges::find(mBoundBufferBlocks, cmd_buf, &std::pair<vk::CommandBuffer, uint32_t>::first);
+        if (it == mBoundBufferBlocks.end() || it->second != set.mBufferIndex) {
+            cmd_buf.bindDescriptorBuffersEXT(vk::DescriptorBufferBindingInfoEXT{
+                .address = mBufferBlocks[set.mBufferIndex].address,
+                .usage = DescriptorBufferUsage,
+            });
+            if (it == mBoundBufferBlocks.end())
+                mBoundBufferBlocks.emplace_back(cmd_buf, set.mBufferIndex);
+            else
+                it->second = set.mBufferIndex;
+        }
+
+        uint32_t buffer_index = 0;
+        cmd_buf.setDescriptorBufferOffsetsEXT(bind_point, pipeline_layout, first_set, buffer_index, set.mBufferOffset);
+    }
+
+    [[nodiscard]] vk::DescriptorPool createPool(vk::DescriptorPoolCreateFlags flags = {}) const {
         std::array sizes = {
             vk::DescriptorPoolSize{vk::DescriptorType::eUniformBuffer, 1024},
             vk::DescriptorPoolSize{vk::DescriptorType::eCombinedImageSampler, 1024},
@@ -44,6 +242,7 @@ struct DescriptorAllocatorImpl {
         inlineUniformInfo.maxInlineUniformBlockBindings = 1024;
 
         vk::DescriptorPoolCreateInfo info{};
+        info.flags = flags;
         info.maxSets = 1024;
         info.poolSizeCount = static_cast<uint32_t>(sizes.size());
         info.pPoolSizes = sizes.data();
@@ -51,62 +250,269 @@ struct DescriptorAllocatorImpl {
 
         return mDevice.createDescriptorPool(info);
     }
+
+    [[nodiscard]] vk::DescriptorPool nextPool() {
+        if (mFreePools.empty())
+            return createPool();
+        vk::DescriptorPool pool = mFreePools.back();
+        mFreePools.pop_back();
+        return pool;
+    }
+
+    /// <summary>
+    /// Tries to allocate a single set without throwing, so running out of pool memory isn't handled via exceptions.
+    /// </summary>
+    vk::Result tryAllocate(vk::DescriptorPool pool, const vk::DescriptorSetLayout &layout, vk::DescriptorSet &set) const {
+        vk::DescriptorSetAllocateInfo info = {
+            .descriptorPool = pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &layout,
+        };
+        return mDevice.allocateDescriptorSets(&info, &set);
+    }
+
+    static bool isPoolExhausted(vk::Result result) {
+        return result == vk::Result::eErrorOutOfPoolMemory || result == vk::Result::eErrorFragmentedPool;
+    }
+
+    static void checkResult(vk::Result result) {
+        if (result != vk::Result::eSuccess)
+            Logger::fatal(std::format("Descriptor set allocation failed: {}", vk::to_string(result)));
+    }
+
+    [[nodiscard]] vk::DescriptorSet allocate(const vk::DescriptorSetLayout &layout) {
+        if (!mCurrentPool) {
+            mCurrentPool = nextPool();
+        }
+
+        vk::DescriptorSet set;
+        vk::Result result = tryAllocate(mCurrentPool, layout, set);
+        if (isPoolExhausted(result)) {
+            // Pool is full. Move to used list and grab a fresh one.
+            mUsedPools.push_back(mCurrentPool);
+            mCurrentPool = nextPool();
+            result = tryAllocate(mCurrentPool, layout, set);
+        }
+        checkResult(result);
+        return set;
+    }
+
+    [[nodiscard]] CachedSet allocateForCache(const vk::DescriptorSetLayout &layout) {
+        vk::DescriptorSet set;
+        // Newer pools are more likely to have space left
+        for (auto it = mCachePools.rbegin(); it != mCachePools.rend(); ++it) {
+            vk::Result result = tryAllocate(*it, layout, set);
+            if (result == vk::Result::eSuccess)
+                return {set, *it, true};
+            if (!isPoolExhausted(result))
+                checkResult(result);
+        }
+
+        mCachePools.push_back(createPool(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet));
+        checkResult(tryAllocate(mCachePools.back(), layout, set));
+        return {set, mCachePools.back(), true};
+    }
+
+    template<typename T>
+    void appendKey(const T &value) {
+        mKeyScratch.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    /// <summary>
+    /// Serializes the layout and the written descriptors (not the destination set) into mKeyScratch.
+    /// The full contents are used as key, so there are no false hits on hash collisions.
+    /// </summary>
+    void buildKey(const vk::DescriptorSetLayout &layout, vk::ArrayProxy<const vk::WriteDescriptorSet> writes) {
+        mKeyScratch.clear();
+        appendKey(static_cast<VkDescriptorSetLayout>(layout));
+        for (const auto &write: writes) {
+            appendKey(write.dstBinding);
+            appendKey(write.dstArrayElement);
+            appendKey(write.descriptorCount);
+            appendKey(write.descriptorType);
+
+            if (write.descriptorType == vk::DescriptorType::eInlineUniformBlock) {
+                // For inline uniform blocks descriptorCount is the size in bytes
+                auto block = static_cast<const vk::WriteDescriptorSetInlineUniformBlock *>(write.pNext);
+                assert(block && block->sType == vk::StructureType::eWriteDescriptorSetInlineUniformBlock);
+                mKeyScratch.append(static_cast<const char *>(block->pData), block->dataSize);
+            } else if (write.pImageInfo) {
+                for (uint32_t i = 0; i < write.descriptorCount; i++) {
+                    appendKey(static_cast<VkSampler>(write.pImageInfo[i].sampler));
+                    appendKey(static_cast<VkImageView>(write.pImageInfo[i].imageView));
+                    appendKey(write.pImageInfo[i].imageLayout);
+                }
+            } else if (write.pBufferInfo) {
+                for (uint32_t i = 0; i < write.descriptorCount; i++) {
+                    appendKey(static_cast<VkBuffer>(write.pBufferInfo[i].buffer));
+                    appendKey(write.pBufferInfo[i].offset);
+                    appendKey(write.pBufferInfo[i].range);
+                }
+            } else if (write.pTexelBufferView) {
+                for (uint32_t i = 0; i < write.descriptorCount; i++) {
+                    appendKey(static_cast<VkBufferView>(write.pTexelBufferView[i]));
+                }
+            }
+        }
+    }
+
+    /// <summary>
+    /// Frees cached sets that haven't been requested since the last reset and marks the remaining ones as unused.
+    /// Must only be called once the device has finished with the previous use of this allocator.
+    /// </summary>
+    void evictUnusedCachedSets() {
+        for (auto it = mCache.begin(); it != mCache.end();) {
+            if (!it->second.used) {
+                mDevice.freeDescriptorSets(it->second.pool, it->second.set);
+                it = mCache.erase(it);
+            } else {
+                it->second.used = false;
+                ++it;
+            }
+        }
+    }
+
+    void clearCache() {
+        mCache.clear();
+        for (auto pool: mCachePools) {
+            mDevice.resetDescriptorPool(pool);
+        }
+    }
+
+    void destroy() {
+        if (mCurrentPool) mDevice.destroyDescriptorPool(mCurrentPool);
+        for (auto p: mUsedPools) mDevice.destroyDescriptorPool(p);
+        for (auto p: mFreePools) mDevice.destroyDescriptorPool(p);
+        for (auto p: mCachePools) mDevice.destroyDescriptorPool(p);
+        mCurrentPool = vk::DescriptorPool{};
+        mUsedPools.clear();
+        mFreePools.clear();
+        mCachePools.clear();
+        mCache.clear();
+        mBufferBlocks.clear();
+    }
 };
 
 DescriptorSet DescriptorAllocator::allocate(const vk::DescriptorSetLayout& layout) const {
     assert(mImpl);
+    return DescriptorSet(mImpl->allocate(layout));
+}
 
-    // Initialize current pool if null
-    if (!mImpl->mCurrentPool) {
-        mImpl->mCurrentPool = mImpl->createPool();
+DescriptorSet DescriptorAllocator::allocate(const DescriptorSetLayout &layout) const {
+    assert(mImpl);
+    if (layout.usesDescriptorBuffer()) {
+        assert(mImpl->mBufferCapacity > 0 && "Allocator has no descriptor buffer");
+        return mImpl->allocateFromBuffer(layout);
     }
+    return DescriptorSet(mImpl->allocate(layout));
+}
 
-    vk::DescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.descriptorPool = mImpl->mCurrentPool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &layout;
+void DescriptorAllocator::update(const DescriptorSet &set, vk::ArrayProxy<const vk::WriteDescriptorSet> writes) const {
+    assert(mImpl);
+    if (set.isBufferBacked()) {
+        mImpl->writeToBuffer(set, writes);
+    } else {
+        mImpl->mDevice.updateDescriptorSets(writes, {});
+    }
+}
 
-    // Try to allocate. If it fails due to pool limits, grow and retry.
-    try {
-        return DescriptorSet(mImpl->mDevice.allocateDescriptorSets(allocInfo)[0]);
+void DescriptorAllocator::bind(
+        const vk::CommandBuffer &cmd_buf,
+        vk::PipelineBindPoint bind_point,
+        vk::PipelineLayout pipeline_layout,
+        uint32_t first_set,
+        const DescriptorSet &set
+) const {
+    assert(mImpl);
+    if (set.isBufferBacked()) {
+        mImpl->bindBuffer(cmd_buf, bind_point, pipeline_layout, first_set, set);
+    } else {
+        cmd_buf.bindDescriptorSets(bind_point, pipeline_layout, first_set, {set}, {});
     }
-    catch (vk::SystemError& err) {
-        if (err.code() == vk::Result::eErrorOutOfPoolMemory || err.code() == vk::Result::eErrorFragmentedPool) {
-            // Pool is full. Move to used list and grab a fresh one.
-            mImpl->mUsedPools.push_back(mImpl->mCurrentPool);
-            mImpl->mCurrentPool = mImpl->createPool();
+}
 
-            allocInfo.descriptorPool = mImpl->mCurrentPool;
-            return DescriptorSet(mImpl->mDevice.allocateDescriptorSets(allocInfo)[0]);
-        }
-        throw;
+DescriptorSet DescriptorAllocator::allocateCached(
+        const DescriptorSetLayout &layout, vk::ArrayProxy<const vk::WriteDescriptorSet> writes
+) const {
+    if (!layout.usesDescriptorBuffer())
+        return allocateCached(vk::DescriptorSetLayout(layout), writes);
+
+    DescriptorSet set = allocate(layout);
+    update(set, writes);
+    return set;
+}
+
+DescriptorSet DescriptorAllocator::allocateCached(
+        const vk::DescriptorSetLayout &layout, vk::ArrayProxy<const vk::WriteDescriptorSet> writes
+) const {
+    assert(mImpl);
+
+    mImpl->buildKey(layout, writes);
+    if (auto it = mImpl->mCache.find(mImpl->mKeyScratch); it != mImpl->mCache.end()) {
+        it->second.used = true;
+        return DescriptorSet(it->second.set);
+    }
+
+    auto cached = mImpl->allocateForCache(layout);
+
+    std::vector<vk::WriteDescriptorSet> patched_writes(writes.begin(), writes.end());
+    for (auto &write: patched_writes) {
+        write.dstSet = cached.set;
     }
+    mImpl->mDevice.updateDescriptorSets(patched_writes, {});
+
+    mImpl->mCache.emplace(mImpl->mKeyScratch, cached);
+    return DescriptorSet(cached.set);
 }
 
 void DescriptorAllocator::reset() const {
     assert(mImpl);
 
-    // Destroy current pool if it exists
+    // Reset pools in place and keep them around for the next use instead of recreating them
     if (mImpl->mCurrentPool) {
-        mImpl->mDevice.destroyDescriptorPool(mImpl->mCurrentPool);
-        mImpl->mCurrentPool = vk::DescriptorPool{}; // Clear it
+        mImpl->mDevice.resetDescriptorPool(mImpl->mCurrentPool);
+        mImpl->mFreePools.push_back(mImpl->mCurrentPool);
+        mImpl->mCurrentPool = vk::DescriptorPool{};
     }
 
-    // Destroy all used pools
     for (auto pool : mImpl->mUsedPools) {
-        mImpl->mDevice.destroyDescriptorPool(pool);
+        mImpl->mDevice.resetDescriptorPool(pool);
+        mImpl->mFreePools.push_back(pool);
     }
     mImpl->mUsedPools.clear();
+
+    mImpl->evictUnusedCachedSets();
+
+    mImpl->mBufferBlockIndex = 0;
+    mImpl->mBufferOffset = 0;
+    mImpl->mBoundBufferBlocks.clear();
+}
+
+void DescriptorAllocator::clearCache() const {
+    assert(mImpl);
+    mImpl->clearCache();
+    mImpl->mBufferLayouts.clear();
 }
 
 UniqueDescriptorAllocator::UniqueDescriptorAllocator(vk::Device device) {
     mImpl = new DescriptorAllocatorImpl(device);
 }
 
+UniqueDescriptorAllocator::UniqueDescriptorAllocator(
+        vk::Device device,
+        vk::PhysicalDevice physical_device,
+        const vma::Allocator &allocator,
+        vk::DeviceSize descriptor_buffer_capacity
+) {
+    if (globals::DescriptorBuffer)
+        mImpl = new DescriptorAllocatorImpl(device, physical_device, allocator, descriptor_buffer_capacity);
+    else
+        mImpl = new DescriptorAllocatorImpl(device);
+}
+
 UniqueDescriptorAllocator::~UniqueDescriptorAllocator() {
     if (mImpl) {
-        if (mImpl->mCurrentPool) mImpl->mDevice.destroyDescriptorPool(mImpl->mCurrentPool);
-        for (auto p : mImpl->mUsedPools) mImpl->mDevice.destroyDescriptorPool(p);
+        mImpl->destroy();
         delete mImpl;
         mImpl = nullptr;
     }
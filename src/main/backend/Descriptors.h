@@ -4,6 +4,12 @@
 #include <span>
 #include <vulkan/vulkan.hpp>
 
+#include "../util/globals.h"
+
+namespace vma {
+    class Allocator;
+}
+
 /// <summary>
 /// A type-erased descriptor set binding for runtime usage.
 /// </summary>
@@ -97,11 +103,13 @@ public:
     DescriptorSetLayout(const DescriptorSetLayout &) = delete;
     DescriptorSetLayout &operator=(const DescriptorSetLayout &) = delete;
 
-    DescriptorSetLayout(DescriptorSetLayout &&other) noexcept : mHandle(std::move(other.mHandle)) {}
+    DescriptorSetLayout(DescriptorSetLayout &&other) noexcept
+        : mHandle(std::move(other.mHandle)), mDescriptorBuffer(other.mDescriptorBuffer) {}
 
     DescriptorSetLayout &operator=(DescriptorSetLayout &&other) noexcept {
         if (this != &other) {
             mHandle = std::move(other.mHandle);
+            mDescriptorBuffer = other.mDescriptorBuffer;
         }
         return *this;
     }
@@ -111,6 +119,11 @@ public:
     /// </summary>
     operator vk::DescriptorSetLayout() const { return *mHandle; }
 
+    /// <summary>
+    /// Whether sets of this layout are placed in a descriptor buffer instead of being allocated from a pool.
+    /// </summary>
+    [[nodiscard]] bool usesDescriptorBuffer() const { return mDescriptorBuffer; }
+
 protected:
     /// <summary>
     /// Creates the descriptor set layout from a variadic list of bindings.
@@ -132,6 +145,7 @@ protected:
         };
 
         mHandle = device.createDescriptorSetLayoutUnique(chain.get());
+        mDescriptorBuffer = static_cast<bool>(flags & vk::DescriptorSetLayoutCreateFlagBits::eDescriptorBufferEXT);
     }
 
     /// <summary>
@@ -144,8 +158,28 @@ protected:
 
 private:
     vk::UniqueDescriptorSetLayout mHandle;
+    bool mDescriptorBuffer = false;
 };
 
+/// <summary>
+/// Creation flags for layouts whose sets are only allocated from per-frame allocators.
+/// These sets are placed in a descriptor buffer if VK_EXT_descriptor_buffer is enabled.
+/// </summary>
+inline vk::DescriptorSetLayoutCreateFlags perFrameDescriptorSetLayoutFlags() {
+    if (globals::DescriptorBuffer)
+        return vk::DescriptorSetLayoutCreateFlagBits::eDescriptorBufferEXT;
+    return {};
+}
+
+/// <summary>
+/// Creation flags for pipelines that only use layouts created with perFrameDescriptorSetLayoutFlags().
+/// </summary>
+inline vk::PipelineCreateFlags perFrameDescriptorPipelineFlags() {
+    if (globals::DescriptorBuffer)
+        return vk::PipelineCreateFlagBits::eDescriptorBufferEXT;
+    return {};
+}
+
 /// <summary>
 /// A wrapper for vk::DescriptorSet providing typed helper methods for descriptor writes.
 /// </summary>
@@ -219,25 +253,94 @@ public:
 
     /// <summary>
     /// Implicit conversion to the underlying vk::DescriptorSet handle.
+    /// Null for sets placed in a descriptor buffer.
     /// </summary>
     operator vk::DescriptorSet() const { return mHandle; }
 
+    /// <summary>
+    /// Whether this set is placed in a descriptor buffer. Such sets must be written and bound through their allocator.
+    /// </summary>
+    [[nodiscard]] bool isBufferBacked() const { return static_cast<bool>(mBufferLayout); }
+
 private:
     vk::DescriptorSet mHandle;
+
+    // Only used for sets placed in a descriptor buffer
+    vk::DescriptorSetLayout mBufferLayout;
+    uint32_t mBufferIndex = 0;
+    vk::DeviceSize mBufferOffset = 0;
+
+    friend class DescriptorAllocator;
+    friend struct DescriptorAllocatorImpl;
 };
 
 struct DescriptorAllocatorImpl;
 
 /// <summary>
-/// A simple allocator for creating descriptor sets from a managed descriptor pool. Cheap to copy.
+/// A simple allocator for creating descriptor sets from managed descriptor pools. Pools are recycled on reset. Cheap to copy.
 /// </summary>
 class DescriptorAllocator {
 public:
     DescriptorAllocator() = default;
 
     [[nodiscard]] DescriptorSet allocate(const vk::DescriptorSetLayout& layout) const;
+
+    /// <summary>
+    /// Allocates a descriptor set. If the layout uses a descriptor buffer, the set is placed in this allocator's
+    /// descriptor buffer and has to be written with update() and bound with bind().
+    /// </summary>
+    [[nodiscard]] DescriptorSet allocate(const DescriptorSetLayout& layout) const;
+
+    /// <summary>
+    /// Writes descriptors into a set allocated from this allocator.
+    /// Sets in a descriptor buffer are written directly into mapped memory, others use vkUpdateDescriptorSets.
+    /// </summary>
+    /// <param name="set">The set to write to.</param>
+    /// <param name="writes">The descriptor writes. Created with set.write(...).</param>
+    void update(const DescriptorSet& set, vk::ArrayProxy<const vk::WriteDescriptorSet> writes) const;
+
+    /// <summary>
+    /// Binds a set allocated from this allocator. Sets in a descriptor buffer are bound via buffer offsets.
+    /// </summary>
+    void bind(
+            const vk::CommandBuffer& cmd_buf,
+            vk::PipelineBindPoint bind_point,
+            vk::PipelineLayout pipeline_layout,
+            uint32_t first_set,
+            const DescriptorSet& set
+    ) const;
+
+    /// <summary>
+    /// Returns a descriptor set containing the given writes. If a set with the same layout and identical contents was
+    /// requested since the previous reset, it is reused without being written again. Cached sets that aren't requested
+    /// between two resets are freed. Intended for sets that rarely change between frames.
+    /// </summary>
+    /// <param name="layout">The layout of the descriptor set.</param>
+    /// <param name="writes">The descriptor writes. Their dstSet is ignored, so they can be created from an empty DescriptorSet.</param>
+    /// <returns>A descriptor set with the requested contents.</returns>
+    [[nodiscard]] DescriptorSet allocateCached(
+            const vk::DescriptorSetLayout& layout, vk::ArrayProxy<const vk::WriteDescriptorSet> writes
+    ) const;
+
+    /// <summary>
+    /// Same as above. If the layout uses a descriptor buffer, writing is cheap enough that the set is simply
+    /// allocated and written instead.
+    /// </summary>
+    [[nodiscard]] DescriptorSet allocateCached(
+            const DescriptorSetLayout& layout, vk::ArrayProxy<const vk::WriteDescriptorSet> writes
+    ) const;
+
+    /// <summary>
+    /// Resets all pools for reuse. The device must have finished using the previously allocated sets.
+    /// </summary>
     void reset() const;
 
+    /// <summary>
+    /// Drops all cached descriptor sets. Has to be called when resources referenced by cached sets are destroyed,
+    /// because a recreated resource may get the same handle value.
+    /// </summary>
+    void clearCache() const;
+
     operator bool() const { return mImpl != nullptr; }
 
 protected:
@@ -249,6 +352,17 @@ class UniqueDescriptorAllocator : public DescriptorAllocator {
 public:
     UniqueDescriptorAllocator() = default;
     explicit UniqueDescriptorAllocator(vk::Device device);
+
+    /// <summary>
+    /// Creates an allocator that additionally owns a descriptor buffer if globals::DescriptorBuffer is enabled.
+    /// The buffer grows by another block of descriptor_buffer_capacity bytes when it runs full.
+    /// </summary>
+    UniqueDescriptorAllocator(
+            vk::Device device,
+            vk::PhysicalDevice physical_device,
+            const vma::Allocator& allocator,
+            vk::DeviceSize descriptor_buffer_capacity = 256 * 1024
+    );
     ~UniqueDescriptorAllocator();
 
     UniqueDescriptorAllocator(const UniqueDescriptorAllocator&) = delete;
@@ -7,7 +7,10 @@
 #include <utility>
 #include <vulkan/utility/vk_format_utils.h>
 
+#include "../debug/Annotation.h"
 #include "../util/Logger.h"
+#include "BarrierBatch.h"
+#include "DeletionQueue.h"
 
 template<typename T>
 PlainImageData<T>::PlainImageData() noexcept = default;
@@ -286,6 +289,49 @@ ImageWithView ImageWithView::create(
     return {std::move(image), std::move(view), viewCreateInfo};
 }
 
+ResizableImage ResizableImage::create(
+        const vk::Device &device, const vma::Allocator &allocator, const ImageCreateInfo &max_create_info, std::string name
+) {
+    ResizableImage result;
+    result.mCreateInfo = max_create_info;
+    result.mStorage = Image::create(allocator, max_create_info);
+    result.mName = std::move(name);
+    util::setDebugName(device, *result.mStorage.image, result.mName + "_storage");
+    result.alias(device, allocator, {max_create_info.width, max_create_info.height});
+    return result;
+}
+
+void ResizableImage::resize(
+        const vk::Device &device, const vma::Allocator &allocator, vk::Extent2D extent, DeletionQueue &deletion_queue
+) {
+    if (extent == this->extent())
+        return;
+    deletion_queue.release(static_cast<ImageWithView &&>(*this));
+    alias(device, allocator, extent);
+}
+
+void ResizableImage::alias(const vk::Device &device, const vma::Allocator &allocator, vk::Extent2D extent) {
+    Logger::check(
+            extent.width <= mCreateInfo.width && extent.height <= mCreateInfo.height,
+            "Resizable image extent exceeds its storage"
+    );
+    ImageCreateInfo create_info = mCreateInfo;
+    create_info.width = extent.width;
+    create_info.height = extent.height;
+
+    auto &&image = Image::createAliasing(allocator, mStorage, create_info);
+    ImageViewInfo view_info = ImageViewInfo::from(image.info);
+    auto &&view = device.createImageViewUnique({
+        .image = image,
+        .viewType = view_info.type,
+        .format = view_info.format,
+        .subresourceRange = view_info.resourceRange,
+    });
+    util::setDebugName(device, *image.image, mName + "_image");
+    util::setDebugName(device, *view, mName + "_image_view");
+    static_cast<ImageWithView &>(*this) = ImageWithView(std::move(image), std::move(view), view_info);
+}
+
 ImageWithView::operator TransientImageViewPair() const { return {*this, *this}; }
 UnmanagedImageWithViewRef::operator TransientImageViewPair() const { return {*this, *this}; }
 UnmanagedImageWithView::operator TransientImageViewPair() const { return {*this, *this}; }
@@ -330,40 +376,59 @@ void ImageBase::load(const vk::CommandBuffer &cmd_buf, uint32_t level, vk::Exten
 }
 
 void ImageBase::generateMipmaps(const vk::CommandBuffer &cmd_buf) {
-    barrier(cmd_buf, ImageResourceAccess::TransferWrite);
-
-    vk::ImageMemoryBarrier2 barrier = {
+    const vk::ImageSubresourceRange level_range = {
+        .aspectMask = info.aspects,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = info.layers,
+    };
+    // Transitions a level that was just written to a blit source
+    const vk::ImageMemoryBarrier2 level_barrier = {
+        .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+        .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+        .dstAccessMask = vk::AccessFlagBits2::eTransferRead,
+        .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+        .newLayout = vk::ImageLayout::eTransferSrcOptimal,
         .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
         .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
         .image = vk::Image(*this),
-        .subresourceRange =
-                {
-                    .aspectMask = info.aspects,
-                    .baseMipLevel = 0,
-                    .levelCount = 1,
-                    .baseArrayLayer = 0,
-                    .layerCount = info.layers,
-                },
+        .subresourceRange = level_range,
     };
 
+    // The 0th level is expected to be loaded. It becomes the first blit source while all other levels become
+    // destinations, which is done in a single dependency.
+    {
+        BarrierBatch barriers(cmd_buf);
+        vk::ImageMemoryBarrier2 source = level_barrier;
+        source.srcStageMask = mPrevAccess.stage;
+        source.srcAccessMask = mPrevAccess.access;
+        source.oldLayout = mPrevAccess.layout;
+        barriers.add(source);
+
+        if (info.levels > 1) {
+            vk::ImageMemoryBarrier2 destinations = source;
+            destinations.dstAccessMask = vk::AccessFlagBits2::eTransferWrite;
+            destinations.newLayout = vk::ImageLayout::eTransferDstOptimal;
+            destinations.subresourceRange.baseMipLevel = 1;
+            destinations.subresourceRange.levelCount = info.levels - 1;
+            barriers.add(destinations);
+        }
+    }
+
     auto level_width = static_cast<int32_t>(info.width);
     auto level_height = static_cast<int32_t>(info.height);
 
-    // run for images 1..n, the 0th is expected to be loaded
+    // run for images 1..n
     for (uint32_t lvl = 1; lvl < info.levels; lvl++) {
         int32_t next_level_width = std::max(level_width / 2, 1);
         int32_t next_level_height = std::max(level_height / 2, 1);
 
-        // transition layout of lower mip to src
-        if (mPrevAccess.layout != vk::ImageLayout::eTransferSrcOptimal) {
+        // transition layout of lower mip to src, the 0th was handled above
+        if (lvl > 1) {
+            vk::ImageMemoryBarrier2 barrier = level_barrier;
             barrier.subresourceRange.baseMipLevel = lvl - 1;
-            barrier.oldLayout = mPrevAccess.layout;
-            barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
-            barrier.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
-            barrier.dstAccessMask = vk::AccessFlagBits2::eTransferRead;
-            barrier.srcStageMask = vk::PipelineStageFlagBits2::eTransfer;
-            barrier.dstStageMask = vk::PipelineStageFlagBits2::eTransfer;
-
             cmd_buf.pipelineBarrier2({.imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &barrier});
         }
 
@@ -396,15 +461,9 @@ void ImageBase::generateMipmaps(const vk::CommandBuffer &cmd_buf) {
     }
 
     // final transition, kinda useless, but brings all levels to the same layout
-    if (mPrevAccess.layout != vk::ImageLayout::eTransferSrcOptimal) {
+    if (info.levels > 1) {
+        vk::ImageMemoryBarrier2 barrier = level_barrier;
         barrier.subresourceRange.baseMipLevel = info.levels - 1;
-        barrier.oldLayout = mPrevAccess.layout;
-        barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
-        barrier.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
-        barrier.dstAccessMask = vk::AccessFlagBits2::eTransferRead;
-        barrier.srcStageMask = vk::PipelineStageFlagBits2::eTransfer;
-        barrier.dstStageMask = vk::PipelineStageFlagBits2::eTransfer;
-
         cmd_buf.pipelineBarrier2({.imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &barrier});
     }
 
@@ -416,26 +475,37 @@ void ImageBase::generateMipmaps(const vk::CommandBuffer &cmd_buf) {
 }
 
 
-Image Image::create(const vma::Allocator &allocator, const ImageCreateInfo &create_info_) {
-    ImageCreateInfo ci = create_info_;
-    if (ci.levels == UINT32_MAX) {
-        ci.levels = static_cast<uint32_t>(std::floor(std::log2(std::max(ci.width, ci.height)))) + 1;
+namespace {
+    ImageCreateInfo resolveLevels(const ImageCreateInfo &create_info) {
+        ImageCreateInfo ci = create_info;
+        if (ci.levels == UINT32_MAX) {
+            ci.levels = static_cast<uint32_t>(std::floor(std::log2(std::max(ci.width, ci.height)))) + 1;
+        }
+        return ci;
     }
 
+    vk::ImageCreateInfo toVulkan(const ImageCreateInfo &ci) {
+        return {
+            .flags = ci.flags,
+            .imageType = ci.type,
+            .format = ci.format,
+            .extent = {.width = ci.width, .height = ci.height, .depth = ci.depth},
+            .mipLevels = ci.levels,
+            .arrayLayers = ci.layers,
+            .samples = ci.samples,
+            .usage = vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | ci.usage,
+            .sharingMode = ci.sharedQueues.size() == 0 ? vk::SharingMode::eExclusive : vk::SharingMode::eConcurrent,
+            .queueFamilyIndexCount = static_cast<uint32_t>(ci.sharedQueues.size()),
+            .pQueueFamilyIndices = ci.sharedQueues.data(),
+        };
+    }
+}
+
+Image Image::create(const vma::Allocator &allocator, const ImageCreateInfo &create_info_) {
+    ImageCreateInfo ci = resolveLevels(create_info_);
+
     auto [image, allocation] = allocator.createImageUnique(
-            vk::ImageCreateInfo{
-                .flags = ci.flags,
-                .imageType = ci.type,
-                .format = ci.format,
-                .extent = {.width = ci.width, .height = ci.height, .depth = ci.depth},
-                .mipLevels = ci.levels,
-                .arrayLayers = ci.layers,
-                .samples = ci.samples,
-                .usage = vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | ci.usage,
-                .sharingMode = ci.sharedQueues.size() == 0 ? vk::SharingMode::eExclusive : vk::SharingMode::eConcurrent,
-                .queueFamilyIndexCount = static_cast<uint32_t>(ci.sharedQueues.size()),
-                .pQueueFamilyIndices = ci.sharedQueues.data(),
-            },
+            toVulkan(ci),
             {
                 .usage = ci.device,
                 .requiredFlags = ci.requiredProperties,
@@ -446,6 +516,13 @@ Image Image::create(const vma::Allocator &allocator, const ImageCreateInfo &crea
     return {std::move(image), std::move(allocation), ci};
 }
 
+Image Image::createAliasing(const vma::Allocator &allocator, const Image &storage, const ImageCreateInfo &create_info_) {
+    ImageCreateInfo ci = resolveLevels(create_info_);
+    auto image = allocator.createAliasingImageUnique(*storage.allocation, toVulkan(ci));
+    // The memory stays owned by the storage image
+    return {std::move(image), {}, ci};
+}
+
 ImageView ImageView::create(const vk::Device &device, const vk::Image &image, const ImageViewInfo &info) {
     return ImageView(
             device.createImageViewUnique({
@@ -1,11 +1,13 @@
 #pragma once
 #include <filesystem>
+#include <string>
 #include <vulkan-memory-allocator-hpp/vk_mem_alloc.hpp>
 
 #include "../util/static_vector.h"
 #include "ImageResource.h"
 
 
+class DeletionQueue;
 class TransientImageViewPair;
 
 /// <summary>
@@ -271,6 +273,8 @@ struct ImageBase : protected ImageResource {
 
     virtual operator vk::Image() const = 0; // NOLINT(*-explicit-constructor)
     explicit virtual operator bool() const = 0;
+
+    friend class BarrierBatch;
 };
 
 /// <summary>
@@ -373,6 +377,12 @@ struct Image : ImageBase {
     /// </para>
     /// </summary>
     static Image create(const vma::Allocator &allocator, const ImageCreateInfo &create_info);
+
+    /// <summary>
+    /// Creates a Vulkan image bound to the memory of `storage` instead of allocating.
+    /// The result doesn't own the memory, so `storage` has to outlive it.
+    /// </summary>
+    static Image createAliasing(const vma::Allocator &allocator, const Image &storage, const ImageCreateInfo &create_info);
 };
 
 /// <summary>
@@ -433,6 +443,47 @@ struct ImageWithView : Image, ImageView {
     explicit operator bool() const override { return image && view; }
 };
 
+/// <summary>
+/// An ImageWithView whose extent can change without allocating, e.g. for dynamic resolution.
+/// The memory is allocated once for the maximum extent and the image aliases it at the current extent.
+/// The contents are undefined after a resize.
+/// </summary>
+struct ResizableImage : ImageWithView {
+    ResizableImage() = default;
+
+    ResizableImage(const ResizableImage &other) = delete;
+    ResizableImage &operator=(const ResizableImage &other) = delete;
+
+    ResizableImage(ResizableImage &&other) noexcept = default;
+    ResizableImage &operator=(ResizableImage &&other) noexcept = default;
+
+    ~ResizableImage() override = default;
+
+    [[nodiscard]] vk::Extent2D extent() const { return {imageInfo().width, imageInfo().height}; }
+    [[nodiscard]] vk::Extent2D maxExtent() const { return {mCreateInfo.width, mCreateInfo.height}; }
+
+    /// <summary>
+    /// Allocates memory for `max_create_info` and creates the image at that extent.
+    /// The name is used for the debug names of the storage, the image and the view.
+    /// </summary>
+    static ResizableImage create(
+            const vk::Device &device, const vma::Allocator &allocator, const ImageCreateInfo &max_create_info, std::string name
+    );
+
+    /// <summary>
+    /// Replaces the image and view by ones of the given extent, which must not exceed the maximum extent.
+    /// The previous ones are released to the deletion queue, since frames in flight may still use them.
+    /// </summary>
+    void resize(const vk::Device &device, const vma::Allocator &allocator, vk::Extent2D extent, DeletionQueue &deletion_queue);
+
+private:
+    void alias(const vk::Device &device, const vma::Allocator &allocator, vk::Extent2D extent);
+
+    ImageCreateInfo mCreateInfo;
+    Image mStorage;
+    std::string mName;
+};
+
 /// <summary>
 /// Wraps a raw vk::Image to provide barrier tracking logic without owning the memory.
 /// <para>
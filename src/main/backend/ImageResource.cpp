@@ -3,6 +3,7 @@
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image.h>
+#include <stb_image_write.h>
 
 constexpr ImageResourceAccess ImageResourceAccess::TransferWrite = {
     .stage = vk::PipelineStageFlagBits2::eTransfer,
@@ -108,6 +109,16 @@ void ImageResource::barrier(
         const vk::CommandBuffer &cmd_buf,
         const ImageResourceAccess &begin,
         const ImageResourceAccess &end
+) const {
+    vk::ImageMemoryBarrier2 barrier = makeBarrier(image, range, begin, end);
+    cmd_buf.pipelineBarrier2({
+        .imageMemoryBarrierCount = 1,
+        .pImageMemoryBarriers = &barrier,
+    });
+}
+
+vk::ImageMemoryBarrier2 ImageResource::makeBarrier(
+        vk::Image image, vk::ImageSubresourceRange range, const ImageResourceAccess &begin, const ImageResourceAccess &end
 ) const {
     vk::ImageMemoryBarrier2 barrier{
         .srcStageMask = mPrevAccess.stage,
@@ -122,14 +133,10 @@ void ImageResource::barrier(
         .subresourceRange = range,
     };
 
-    cmd_buf.pipelineBarrier2({
-        .imageMemoryBarrierCount = 1,
-        .pImageMemoryBarriers = &barrier,
-    });
-
     mPrevAccess.stage = end.stage;
     mPrevAccess.access = end.access;
     mPrevAccess.layout = end.layout == vk::ImageLayout::eUndefined ? mPrevAccess.layout : end.layout;
+    return barrier;
 }
 
 
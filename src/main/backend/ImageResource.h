@@ -61,6 +61,14 @@ protected:
             const ImageResourceAccess &end
     ) const;
 
+    /// <summary>
+    /// Creates an image memory barrier and advances the tracked state, without recording it.
+    /// The caller is responsible for recording the barrier before the image is accessed.
+    /// </summary>
+    [[nodiscard]] vk::ImageMemoryBarrier2 makeBarrier(
+            vk::Image image, vk::ImageSubresourceRange range, const ImageResourceAccess &begin, const ImageResourceAccess &end
+    ) const;
+
     /// <summary>
     /// Transfers ownership of the image between queue families.
     /// It does NOT perform any memory barriers or layout transitions. Execution ordering must be handled with a semaphore.
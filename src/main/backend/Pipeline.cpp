@@ -212,6 +212,7 @@ ConfiguredComputePipeline createComputePipeline(
     );
 
     vk::ComputePipelineCreateInfo pipeline_create_info = {
+        .flags = c.flags,
         .stage = shader_stage_create_info,
         .layout = *layout,
     };
@@ -283,6 +283,8 @@ private:
 /// Configuration for creating a Vulkan compute pipeline.
 /// </summary>
 struct ComputePipelineConfig {
+    /// <summary>Pipeline creation flags, e.g. for descriptor buffer usage.</summary>
+    vk::PipelineCreateFlags flags = {};
     /// <summary>Layouts of descriptor sets used by the pipeline.</summary>
     util::static_vector<vk::DescriptorSetLayout, 4> descriptorSetLayouts;
     /// <summary>Push constant ranges used by the pipeline.</summary>
@@ -62,7 +62,7 @@ vk::Buffer StagingBuffer::stage(const void *data, size_t size) {
 }
 
 StagingBuffer::StagingBuffer(const vma::Allocator &allocator, const vk::Device &device, const vk::CommandPool &cmd_pool)
-    : mDevice(device), mAllocator(allocator), mCommandPool(cmd_pool) {
+    : mDevice(device), mAllocator(allocator), mCommandPool(cmd_pool), mTimeline(device) {
     createCommandBuffer();
 }
 
@@ -74,16 +74,15 @@ StagingBuffer::~StagingBuffer() {
     mDevice.freeCommandBuffers(mCommandPool, {mCommands});
 }
 
-void StagingBuffer::submit(const vk::Queue &queue, const vk::SubmitInfo &submit_info_) {
+uint64_t StagingBuffer::submit(const vk::Queue &queue) {
     mCommands.end();
 
-    vk::SubmitInfo submit_info = submit_info_;
-    submit_info.setCommandBuffers(mCommands);
-    auto fence = mDevice.createFenceUnique(vk::FenceCreateInfo());
-    queue.submit({submit_info}, *fence);
+    uint64_t value = mTimeline.next();
+    vk::CommandBufferSubmitInfo cmd_info = {.commandBuffer = mCommands};
+    vk::SemaphoreSubmitInfo signal_info = mTimeline.signalInfo(value);
+    queue.submit2(vk::SubmitInfo2().setCommandBufferInfos(cmd_info).setSignalSemaphoreInfos(signal_info));
 
-    while (mDevice.waitForFences(*fence, true, UINT64_MAX) == vk::Result::eTimeout) {
-    }
+    mTimeline.wait(value);
     mDevice.freeCommandBuffers(mCommandPool, {mCommands});
     createCommandBuffer();
 
@@ -91,6 +90,7 @@ void StagingBuffer::submit(const vk::Queue &queue, const vk::SubmitInfo &submit_
         mAllocator.destroyBuffer(buffer, alloc);
     }
     mAllocations.clear();
+    return value;
 }
 
 void StagingBuffer::createCommandBuffer() {
@@ -3,6 +3,8 @@
 #include <ranges>
 #include <vulkan-memory-allocator-hpp/vk_mem_alloc.hpp>
 
+#include "TimelineSemaphore.h"
+
 /// <summary>
 /// A buffer to upload data from the CPU to the GPU.
 /// </summary>
@@ -90,10 +92,18 @@ public:
     }
 
     /// <summary>
-    /// Submits all staged uploads to the GPU.
+    /// Submits all staged uploads to the GPU and blocks until they completed.
     /// </summary>
     /// <param name="queue">The Vulkan queue to submit to. It should be a transfer queue.</param>
-    void submit(const vk::Queue &queue, const vk::SubmitInfo& = {});
+    /// <returns>The value of timeline() signaled by this submission, for other queues to wait on.</returns>
+    uint64_t submit(const vk::Queue &queue);
+
+    /// <summary>
+    /// The timeline semaphore signaled by submit().
+    /// </summary>
+    [[nodiscard]] const TimelineSemaphore &timeline() const {
+        return mTimeline;
+    }
 
     /// <summary>
     /// Returns the command buffer used for staging operations. Only transfer commands may be permitted.
@@ -113,5 +123,6 @@ private:
     vma::Allocator mAllocator;
     vk::CommandPool mCommandPool;
     vk::CommandBuffer mCommands;
+    TimelineSemaphore mTimeline;
     std::vector<std::pair<vk::Buffer, vma::Allocation>> mAllocations;
 };
@@ -18,7 +18,74 @@ Swapchain::Swapchain(
     create();
 }
 
+Swapchain::Swapchain(const vk::Device &device, const vma::Allocator &allocator, vk::Extent2D extents)
+    : mDevice(device), mAllocator(allocator), mSurfaceExtents(extents), mHeadless(true) {
+    create();
+}
+
 void Swapchain::create() {
+    // Need to be cleared before swapchain is created
+    mSwapchainImageViewsUnorm.clear();
+    mSwapchainImages.clear();
+
+    if (mHeadless)
+        createOffscreenImages();
+    else
+        createSwapchainImages();
+
+    for (const auto &swapchain_image: mSwapchainImages) {
+        util::setDebugName(mDevice, static_cast<vk::Image>(swapchain_image), "swapchain_image");
+        const auto &view =
+                mSwapchainImageViewsUnorm.emplace_back(ImageView::create(mDevice, swapchain_image));
+        util::setDebugName(mDevice, static_cast<vk::ImageView>(view), "swapchain_image_view");
+    }
+
+    mDepthImage = Image::create(
+            mAllocator,
+            ImageCreateInfo{
+                .format = mDepthFormat,
+                .aspects = vk::ImageAspectFlagBits::eDepth,
+                .width = mSurfaceExtents.width,
+                .height = mSurfaceExtents.height,
+                .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
+                .device = vma::MemoryUsage::eAutoPreferDevice,
+            }
+    );
+    util::setDebugName(mDevice, static_cast<vk::Image>(mDepthImage), "swapchain_depth_image");
+
+    mDepthImageView = ImageView::create(mDevice, mDepthImage);
+    util::setDebugName(mDevice, static_cast<vk::ImageView>(mDepthImageView), "swapchain_depth_image_view");
+
+    mInvalid = false;
+}
+
+void Swapchain::createOffscreenImages() {
+    // RGBA instead of BGRA, so readbacks can be written out without swizzling
+    mSurfaceFormat = {.format = vk::Format::eR8G8B8A8Unorm, .colorSpace = vk::ColorSpaceKHR::eSrgbNonlinear};
+    mImageCount = globals::MaxFramesInFlight + 1;
+    mReadable = true;
+    mMinImageCount = mImageCount;
+    mMaxImageCount = mImageCount;
+
+    mOffscreenImages.clear();
+    for (int i = 0; i < mImageCount; i++) {
+        const auto &image = mOffscreenImages.emplace_back(Image::create(
+                mAllocator,
+                ImageCreateInfo{
+                    .format = mSurfaceFormat.format,
+                    .aspects = vk::ImageAspectFlagBits::eColor,
+                    .width = mSurfaceExtents.width,
+                    .height = mSurfaceExtents.height,
+                    .usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eStorage |
+                             vk::ImageUsageFlagBits::eTransferSrc,
+                    .device = vma::MemoryUsage::eAutoPreferDevice,
+                }
+        ));
+        mSwapchainImages.emplace_back(static_cast<vk::Image>(image), image.info);
+    }
+}
+
+void Swapchain::createSwapchainImages() {
     auto surface_formats = mPhysicalDevice.getSurfaceFormatsKHR(mSurface);
     auto surface_present_modes = mPhysicalDevice.getSurfacePresentModesKHR(mSurface);
 
@@ -77,9 +144,11 @@ void Swapchain::create() {
             mSurfaceExtents.height, surface_capabilities.minImageExtent.height, surface_capabilities.maxImageExtent.height
     );
 
-    // Need to be cleared before swapchain is created
-    mSwapchainImageViewsUnorm.clear();
-    mSwapchainImages.clear();
+    vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eStorage;
+    // Needed for frame captures, but not guaranteed by every surface
+    mReadable = static_cast<bool>(surface_capabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferSrc);
+    if (mReadable)
+        usage |= vk::ImageUsageFlagBits::eTransferSrc;
 
     mSwapchain = mDevice.createSwapchainKHRUnique({
         .surface = mSurface,
@@ -88,7 +157,7 @@ void Swapchain::create() {
         .imageColorSpace = mSurfaceFormat.colorSpace,
         .imageExtent = mSurfaceExtents,
         .imageArrayLayers = 1,
-        .imageUsage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eStorage,
+        .imageUsage = usage,
         .imageSharingMode = vk::SharingMode::eExclusive,
         .preTransform = surface_capabilities.currentTransform,
         .compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque,
@@ -108,34 +177,15 @@ void Swapchain::create() {
                 }
         );
     }
-
-    for (const auto &swapchain_image: mSwapchainImages) {
-        util::setDebugName(mDevice, static_cast<vk::Image>(swapchain_image), "swapchain_image");
-        const auto &view =
-                mSwapchainImageViewsUnorm.emplace_back(ImageView::create(mDevice, swapchain_image));
-        util::setDebugName(mDevice, static_cast<vk::ImageView>(view), "swapchain_image_view");
-    }
-
-    mDepthImage = Image::create(
-            mAllocator,
-            ImageCreateInfo{
-                .format = mDepthFormat,
-                .aspects = vk::ImageAspectFlagBits::eDepth,
-                .width = mSurfaceExtents.width,
-                .height = mSurfaceExtents.height,
-                .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
-                .device = vma::MemoryUsage::eAutoPreferDevice,
-            }
-    );
-    util::setDebugName(mDevice, static_cast<vk::Image>(mDepthImage), "swapchain_depth_image");
-
-    mDepthImageView = ImageView::create(mDevice, mDepthImage);
-    util::setDebugName(mDevice, static_cast<vk::ImageView>(mDepthImageView), "swapchain_depth_image_view");
-
-    mInvalid = false;
 }
 
 void Swapchain::recreate() {
+    if (mHeadless) {
+        mDevice.waitIdle();
+        create();
+        return;
+    }
+
     // wait if the window is minimized, it can crash otherwise
     auto extents = mWindow.getFramebufferSize();
     while (extents.width == 0 || extents.height == 0) {
@@ -148,6 +198,11 @@ void Swapchain::recreate() {
 }
 
 bool Swapchain::advance(const vk::Semaphore &image_available_semaphore) {
+    if (mHeadless) {
+        mActiveImageIndex = (mActiveImageIndex + 1) % mImageCount;
+        return true;
+    }
+
     auto extents = mWindow.getFramebufferSize();
     if (mSurfaceExtents.width != extents.width || mSurfaceExtents.height != extents.height) {
         Logger::debug("Swapchain needs recreation: framebuffer size changed");
@@ -181,6 +236,9 @@ bool Swapchain::advance(const vk::Semaphore &image_available_semaphore) {
 }
 
 bool Swapchain::present(const vk::Queue &queue, vk::PresentInfoKHR &present_info) {
+    if (mHeadless)
+        return true;
+
     present_info.setSwapchains(*mSwapchain).setImageIndices(mActiveImageIndex);
 
     try {
@@ -35,6 +35,24 @@ public:
             const vma::Allocator &allocator
     );
 
+    /// <summary>
+    /// Initializes a headless swapchain, which renders into offscreen images instead of presenting to a surface.
+    /// </summary>
+    /// <param name="device">The Vulkan device.</param>
+    /// <param name="allocator">The VMA allocator.</param>
+    /// <param name="extents">The fixed size of the offscreen images.</param>
+    Swapchain(const vk::Device &device, const vma::Allocator &allocator, vk::Extent2D extents);
+
+    /// <summary>
+    /// Whether images are offscreen targets. Headless swapchains neither signal nor wait for semaphores.
+    /// </summary>
+    [[nodiscard]] bool headless() const { return mHeadless; }
+
+    /// <summary>
+    /// Whether the images can be used as a transfer source, which frame captures require.
+    /// </summary>
+    [[nodiscard]] bool readable() const { return mReadable; }
+
     /// <summary>
     /// Gets the linear color format of the swapchain.
     /// </summary>
@@ -170,6 +188,9 @@ public:
     [[nodiscard]] bool present(const vk::Queue &queue, vk::PresentInfoKHR &present_info);
 
 private:
+    void createSwapchainImages();
+    void createOffscreenImages();
+
     vk::Device mDevice;
     vk::PhysicalDevice mPhysicalDevice;
     vk::SurfaceKHR mSurface;
@@ -182,6 +203,8 @@ private:
     vk::UniqueSwapchainKHR mSwapchain;
     std::vector<UnmanagedImage> mSwapchainImages;
     std::vector<ImageView> mSwapchainImageViewsUnorm;
+    // Owns the memory behind mSwapchainImages in headless mode
+    std::vector<Image> mOffscreenImages;
 
     Image mDepthImage;
     ImageView mDepthImageView;
@@ -193,4 +216,6 @@ private:
     int mMaxImageCount = 0;
     vk::PresentModeKHR mPresentMode = vk::PresentModeKHR::eImmediate;
     bool mInvalid = true;
+    bool mHeadless = false;
+    bool mReadable = false;
 };
@@ -0,0 +1,28 @@
+#include "TimelineSemaphore.h"
+
+#include <format>
+
+#include "../util/Logger.h"
+
+TimelineSemaphore::TimelineSemaphore(const vk::Device &device, uint64_t initial_value)
+    : mDevice(device), mValue(initial_value) {
+    vk::SemaphoreTypeCreateInfo type_info = {
+        .semaphoreType = vk::SemaphoreType::eTimeline,
+        .initialValue = initial_value,
+    };
+    mSemaphore = device.createSemaphoreUnique({.pNext = &type_info});
+}
+
+void TimelineSemaphore::wait(uint64_t value) const {
+    vk::Semaphore semaphore = *mSemaphore;
+    vk::Result result = mDevice.waitSemaphores(
+            {
+                .semaphoreCount = 1,
+                .pSemaphores = &semaphore,
+                .pValues = &value,
+            },
+            UINT64_MAX
+    );
+    if (result != vk::Result::eSuccess)
+        Logger::fatal(std::format("waitSemaphores failed: {}", vk::to_string(result)));
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+/// <summary>
+/// A timeline semaphore together with the last value scheduled to be signaled.
+/// Values increase monotonically, so "the GPU reached value N" can be queried or waited for exactly and without fences.
+/// </summary>
+class TimelineSemaphore {
+public:
+    TimelineSemaphore() = default;
+    explicit TimelineSemaphore(const vk::Device &device, uint64_t initial_value = 0);
+
+    /// <summary>
+    /// Reserves and returns the next value to signal.
+    /// </summary>
+    uint64_t next() { return ++mValue; }
+
+    /// <summary>
+    /// The last value returned by next(), or the initial value.
+    /// </summary>
+    [[nodiscard]] uint64_t value() const { return mValue; }
+
+    /// <summary>
+    /// Queries the value the device has reached so far.
+    /// </summary>
+    [[nodiscard]] uint64_t completed() const { return mDevice.getSemaphoreCounterValue(*mSemaphore); }
+
+    [[nodiscard]] bool reached(uint64_t value) const { return completed() >= value; }
+
+    /// <summary>
+    /// Blocks until the device has reached the given value.
+    /// </summary>
+    void wait(uint64_t value) const;
+
+    /// <summary>
+    /// Creates a submit info to wait for a value before the given stages execute.
+    /// </summary>
+    [[nodiscard]] vk::SemaphoreSubmitInfo waitInfo(uint64_t value, vk::PipelineStageFlags2 stages) const {
+        return {.semaphore = *mSemaphore, .value = value, .stageMask = stages};
+    }
+
+    /// <summary>
+    /// Creates a submit info to signal a value once the given stages completed.
+    /// </summary>
+    [[nodiscard]] vk::SemaphoreSubmitInfo signalInfo(
+            uint64_t value, vk::PipelineStageFlags2 stages = vk::PipelineStageFlagBits2::eAllCommands
+    ) const {
+        return {.semaphore = *mSemaphore, .value = value, .stageMask = stages};
+    }
+
+    operator vk::Semaphore() const { return *mSemaphore; } // NOLINT(*-explicit-constructor)
+    explicit operator bool() const { return static_cast<bool>(mSemaphore); }
+
+private:
+    vk::Device mDevice;
+    vk::UniqueSemaphore mSemaphore;
+    uint64_t mValue = 0;
+};
@@ -5,6 +5,7 @@
 #include <VkBootstrap.h>
 #include <glfw/glfw3.h>
 #include <iostream>
+#include <tracy/Tracy.hpp>
 #include <vulkan/vulkan.hpp>
 
 #include "../debug/Annotation.h"
@@ -23,7 +24,11 @@ static auto makeUniqueHandle(const T &t, Args &&...args) {
     );
 }
 
-static glfw::UniqueWindow createWindow(const glfw::WindowCreateInfo &window_create_info) {
+static glfw::UniqueWindow createWindow(const glfw::WindowCreateInfo &window_create_info, bool headless) {
+    // The null platform still provides windows, input and monitors, so the rest of the application is unaffected
+    if (headless)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+
     glfw::Context::init([](int error, const char *description) {
         Logger::error(std::format("GLFW error {:#010x}: {}", error, description));
     });
@@ -31,13 +36,14 @@ static glfw::UniqueWindow createWindow(const glfw::WindowCreateInfo &window_crea
     return std::make_unique<glfw::Window>(window_create_info);
 }
 
-static vkb::Instance createInstance() {
-    uint32_t required_glfw_extension_count = 0;
-    auto required_glfw_extensions = glfwGetRequiredInstanceExtensions(&required_glfw_extension_count);
-    auto instance_builder = vkb::InstanceBuilder{}
-                                    .require_api_version(1, 3, 0)
-                                    .enable_extension(vk::KHRGetSurfaceCapabilities2ExtensionName)
-                                    .enable_extensions(required_glfw_extension_count, required_glfw_extensions);
+static vkb::Instance createInstance(bool headless) {
+    auto instance_builder = vkb::InstanceBuilder{}.require_api_version(1, 3, 0).set_headless(headless);
+    if (!headless) {
+        uint32_t required_glfw_extension_count = 0;
+        auto required_glfw_extensions = glfwGetRequiredInstanceExtensions(&required_glfw_extension_count);
+        instance_builder.enable_extension(vk::KHRGetSurfaceCapabilities2ExtensionName)
+                .enable_extensions(required_glfw_extension_count, required_glfw_extensions);
+    }
     if (globals::Debug) {
         Logger::info("Using validation layers");
         instance_builder.enable_validation_layers(true);
@@ -54,7 +60,7 @@ static vkb::Instance createInstance() {
     return instance_ret.value();
 }
 
-void printSystemInformation(const vk::Instance &instance) {
+void printSystemInformation(const vk::Instance &instance, bool headless) {
     Logger::info("Available layers:");
     for (auto layer_property: vk::enumerateInstanceLayerProperties()) {
         Logger::info(std::format(
@@ -86,7 +92,7 @@ void printSystemInformation(const vk::Instance &instance) {
                 caps.emplace_back("Protected");
             if (queue.queueFlags & vk::QueueFlagBits::eSparseBinding)
                 caps.emplace_back("SparseBinding");
-            if (glfwGetPhysicalDevicePresentationSupport(instance, device, i))
+            if (!headless && glfwGetPhysicalDevicePresentationSupport(instance, device, i))
                 caps.emplace_back("Present");
             Logger::info(std::format("  Queue Family: {} x {}", queue.queueCount, caps));
         }
@@ -96,7 +102,6 @@ void printSystemInformation(const vk::Instance &instance) {
 vkb::PhysicalDevice createPhysicalDevice(const vkb::Instance &instance, const vk::SurfaceKHR &surface) {
     auto phys_device_selector =
             vkb::PhysicalDeviceSelector(instance)
-                    .set_surface(surface)
                     .set_required_features({
                         .robustBufferAccess = true,
                         .multiDrawIndirect = true,
@@ -118,8 +123,9 @@ vkb::PhysicalDevice createPhysicalDevice(const vkb::Instance &instance, const vk
                         .runtimeDescriptorArray = true,
                         .scalarBlockLayout = true,
                         .uniformBufferStandardLayout = true,
+                        .hostQueryReset = true, // GPU profiler resets its timestamp queries on the host
                         .timelineSemaphore = true,
-                        .bufferDeviceAddress = false, // maybe later
+                        .bufferDeviceAddress = true, // core in Vulkan 1.3, needed for descriptor buffers
                         .bufferDeviceAddressCaptureReplay = false,
                         .bufferDeviceAddressMultiDevice = false,
                     })
@@ -130,22 +136,60 @@ vkb::PhysicalDevice createPhysicalDevice(const vkb::Instance &instance, const vk
                         .dynamicRendering = true,
                         .maintenance4 = true, // allows using temporary pipeline layouts for pipeline creation
                     })
-                    .add_required_extension(vk::KHRSwapchainExtensionName)
                     .add_required_extension(vk::EXTMemoryBudgetExtensionName)
-                    .add_required_extension(vk::KHRSwapchainMutableFormatExtensionName)
                     .add_required_extension(vk::KHRMaintenance4ExtensionName)
                     .add_required_extension_features(
                             vk::PhysicalDeviceShaderDrawParametersFeatures{.shaderDrawParameters = true}
                     )
-                    .prefer_gpu_device_type(vkb::PreferredDeviceType::discrete)
-                    .allow_any_gpu_device_type(false)
-                    .require_present();
+                    .prefer_gpu_device_type(vkb::PreferredDeviceType::discrete);
+
+    if (surface) {
+        phys_device_selector.set_surface(surface)
+                .add_required_extension(vk::KHRSwapchainExtensionName)
+                .add_required_extension(vk::KHRSwapchainMutableFormatExtensionName)
+                .allow_any_gpu_device_type(false)
+                .require_present();
+    } else {
+        // Headless machines often only have a software implementation like lavapipe
+        phys_device_selector.allow_any_gpu_device_type(true).require_present(false);
+    }
 
     auto phys_device_ret = phys_device_selector.select(vkb::DeviceSelectionMode::only_fully_suitable);
     if (!phys_device_ret) {
         Logger::fatal(phys_device_ret.error().message());
     }
-    return phys_device_ret.value();
+    vkb::PhysicalDevice physical_device = phys_device_ret.value();
+
+    if (globals::DescriptorBuffer) {
+        bool supported = physical_device.enable_extension_if_present(vk::EXTDescriptorBufferExtensionName) &&
+                         physical_device.enable_extension_features_if_present(
+                                 vk::PhysicalDeviceDescriptorBufferFeaturesEXT{.descriptorBuffer = true}
+                         );
+        if (supported) {
+            Logger::info("Using descriptor buffers for per-frame descriptor sets");
+        } else {
+            Logger::warning("VK_EXT_descriptor_buffer is not supported, falling back to descriptor pools");
+            globals::DescriptorBuffer = false;
+        }
+    }
+
+    // Optional, the shadow cascades are rendered in one pass if supported.
+    // Shaders target SPIR-V 1.3, where writing gl_Layer from a vertex shader needs the extension besides the feature
+    globals::ShaderOutputLayer =
+            physical_device.enable_extension_if_present(vk::EXTShaderViewportIndexLayerExtensionName) &&
+            physical_device.enable_extension_features_if_present(
+                    vk::PhysicalDeviceVulkan12Features{.shaderOutputLayer = true}
+            );
+
+    // Optional, reductions fall back to shared atomics without it
+    auto subgroup_properties = vk::PhysicalDevice(physical_device.physical_device)
+                                       .getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceSubgroupProperties>()
+                                       .get<vk::PhysicalDeviceSubgroupProperties>();
+    globals::SubgroupArithmetic =
+            (subgroup_properties.supportedStages & vk::ShaderStageFlagBits::eCompute) &&
+            (subgroup_properties.supportedOperations & vk::SubgroupFeatureFlagBits::eArithmetic);
+
+    return physical_device;
 }
 
 vkb::Device createDevice(const vkb::PhysicalDevice &physical_device) {
@@ -157,6 +201,21 @@ vkb::Device createDevice(const vkb::PhysicalDevice &physical_device) {
     return device_ret.value();
 }
 
+#ifdef TRACY_ENABLE
+// Tracy identifies memory pools by pointer, not by string contents
+static constexpr const char *TracyDeviceMemoryPool = "Vulkan Device Memory";
+
+// VMA reports every VkDeviceMemory block, including dedicated allocations, which is what counts against the heaps
+static void VKAPI_PTR
+tracyDeviceMemoryAllocate(VmaAllocator, uint32_t, VkDeviceMemory memory, VkDeviceSize size, void *) {
+    TracyAllocN(reinterpret_cast<void *>(memory), size, TracyDeviceMemoryPool);
+}
+
+static void VKAPI_PTR tracyDeviceMemoryFree(VmaAllocator, uint32_t, VkDeviceMemory memory, VkDeviceSize, void *) {
+    TracyFreeN(reinterpret_cast<void *>(memory), TracyDeviceMemoryPool);
+}
+#endif
+
 vma::UniqueAllocator createVmaAllocator(
         const vk::Instance &instance, const vk::Device &device, const vk::PhysicalDevice &physical_device
 ) {
@@ -164,10 +223,16 @@ vma::UniqueAllocator createVmaAllocator(
         .vkGetInstanceProcAddr = VULKAN_HPP_DEFAULT_DISPATCHER.vkGetInstanceProcAddr,
         .vkGetDeviceProcAddr = VULKAN_HPP_DEFAULT_DISPATCHER.vkGetDeviceProcAddr
     };
+    vma::DeviceMemoryCallbacks device_memory_callbacks = {};
+#ifdef TRACY_ENABLE
+    device_memory_callbacks.pfnAllocate = tracyDeviceMemoryAllocate;
+    device_memory_callbacks.pfnFree = tracyDeviceMemoryFree;
+#endif
     return vma::createAllocatorUnique({
-        .flags = vma::AllocatorCreateFlagBits::eExtMemoryBudget,
+        .flags = vma::AllocatorCreateFlagBits::eExtMemoryBudget | vma::AllocatorCreateFlagBits::eBufferDeviceAddress,
         .physicalDevice = physical_device,
         .device = device,
+        .pDeviceMemoryCallbacks = &device_memory_callbacks,
         .pVulkanFunctions = &vma_vulkan_functions,
         .instance = instance,
         .vulkanApiVersion = VK_API_VERSION_1_3,
@@ -179,7 +244,8 @@ void createQueues(
         DeviceQueue &out_graphics_queue,
         DeviceQueue &out_compute_queue,
         DeviceQueue &out_transfer_queue,
-        DeviceQueue &out_present_queue
+        DeviceQueue &out_present_queue,
+        bool headless
 ) {
     auto gq_ret = device.get_queue(vkb::QueueType::graphics);
     auto gq_family_ret = device.get_queue_index(vkb::QueueType::graphics);
@@ -197,36 +263,46 @@ void createQueues(
         out_compute_queue = {cq_ret.value(), cq_family_ret.value()};
     }
 
-    auto pq_ret = device.get_queue(vkb::QueueType::present);
-    auto pq_family_ret = device.get_queue_index(vkb::QueueType::present);
-    if (!pq_ret.has_value() || !pq_family_ret.has_value()) {
-        Logger::fatal("failed to get present queue: " + pq_ret.error().message());
+    if (headless) {
+        // Nothing is ever presented
+        out_present_queue = out_graphics_queue;
+    } else {
+        auto pq_ret = device.get_queue(vkb::QueueType::present);
+        auto pq_family_ret = device.get_queue_index(vkb::QueueType::present);
+        if (!pq_ret.has_value() || !pq_family_ret.has_value()) {
+            Logger::fatal("failed to get present queue: " + pq_ret.error().message());
+        }
+        out_present_queue = {pq_ret.value(), pq_family_ret.value()};
     }
-    out_present_queue = {pq_ret.value(), pq_family_ret.value()};
 
     auto tq_ret = device.get_dedicated_queue(vkb::QueueType::transfer);
     auto tq_family_ret = device.get_dedicated_queue_index(vkb::QueueType::transfer);
     if (!tq_ret.has_value() || !tq_family_ret.has_value()) {
-        Logger::fatal("failed to get transfer queue: " + tq_ret.error().message());
+        // Software implementations like lavapipe only expose a single queue family
+        Logger::warning("No dedicated transfer queue available, using the main queue: " + tq_ret.error().message());
+        out_transfer_queue = out_graphics_queue;
+    } else {
+        out_transfer_queue = {tq_ret.value(), tq_family_ret.value()};
     }
-    out_transfer_queue = {tq_ret.value(), tq_family_ret.value()};
 }
 
 
-VulkanContext VulkanContext::create(const glfw::WindowCreateInfo &window_create_info) {
+VulkanContext VulkanContext::create(const glfw::WindowCreateInfo &window_create_info, bool headless) {
     // Step 1: Create Window
-    glfw::UniqueWindow window = createWindow(window_create_info);
+    glfw::UniqueWindow window = createWindow(window_create_info, headless);
 
     // Step 2: Create Vulkan Instance
-    vkb::Instance instance = createInstance();
+    vkb::Instance instance = createInstance(headless);
     // This loads the vulkan function pointers into the singleton dispatcher.
     // Thus we don't need to pass it to any vk::* calls.
     VULKAN_HPP_DEFAULT_DISPATCHER.init(instance.fp_vkGetInstanceProcAddr);
     VULKAN_HPP_DEFAULT_DISPATCHER.init(vk::Instance(instance.instance), instance.fp_vkGetInstanceProcAddr);
-    printSystemInformation(instance.instance);
+    printSystemInformation(instance.instance, headless);
 
     // Step 3: Create Physical Device
-    vk::UniqueSurfaceKHR surface = window->createWindowSurfaceKHRUnique(instance.instance);
+    vk::UniqueSurfaceKHR surface;
+    if (!headless)
+        surface = window->createWindowSurfaceKHRUnique(instance.instance);
     vkb::PhysicalDevice physical_device = createPhysicalDevice(instance, *surface);
     Logger::info("Using Physical Device: " + physical_device.name);
 
@@ -239,7 +315,7 @@ VulkanContext VulkanContext::create(const glfw::WindowCreateInfo &window_create_
 
     // Step 6: Retrieve Queues
     DeviceQueue main_queue, compute_queue, transfer_queue, present_queue;
-    createQueues(device, main_queue, compute_queue, transfer_queue, present_queue);
+    createQueues(device, main_queue, compute_queue, transfer_queue, present_queue, headless);
     util::setDebugName(device.device, main_queue.queue, "main");
     if (compute_queue.queue != main_queue.queue)
         util::setDebugName(device.device, compute_queue.queue, "compute");
@@ -249,8 +325,17 @@ VulkanContext VulkanContext::create(const glfw::WindowCreateInfo &window_create_
         util::setDebugName(device.device, present_queue.queue, "present");
 
     // Step 7: Create Swapchain
-    auto swapchain =
-            std::make_unique<Swapchain>(device.device, physical_device.physical_device, *surface, *window, *allocator);
+    std::unique_ptr<Swapchain> swapchain;
+    if (headless) {
+        vk::Extent2D extents = {
+            static_cast<uint32_t>(window_create_info.width), static_cast<uint32_t>(window_create_info.height)
+        };
+        swapchain = std::make_unique<Swapchain>(device.device, *allocator, extents);
+    } else {
+        swapchain = std::make_unique<Swapchain>(
+                device.device, physical_device.physical_device, *surface, *window, *allocator
+        );
+    }
 
     return VulkanContext{
         makeUniqueHandle(vk::Instance(instance.instance), nullptr),
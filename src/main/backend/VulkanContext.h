@@ -105,9 +105,12 @@ public:
     /// <summary>
     /// Creates a new VulkanContext.
     /// </summary>
-    /// <param name="window_create_info">The window creation info.</param>
+    /// <param name="window_create_info">The window creation info. In headless mode it only defines the render size.</param>
+    /// <param name="headless">
+    /// Render into offscreen images without a surface. The window uses the GLFW null platform.
+    /// </param>
     /// <returns>A new VulkanContext.</returns>
-    static VulkanContext create(const glfw::WindowCreateInfo &window_create_info);
+    static VulkanContext create(const glfw::WindowCreateInfo &window_create_info, bool headless = false);
 
 private:
     // order is important here
@@ -1,5 +1,6 @@
 #include "System.h"
 
+#include <tracy/Tracy.hpp>
 #include <unordered_set>
 #include <vector>
 
@@ -39,30 +40,29 @@ namespace blob {
         );
         util::setDebugName(device, *mMetaballBuffer.buffer, "blob_metaball_buffer");
 
-        mTrash.create(globals::MaxFramesInFlight + 1, [] { return std::vector<std::function<void()>>(); });
-
-        // Pre-allocate
-        resizeDomainMemberBuffer(allocator, device, 1024*1024);
-        resizeDrawIndirectBuffer(allocator, device, 512);
-        resizeVertexBuffer(allocator, device, 1024);
+        // Pre-allocate, there is nothing to replace yet
+        (void) resizeDomainMemberBuffer(allocator, device, 1024*1024);
+        (void) resizeDrawIndirectBuffer(allocator, device, 512);
+        (void) resizeVertexBuffer(allocator, device, 1024);
     }
 
-    void System::update(const vma::Allocator &allocator, const vk::Device &device, const vk::CommandBuffer &cmd_buf) {
-        auto &trash = mTrash.next();
-        for (const auto &t: trash) {
-            t();
-        }
-        trash.clear();
-
+    void System::update(
+            const vma::Allocator &allocator,
+            const vk::Device &device,
+            const vk::CommandBuffer &cmd_buf,
+            const UploadHeap &upload_heap,
+            DeletionQueue &deletion_queue
+    ) {
+        ZoneScoped;
         partition();
 
-        resizeDrawIndirectBuffer(allocator, device, mDomains.size());
+        deletion_queue.release(resizeDrawIndirectBuffer(allocator, device, mDomains.size()));
 
         size_t required_count = 0;
         for (const auto &d: mDomains) {
             required_count += estimateVertexCount(d);
         }
-        resizeVertexBuffer(allocator, device, required_count);
+        deletion_queue.release(resizeVertexBuffer(allocator, device, required_count));
 
         std::vector<MetaballBlock> metaball_data(mBalls.size());
         for (size_t i = 0; i < mBalls.size(); i++) {
@@ -75,9 +75,7 @@ namespace blob {
             };
         }
 
-        mMetaballBuffer.barrier(cmd_buf, BufferResourceAccess::TransferWrite);
-        assert(metaball_data.size() * sizeof(MetaballBlock) < 65536);
-        cmd_buf.updateBuffer(mMetaballBuffer, 0, metaball_data.size() * sizeof(MetaballBlock), metaball_data.data());
+        upload_heap.upload(metaball_data, mMetaballBuffer);
 
         // Calculate total members across all domains
         size_t totalMembers = 0;
@@ -93,10 +91,9 @@ namespace blob {
             }
         }
 
-        resizeDomainMemberBuffer(allocator, device, domain_members.size());
-        mDomainMemberBuffer.barrier(cmd_buf, BufferResourceAccess::TransferWrite);
-        assert(domain_members.size() * sizeof(uint32_t) < 65536);
-        cmd_buf.updateBuffer(mDomainMemberBuffer, 0, domain_members.size() * sizeof(uint32_t), domain_members.data());
+        deletion_queue.release(resizeDomainMemberBuffer(allocator, device, domain_members.size()));
+        upload_heap.upload(domain_members, mDomainMemberBuffer);
+        upload_heap.flush(cmd_buf);
     }
 
     size_t System::estimateVertexCount(const Domain &domain) const {
@@ -121,6 +118,7 @@ namespace blob {
     };
 
     void System::partition() {
+        ZoneScoped;
         mDomains.clear();
         if (mBalls.empty())
             return;
@@ -223,24 +221,17 @@ namespace blob {
     }
 
 
-    void System::resizeVertexBuffer(const vma::Allocator &allocator, const vk::Device &device, size_t required_count) {
+    Buffer System::resizeVertexBuffer(const vma::Allocator &allocator, const vk::Device &device, size_t required_count) {
         size_t current_count = mVertexBuffer.size / sizeof(VertexData);
         size_t reallocated_count = 0;
         // if (required_count > current_count || required_count < current_count / 2) {
         if (required_count > current_count) {
             reallocated_count = static_cast<size_t>(1.5 * static_cast<double>(required_count));
         } else {
-            return;
-        }
-
-        if (mVertexBuffer) {
-            auto old_buffer = mVertexBuffer.buffer.release();
-            auto old_alloc = mVertexBuffer.allocation.release();
-            mTrash.get().emplace_back([allocator, old_buffer, old_alloc]() {
-                allocator.destroyBuffer(old_buffer, old_alloc);
-            });
+            return {};
         }
 
+        Buffer old_buffer = std::move(mVertexBuffer);
         mVertexBuffer = Buffer::create(
                 allocator,
                 {
@@ -249,26 +240,20 @@ namespace blob {
                 }
         );
         util::setDebugName(device, *mVertexBuffer.buffer, "blob_vertex_buffer");
+        return old_buffer;
     }
 
-    void System::resizeDrawIndirectBuffer(const vma::Allocator &allocator, const vk::Device &device, size_t required_count) {
+    Buffer System::resizeDrawIndirectBuffer(const vma::Allocator &allocator, const vk::Device &device, size_t required_count) {
         size_t current_count = mDrawIndirectBuffer.size / sizeof(vk::DrawIndirectCommand);
         size_t reallocated_count = 0;
         // if (required_count > current_count || required_count < current_count / 2) {
         if (required_count > current_count) {
             reallocated_count = static_cast<size_t>(1.5 * static_cast<double>(required_count));
         } else {
-            return;
-        }
-
-        if (mDrawIndirectBuffer) {
-            auto old_buffer = mDrawIndirectBuffer.buffer.release();
-            auto old_alloc = mDrawIndirectBuffer.allocation.release();
-            mTrash.get().emplace_back([allocator, old_buffer, old_alloc]() {
-                allocator.destroyBuffer(old_buffer, old_alloc);
-            });
+            return {};
         }
 
+        Buffer old_buffer = std::move(mDrawIndirectBuffer);
         mDrawIndirectBuffer = Buffer::create(
                 allocator,
                 {
@@ -278,26 +263,20 @@ namespace blob {
                 }
         );
         util::setDebugName(device, *mDrawIndirectBuffer.buffer, "blob_draw_indirect_buffer");
+        return old_buffer;
     }
 
-    void System::resizeDomainMemberBuffer(const vma::Allocator &allocator, const vk::Device &device, size_t required_count) {
+    Buffer System::resizeDomainMemberBuffer(const vma::Allocator &allocator, const vk::Device &device, size_t required_count) {
         size_t current_count = mDomainMemberBuffer.size / sizeof(uint32_t);
         size_t reallocated_count = 0;
         // if (required_count > current_count || required_count < current_count / 2) {
         if (required_count > current_count) {
             reallocated_count = static_cast<size_t>(1.5 * static_cast<double>(required_count));
         } else {
-            return;
-        }
-
-        if (mDomainMemberBuffer) {
-            auto old_buffer = mDomainMemberBuffer.buffer.release();
-            auto old_alloc = mDomainMemberBuffer.allocation.release();
-            mTrash.get().emplace_back([allocator, old_buffer, old_alloc]() {
-                allocator.destroyBuffer(old_buffer, old_alloc);
-            });
+            return {};
         }
 
+        Buffer old_buffer = std::move(mDomainMemberBuffer);
         mDomainMemberBuffer = Buffer::create(
                 allocator,
                 {
@@ -306,6 +285,7 @@ namespace blob {
                 }
         );
         util::setDebugName(device, *mDomainMemberBuffer.buffer, "blob_domain_member_buffer");
+        return old_buffer;
     }
 
 } // namespace blob
@@ -1,10 +1,10 @@
 #pragma once
-#include <functional>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 #include <vector>
 
 #include "../backend/Buffer.h"
+#include "../backend/DeletionQueue.h"
 #include "../debug/Annotation.h"
 #include "../util/PerFrame.h"
 
@@ -55,7 +55,13 @@ namespace blob {
 
         System(const vma::Allocator &allocator, const vk::Device &device, int count, float cell_size);
 
-        void update(const vma::Allocator &allocator, const vk::Device &device, const vk::CommandBuffer &cmd_buf);
+        void update(
+                const vma::Allocator &allocator,
+                const vk::Device &device,
+                const vk::CommandBuffer &cmd_buf,
+                const UploadHeap &upload_heap,
+                DeletionQueue &deletion_queue
+        );
 
         [[nodiscard]] const BufferBase &vertexBuffer() const { return mVertexBuffer; }
         [[nodiscard]] const BufferBase &drawIndirectBuffer() const { return mDrawIndirectBuffer; }
@@ -75,9 +81,10 @@ namespace blob {
     private:
         void partition();
 
-        void resizeVertexBuffer(const vma::Allocator &allocator, const vk::Device &device, size_t required_count);
-        void resizeDrawIndirectBuffer(const vma::Allocator &allocator, const vk::Device &device, size_t required_count);
-        void resizeDomainMemberBuffer(const vma::Allocator &allocator, const vk::Device &device, size_t required_count);
+        // These return the replaced buffer, which may still be in use by frames in flight
+        [[nodiscard]] Buffer resizeVertexBuffer(const vma::Allocator &allocator, const vk::Device &device, size_t required_count);
+        [[nodiscard]] Buffer resizeDrawIndirectBuffer(const vma::Allocator &allocator, const vk::Device &device, size_t required_count);
+        [[nodiscard]] Buffer resizeDomainMemberBuffer(const vma::Allocator &allocator, const vk::Device &device, size_t required_count);
 
         std::vector<Metaball> mBalls;
         std::vector<Domain> mDomains;
@@ -86,7 +93,5 @@ namespace blob {
         Buffer mMetaballBuffer;
         Buffer mVertexBuffer;
         Buffer mDomainMemberBuffer;
-
-        util::PerFrame<std::vector<std::function<void()>>> mTrash;
     };
 } // namespace blob
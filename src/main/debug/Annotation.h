@@ -4,6 +4,7 @@
 #include <vulkan/vulkan.hpp>
 
 #include "../util/globals.h"
+#include "GpuProfiler.h"
 
 // namespace util?? idk...
 namespace util {
@@ -22,28 +23,29 @@ namespace util {
 
         ~ScopedCommandLabel();
 
+        // Every scope is also timed by the GPU profiler, if one is active, regardless of globals::Debug
         void start(const char *label) const {
+            mCount++;
             if (globals::Debug) {
-                mCount++;
                 vk::DebugUtilsLabelEXT info;
                 info.pLabelName = label;
                 mCmd.beginDebugUtilsLabelEXT(info);
             }
+            GpuProfiler::beginScope(mCmd, label);
         }
 
 
         void end() const {
+            mCount--;
+            GpuProfiler::endScope(mCmd);
             if (globals::Debug) {
-                mCount--;
                 mCmd.endDebugUtilsLabelEXT();
             }
         }
 
         void swap(std::string_view new_label) const {
-            if (globals::Debug) {
-                end();
-                start(new_label.data());
-            }
+            end();
+            start(new_label.data());
         }
     };
 
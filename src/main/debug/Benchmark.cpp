@@ -0,0 +1,161 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <format>
+#include <fstream>
+#include <tuple>
+
+#include "../util/Logger.h"
+
+Benchmark::Benchmark(float duration, std::filesystem::path report_path)
+    : mDuration(duration), mReportPath(std::move(report_path)) {
+    Logger::info(std::format(
+            "Benchmark over {:.1f}s of animation at {:.4f}s per frame, report goes to {}", mDuration, TimeStep,
+            mReportPath.string()
+    ));
+}
+
+bool Benchmark::finished() const {
+    return static_cast<float>(mFrame) * TimeStep >= mDuration;
+}
+
+void Benchmark::record(std::string_view metric, double ms) {
+    if (mFrame < WarmupFrames)
+        return;
+    auto it = mSamples.find(metric);
+    if (it == mSamples.end())
+        it = mSamples.emplace(std::string(metric), std::vector<float>{}).first;
+    it->second.push_back(static_cast<float>(ms));
+}
+
+Benchmark::Summary Benchmark::summarize(std::vector<float> samples) {
+    if (samples.empty())
+        return {};
+    std::ranges::sort(samples);
+
+    double sum = 0;
+    for (float sample: samples)
+        sum += sample;
+    // Nearest-rank percentile, same as the GPU pass statistics
+    auto percentile = [&](double p) {
+        size_t index = static_cast<size_t>(std::ceil(p * static_cast<double>(samples.size())));
+        return static_cast<double>(samples[std::clamp<size_t>(index, 1, samples.size()) - 1]);
+    };
+
+    return {
+        .avg = sum / static_cast<double>(samples.size()),
+        .min = samples.front(),
+        .p50 = percentile(0.50),
+        .p90 = percentile(0.90),
+        .p95 = percentile(0.95),
+        .p99 = percentile(0.99),
+        .max = samples.back(),
+    };
+}
+
+void Benchmark::writeReport() const {
+    std::ofstream file(mReportPath);
+    if (!file) {
+        Logger::warning(std::format("Could not open {} for writing", mReportPath.string()));
+        return;
+    }
+
+    file << "{\n";
+    file << std::format("  \"timeStep\": {},\n", TimeStep);
+    file << std::format("  \"duration\": {},\n", mDuration);
+    file << std::format("  \"frames\": {},\n", mFrame);
+    file << std::format("  \"warmupFrames\": {},\n", WarmupFrames);
+    file << "  \"metrics\": {";
+    // Every metric is written on a single line with its summary first, readSummaries() relies on that
+    bool first = true;
+    for (const auto &[name, samples]: mSamples) {
+        Summary s = summarize(samples);
+        file << (first ? "\n" : ",\n");
+        first = false;
+        file << std::format(
+                "    \"{}\": {{\"avg\": {:.4f}, \"min\": {:.4f}, \"p50\": {:.4f}, \"p90\": {:.4f}, \"p95\": {:.4f}, "
+                "\"p99\": {:.4f}, \"max\": {:.4f}, \"samples\": [",
+                name, s.avg, s.min, s.p50, s.p90, s.p95, s.p99, s.max
+        );
+        for (size_t i = 0; i < samples.size(); i++)
+            file << std::format("{}{:.4f}", i == 0 ? "" : ", ", samples[i]);
+        file << "]}";
+
+        Logger::info(std::format(
+                "{:<16} avg {:7.3f}  p50 {:7.3f}  p95 {:7.3f}  p99 {:7.3f}  max {:7.3f} ms", name, s.avg, s.p50, s.p95,
+                s.p99, s.max
+        ));
+    }
+    file << "\n  }\n}\n";
+
+    Logger::info(std::format("Wrote benchmark report of {} frames to {}", mFrame, mReportPath.string()));
+}
+
+std::map<std::string, Benchmark::Summary> Benchmark::readSummaries(const std::filesystem::path &path) {
+    std::map<std::string, Summary> result;
+    std::ifstream file(path);
+    if (!file) {
+        Logger::warning(std::format("Could not open {} for reading", path.string()));
+        return result;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        std::array<char, 128> name = {};
+        Summary s;
+        int matched = std::sscanf(
+                line.c_str(),
+                " \"%127[^\"]\": {\"avg\": %lf, \"min\": %lf, \"p50\": %lf, \"p90\": %lf, \"p95\": %lf, \"p99\": %lf, "
+                "\"max\": %lf",
+                name.data(), &s.avg, &s.min, &s.p50, &s.p90, &s.p95, &s.p99, &s.max
+        );
+        if (matched == 8)
+            result.emplace(name.data(), s);
+    }
+    return result;
+}
+
+bool Benchmark::compare(const std::filesystem::path &baseline, const std::filesystem::path &report, float tolerance) {
+    auto baseline_summaries = readSummaries(baseline);
+    auto report_summaries = readSummaries(report);
+    if (baseline_summaries.empty() || report_summaries.empty()) {
+        Logger::error("Benchmark comparison needs two reports with metrics");
+        return false;
+    }
+
+    bool passed = true;
+    for (const auto &[name, base]: baseline_summaries) {
+        auto it = report_summaries.find(name);
+        if (it == report_summaries.end()) {
+            Logger::warning(std::format("{} is missing from {}", name, report.string()));
+            continue;
+        }
+        const Summary &current = it->second;
+
+        std::array<std::tuple<const char *, double, double>, 4> values = {{
+            {"avg", base.avg, current.avg},
+            {"p50", base.p50, current.p50},
+            {"p95", base.p95, current.p95},
+            {"p99", base.p99, current.p99},
+        }};
+        for (const auto &[stat, before, after]: values) {
+            double change = before > 0 ? (after - before) / before : 0;
+            bool regression = change > tolerance && after - before > NoiseFloorMs;
+            std::string message = std::format(
+                    "{:<16} {} {:7.3f} -> {:7.3f} ms ({:+.1f}%)", name, stat, before, after, change * 100
+            );
+            if (regression) {
+                Logger::error(message + " REGRESSION");
+                passed = false;
+            } else {
+                Logger::info(message);
+            }
+        }
+    }
+
+    Logger::info(passed ? "No benchmark regressions" : "Benchmark regressions found");
+    return passed;
+}
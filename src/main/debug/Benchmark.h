@@ -0,0 +1,69 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// <summary>
+/// Deterministic benchmark over the scene animation. The animation advances by a fixed simulated timestep
+/// instead of wall clock time, so frame N shows the same content in every run and builds can be compared.
+/// Timings are recorded per frame and written as a JSON report with percentiles.
+/// </summary>
+class Benchmark {
+public:
+    static constexpr float TimeStep = 1.0f / 60.0f;
+    // Frames that are rendered but not recorded, while caches and pipelines settle
+    static constexpr uint32_t WarmupFrames = 30;
+    // Relative increase of a percentile that counts as a regression
+    static constexpr float DefaultTolerance = 0.05f;
+    // Absolute increase in milliseconds below which differences are considered noise
+    static constexpr float NoiseFloorMs = 0.05f;
+
+    Benchmark(float duration, std::filesystem::path report_path);
+
+    /// <summary>Simulated time advanced per frame in seconds.</summary>
+    [[nodiscard]] float timeDelta() const { return TimeStep; }
+
+    /// <summary>Whether the whole animation has been rendered.</summary>
+    [[nodiscard]] bool finished() const;
+
+    /// <summary>Records a timing in milliseconds for the current frame. Ignored during warmup.</summary>
+    void record(std::string_view metric, double ms);
+
+    /// <summary>Advances to the next simulated frame.</summary>
+    void endFrame() { mFrame++; }
+
+    [[nodiscard]] uint32_t frame() const { return mFrame; }
+
+    void writeReport() const;
+
+    /// <summary>
+    /// Compares the percentiles of two reports and logs every metric that got slower than the tolerance allows.
+    /// </summary>
+    /// <returns>True if no regression was found.</returns>
+    static bool compare(
+            const std::filesystem::path &baseline, const std::filesystem::path &report, float tolerance = DefaultTolerance
+    );
+
+private:
+    struct Summary {
+        double avg = 0;
+        double min = 0;
+        double p50 = 0;
+        double p90 = 0;
+        double p95 = 0;
+        double p99 = 0;
+        double max = 0;
+    };
+
+    static Summary summarize(std::vector<float> samples);
+    static std::map<std::string, Summary> readSummaries(const std::filesystem::path &path);
+
+    float mDuration;
+    std::filesystem::path mReportPath;
+    uint32_t mFrame = 0;
+    // Ordered, so reports list metrics in a stable order
+    std::map<std::string, std::vector<float>, std::less<>> mSamples;
+};
@@ -0,0 +1,253 @@
+#include "BvhBenchmark.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <format>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <limits>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "../scene/Loader.h"
+#include "../util/Logger.h"
+
+namespace {
+    struct Ray {
+        glm::vec3 origin;
+        glm::vec3 direction;
+        float maxT;
+    };
+
+    struct Sphere {
+        glm::vec3 center;
+        float radius;
+    };
+
+    bool isEmpty(const util::BoundingBox &bounds) { return bounds.min.x > bounds.max.x; }
+
+    // The linear scans use the same tests as the leaves of the hierarchy, so both return the same instances
+
+    void scanFrustum(
+            const std::vector<util::BoundingBox> &bounds, const std::array<glm::vec4, 6> &planes, std::vector<uint32_t> &out
+    ) {
+        for (uint32_t i = 0; i < bounds.size(); i++) {
+            if (isEmpty(bounds[i]))
+                continue;
+            bool outside = std::ranges::any_of(planes, [&](const glm::vec4 &plane) {
+                glm::vec3 p = glm::mix(bounds[i].min, bounds[i].max, glm::greaterThan(glm::vec3(plane), glm::vec3(0.0f)));
+                return glm::dot(glm::vec3(plane), p) + plane.w < 0.0f;
+            });
+            if (!outside)
+                out.push_back(i);
+        }
+    }
+
+    void scanSphere(const std::vector<util::BoundingBox> &bounds, const Sphere &sphere, std::vector<uint32_t> &out) {
+        for (uint32_t i = 0; i < bounds.size(); i++) {
+            if (isEmpty(bounds[i]))
+                continue;
+            glm::vec3 d = glm::max(glm::max(bounds[i].min - sphere.center, glm::vec3(0.0f)), sphere.center - bounds[i].max);
+            if (glm::dot(d, d) <= sphere.radius * sphere.radius)
+                out.push_back(i);
+        }
+    }
+
+    // Distance at which the ray enters the box, or infinity if it misses it
+    float rayEntry(const Ray &ray, const glm::vec3 &inv_direction, const util::BoundingBox &bounds) {
+        glm::vec3 t0 = (bounds.min - ray.origin) * inv_direction;
+        glm::vec3 t1 = (bounds.max - ray.origin) * inv_direction;
+        glm::vec3 t_near = glm::min(t0, t1);
+        glm::vec3 t_far = glm::max(t0, t1);
+        float t_enter = std::max({t_near.x, t_near.y, t_near.z, 0.0f});
+        float t_exit = std::min({t_far.x, t_far.y, t_far.z, ray.maxT});
+        return t_enter <= t_exit ? t_enter : std::numeric_limits<float>::infinity();
+    }
+
+    void scanRay(const std::vector<util::BoundingBox> &bounds, const Ray &ray, std::vector<uint32_t> &out) {
+        glm::vec3 inv_direction = 1.0f / ray.direction;
+        for (uint32_t i = 0; i < bounds.size(); i++) {
+            if (!isEmpty(bounds[i]) && rayEntry(ray, inv_direction, bounds[i]) <= ray.maxT)
+                out.push_back(i);
+        }
+    }
+
+    float scanRaycast(const std::vector<util::BoundingBox> &bounds, const Ray &ray) {
+        glm::vec3 inv_direction = 1.0f / ray.direction;
+        float closest = std::numeric_limits<float>::infinity();
+        for (const util::BoundingBox &box: bounds) {
+            if (!isEmpty(box))
+                closest = std::min(closest, rayEntry(ray, inv_direction, box));
+        }
+        return closest;
+    }
+
+    // Runs the query for every input and returns the average time per query in milliseconds
+    template<typename T, typename Query>
+    double timeQueries(const std::vector<T> &inputs, Query &&query) {
+        auto begin = std::chrono::steady_clock::now();
+        for (const T &input: inputs)
+            query(input);
+        std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - begin;
+        return duration.count() / static_cast<double>(std::max<size_t>(inputs.size(), 1));
+    }
+
+    void logTimings(std::string_view name, double bvh_ms, double linear_ms, size_t results, size_t queries) {
+        Logger::info(std::format(
+                "{:<8} bvh {:.5f}ms linear {:.5f}ms per query, {:.1f}x faster, {:.1f} results per query", name, bvh_ms,
+                linear_ms, linear_ms / bvh_ms, static_cast<double>(results) / static_cast<double>(std::max<size_t>(queries, 1))
+        ));
+    }
+}
+
+bool BvhBenchmark::run(const std::filesystem::path &scene_path, uint32_t query_count) {
+    scene::CpuData cpu_data = scene::Loader::loadCpuData(scene_path);
+
+    std::vector<util::BoundingBox> local_bounds(cpu_data.instances.size());
+    std::vector<glm::mat4> transforms(cpu_data.instances.size());
+    for (size_t i = 0; i < cpu_data.instances.size(); i++) {
+        local_bounds[i] = cpu_data.instances[i].bounds;
+        transforms[i] = cpu_data.instances[i].transform;
+    }
+    size_t animated_count = cpu_data.instance_animations.size();
+    std::span<const glm::mat4> animated_transforms = std::span(transforms).last(animated_count);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BuildRepetitions; i++)
+        cpu_data.instance_bvh = scene::InstanceBvh(local_bounds, transforms, animated_count);
+    std::chrono::duration<double, std::milli> build_duration = std::chrono::steady_clock::now() - begin;
+
+    begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BuildRepetitions; i++)
+        cpu_data.instance_bvh.refit(animated_transforms);
+    std::chrono::duration<double, std::milli> refit_duration = std::chrono::steady_clock::now() - begin;
+
+    const scene::InstanceBvh &bvh = cpu_data.instance_bvh;
+    const std::vector<util::BoundingBox> &bounds = bvh.worldBounds();
+    Logger::info(std::format(
+            "{} instances, {} animated, {} nodes, build {:.3f}ms, refit {:.3f}ms", bounds.size(), animated_count,
+            bvh.nodeCount(), build_duration.count() / BuildRepetitions, refit_duration.count() / BuildRepetitions
+    ));
+
+    util::BoundingBox scene_bounds;
+    for (const util::BoundingBox &box: bounds)
+        if (!isEmpty(box))
+            scene_bounds.extend(box);
+    if (isEmpty(scene_bounds)) {
+        Logger::error(std::format("{} has no mesh instances", scene_path.string()));
+        return false;
+    }
+    float scene_size = glm::length(scene_bounds.max - scene_bounds.min);
+
+    // Fixed seed, so every run measures the same queries
+    std::mt19937 rng(1);
+    auto random_point = [&] {
+        std::uniform_real_distribution<float> u(0.0f, 1.0f);
+        return glm::mix(scene_bounds.min, scene_bounds.max, glm::vec3(u(rng), u(rng), u(rng)));
+    };
+    auto random_direction = [&] {
+        std::normal_distribution<float> n;
+        glm::vec3 d = {n(rng), n(rng), n(rng)};
+        return glm::length(d) > 0.0f ? glm::normalize(d) : glm::vec3(0.0f, 0.0f, -1.0f);
+    };
+
+    std::vector<std::array<glm::vec4, 6>> frustums(query_count);
+    std::vector<Sphere> spheres(query_count);
+    std::vector<Ray> rays(query_count);
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, scene_size * 0.25f);
+    std::uniform_real_distribution<float> radius(0.01f * scene_size, 0.05f * scene_size);
+    for (uint32_t i = 0; i < query_count; i++) {
+        glm::vec3 eye = random_point();
+        glm::vec3 forward = random_direction();
+        glm::mat4 view = glm::lookAt(eye, eye + forward, util::safeUpVector(forward));
+        frustums[i] = util::extractFrustumPlanes(projection * view);
+        spheres[i] = {random_point(), radius(rng)};
+        rays[i] = {random_point(), random_direction(), scene_size};
+    }
+
+    std::vector<uint32_t> result;
+    size_t bvh_results = 0;
+    size_t linear_results = 0;
+
+    double bvh_ms = timeQueries(frustums, [&](const std::array<glm::vec4, 6> &planes) {
+        result.clear();
+        bvh.queryFrustum(planes, result);
+        bvh_results += result.size();
+    });
+    double linear_ms = timeQueries(frustums, [&](const std::array<glm::vec4, 6> &planes) {
+        result.clear();
+        scanFrustum(bounds, planes, result);
+        linear_results += result.size();
+    });
+    logTimings("frustum", bvh_ms, linear_ms, bvh_results, query_count);
+
+    bvh_results = linear_results = 0;
+    bvh_ms = timeQueries(spheres, [&](const Sphere &sphere) {
+        result.clear();
+        bvh.querySphere(sphere.center, sphere.radius, result);
+        bvh_results += result.size();
+    });
+    linear_ms = timeQueries(spheres, [&](const Sphere &sphere) {
+        result.clear();
+        scanSphere(bounds, sphere, result);
+        linear_results += result.size();
+    });
+    logTimings("sphere", bvh_ms, linear_ms, bvh_results, query_count);
+
+    bvh_results = linear_results = 0;
+    bvh_ms = timeQueries(rays, [&](const Ray &ray) {
+        result.clear();
+        bvh.queryRay(ray.origin, ray.direction, ray.maxT, result);
+        bvh_results += result.size();
+    });
+    linear_ms = timeQueries(rays, [&](const Ray &ray) {
+        result.clear();
+        scanRay(bounds, ray, result);
+        linear_results += result.size();
+    });
+    logTimings("ray", bvh_ms, linear_ms, bvh_results, query_count);
+
+    bvh_results = linear_results = 0;
+    bvh_ms = timeQueries(rays, [&](const Ray &ray) {
+        bvh_results += bvh.raycast(ray.origin, ray.direction, ray.maxT).has_value();
+    });
+    linear_ms = timeQueries(rays, [&](const Ray &ray) {
+        linear_results += scanRaycast(bounds, ray) <= ray.maxT;
+    });
+    logTimings("raycast", bvh_ms, linear_ms, bvh_results, query_count);
+
+    // Compared outside of the timed loops, the hierarchy returns instances in traversal order
+    uint32_t mismatches = 0;
+    std::vector<uint32_t> expected;
+    auto compare = [&] {
+        std::ranges::sort(result);
+        mismatches += result != expected;
+        result.clear();
+        expected.clear();
+    };
+    for (uint32_t i = 0; i < query_count; i++) {
+        bvh.queryFrustum(frustums[i], result);
+        scanFrustum(bounds, frustums[i], expected);
+        compare();
+        bvh.querySphere(spheres[i].center, spheres[i].radius, result);
+        scanSphere(bounds, spheres[i], expected);
+        compare();
+        bvh.queryRay(rays[i].origin, rays[i].direction, rays[i].maxT, result);
+        scanRay(bounds, rays[i], expected);
+        compare();
+
+        auto hit = bvh.raycast(rays[i].origin, rays[i].direction, rays[i].maxT);
+        float closest = scanRaycast(bounds, rays[i]);
+        mismatches += hit ? std::abs(hit->t - closest) > 1e-4f * std::max(closest, 1.0f) : closest <= rays[i].maxT;
+    }
+
+    if (mismatches > 0) {
+        Logger::error(std::format("{} queries of the BVH differ from the linear scans", mismatches));
+        return false;
+    }
+    Logger::info("BVH queries match the linear scans");
+    return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+/// <summary>
+/// Measures the spatial queries of scene::InstanceBvh against linear scans over the same instance bounds.
+/// Only the CPU side of the scene is loaded, so this runs without a GPU.
+/// Both sides are checked to return the same instances, which makes this a correctness check as well.
+/// </summary>
+class BvhBenchmark {
+public:
+    static constexpr char DefaultScene[]{"resources/scenes/city_scene.glb"};
+    static constexpr uint32_t DefaultQueryCount = 10000;
+    // Rebuilds and refits that are averaged
+    static constexpr uint32_t BuildRepetitions = 20;
+
+    /// <summary>
+    /// Runs the given number of random frustum, sphere and ray queries within the bounds of the scene.
+    /// </summary>
+    /// <returns>True if the hierarchy returned the same instances as the linear scans for every query.</returns>
+    static bool run(const std::filesystem::path &scene_path, uint32_t query_count = DefaultQueryCount);
+};
@@ -0,0 +1,270 @@
+#include "FrameCapture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <limits>
+#include <glm/glm.hpp>
+#include <stb_image.h>
+#include <stb_image_write.h>
+
+#include "../backend/Image.h"
+#include "../util/Logger.h"
+#include "../util/globals.h"
+
+namespace {
+    glm::vec3 srgbToLab(const uint8_t *pixel) {
+        glm::vec3 rgb;
+        for (int c = 0; c < 3; c++) {
+            float v = static_cast<float>(pixel[c]) / 255.0f;
+            rgb[c] = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+        }
+        // Linear sRGB to XYZ, normalized to the D65 white point
+        glm::vec3 xyz = {
+            (0.4124f * rgb.r + 0.3576f * rgb.g + 0.1805f * rgb.b) / 0.95047f,
+            0.2126f * rgb.r + 0.7152f * rgb.g + 0.0722f * rgb.b,
+            (0.0193f * rgb.r + 0.1192f * rgb.g + 0.9505f * rgb.b) / 1.08883f,
+        };
+        auto f = [](float t) { return t > 0.008856f ? std::cbrt(t) : 7.787f * t + 16.0f / 116.0f; };
+        return {116.0f * f(xyz.y) - 16.0f, 500.0f * (f(xyz.x) - f(xyz.y)), 200.0f * (f(xyz.y) - f(xyz.z))};
+    }
+
+    // Distance used by the color pipeline of FLIP, which is more robust to large differences than Delta E
+    float hyab(const glm::vec3 &a, const glm::vec3 &b) {
+        glm::vec3 d = a - b;
+        return std::abs(d.x) + std::sqrt(d.y * d.y + d.z * d.z);
+    }
+}
+
+FrameCapture::FrameCapture(const vk::Device &device, const vma::Allocator &allocator)
+    : mDevice(device), mAllocator(allocator) {
+    mSlots.create(globals::MaxFramesInFlight, [] { return Slot{}; });
+    mWriter = std::jthread([this](const std::stop_token &stop) { writerLoop(stop); });
+}
+
+void FrameCapture::request(std::filesystem::path path) {
+    mRequest = std::move(path);
+}
+
+void FrameCapture::beginFrame(size_t frame_index) {
+    mFrameIndex = frame_index;
+    collect(mSlots.get(frame_index));
+}
+
+void FrameCapture::record(const vk::CommandBuffer &cmd_buf, const ImageBase &image) {
+    if (!mRequest)
+        return;
+
+    const ImageInfo &info = image.info;
+    bool bgra = info.format == vk::Format::eB8G8R8A8Unorm || info.format == vk::Format::eB8G8R8A8Srgb;
+    bool rgba = info.format == vk::Format::eR8G8B8A8Unorm || info.format == vk::Format::eR8G8B8A8Srgb;
+    if (!bgra && !rgba) {
+        Logger::warning(std::format("Cannot capture image with format {}", vk::to_string(info.format)));
+        mRequest.reset();
+        return;
+    }
+
+    auto &slot = mSlots.get(mFrameIndex);
+    size_t size = static_cast<size_t>(info.width) * info.height * 4;
+    if (slot.readback.size < size) {
+        slot.readback = Buffer::create(
+                mAllocator,
+                {
+                    .size = size,
+                    .usage = vk::BufferUsageFlagBits::eTransferDst,
+                    .flags = vma::AllocationCreateFlagBits::eHostAccessRandom | vma::AllocationCreateFlagBits::eMapped,
+                    .requiredProperties = vk::MemoryPropertyFlagBits::eHostVisible,
+                    .preferredProperties = vk::MemoryPropertyFlagBits::eHostCached,
+                }
+        );
+    }
+
+    image.barrier(cmd_buf, ImageResourceAccess::TransferRead);
+    cmd_buf.copyImageToBuffer(
+            image,
+            vk::ImageLayout::eTransferSrcOptimal,
+            slot.readback,
+            vk::BufferImageCopy{
+                .imageSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor, .layerCount = 1},
+                .imageExtent = {info.width, info.height, 1},
+            }
+    );
+    // Makes the copy visible to the host once the frame's timeline value is reached
+    vk::MemoryBarrier2 host_barrier = {
+        .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+        .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+        .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo().setMemoryBarriers(host_barrier));
+
+    slot.pending = Job{
+        .path = std::move(*mRequest),
+        .width = info.width,
+        .height = info.height,
+        .bgra = bgra,
+    };
+    mRequest.reset();
+}
+
+void FrameCapture::collect(Slot &slot) {
+    if (!slot.pending)
+        return;
+
+    Job job = std::move(*slot.pending);
+    slot.pending.reset();
+
+    size_t size = static_cast<size_t>(job.width) * job.height * 4;
+    mAllocator.invalidateAllocation(*slot.readback.allocation, 0, vk::WholeSize);
+    const auto *data = static_cast<const uint8_t *>(slot.readback.persistentMapping);
+    job.pixels.assign(data, data + size);
+
+    {
+        std::lock_guard lock(mMutex);
+        mJobs.push_back(std::move(job));
+    }
+    mJobAvailable.notify_one();
+}
+
+void FrameCapture::flush() {
+    for (size_t i = 0; i < mSlots.size(); i++)
+        collect(mSlots.get(i));
+
+    std::unique_lock lock(mMutex);
+    mIdle.wait(lock, [this] { return mJobs.empty() && !mWriting; });
+}
+
+void FrameCapture::writerLoop(const std::stop_token &stop) {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock lock(mMutex);
+            // Pending jobs are still written after a stop was requested
+            if (!mJobAvailable.wait(lock, stop, [this] { return !mJobs.empty(); }))
+                return;
+            job = std::move(mJobs.front());
+            mJobs.pop_front();
+            mWriting = true;
+        }
+
+        write(job);
+
+        {
+            std::lock_guard lock(mMutex);
+            mWriting = false;
+        }
+        mIdle.notify_all();
+    }
+}
+
+void FrameCapture::write(Job &job) {
+    for (size_t i = 0; i < job.pixels.size(); i += 4) {
+        if (job.bgra)
+            std::swap(job.pixels[i], job.pixels[i + 2]);
+        // The swapchain alpha is undefined for opaque composition
+        job.pixels[i + 3] = 255;
+    }
+
+    if (job.path.has_parent_path())
+        std::filesystem::create_directories(job.path.parent_path());
+
+    int width = static_cast<int>(job.width);
+    int height = static_cast<int>(job.height);
+    if (!stbi_write_png(job.path.string().c_str(), width, height, 4, job.pixels.data(), width * 4)) {
+        Logger::warning("Failed to write frame capture to " + job.path.string());
+        return;
+    }
+    Logger::info("Wrote frame capture to " + job.path.string());
+}
+
+ImageComparison FrameCapture::compareImages(
+        const std::filesystem::path &golden, const std::filesystem::path &capture, int tolerance
+) {
+    ImageComparison result;
+    int golden_width, golden_height, capture_width, capture_height, channels;
+    stbi_uc *golden_pixels = stbi_load(golden.string().c_str(), &golden_width, &golden_height, &channels, 4);
+    stbi_uc *capture_pixels = stbi_load(capture.string().c_str(), &capture_width, &capture_height, &channels, 4);
+
+    if (golden_pixels == nullptr || capture_pixels == nullptr) {
+        Logger::error(std::format("Could not load {} or {}", golden.string(), capture.string()));
+    } else if (golden_width != capture_width || golden_height != capture_height) {
+        Logger::error(std::format(
+                "Size mismatch: {}x{} golden vs {}x{} capture", golden_width, golden_height, capture_width,
+                capture_height
+        ));
+    } else {
+        result.width = static_cast<uint32_t>(golden_width);
+        result.height = static_cast<uint32_t>(golden_height);
+        size_t pixel_count = static_cast<size_t>(golden_width) * golden_height;
+
+        // FLIP normalizes by the largest HyAB distance between two colors of the sRGB gamut, green to blue
+        const uint8_t green[3] = {0, 255, 0};
+        const uint8_t blue[3] = {0, 0, 255};
+        float max_distance = hyab(srgbToLab(green), srgbToLab(blue));
+
+        double squared_error = 0;
+        double color_error = 0;
+        for (size_t i = 0; i < pixel_count; i++) {
+            const stbi_uc *a = golden_pixels + i * 4;
+            const stbi_uc *b = capture_pixels + i * 4;
+            int max_diff = 0;
+            for (int c = 0; c < 3; c++) {
+                int diff = std::abs(static_cast<int>(a[c]) - static_cast<int>(b[c]));
+                max_diff = std::max(max_diff, diff);
+                squared_error += static_cast<double>(diff * diff);
+            }
+            if (max_diff > tolerance)
+                result.differingPixels++;
+            if (max_diff > 0) {
+                double error = std::min(1.0, static_cast<double>(hyab(srgbToLab(a), srgbToLab(b)) / max_distance));
+                color_error += error;
+                result.maxColorError = std::max(result.maxColorError, error);
+            }
+        }
+
+        double mse = squared_error / static_cast<double>(pixel_count * 3);
+        result.psnr = mse > 0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : std::numeric_limits<double>::infinity();
+        result.meanColorError = color_error / static_cast<double>(pixel_count);
+        result.passed =
+                static_cast<double>(result.differingPixels) <= MaxDifferingFraction * static_cast<double>(pixel_count);
+    }
+
+    stbi_image_free(golden_pixels);
+    stbi_image_free(capture_pixels);
+    return result;
+}
+
+bool FrameCapture::compare(const std::filesystem::path &golden, const std::filesystem::path &capture, int tolerance) {
+    std::vector<std::pair<std::filesystem::path, std::filesystem::path>> pairs;
+    if (std::filesystem::is_directory(golden)) {
+        for (const auto &entry: std::filesystem::directory_iterator(golden)) {
+            if (entry.path().extension() == ".png")
+                pairs.emplace_back(entry.path(), capture / entry.path().filename());
+        }
+        std::ranges::sort(pairs);
+    } else {
+        pairs.emplace_back(golden, capture);
+    }
+
+    if (pairs.empty()) {
+        Logger::error("No golden images found in " + golden.string());
+        return false;
+    }
+
+    bool passed = true;
+    for (const auto &[golden_path, capture_path]: pairs) {
+        ImageComparison result = compareImages(golden_path, capture_path, tolerance);
+        std::string message = std::format(
+                "{}: {} differing pixels, PSNR {:.2f} dB, color error mean {:.5f} max {:.3f}",
+                capture_path.filename().string(), result.differingPixels, result.psnr, result.meanColorError,
+                result.maxColorError
+        );
+        if (result.passed) {
+            Logger::info(message);
+        } else {
+            Logger::error(message + " FAILED");
+            passed = false;
+        }
+    }
+    return passed;
+}
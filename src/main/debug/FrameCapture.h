@@ -0,0 +1,114 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "../backend/Buffer.h"
+#include "../util/PerFrame.h"
+
+class ImageBase;
+
+/// <summary>
+/// Result of comparing a capture against a golden image.
+/// </summary>
+struct ImageComparison {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Pixels where any channel differs by more than the tolerance
+    size_t differingPixels = 0;
+    double psnr = 0;
+    // Mean HyAB color difference in CIELAB, normalized to [0, 1] like the color term of FLIP
+    double meanColorError = 0;
+    double maxColorError = 0;
+    bool passed = false;
+};
+
+/// <summary>
+/// Reads back the final color image of requested frames without stalling the frame.
+/// Each frame in flight copies into its own host-visible buffer, which is read once the frame slot is reused.
+/// Encoding and writing the PNG happens on a worker thread.
+/// </summary>
+class FrameCapture {
+public:
+    // Per-channel difference in 8-bit units that is not counted as a differing pixel
+    static constexpr int DefaultTolerance = 2;
+    // Fraction of differing pixels at which a comparison fails
+    static constexpr double MaxDifferingFraction = 0.001;
+
+    FrameCapture(const vk::Device &device, const vma::Allocator &allocator);
+    // Stopping the writer waits for queued captures, but not for readbacks still in flight, see flush()
+    ~FrameCapture() = default;
+
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    /// <summary>Requests the image recorded in the current frame to be written to the path.</summary>
+    void request(std::filesystem::path path);
+
+    /// <summary>
+    /// Hands the readback of the frame slot that is about to be reused to the writer.
+    /// The frame slot must have finished execution on the GPU.
+    /// </summary>
+    void beginFrame(size_t frame_index);
+
+    /// <summary>
+    /// Records the copy of the image into the current frame's readback buffer, if a capture was requested.
+    /// The image must be a 4 channel 8-bit color image with transfer source usage.
+    /// </summary>
+    void record(const vk::CommandBuffer &cmd_buf, const ImageBase &image);
+
+    /// <summary>Writes all pending captures and waits for the writer. The device must be idle.</summary>
+    void flush();
+
+    /// <summary>
+    /// Compares two images per pixel. Either both paths are files or both are directories,
+    /// in which case every PNG of the golden directory is compared to the same name in the other.
+    /// </summary>
+    /// <returns>True if every comparison passed.</returns>
+    static bool compare(
+            const std::filesystem::path &golden, const std::filesystem::path &capture, int tolerance = DefaultTolerance
+    );
+
+    static ImageComparison compareImages(
+            const std::filesystem::path &golden, const std::filesystem::path &capture, int tolerance = DefaultTolerance
+    );
+
+private:
+    struct Job {
+        std::filesystem::path path;
+        uint32_t width;
+        uint32_t height;
+        bool bgra;
+        std::vector<uint8_t> pixels;
+    };
+
+    struct Slot {
+        Buffer readback;
+        std::optional<Job> pending;
+    };
+
+    void collect(Slot &slot);
+    void writerLoop(const std::stop_token &stop);
+    static void write(Job &job);
+
+    vk::Device mDevice;
+    vma::Allocator mAllocator;
+
+    util::PerFrame<Slot> mSlots;
+    size_t mFrameIndex = 0;
+    std::optional<std::filesystem::path> mRequest;
+
+    std::mutex mMutex;
+    std::condition_variable_any mJobAvailable;
+    std::condition_variable mIdle;
+    std::deque<Job> mJobs;
+    bool mWriting = false;
+    // Declared last, so the thread stops before the queue is destroyed
+    std::jthread mWriter;
+};
@@ -0,0 +1,345 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <limits>
+
+#include "../backend/VulkanContext.h"
+#include "../util/Logger.h"
+#include "../util/globals.h"
+
+GpuProfiler *GpuProfiler::sActive = nullptr;
+
+namespace {
+    // Default labels are full function signatures, e.g. "void FogRenderer::execute(const vk::Device &, ...)"
+    std::string shortLabel(std::string_view label) {
+        if (auto params = label.find('('); params != std::string_view::npos)
+            label = label.substr(0, params);
+        if (auto space = label.rfind(' '); space != std::string_view::npos)
+            label = label.substr(space + 1);
+        return std::string(label);
+    }
+
+    std::string escapeJson(std::string_view str) {
+        std::string result;
+        result.reserve(str.size());
+        for (char c: str) {
+            if (c == '"' || c == '\\')
+                result.push_back('\\');
+            result.push_back(c);
+        }
+        return result;
+    }
+
+    uint64_t timestampMask(uint32_t valid_bits) {
+        return valid_bits >= 64 ? std::numeric_limits<uint64_t>::max() : (uint64_t{1} << valid_bits) - 1;
+    }
+} // namespace
+
+GpuProfiler::GpuProfiler(
+        const vk::Device &device,
+        const vk::PhysicalDevice &physical_device,
+        uint32_t graphics_family,
+        uint32_t compute_family
+)
+    : mDevice(device) {
+    auto families = physical_device.getQueueFamilyProperties();
+    uint32_t graphics_bits = families.at(graphics_family).timestampValidBits;
+    uint32_t compute_bits = families.at(compute_family).timestampValidBits;
+    mTimestampMasks[static_cast<uint32_t>(Queue::Graphics)] = graphics_bits == 0 ? 0 : timestampMask(graphics_bits);
+    mTimestampMasks[static_cast<uint32_t>(Queue::Compute)] = compute_bits == 0 ? 0 : timestampMask(compute_bits);
+    mTimestampPeriodNs = physical_device.getProperties().limits.timestampPeriod;
+
+    mEnabled = graphics_bits != 0;
+    if (!mEnabled) {
+        Logger::warning("The graphics queue does not support timestamps, GPU profiling is disabled");
+        return;
+    }
+
+    mFrames.create(globals::MaxFramesInFlight, [&] {
+        Frame frame = {
+            .queryPool = device.createQueryPoolUnique({
+                .queryType = vk::QueryType::eTimestamp,
+                .queryCount = MaxQueriesPerFrame,
+            }),
+        };
+        device.resetQueryPool(*frame.queryPool, 0, MaxQueriesPerFrame);
+        return frame;
+    });
+
+    sActive = this;
+}
+
+GpuProfiler::~GpuProfiler() {
+    if (sActive == this)
+        sActive = nullptr;
+#ifdef TRACY_ENABLE
+    for (auto ctx: mTracyContexts) {
+        if (ctx != nullptr)
+            TracyVkDestroy(ctx);
+    }
+#endif
+}
+
+void GpuProfiler::initTracy(
+        const VulkanContext &context, const vk::CommandPool &graphics_pool, const vk::CommandPool &compute_pool
+) {
+#ifdef TRACY_ENABLE
+    auto create_context = [&](const DeviceQueue &queue, const vk::CommandPool &pool, const char *name) -> TracyVkCtx {
+        const auto &device = context.device();
+        vk::CommandBuffer cmd_buf =
+                device.allocateCommandBuffers({.commandPool = pool, .commandBufferCount = 1}).at(0);
+        TracyVkCtx ctx = TracyVkContext(
+                context.instance(), context.physicalDevice(), device, queue.queue, cmd_buf,
+                VULKAN_HPP_DEFAULT_DISPATCHER.vkGetInstanceProcAddr, VULKAN_HPP_DEFAULT_DISPATCHER.vkGetDeviceProcAddr
+        );
+        TracyVkContextName(ctx, name, std::strlen(name));
+        device.freeCommandBuffers(pool, cmd_buf);
+        return ctx;
+    };
+
+    mTracyContexts[static_cast<uint32_t>(Queue::Graphics)] =
+            create_context(context.mainQueue, graphics_pool, "Graphics Queue");
+    if (context.computeQueue.queue)
+        mTracyContexts[static_cast<uint32_t>(Queue::Compute)] =
+                create_context(context.computeQueue, compute_pool, "Compute Queue");
+#endif
+}
+
+void GpuProfiler::collect(const vk::CommandBuffer &cmd_buf, Queue queue) const {
+#ifdef TRACY_ENABLE
+    if (auto ctx = mTracyContexts[static_cast<uint32_t>(queue)])
+        TracyVkCollect(ctx, cmd_buf);
+#endif
+}
+
+void GpuProfiler::beginFrame(size_t frame_index, uint64_t frame_number) {
+    for (const auto &[cmd_buf, tracked]: mTracked) {
+        if (!tracked.open.empty())
+            Logger::warning("GPU profiler scope was still open at the end of the frame");
+    }
+    mTracked.clear();
+    if (!mEnabled)
+        return;
+
+    mFrameIndex = frame_index;
+    auto &frame = mFrames.get(frame_index);
+    resolve(frame);
+
+    mDevice.resetQueryPool(*frame.queryPool, 0, MaxQueriesPerFrame);
+    frame.usedQueries = 0;
+    frame.frameNumber = frame_number;
+    frame.scopes.clear();
+}
+
+void GpuProfiler::track(const vk::CommandBuffer &cmd_buf, Queue queue) {
+    if (!mEnabled || mTimestampMasks[static_cast<uint32_t>(queue)] == 0)
+        return;
+    mTracked[cmd_buf] = {.queue = queue};
+}
+
+void GpuProfiler::beginScope(const vk::CommandBuffer &cmd_buf, const char *label) {
+    if (sActive != nullptr)
+        sActive->begin(cmd_buf, label);
+}
+
+void GpuProfiler::endScope(const vk::CommandBuffer &cmd_buf) {
+    if (sActive != nullptr)
+        sActive->end(cmd_buf);
+}
+
+void GpuProfiler::begin(const vk::CommandBuffer &cmd_buf, const char *label) {
+    auto it = mTracked.find(cmd_buf);
+    if (it == mTracked.end())
+        return;
+    auto &tracked = it->second;
+    auto &frame = mFrames.get(mFrameIndex);
+    std::string short_label = shortLabel(label);
+
+#ifdef TRACY_ENABLE
+    if (auto ctx = mTracyContexts[static_cast<uint32_t>(tracked.queue)]) {
+        // Labels are runtime strings, so the zones use a transient source location
+        size_t length = std::strlen(label);
+        tracked.tracyZones.push_back(std::make_unique<tracy::VkCtxScope>(
+                ctx, 0, label, length, label, length, short_label.c_str(), short_label.size(), cmd_buf, true
+        ));
+    }
+#endif
+
+    // Both queries of a scope are reserved up front, so an open scope can always be closed
+    if (frame.usedQueries + 2 > MaxQueriesPerFrame) {
+        tracked.open.push_back(NoQuery);
+        return;
+    }
+
+    std::string path = short_label;
+    if (!tracked.open.empty() && tracked.open.back() != NoQuery)
+        path = std::format("{}/{}", frame.scopes[tracked.open.back()].path, short_label);
+
+    uint32_t query = frame.usedQueries;
+    frame.usedQueries += 2;
+    cmd_buf.writeTimestamp2(vk::PipelineStageFlagBits2::eTopOfPipe, *frame.queryPool, query);
+
+    tracked.open.push_back(static_cast<uint32_t>(frame.scopes.size()));
+    frame.scopes.push_back({
+        .path = std::move(path),
+        .label = std::move(short_label),
+        .depth = static_cast<uint32_t>(tracked.open.size() - 1),
+        .queue = tracked.queue,
+        .beginQuery = query,
+    });
+}
+
+void GpuProfiler::end(const vk::CommandBuffer &cmd_buf) {
+    auto it = mTracked.find(cmd_buf);
+    if (it == mTracked.end() || it->second.open.empty())
+        return;
+    auto &tracked = it->second;
+#ifdef TRACY_ENABLE
+    if (!tracked.tracyZones.empty())
+        tracked.tracyZones.pop_back();
+#endif
+    uint32_t scope_index = tracked.open.back();
+    tracked.open.pop_back();
+    if (scope_index == NoQuery)
+        return;
+
+    auto &frame = mFrames.get(mFrameIndex);
+    auto &scope = frame.scopes[scope_index];
+    scope.endQuery = scope.beginQuery + 1;
+    cmd_buf.writeTimestamp2(vk::PipelineStageFlagBits2::eBottomOfPipe, *frame.queryPool, scope.endQuery);
+}
+
+void GpuProfiler::resolve(Frame &frame) {
+    if (frame.usedQueries == 0)
+        return;
+
+    std::vector<uint64_t> timestamps(frame.usedQueries);
+    vk::Result result = mDevice.getQueryPoolResults(
+            *frame.queryPool, 0, frame.usedQueries, timestamps.size() * sizeof(uint64_t), timestamps.data(),
+            sizeof(uint64_t), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait
+    );
+    if (result != vk::Result::eSuccess) {
+        Logger::warning(std::format("Reading GPU timestamps failed: {}", vk::to_string(result)));
+        return;
+    }
+
+    // Scopes with the same path, like per-cascade passes, are summed up within a frame
+    std::unordered_map<std::string, float> frame_times;
+    std::vector<TraceEvent> trace;
+    trace.reserve(frame.scopes.size());
+    mLastPasses.clear();
+    uint64_t frame_begin = std::numeric_limits<uint64_t>::max();
+    uint64_t frame_end = 0;
+
+    for (const auto &scope: frame.scopes) {
+        if (scope.endQuery == NoQuery)
+            continue;
+        uint64_t mask = mTimestampMasks[static_cast<uint32_t>(scope.queue)];
+        uint64_t begin = timestamps[scope.beginQuery] & mask;
+        uint64_t end = timestamps[scope.endQuery] & mask;
+        double ticks = static_cast<double>((end - begin) & mask);
+
+        if (scope.queue == Queue::Graphics) {
+            frame_begin = std::min(frame_begin, begin);
+            frame_end = std::max(frame_end, begin + ((end - begin) & mask));
+        }
+
+        auto [time, inserted] = frame_times.try_emplace(scope.path, 0.0f);
+        time->second += static_cast<float>(ticks * mTimestampPeriodNs / 1e6);
+        if (inserted)
+            mLastPasses.emplace_back(scope.path, scope.label, scope.depth);
+
+        trace.push_back({
+            .label = scope.label,
+            .queue = scope.queue,
+            .depth = scope.depth,
+            .frameNumber = frame.frameNumber,
+            .beginUs = static_cast<double>(begin) * mTimestampPeriodNs / 1e3,
+            .endUs = static_cast<double>(begin) * mTimestampPeriodNs / 1e3 + ticks * mTimestampPeriodNs / 1e3,
+        });
+    }
+
+    for (const auto &[path, time]: frame_times) {
+        auto &history = mHistory[path];
+        history.samples[history.index] = time;
+        history.index = (history.index + 1) % history.samples.size();
+        history.count = std::min(history.count + 1, history.samples.size());
+    }
+
+    mLastResolvedFrame = frame.frameNumber;
+    mLastFrameTime = frame_end > frame_begin
+                             ? static_cast<float>(static_cast<double>(frame_end - frame_begin) * mTimestampPeriodNs / 1e6)
+                             : 0.0f;
+
+    mTrace.push_back(std::move(trace));
+    if (mTrace.size() > TraceFrames)
+        mTrace.pop_front();
+}
+
+std::vector<GpuPassStats> GpuProfiler::passStats() const {
+    std::vector<GpuPassStats> result;
+    result.reserve(mLastPasses.size());
+
+    std::vector<float> sorted;
+    for (const auto &[path, label, depth]: mLastPasses) {
+        const auto &history = mHistory.at(path);
+        sorted.assign(history.samples.begin(), history.samples.begin() + static_cast<ptrdiff_t>(history.count));
+        std::ranges::sort(sorted);
+
+        float sum = 0;
+        for (float sample: sorted)
+            sum += sample;
+        size_t p99_index = static_cast<size_t>(std::ceil(0.99 * static_cast<double>(sorted.size()))) - 1;
+        size_t last_index = (history.index + history.samples.size() - 1) % history.samples.size();
+
+        result.push_back({
+            .path = path,
+            .label = label,
+            .depth = depth,
+            .last = history.samples[last_index],
+            .min = sorted.front(),
+            .avg = sum / static_cast<float>(sorted.size()),
+            .p99 = sorted[p99_index],
+        });
+    }
+    return result;
+}
+
+void GpuProfiler::writeChromeTrace(const std::filesystem::path &path) const {
+    std::ofstream file(path);
+    if (!file) {
+        Logger::warning(std::format("Could not open {} for writing", path.string()));
+        return;
+    }
+
+    // Chrome trace timestamps only need to be relative, start at the earliest event
+    double origin = std::numeric_limits<double>::infinity();
+    for (const auto &frame: mTrace) {
+        for (const auto &event: frame)
+            origin = std::min(origin, event.beginUs);
+    }
+
+    // Timestamps of both queues are written as if they shared one time domain, which holds on common drivers
+    // but is not guaranteed by the specification
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << R"({"name":"process_name","ph":"M","pid":1,"args":{"name":"GPU"}},)" << "\n";
+    file << R"({"name":"thread_name","ph":"M","pid":1,"tid":0,"args":{"name":"Graphics Queue"}},)" << "\n";
+    file << R"({"name":"thread_name","ph":"M","pid":1,"tid":1,"args":{"name":"Compute Queue"}})";
+    for (const auto &frame: mTrace) {
+        for (const auto &event: frame) {
+            file << std::format(
+                    ",\n{{\"name\":\"{}\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f},"
+                    "\"args\":{{\"frame\":{},\"depth\":{}}}}}",
+                    escapeJson(event.label), static_cast<uint32_t>(event.queue), event.beginUs - origin,
+                    event.endUs - event.beginUs, event.frameNumber, event.depth
+            );
+        }
+    }
+    file << "\n]}\n";
+
+    Logger::info(std::format("Wrote GPU trace of {} frames to {}", mTrace.size(), path.string()));
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <array>
+#include <deque>
+#include <filesystem>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <vulkan/vulkan.hpp>
+#include <tracy/TracyVulkan.hpp>
+
+#include "../util/PerFrame.h"
+
+class VulkanContext;
+
+/// <summary>
+/// Rolling GPU time statistics of one labeled pass, in milliseconds.
+/// </summary>
+struct GpuPassStats {
+    // Labels of all enclosing scopes joined with '/', which keeps equally named nested passes apart
+    std::string path;
+    std::string label;
+    uint32_t depth = 0;
+    float last = 0;
+    float min = 0;
+    float avg = 0;
+    float p99 = 0;
+};
+
+/// <summary>
+/// Measures GPU time of every util::ScopedCommandLabel scope with timestamp queries.
+/// One query pool is used per frame in flight, results are read back when the frame slot is reused.
+/// When built with TRACY_ENABLE the same scopes are also emitted as Tracy GPU zones.
+/// </summary>
+class GpuProfiler {
+public:
+    enum class Queue : uint32_t {
+        Graphics = 0,
+        Compute = 1,
+    };
+
+    static constexpr uint32_t MaxQueriesPerFrame = 512;
+    static constexpr size_t HistorySize = 128;
+    static constexpr size_t TraceFrames = 64;
+
+    GpuProfiler(
+            const vk::Device &device,
+            const vk::PhysicalDevice &physical_device,
+            uint32_t graphics_family,
+            uint32_t compute_family
+    );
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler &) = delete;
+    GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+    /// <summary>
+    /// Collects the results of the frame slot that is about to be reused and resets its queries.
+    /// The frame slot must have finished execution on the GPU.
+    /// </summary>
+    void beginFrame(size_t frame_index, uint64_t frame_number);
+
+    /// <summary>
+    /// Enables profiling of labeled scopes recorded into the command buffer during the current frame.
+    /// </summary>
+    void track(const vk::CommandBuffer &cmd_buf, Queue queue);
+
+    /// <summary>
+    /// Creates the Tracy GPU contexts, which submit a calibration command buffer to each queue.
+    /// Does nothing unless built with TRACY_ENABLE.
+    /// </summary>
+    void initTracy(const VulkanContext &context, const vk::CommandPool &graphics_pool, const vk::CommandPool &compute_pool);
+
+    /// <summary>
+    /// Records the readback of Tracy GPU zones of the queue. Must be recorded outside of rendering.
+    /// </summary>
+    void collect(const vk::CommandBuffer &cmd_buf, Queue queue) const;
+
+    /// <summary>
+    /// Writes the recorded frames as Chrome trace event JSON, viewable in chrome://tracing or Perfetto.
+    /// </summary>
+    void writeChromeTrace(const std::filesystem::path &path) const;
+
+    /// <summary>Passes of the last resolved frame in recording order, with statistics over the recent history.</summary>
+    [[nodiscard]] std::vector<GpuPassStats> passStats() const;
+
+    /// <summary>
+    /// Graphics queue time of the last resolved frame in milliseconds, from its first to its last timestamp.
+    /// </summary>
+    [[nodiscard]] float lastFrameTime() const { return mLastFrameTime; }
+
+    /// <summary>Frame number of the last resolved frame, which lags MaxFramesInFlight frames behind.</summary>
+    [[nodiscard]] std::optional<uint64_t> lastResolvedFrame() const { return mLastResolvedFrame; }
+
+    [[nodiscard]] bool enabled() const { return mEnabled; }
+
+    /// <summary>Called by util::ScopedCommandLabel.</summary>
+    static void beginScope(const vk::CommandBuffer &cmd_buf, const char *label);
+    /// <summary>Called by util::ScopedCommandLabel.</summary>
+    static void endScope(const vk::CommandBuffer &cmd_buf);
+
+private:
+    static constexpr uint32_t NoQuery = ~0u;
+
+    struct Scope {
+        std::string path;
+        std::string label;
+        uint32_t depth;
+        Queue queue;
+        uint32_t beginQuery;
+        uint32_t endQuery = NoQuery;
+    };
+
+    struct Frame {
+        vk::UniqueQueryPool queryPool;
+        uint32_t usedQueries = 0;
+        uint64_t frameNumber = 0;
+        std::vector<Scope> scopes;
+    };
+
+    struct Tracked {
+        Queue queue;
+        std::vector<uint32_t> open;
+#ifdef TRACY_ENABLE
+        std::vector<std::unique_ptr<tracy::VkCtxScope>> tracyZones;
+#endif
+    };
+
+    struct TraceEvent {
+        std::string label;
+        Queue queue;
+        uint32_t depth;
+        uint64_t frameNumber;
+        double beginUs;
+        double endUs;
+    };
+
+    struct History {
+        std::array<float, HistorySize> samples = {};
+        size_t count = 0;
+        size_t index = 0;
+    };
+
+    void begin(const vk::CommandBuffer &cmd_buf, const char *label);
+    void end(const vk::CommandBuffer &cmd_buf);
+    void resolve(Frame &frame);
+
+    static GpuProfiler *sActive;
+
+    vk::Device mDevice;
+    bool mEnabled = false;
+    double mTimestampPeriodNs = 1.0;
+    std::array<uint64_t, 2> mTimestampMasks = {};
+
+    util::PerFrame<Frame> mFrames;
+    std::array<TracyVkCtx, 2> mTracyContexts = {};
+    std::unordered_map<VkCommandBuffer, Tracked> mTracked;
+
+    size_t mFrameIndex = 0;
+
+    // Path, label and depth of the last resolved frame's scopes
+    std::vector<std::tuple<std::string, std::string, uint32_t>> mLastPasses;
+    std::optional<uint64_t> mLastResolvedFrame;
+    float mLastFrameTime = 0;
+    std::unordered_map<std::string, History> mHistory;
+    std::deque<std::vector<TraceEvent>> mTrace;
+};
@@ -55,6 +55,31 @@ void FrameTimes::draw() {
     }
     lines.clear();
 
+    if (!gpuPasses.empty() && CollapsingHeader("GPU Passes")) {
+        if (Button("Export Chrome Trace"))
+            exportGpuTrace = true;
+        if (BeginTable("##gpu_passes", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+            TableSetupColumn("Pass");
+            TableSetupColumn("Min");
+            TableSetupColumn("Avg");
+            TableSetupColumn("P99");
+            TableHeadersRow();
+            for (const auto &pass: gpuPasses) {
+                TableNextRow();
+                TableNextColumn();
+                Text("%*s%s", static_cast<int>(pass.depth) * 2, "", pass.label.c_str());
+                TableNextColumn();
+                Text("%.3f", pass.min);
+                TableNextColumn();
+                Text("%.3f", pass.avg);
+                TableNextColumn();
+                Text("%.3f", pass.p99);
+            }
+            EndTable();
+        }
+    }
+    gpuPasses.clear();
+
     End();
 }
 
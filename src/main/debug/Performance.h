@@ -5,6 +5,8 @@
 #include <limits>
 #include <vector>
 
+#include "GpuProfiler.h"
+
 struct FrameTimes {
     int singleIndex = 0;
     int cumulativeIndex = 0;
@@ -25,6 +27,10 @@ struct FrameTimes {
     std::array<float, 32> max = {};
 
     std::vector <std::pair<std::string, float>> lines = {};
+    // GPU time per labeled pass in ms, cleared after drawing like lines
+    std::vector<GpuPassStats> gpuPasses = {};
+    // Set when the user requested a GPU trace export, reset by the caller
+    bool exportGpuTrace = false;
 
     void update(float delta);
     void draw();
@@ -0,0 +1,134 @@
+#include "QualityGovernor.h"
+
+#include <algorithm>
+#include <format>
+
+#include "../util/Logger.h"
+
+namespace {
+    // Only the fields touched by the steps are restored, everything else stays under user control
+    void restoreKnobs(Settings &settings, const Settings &baseline) {
+        settings.fog.samples = baseline.fog.samples;
+        settings.ssao.slices = baseline.ssao.slices;
+        settings.shadowCascade.resolution = baseline.shadowCascade.resolution;
+        settings.rendering.msaa = baseline.rendering.msaa;
+    }
+
+    bool knobsEqual(const Settings &a, const Settings &b) {
+        return a.fog.samples == b.fog.samples && a.ssao.slices == b.ssao.slices &&
+               a.shadowCascade.resolution == b.shadowCascade.resolution && a.rendering.msaa == b.rendering.msaa;
+    }
+
+    QualityGovernor::Reload knobReloads(const Settings &a, const Settings &b) {
+        auto reload = QualityGovernor::Reload::None;
+        if (a.ssao.slices != b.ssao.slices || a.rendering.msaa != b.rendering.msaa)
+            reload = reload | QualityGovernor::Reload::RenderSystem;
+        if (a.shadowCascade.resolution != b.shadowCascade.resolution)
+            reload = reload | QualityGovernor::Reload::ShadowMaps;
+        return reload;
+    }
+}
+
+QualityGovernor::QualityGovernor() {
+    // Ordered by visual impact, the low frequency fog hides reduced sampling best
+    mSteps = {
+        {"Fog samples 48", [](Settings &s) { s.fog.samples = std::min(s.fog.samples, 48); }},
+        {"Fog samples 32", [](Settings &s) { s.fog.samples = std::min(s.fog.samples, 32); }},
+        {"SSAO slices 2", [](Settings &s) { s.ssao.slices = std::min(s.ssao.slices, 2); }},
+        {"Fog samples 16", [](Settings &s) { s.fog.samples = std::min(s.fog.samples, 16); }},
+        {"SSAO slices 1", [](Settings &s) { s.ssao.slices = std::min(s.ssao.slices, 1); }},
+        {"Shadow resolution 1024",
+         [](Settings &s) { s.shadowCascade.resolution = std::min(s.shadowCascade.resolution, 1024); }},
+        {"MSAA x2", [](Settings &s) { s.rendering.msaa = std::min(s.rendering.msaa, 2); }},
+        {"MSAA off", [](Settings &s) { s.rendering.msaa = 1; }},
+    };
+}
+
+QualityGovernor::Reload QualityGovernor::update(
+        Settings &settings, float gpu_frame_time, std::span<const GpuPassStats> passes
+) {
+    // Knobs edited since the last adjustment are what the user wants now, the levels restart from them
+    if (mActive && !knobsEqual(settings, mApplied)) {
+        if (mLevel > 0)
+            Logger::info(std::format("Quality governor restarting from edited settings, dropping level {}", mLevel));
+        mActive = false;
+        mLevel = 0;
+        mFramesOver = 0;
+        mFramesUnder = 0;
+        mCooldown = 0;
+    }
+    if (!mActive) {
+        mBaseline = settings;
+        mApplied = settings;
+        mActive = true;
+        mAverage = gpu_frame_time;
+    }
+    mAverage += (gpu_frame_time - mAverage) * 0.1f;
+
+    if (mCooldown > 0) {
+        mCooldown--;
+        return Reload::None;
+    }
+
+    float target = settings.governor.targetFrameTime;
+    mFramesOver = mAverage > target * DegradeThreshold ? mFramesOver + 1 : 0;
+    mFramesUnder = mAverage < target * UpgradeThreshold ? mFramesUnder + 1 : 0;
+
+    if (mFramesOver >= DegradeFrames && mLevel < mSteps.size())
+        return setLevel(settings, mLevel + 1, gpu_frame_time, passes);
+    if (mFramesUnder >= UpgradeFrames && mLevel > 0)
+        return setLevel(settings, mLevel - 1, gpu_frame_time, passes);
+    return Reload::None;
+}
+
+QualityGovernor::Reload QualityGovernor::reset(Settings &settings) {
+    Settings previous = settings;
+    // Knobs edited since the last adjustment are kept
+    if (mActive && knobsEqual(settings, mApplied)) {
+        if (mLevel > 0)
+            Logger::info(std::format("Quality governor stopped, restoring full quality from level {}", mLevel));
+        restoreKnobs(settings, mBaseline);
+    }
+    mActive = false;
+    mLevel = 0;
+    mFramesOver = 0;
+    mFramesUnder = 0;
+    mCooldown = 0;
+    return knobReloads(previous, settings);
+}
+
+QualityGovernor::Reload QualityGovernor::setLevel(
+        Settings &settings, size_t level, float gpu_frame_time, std::span<const GpuPassStats> passes
+) {
+    Settings previous = settings;
+    restoreKnobs(settings, mBaseline);
+    for (size_t i = 0; i < level; i++)
+        mSteps[i].apply(settings);
+
+    // The most expensive top level pass is usually what pushed the frame over budget
+    std::string heaviest;
+    float heaviest_time = 0;
+    for (const auto &pass: passes) {
+        if (pass.depth == 0 && pass.avg > heaviest_time) {
+            heaviest = pass.label;
+            heaviest_time = pass.avg;
+        }
+    }
+
+    const char *step = level > mLevel ? mSteps[level - 1].name : mSteps[mLevel - 1].name;
+    Logger::info(std::format(
+            "Quality governor {} '{}' at level {}/{}: GPU {:.2f} ms (avg {:.2f}, target {:.2f}), heaviest pass {} "
+            "{:.2f} ms",
+            level > mLevel ? "applied" : "reverted", step, level, mSteps.size(), gpu_frame_time, mAverage,
+            settings.governor.targetFrameTime, heaviest.empty() ? "-" : heaviest, heaviest_time
+    ));
+
+    mApplied = settings;
+    mLevel = level;
+    mFramesOver = 0;
+    mFramesUnder = 0;
+
+    Reload reload = knobReloads(previous, settings);
+    mCooldown = reload == Reload::None ? Cooldown : ReloadCooldown;
+    return reload;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "GpuProfiler.h"
+#include "Settings.h"
+
+/// <summary>
+/// Adjusts quality settings to hold a target GPU frame time.
+/// Steps are applied in priority order, cheap visual losses first, and reverted in reverse order once there is headroom.
+/// Changes are only made after the frame time stayed outside the hysteresis band for a while,
+/// followed by a cooldown that is longer for steps that recreate resources.
+/// Knobs edited outside of the governor become its new baseline instead of being overwritten.
+/// </summary>
+class QualityGovernor {
+public:
+    enum class Reload : uint32_t {
+        None = 0,
+        RenderSystem = 1,
+        ShadowMaps = 2,
+    };
+
+    struct Step {
+        const char *name;
+        void (*apply)(Settings &settings);
+    };
+
+    // Degrade above target * DegradeThreshold, upgrade below target * UpgradeThreshold
+    static constexpr float DegradeThreshold = 1.05f;
+    static constexpr float UpgradeThreshold = 0.80f;
+    static constexpr uint32_t DegradeFrames = 30;
+    static constexpr uint32_t UpgradeFrames = 120;
+    static constexpr uint32_t Cooldown = 60;
+    static constexpr uint32_t ReloadCooldown = 240;
+
+    QualityGovernor();
+
+    /// <summary>
+    /// Feeds the GPU time of one resolved frame and adjusts the settings if needed.
+    /// The passes are only used to explain adjustments in the log.
+    /// </summary>
+    /// <returns>Resources that have to be recreated for the new settings.</returns>
+    Reload update(Settings &settings, float gpu_frame_time, std::span<const GpuPassStats> passes);
+
+    /// <summary>
+    /// Restores the settings the governor started from, unless they were edited since, and resets its state.
+    /// </summary>
+    /// <returns>Resources that have to be recreated for the restored settings.</returns>
+    Reload reset(Settings &settings);
+
+    [[nodiscard]] size_t level() const { return mLevel; }
+
+private:
+    Reload setLevel(Settings &settings, size_t level, float gpu_frame_time, std::span<const GpuPassStats> passes);
+
+    std::vector<Step> mSteps;
+    // Settings before the first adjustment, every level is applied on top of them
+    Settings mBaseline;
+    // Settings after the last adjustment, to detect knobs edited outside of the governor
+    Settings mApplied;
+    bool mActive = false;
+    size_t mLevel = 0;
+
+    float mAverage = 0;
+    uint32_t mFramesOver = 0;
+    uint32_t mFramesUnder = 0;
+    uint32_t mCooldown = 0;
+};
+
+inline QualityGovernor::Reload operator|(QualityGovernor::Reload a, QualityGovernor::Reload b) {
+    return static_cast<QualityGovernor::Reload>(static_cast<uint32_t>(a) | static_cast<uint32_t>(b));
+}
+
+inline bool operator&(QualityGovernor::Reload a, QualityGovernor::Reload b) {
+    return (static_cast<uint32_t>(a) & static_cast<uint32_t>(b)) != 0;
+}
@@ -1,5 +1,7 @@
 #include "Settings.h"
 
+#include <algorithm>
+
 #include "../entity/ShadowCaster.h"
 
 void Settings::Shadow::applyTo(ShadowCaster &caster) const {
@@ -10,4 +12,5 @@ void Settings::Shadow::applyTo(ShadowCaster &caster) const {
     caster.sampleBiasClamp = sampleBiasClamp;
     caster.normalBias = normalBias;
     caster.extrusionBias = extrusionBias;
+    caster.updateInterval = static_cast<uint32_t>(std::max(updateInterval, 1));
 }
@@ -27,11 +27,16 @@ struct Settings {
         float depthBiasConstant = -2.0f;
         float depthBiasSlope = -2.5f;
         float depthBiasClamp = 0.0f;
+        // In frames
+        int updateInterval = 1;
 
         void applyTo(ShadowCaster &caster) const;
     };
     
-    std::array<Shadow, SHADOW_CASCADE_COUNT> shadowCascades;
+    // Far cascades cover a lot of area per texel, where a few frames of latency are not visible
+    std::array<Shadow, SHADOW_CASCADE_COUNT> shadowCascades = {
+        Shadow{}, Shadow{}, Shadow{.updateInterval = 2}, Shadow{.updateInterval = 2}, Shadow{.updateInterval = 4},
+    };
     
     struct ShadowCascade {
         float lambda = 0.9f;
@@ -39,6 +44,14 @@ struct Settings {
         int resolution = 2048;
         bool visualize = false;
         bool update = true;
+        // Render all cascades into one array image in a single pass, if supported
+        bool layered = true;
+        // Cull casters that cannot shadow anything inside the camera frustum
+        bool casterCulling = true;
+        // Keep the static casters in a cache that is only re-rendered when a cascade's light matrix changes
+        bool cacheStatic = true;
+        // Fit the splits to the depth range of the visible geometry, read back from the depth prepass
+        bool fitToDepth = true;
     } shadowCascade;
 
     struct AgXParams {
@@ -70,11 +83,19 @@ struct Settings {
         glm::vec3 ambient = glm::vec3(0.593f, 0.729, 1.000);
         bool enableFrustumCulling = true;
         bool pauseFrustumCulling = false;
+        // Two phase occlusion culling of the depth prepass against a depth pyramid
+        bool occlusionCulling = true;
+        // Cull clusters of sections first and only test the sections of visible clusters
+        bool hierarchicalCulling = true;
         bool whiteWorld = false;
         bool lightDensity = false;
         float lightRangeFactor = 1.0f;
         bool asyncCompute = true;
         int msaa = 4;
+        // Temporal anti-aliasing replaces MSAA while enabled
+        bool taa = false;
+        // Weight of the reprojected history in the TAA resolve
+        float taaFeedback = 0.9f;
     } rendering;
     
     struct SSAO {
@@ -89,6 +110,21 @@ struct Settings {
         float filterSharpness = 20.0f;
     } ssao;
 
+    struct Governor {
+        // Adjusts fog, SSAO, shadow and MSAA settings to hold the target GPU frame time.
+        // Paused at full quality while dynamic resolution is enabled, which then owns the frame time budget
+        bool enabled = false;
+        float targetFrameTime = 16.6f; // ms
+    } governor;
+
+    struct DynamicResolution {
+        // Renders the scene below the output resolution to hold the target GPU frame time and upscales it
+        bool enabled = false;
+        float targetFrameTime = 16.6f; // ms
+        float minScale = 0.5f;
+        float sharpness = 0.5f;
+    } dynamicResolution;
+
     struct Blob {
         float dispersionXZ = 1.0f;
         float dispersionY = 1.0f;
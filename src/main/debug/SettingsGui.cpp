@@ -51,6 +51,9 @@ void SettingsGui::draw(Settings &settings) {
     if (CollapsingHeader("Shadows")) {
         Checkbox("Update", &settings.shadowCascade.update);
         Checkbox("Visualize", &settings.shadowCascade.visualize);
+        Checkbox("Caster Culling", &settings.shadowCascade.casterCulling);
+        Checkbox("Cache Static Casters", &settings.shadowCascade.cacheStatic);
+        Checkbox("Fit To Depth", &settings.shadowCascade.fitToDepth);
         SliderFloat("Split Lambda", &settings.shadowCascade.lambda, 0.0f, 1.0f);
         DragFloat("Distance", &settings.shadowCascade.distance);
         Indent();
@@ -65,6 +68,7 @@ void SettingsGui::draw(Settings &settings) {
                 DragFloat("Depth Bias Const", &cascade.depthBiasConstant);
                 SliderFloat("Depth Bias Slope", &cascade.depthBiasSlope, -2.5f, 2.5f, "%.5f");
                 SliderFloat("Depth Bias Clamp", &cascade.depthBiasClamp, 0.0f, 0.1f, "%.5f");
+                SliderInt("Update Interval", &cascade.updateInterval, 1, 8);
                 PopID();
             }
         }
@@ -107,12 +111,16 @@ void SettingsGui::draw(Settings &settings) {
         PushID("rendering");
         ColorEdit3("Ambient", glm::value_ptr(settings.rendering.ambient), ImGuiColorEditFlags_Float);
         Checkbox("Frustum Culling", &settings.rendering.enableFrustumCulling);
+        Checkbox("Occlusion Culling", &settings.rendering.occlusionCulling);
+        Checkbox("Hierarchical Culling", &settings.rendering.hierarchicalCulling);
         Checkbox("Async Compute", &settings.rendering.asyncCompute);
         Checkbox("Pause Culling", &settings.rendering.pauseFrustumCulling);
         Checkbox("White World", &settings.rendering.whiteWorld);
         Checkbox("Light Density", &settings.rendering.lightDensity);
         SliderFloat("Light Range Factor", &settings.rendering.lightRangeFactor, 0.0f, 1.0f);
+        SliderFloat("TAA Feedback", &settings.rendering.taaFeedback, 0.0f, 0.98f);
         Text("Settings below require a resource reload.");
+        Checkbox("TAA (replaces MSAA)", &settings.rendering.taa);
         if (BeginCombo("MSAA", std::format("x{}", settings.rendering.msaa).c_str())) {
             for (int msaa : {1,2,4,8}) {
                 bool is_selected = settings.rendering.msaa == msaa; // You can store your selection however you want, outside or inside your objects
@@ -140,6 +148,24 @@ void SettingsGui::draw(Settings &settings) {
         PopID();
     }
 
+    if (CollapsingHeader("Quality Governor")) {
+        PushID("governor");
+        Checkbox("Enabled", &settings.governor.enabled);
+        SliderFloat("Target Frame Time", &settings.governor.targetFrameTime, 4.0f, 50.0f, "%.1f ms");
+        if (settings.governor.enabled && settings.dynamicResolution.enabled)
+            Text("Paused while dynamic resolution is enabled.");
+        PopID();
+    }
+
+    if (CollapsingHeader("Dynamic Resolution")) {
+        PushID("dynamic_resolution");
+        Checkbox("Enabled", &settings.dynamicResolution.enabled);
+        SliderFloat("Target Frame Time", &settings.dynamicResolution.targetFrameTime, 4.0f, 50.0f, "%.1f ms");
+        SliderFloat("Min Scale", &settings.dynamicResolution.minScale, 0.25f, 1.0f);
+        SliderFloat("Sharpness", &settings.dynamicResolution.sharpness, 0.0f, 1.0f);
+        PopID();
+    }
+
     if (CollapsingHeader("Animation")) {
         PushID("animation");
         Checkbox("Render Blob", &settings.animation.renderBlob);
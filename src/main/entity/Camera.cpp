@@ -28,7 +28,8 @@ void Camera::updateBasedOnTransform(const glm::mat4 &camera_instance_transform)
 void Camera::updateProjectionMatrix() {
     float a = mViewportSize.x / mViewportSize.y;
     mAspect = a;
-    mProjectionMatrix = util::createReverseZInfiniteProjectionMatrix(mViewportSize, mFov, mNearPlane);
+    mUnjitteredProjectionMatrix = util::createReverseZInfiniteProjectionMatrix(mViewportSize, mFov, mNearPlane);
+    mProjectionMatrix = jitterMatrix() * mUnjitteredProjectionMatrix;
 }
 
 void Camera::updateViewMatrix() {
@@ -25,8 +25,14 @@ class Camera {
     /// </summary>
     float mNearPlane;
 
+    /// <summary>
+    /// Sub-pixel offset of the projection in normalized device coordinates.
+    /// </summary>
+    glm::vec2 mJitter = {0, 0};
+
     glm::mat4 mViewMatrix = glm::mat4(1.0);
     glm::mat4 mProjectionMatrix = glm::mat4(1.0);
+    glm::mat4 mUnjitteredProjectionMatrix = glm::mat4(1.0);
 
     /// <summary>
     /// Recalculates the projection matrix.
@@ -96,6 +102,17 @@ public:
         updateProjectionMatrix();
     }
 
+    /// <summary>
+    /// Offsets the projection by a fraction of a pixel, used for temporal anti-aliasing.
+    /// </summary>
+    /// <param name="jitter">The offset in normalized device coordinates.</param>
+    void setJitter(glm::vec2 jitter) {
+        if (jitter == mJitter)
+            return;
+        mJitter = jitter;
+        updateProjectionMatrix();
+    }
+
     /// <summary>
     /// Recalculates the view matrix based on the camera's position and orientation.
     /// </summary>
@@ -132,6 +149,23 @@ public:
     /// <returns>The projection matrix.</returns>
     [[nodiscard]] glm::mat4 projectionMatrix() const { return mProjectionMatrix; }
 
+    /// <summary>
+    /// Gets the projection matrix without the jitter.
+    /// </summary>
+    /// <returns>The unjittered projection matrix.</returns>
+    [[nodiscard]] glm::mat4 unjitteredProjectionMatrix() const { return mUnjitteredProjectionMatrix; }
+
+    /// <summary>
+    /// Gets the clip space translation that applies the jitter, so projectionMatrix() = jitterMatrix() * unjitteredProjectionMatrix().
+    /// </summary>
+    /// <returns>The jitter matrix.</returns>
+    [[nodiscard]] glm::mat4 jitterMatrix() const {
+        glm::mat4 result(1.0f);
+        result[3][0] = mJitter.x;
+        result[3][1] = mJitter.y;
+        return result;
+    }
+
     /// <summary>
     /// Gets the view matrix of the camera.
     /// </summary>
@@ -5,6 +5,7 @@
 
 #include "../backend/DeviceQueue.h"
 #include "../backend/StagingBuffer.h"
+#include "../backend/TimelineSemaphore.h"
 
 Cubemap::Cubemap(
         const vma::Allocator &allocator,
@@ -60,23 +61,22 @@ Cubemap::Cubemap(
 
     graphicsCommandBuffer.end();
 
-    vk::UniqueFence graphicsQueueFence = device.createFenceUnique({});
-    vk::UniqueSemaphore imageTransferSemaphore = device.createSemaphoreUnique({});
-
-    stagingBuffer.submit(transferQueue, vk::SubmitInfo().setSignalSemaphores(*imageTransferSemaphore));
-
-    vk::PipelineStageFlags semaphoreStageMask = vk::PipelineStageFlagBits::eTopOfPipe;
-
-    graphicsQueue.queue.submit(
-            {vk::SubmitInfo()
-                     .setWaitSemaphores(*imageTransferSemaphore)
-                     .setCommandBuffers(graphicsCommandBuffer)
-                     .setWaitDstStageMask(semaphoreStageMask)},
-            *graphicsQueueFence
+    uint64_t transferValue = stagingBuffer.submit(transferQueue);
+
+    // The acquire barrier must not run before the release on the transfer queue
+    TimelineSemaphore graphicsTimeline = TimelineSemaphore(device);
+    vk::CommandBufferSubmitInfo commandBufferInfo = {.commandBuffer = graphicsCommandBuffer};
+    vk::SemaphoreSubmitInfo waitInfo =
+            stagingBuffer.timeline().waitInfo(transferValue, vk::PipelineStageFlagBits2::eAllCommands);
+    vk::SemaphoreSubmitInfo signalInfo = graphicsTimeline.signalInfo(graphicsTimeline.next());
+    graphicsQueue.queue.submit2(
+            vk::SubmitInfo2()
+                    .setWaitSemaphoreInfos(waitInfo)
+                    .setCommandBufferInfos(commandBufferInfo)
+                    .setSignalSemaphoreInfos(signalInfo)
     );
 
-    while (device.waitForFences(*graphicsQueueFence, true, UINT64_MAX) == vk::Result::eTimeout) {
-    }
+    graphicsTimeline.wait(graphicsTimeline.value());
 
     ImageViewInfo viewInfo = ImageViewInfo::from(image.info);
     viewInfo.type = vk::ImageViewType::eCube;
@@ -1,8 +1,14 @@
 #include "ShadowCaster.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include <optional>
 #include <glm/ext/matrix_clip_space.hpp>
 #include <glm/ext/matrix_transform.hpp>
 
+#include "../backend/BarrierBatch.h"
 #include "../debug/Annotation.h"
 #include "../util/math.h"
 
@@ -15,7 +21,8 @@ ShadowCaster::ShadowCaster(const vk::Device &device, const vma::Allocator &alloc
                 .aspects = vk::ImageAspectFlagBits::eDepth,
                 .width = resolution,
                 .height = resolution,
-                .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
+                .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled |
+                         vk::ImageUsageFlagBits::eTransferDst,
             }
     );
     util::setDebugName(device, static_cast<vk::Image>(mDepthImage), "shadow_depth_image");
@@ -26,6 +33,22 @@ ShadowCaster::ShadowCaster(const vk::Device &device, const vma::Allocator &alloc
     mFramebuffer.depthAttachment = ImageViewPair(mDepthImage, mDepthImageView);
 }
 
+ShadowCaster::ShadowCaster(const vk::Device &device, const Image &layered_image, uint32_t layer)
+    : mResolution(layered_image.info.width) {
+    mDepthImageView = ImageView::create(
+            device, layered_image,
+            ImageViewInfo{
+                .format = DepthFormat,
+                .width = mResolution,
+                .height = mResolution,
+                .resourceRange = {.aspectMask = vk::ImageAspectFlagBits::eDepth, .levelCount = 1, .baseArrayLayer = layer, .layerCount = 1},
+            }
+    );
+    util::setDebugName(device, static_cast<vk::ImageView>(mDepthImageView), "shadow_depth_image_view");
+    mFramebuffer = Framebuffer{vk::Extent2D{mResolution, mResolution}};
+    mFramebuffer.depthAttachment = ImageViewPair(layered_image, mDepthImageView);
+}
+
 SimpleShadowCaster::SimpleShadowCaster(
         const vk::Device &device, const vma::Allocator &allocator, uint32_t resolution, float radius, float start, float end
 )
@@ -81,31 +104,107 @@ void SimpleShadowCaster::lookAt(const glm::vec3 &target, float azimuth, float el
     lookAt(target, -direction, distance, up);
 }
 
-ShadowCascade::ShadowCascade(const vk::Device &device, const vma::Allocator &allocator, uint32_t resolution, int count) {
+ShadowCascade::ShadowCascade(
+        const vk::Device &device, const vma::Allocator &allocator, uint32_t resolution, int count, bool layered
+) {
+    auto layers = static_cast<uint32_t>(count);
+
+    mStaticCacheKeys.resize(count);
+
     mCascades.reserve(count);
-    for (size_t i = 0; i < count; i++) {
-        mCascades.emplace_back(device, allocator, resolution);
+    if (!layered) {
+        for (size_t i = 0; i < count; i++) {
+            mCascades.emplace_back(device, allocator, resolution);
+        }
+        return;
+    }
+
+    mLayeredImage = Image::create(
+            allocator,
+            ImageCreateInfo{
+                .format = ShadowCaster::DepthFormat,
+                .aspects = vk::ImageAspectFlagBits::eDepth,
+                .width = resolution,
+                .height = resolution,
+                .layers = layers,
+                .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled |
+                         vk::ImageUsageFlagBits::eTransferDst,
+            }
+    );
+    util::setDebugName(device, static_cast<vk::Image>(mLayeredImage), "shadow_cascade_depth_image");
+    mLayeredImageView = ImageView::create(
+            device, mLayeredImage,
+            ImageViewInfo{
+                .format = ShadowCaster::DepthFormat,
+                .type = vk::ImageViewType::e2DArray,
+                .width = resolution,
+                .height = resolution,
+                .resourceRange = {.aspectMask = vk::ImageAspectFlagBits::eDepth, .levelCount = 1, .layerCount = layers},
+            }
+    );
+    util::setDebugName(device, static_cast<vk::ImageView>(mLayeredImageView), "shadow_cascade_depth_image_view");
+    mLayeredFramebuffer = Framebuffer{vk::Extent2D{resolution, resolution}};
+    mLayeredFramebuffer.depthAttachment = ImageViewPair(mLayeredImage, mLayeredImageView);
+
+    // Each cascade renders and samples its own layer
+    for (uint32_t i = 0; i < layers; i++) {
+        mCascades.emplace_back(device, mLayeredImage, i);
     }
 }
 
-void ShadowCascade::update(float frustum_fov, float frustum_aspect, glm::mat4 view_matrix, glm::vec3 light_dir) {
+void ShadowCascade::update(
+        float frustum_fov, float frustum_aspect, glm::mat4 view_matrix, glm::vec3 light_dir,
+        std::optional<glm::vec2> visible_depth
+) {
 
     float near_clip = 0.1f;
     float far_clip = distance;
+    if (fitToDepth && visible_depth) {
+        float fit_near = std::exp2(std::floor(std::log2(visible_depth->x) * DepthFitSteps) / DepthFitSteps);
+        float fit_far = std::exp2(std::ceil(std::log2(visible_depth->y) * DepthFitSteps) / DepthFitSteps);
+        near_clip = std::clamp(fit_near, near_clip, far_clip);
+        far_clip = std::clamp(fit_far, near_clip, far_clip);
+        // Degenerate if everything visible is within one step
+        if (far_clip <= near_clip) {
+            near_clip = 0.1f;
+            far_clip = distance;
+        }
+    }
     float clip_range = far_clip - near_clip;
 
     // cannot use camera projection matrix directly because it has an infinite far plane
     glm::mat4 camera_projection = glm::perspective(frustum_fov, frustum_aspect, near_clip, far_clip);
     glm::mat4 camera_inverse = glm::inverse(camera_projection * view_matrix);
 
+    // Rays through the corners of the camera frustum, scaled to a view depth of one
+    glm::mat4 camera_to_world = glm::inverse(view_matrix);
+    glm::vec3 camera_position = camera_to_world[3];
+    float tan_half_fov = std::tan(frustum_fov * 0.5f);
+    std::array<glm::vec3, 4> corner_rays;
+    const glm::vec2 corner_signs[] = {{-1.0f, -1.0f}, {1.0f, -1.0f}, {1.0f, 1.0f}, {-1.0f, 1.0f}};
+    for (size_t j = 0; j < 4; j++) {
+        glm::vec2 s = corner_signs[j] * glm::vec2(tan_half_fov * frustum_aspect, tan_half_fov);
+        corner_rays[j] = camera_to_world * glm::vec4(s.x, s.y, -1.0f, 0.0f);
+    }
+
     // NOTE: I'm not 100% that this code is working correctly. May not produce optimal results.
 
+    scheduleUpdates();
+
     size_t count = mCascades.size();
     float last_split_dist = 0.0f;
     for (size_t i = 0; i < count; i++) {
         float f = static_cast<float>(i + 1) / static_cast<float>(count);
         float split = calculateSplitDistance(lambda, near_clip, far_clip, clip_range, f);
 
+        // Cascades that are not due keep the matrices their shadow map was rendered with
+        uint32_t interval = std::clamp(mCascades[i].updateInterval, 1u, MaxUpdateInterval);
+        mCascades[i].due = mUpdateCount == 0 || mUpdateCount % interval == mCascades[i].updatePhase;
+        if (!mCascades[i].due) {
+            last_split_dist = split;
+            continue;
+        }
+
         glm::vec3 frustum_corners[] = {
             glm::vec3(-1.0f, 1.0f, 0.0f),  glm::vec3(1.0f, 1.0f, 0.0f),   glm::vec3(1.0f, -1.0f, 0.0f),
             glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(-1.0f, 1.0f, 1.0f),  glm::vec3(1.0f, 1.0f, 1.0f),
@@ -149,8 +248,93 @@ void ShadowCascade::update(float frustum_fov, float frustum_aspect, glm::mat4 vi
         mCascades[i].distance = split * clip_range * 2.0f;
         mCascades[i].viewMatrix = light_view_mat;
         mCascades[i].projectionMatrix = light_ortho_mat;
+
+        // Receivers beyond the slice may fall into the cascade's box and sample it as well,
+        // so the volume starts at the slice but is open towards the far end
+        mCascades[i].casterVolume.clear();
+        if (casterCulling) {
+            float near_depth = near_clip + last_split_dist * clip_range;
+            mCascades[i].casterVolume = createCasterVolume(camera_position, corner_rays, near_depth, light_dir);
+        }
         last_split_dist = split;
     }
+    mUpdateCount++;
+}
+
+void ShadowCascade::scheduleUpdates() {
+    uint32_t period = 1;
+    for (const auto &cascade: mCascades)
+        period = std::lcm(period, std::clamp(cascade.updateInterval, 1u, MaxUpdateInterval));
+
+    // Greedily picks the phase whose frames have the fewest updates so far
+    std::vector<uint32_t> load(period, 0);
+    for (auto &cascade: mCascades) {
+        uint32_t interval = std::clamp(cascade.updateInterval, 1u, MaxUpdateInterval);
+        uint32_t best_phase = 0;
+        uint32_t best_load = UINT32_MAX;
+        for (uint32_t phase = 0; phase < interval; phase++) {
+            uint32_t max_load = 0;
+            for (uint32_t frame = phase; frame < period; frame += interval)
+                max_load = std::max(max_load, load[frame]);
+            if (max_load < best_load) {
+                best_load = max_load;
+                best_phase = phase;
+            }
+        }
+        for (uint32_t frame = best_phase; frame < period; frame += interval)
+            load[frame]++;
+        cascade.updatePhase = best_phase;
+    }
+}
+
+void ShadowCascade::setCacheStatic(const vk::Device &device, const vma::Allocator &allocator, bool cache_static) {
+    mCacheStatic = cache_static;
+    if (!cache_static || mStaticCacheImage)
+        return;
+
+    // Each cache renders into its own layer
+    auto layers = static_cast<uint32_t>(mCascades.size());
+    uint32_t resolution = mCascades.front().resolution();
+    mStaticCacheImage = Image::create(
+            allocator,
+            ImageCreateInfo{
+                .format = ShadowCaster::DepthFormat,
+                .aspects = vk::ImageAspectFlagBits::eDepth,
+                .width = resolution,
+                .height = resolution,
+                .layers = layers,
+                .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+            }
+    );
+    util::setDebugName(device, static_cast<vk::Image>(mStaticCacheImage), "shadow_static_cache_image");
+    mStaticCaches.reserve(layers);
+    for (uint32_t i = 0; i < layers; i++) {
+        mStaticCaches.emplace_back(device, mStaticCacheImage, i);
+    }
+    invalidateStaticCaches();
+}
+
+bool ShadowCascade::staticCacheStale(size_t index) const {
+    return mStaticCacheKeys[index] != staticCacheKey(mCascades[index]);
+}
+
+void ShadowCascade::markStaticCacheRendered(size_t index) const {
+    mStaticCacheKeys[index] = staticCacheKey(mCascades[index]);
+}
+
+void ShadowCascade::invalidateStaticCaches() const {
+    std::ranges::fill(mStaticCacheKeys, std::nullopt);
+}
+
+ShadowCascade::StaticCacheKey ShadowCascade::staticCacheKey(const ShadowCaster &caster) {
+    return {
+        .viewMatrix = caster.viewMatrix,
+        .projectionMatrix = caster.projectionMatrix,
+        .extrusionBias = caster.extrusionBias,
+        .depthBiasConstant = caster.depthBiasConstant,
+        .depthBiasClamp = caster.depthBiasClamp,
+        .depthBiasSlope = caster.depthBiasSlope,
+    };
 }
 
 float ShadowCascade::calculateSplitDistance(float lambda, float near_clip, float far_clip, float clip_range, float f) {
@@ -162,6 +346,57 @@ float ShadowCascade::calculateSplitDistance(float lambda, float near_clip, float
     return (d - near_clip) / clip_range;
 }
 
+util::static_vector<glm::vec4, CascadedShadowCaster::MaxCasterVolumePlanes> ShadowCascade::createCasterVolume(
+        glm::vec3 camera_position, const std::array<glm::vec3, 4> &corner_rays, float near_depth, glm::vec3 light_dir
+) {
+    // Corner rays are ordered around the frustum, side face j lies between ray j and j + 1
+    glm::vec3 center_ray = (corner_rays[0] + corner_rays[1] + corner_rays[2] + corner_rays[3]) * 0.25f;
+    glm::vec3 interior = camera_position + center_ray * (near_depth + 1.0f);
+
+    // Plane through the point, facing the interior. Degenerate planes are dropped, which only grows the volume.
+    auto create_plane = [&](glm::vec3 normal, glm::vec3 point) -> std::optional<glm::vec4> {
+        float length = glm::length(normal);
+        if (length < 1e-6f)
+            return std::nullopt;
+        normal /= length;
+        if (glm::dot(normal, interior - point) < 0.0f)
+            normal = -normal;
+        return glm::vec4(normal, -glm::dot(normal, point));
+    };
+
+    // Faces 0 to 3 are the sides, face 4 the near plane of the slice
+    std::array<std::optional<glm::vec4>, 5> faces;
+    for (size_t j = 0; j < 4; j++) {
+        faces[j] = create_plane(glm::cross(corner_rays[j], corner_rays[(j + 1) % 4]), camera_position);
+    }
+    faces[4] = create_plane(center_ray, camera_position + center_ray * near_depth);
+
+    // Sweeping along the light keeps the faces whose inside extends against the light direction
+    std::array<bool, 5> kept = {};
+    util::static_vector<glm::vec4, CascadedShadowCaster::MaxCasterVolumePlanes> planes;
+    for (size_t j = 0; j < faces.size(); j++) {
+        kept[j] = !faces[j] || glm::dot(glm::vec3(*faces[j]), light_dir) <= 0.0f;
+        if (faces[j] && kept[j])
+            planes.push_back(*faces[j]);
+    }
+
+    // Edges between a kept and a dropped face form the silhouette, their planes contain the light direction
+    auto add_silhouette = [&](size_t face_a, size_t face_b, glm::vec3 point, glm::vec3 direction) {
+        if (kept[face_a] == kept[face_b])
+            return;
+        if (auto plane = create_plane(glm::cross(direction, light_dir), point))
+            planes.push_back(*plane);
+    };
+    for (size_t j = 0; j < 4; j++) {
+        size_t next = (j + 1) % 4;
+        // Side edge along ray j + 1, between side faces j and j + 1
+        add_silhouette(j, next, camera_position, corner_rays[next]);
+        // Near edge of side face j
+        add_silhouette(j, 4, camera_position + corner_rays[j] * near_depth, corner_rays[next] - corner_rays[j]);
+    }
+    return planes;
+}
+
 glm::mat4 ShadowCascade::createTexelAlignedViewMatrix(
         glm::vec3 light_dir, uint32_t resolution, float radius, glm::vec3 frustum_center
 ) {
@@ -173,9 +408,20 @@ glm::mat4 ShadowCascade::createTexelAlignedViewMatrix(
     // Round the X and Y coordinates to the nearest world_space_unit (texel size)
     center_light_space.x = std::round(center_light_space.x / world_space_unit) * world_space_unit;
     center_light_space.y = std::round(center_light_space.y / world_space_unit) * world_space_unit;
+    // Depth as well, so that the matrix and with it the static cache only change in texel steps
+    center_light_space.z = std::round(center_light_space.z / world_space_unit) * world_space_unit;
     // Transform the snapped center back to world space
     glm::vec3 snapped_center = glm::inverse(zero_view) * center_light_space;
 
     // Adjust the light view matrix to be centered on the snapped position
     return glm::lookAt(snapped_center - light_dir, snapped_center, up);
 }
+
+void ShadowCascade::barrier(BarrierBatch &barriers, const ImageResourceAccess &access) const {
+    if (layered()) {
+        barriers.add(mLayeredImage, access);
+        return;
+    }
+    for (const CascadedShadowCaster &cascade: mCascades)
+        barriers.add(cascade.framebuffer().depthAttachment.image(), access);
+}
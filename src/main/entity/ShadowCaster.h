@@ -3,14 +3,17 @@
 #include <glm/ext/matrix_clip_space.hpp>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/glm.hpp>
+#include <optional>
 #include <vulkan/vulkan.hpp>
 
 #include "../backend/Framebuffer.h"
 #include "../backend/Image.h"
+#include "../util/static_vector.h"
 
 namespace vma {
     class Allocator;
 }
+class BarrierBatch;
 
 class ShadowCaster {
 public:
@@ -32,9 +35,13 @@ public:
     float depthBiasClamp = 0.0f;
     /// <summary>See Vulkan's depthBiasSlopeFactor.</summary>
     float depthBiasSlope = 0.0f;
+    /// <summary>Update the shadow map only every n-th frame. Only applies to cascades, see ShadowCascade.</summary>
+    uint32_t updateInterval = 1;
 
     ShadowCaster() = default;
     ShadowCaster(const vk::Device &device, const vma::Allocator &allocator, uint32_t resolution);
+    /// <summary>Renders into a layer of an array image owned elsewhere, which must outlive the caster.</summary>
+    ShadowCaster(const vk::Device &device, const Image &layered_image, uint32_t layer);
     virtual ~ShadowCaster() = default;
 
     ShadowCaster(ShadowCaster &&other) noexcept = default;
@@ -91,11 +98,30 @@ private:
 
 class CascadedShadowCaster : public ShadowCaster {
 public:
+    // The five faces of the camera frustum slice and its eight edges as silhouette
+    static constexpr size_t MaxCasterVolumePlanes = 13;
+
     float distance = 0.0f;
 
+    /// <summary>
+    /// Whether the matrices were updated this frame, so the shadow map has to be rendered.
+    /// Otherwise they are left as they were when the shadow map was last rendered.
+    /// </summary>
+    bool due = true;
+    /// <summary>Frame within the update interval at which the cascade is updated.</summary>
+    uint32_t updatePhase = 0;
+
+    /// <summary>
+    /// Planes of the camera frustum that samples this cascade, swept towards the light.
+    /// Only objects intersecting it can cast shadows onto visible receivers. Empty if caster culling is disabled.
+    /// </summary>
+    util::static_vector<glm::vec4, MaxCasterVolumePlanes> casterVolume;
+
     CascadedShadowCaster() = default;
     CascadedShadowCaster(const vk::Device &device, const vma::Allocator &allocator, uint32_t resolution)
         : ShadowCaster(device, allocator, resolution) {}
+    CascadedShadowCaster(const vk::Device &device, const Image &layered_image, uint32_t layer)
+        : ShadowCaster(device, layered_image, layer) {}
     ~CascadedShadowCaster() override = default;
 
     CascadedShadowCaster(CascadedShadowCaster &&other) noexcept = default;
@@ -110,17 +136,106 @@ public:
     /// <summary>The maximum shadow distance.</summary>
     float distance = 1000.0f;
 
-    ShadowCascade(const vk::Device &device, const vma::Allocator &allocator, uint32_t resolution, int count);
-
-    void update(float frustum_fov, float frustum_aspect, glm::mat4 view_matrix, glm::vec3 light_dir);
+    /// <summary>Whether the cascades get a caster volume, see CascadedShadowCaster::casterVolume.</summary>
+    bool casterCulling = true;
+
+    /// <summary>
+    /// Whether the splits are fitted to the view depth range of the visible geometry instead of the near plane and
+    /// distance, see update.
+    /// </summary>
+    bool fitToDepth = true;
+
+    /// <summary>
+    /// If layered, the cascades are layers of one array image, which can be rendered in a single pass.
+    /// </summary>
+    ShadowCascade(const vk::Device &device, const vma::Allocator &allocator, uint32_t resolution, int count, bool layered = false);
+
+    /// <summary>
+    /// Fits the cascades that are due this frame to the camera frustum, according to their update intervals.
+    /// If fitting to depth, the frustum is narrowed to the visible view depth range, which may be a few frames old.
+    /// </summary>
+    void update(
+            float frustum_fov, float frustum_aspect, glm::mat4 view_matrix, glm::vec3 light_dir,
+            std::optional<glm::vec2> visible_depth = std::nullopt
+    );
 
     [[nodiscard]] std::span<const CascadedShadowCaster> cascades() const { return mCascades; }
     [[nodiscard]] std::span<CascadedShadowCaster> cascades() { return mCascades; }
 
+    [[nodiscard]] bool layered() const { return static_cast<bool>(mLayeredImage); }
+    /// <summary>
+    /// Adds a barrier for the shadow maps of all cascades.
+    /// Layered cascades share one image, which is added once since it may only be transitioned once per batch.
+    /// </summary>
+    void barrier(BarrierBatch &barriers, const ImageResourceAccess &access) const;
+    /// <summary>A framebuffer over all layers, only valid if layered.</summary>
+    [[nodiscard]] const Framebuffer &layeredFramebuffer() const { return mLayeredFramebuffer; }
+
+    /// <summary>
+    /// Sets whether the static casters are rendered from the caches, see staticCache.
+    /// The caches are allocated when first enabled and kept while disabled, frames in flight may still use them.
+    /// </summary>
+    void setCacheStatic(const vk::Device &device, const vma::Allocator &allocator, bool cache_static);
+    [[nodiscard]] bool cacheStatic() const { return mCacheStatic; }
+
+    /// <summary>
+    /// Depth of only the static casters of a cascade, at its layer of the cache image.
+    /// It is copied into the shadow map each frame before the animated casters are drawn on top.
+    /// Only valid while caching static casters.
+    /// </summary>
+    [[nodiscard]] const ShadowCaster &staticCache(size_t index) const { return mStaticCaches[index]; }
+    [[nodiscard]] const Image &staticCacheImage() const { return mStaticCacheImage; }
+
+    /// <summary>Whether the cache of a cascade was rendered with other matrices or biases than the cascade has now.</summary>
+    [[nodiscard]] bool staticCacheStale(size_t index) const;
+    /// <summary>Records that the cache of a cascade was rendered with the cascade's current state.</summary>
+    void markStaticCacheRendered(size_t index) const;
+    void invalidateStaticCaches() const;
+
 private:
+    // Everything the depth of the static casters depends on
+    struct StaticCacheKey {
+        glm::mat4 viewMatrix;
+        glm::mat4 projectionMatrix;
+        float extrusionBias;
+        float depthBiasConstant;
+        float depthBiasClamp;
+        float depthBiasSlope;
+
+        bool operator==(const StaticCacheKey &other) const = default;
+    };
+
+    static StaticCacheKey staticCacheKey(const ShadowCaster &caster);
+
+    // Declared before the cascades, which reference it
+    Image mLayeredImage;
+    ImageView mLayeredImageView;
+    Framebuffer mLayeredFramebuffer;
     std::vector<CascadedShadowCaster> mCascades;
 
+    bool mCacheStatic = false;
+    Image mStaticCacheImage;
+    std::vector<ShadowCaster> mStaticCaches;
+    // Updated while recording, like the barrier state of resources
+    mutable std::vector<std::optional<StaticCacheKey>> mStaticCacheKeys;
+
+    uint64_t mUpdateCount = 0;
+
+    // Longest update interval, which bounds the scheduling period
+    static constexpr uint32_t MaxUpdateInterval = 8;
+
+    /// <summary>Spreads the update phases of the cascades, so that about as many are updated every frame.</summary>
+    void scheduleUpdates();
+
+    // The fitted range snaps outwards to steps of this fraction of an octave, so the cascades and their static caches
+    // don't change with every small movement of the camera, and geometry that came into view since has some margin
+    static constexpr float DepthFitSteps = 8.0f;
+
     static float calculateSplitDistance(float lambda, float near_clip, float far_clip, float clip_range, float f);
 
+    static util::static_vector<glm::vec4, CascadedShadowCaster::MaxCasterVolumePlanes> createCasterVolume(
+            glm::vec3 camera_position, const std::array<glm::vec3, 4> &corner_rays, float near_depth, glm::vec3 light_dir
+    );
+
     static glm::mat4 createTexelAlignedViewMatrix(glm::vec3 light_dir, uint32_t resolution, float radius, glm::vec3 frustum_center);
 };
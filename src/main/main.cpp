@@ -1,11 +1,38 @@
 #include <cpptrace/utils.hpp>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
 
 #include "Application.h"
+#include "debug/Benchmark.h"
+#include "debug/BvhBenchmark.h"
+#include "debug/FrameCapture.h"
 #include "util/globals.h"
 
-int main() {
+int main(int argc, char *argv[]) {
+    // Usage: main compare-benchmark <baseline.json> <report.json> [tolerance]
+    if (argc >= 4 && std::strcmp(argv[1], "compare-benchmark") == 0) {
+        float tolerance = argc >= 5 ? std::strtof(argv[4], nullptr) : Benchmark::DefaultTolerance;
+        return Benchmark::compare(argv[2], argv[3], tolerance) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    // Usage: main compare-images <golden> <capture> [tolerance], both files or both directories
+    if (argc >= 4 && std::strcmp(argv[1], "compare-images") == 0) {
+        int tolerance = argc >= 5 ? std::atoi(argv[4]) : FrameCapture::DefaultTolerance;
+        return FrameCapture::compare(argv[2], argv[3], tolerance) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    // Usage: main benchmark-bvh [scene.glb] [query count], runs on the CPU only
+    if (argc >= 2 && std::strcmp(argv[1], "benchmark-bvh") == 0) {
+        std::filesystem::path scene_path = argc >= 3 ? argv[2] : BvhBenchmark::DefaultScene;
+        uint32_t query_count = argc >= 4 ? static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10))
+                                         : BvhBenchmark::DefaultQueryCount;
+        try {
+            return BvhBenchmark::run(scene_path, query_count) ? EXIT_SUCCESS : EXIT_FAILURE;
+        } catch (const std::exception &e) {
+            std::cerr << "Exception: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
 
     if (!std::filesystem::exists("resources")) {
         std::cerr << "Directory 'resources' not found. Current working directory is '"
@@ -22,6 +49,21 @@ int main() {
         }
     }
 
+    // ReSharper disable once CppDeprecatedEntity
+    auto descriptor_buffer_env_var = std::getenv("DESCRIPTOR_BUFFER");
+    if (descriptor_buffer_env_var != nullptr && std::strcmp(descriptor_buffer_env_var, "1") == 0) {
+        globals::DescriptorBuffer = true;
+        std::cerr << "Descriptor buffers requested via DESCRIPTOR_BUFFER env var." << std::endl;
+    }
+
+    // ReSharper disable once CppDeprecatedEntity
+    auto headless_env_var = std::getenv("HEADLESS");
+    if (headless_env_var != nullptr && std::atoi(headless_env_var) > 0) {
+        globals::HeadlessFrames = std::atoi(headless_env_var);
+        std::cerr << "Headless mode for " << globals::HeadlessFrames << " frames enabled via HEADLESS env var."
+                  << std::endl;
+    }
+
     try {
         Application app;
         app.run();
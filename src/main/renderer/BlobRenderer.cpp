@@ -39,7 +39,11 @@ void BlobRenderer::recreate(const vk::Device &device, const ShaderLoader &shader
 }
 
 void BlobRenderer::compute(
-        const vk::Device &device, const vk::CommandBuffer &cmd_buf, const blob::System &blobSystem, float timestamp
+        const vk::Device &device,
+        const vk::CommandBuffer &cmd_buf,
+        const UploadHeap &upload_heap,
+        const blob::System &blobSystem,
+        float timestamp
 ) {
     util::ScopedCommandLabel dbg_cmd_label_func(cmd_buf, "Compute");
 
@@ -63,9 +67,8 @@ void BlobRenderer::compute(
         cumulative_vertex_offset += blobSystem.estimateVertexCount(domains[i]);
     }
 
-    indirect_buffer.barrier(cmd_buf, BufferResourceAccess::TransferWrite);
-    assert(drawCommands.size() * sizeof(vk::DrawIndirectCommand));
-    cmd_buf.updateBuffer(indirect_buffer, 0, drawCommands.size() * sizeof(vk::DrawIndirectCommand), drawCommands.data());
+    upload_heap.upload(drawCommands, indirect_buffer);
+    upload_heap.flush(cmd_buf);
 
     indirect_buffer.barrier(cmd_buf, BufferResourceAccess::ComputeShaderStorageReadWrite);
     vertex_buffer.barrier(cmd_buf, BufferResourceAccess::ComputeShaderStorageWrite);
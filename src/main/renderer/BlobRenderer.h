@@ -12,6 +12,7 @@
 
 
 struct DirectionalLight;
+class UploadHeap;
 namespace blob {
     class System;
 }
@@ -90,7 +91,13 @@ public:
 
     void recreate(const vk::Device &device, const ShaderLoader &shaderLoader, const Framebuffer &framebuffer);
 
-    void compute(const vk::Device &device, const vk::CommandBuffer &cmd_buf, const blob::System &blobSystem, float timestamp);
+    void compute(
+            const vk::Device &device,
+            const vk::CommandBuffer &cmd_buf,
+            const UploadHeap &upload_heap,
+            const blob::System &blobSystem,
+            float timestamp
+    );
 
     void draw(
             const vk::Device &device,
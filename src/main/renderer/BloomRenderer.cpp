@@ -1,5 +1,6 @@
 #include "BloomRenderer.h"
 
+#include "../backend/BarrierBatch.h"
 #include "../backend/Image.h"
 #include "../backend/ImageResource.h"
 #include "../backend/ShaderCompiler.h"
@@ -57,7 +58,8 @@ void BloomRenderer::execute(
         prev_image = out_image;
     }
 
-    barrier(ImageViewPair{mUpImage.get(), &mUpImageViews[0]}, mUpImageAccess, cmd_buf,
+    BarrierBatch barriers(cmd_buf);
+    barrier(ImageViewPair{mUpImage.get(), &mUpImageViews[0]}, mUpImageAccess, barriers,
             ImageResourceAccess::ComputeShaderReadOptimal);
 }
 
@@ -71,33 +73,34 @@ void BloomRenderer::downPass(
 ) {
     util::ScopedCommandLabel dbg_cmd_label_region_culling(cmd_buf, "Down-Pass " + std::to_string(level));
 
+    BarrierBatch barriers(cmd_buf);
     if (level == 0) {
         // level 0 gets hdr input
-        in_image.image().barrier(cmd_buf, ImageResourceAccess::ComputeShaderReadOptimal);
+        barriers.add(in_image.image(), ImageResourceAccess::ComputeShaderReadOptimal);
     } else {
         // Others get prev down level
-        barrier(in_image, mDownImageAccess, cmd_buf, ImageResourceAccess::ComputeShaderReadOptimal);
+        barrier(in_image, mDownImageAccess, barriers, ImageResourceAccess::ComputeShaderReadOptimal);
     }
+    barrier(out_image, mDownImageAccess, barriers, ImageResourceAccess::ComputeShaderWriteGeneral);
+    barriers.flush();
 
-    barrier(out_image, mDownImageAccess, cmd_buf, ImageResourceAccess::ComputeShaderWriteGeneral);
-
-    auto descriptor_set = allocator.allocate(mDownDescriptorLayout);
-    device.updateDescriptorSets(
+    // The bloom images only change on recreate, so the sets can be reused across frames
+    auto descriptor_set = allocator.allocateCached(
+            mDownDescriptorLayout,
             {
-                descriptor_set.write(
+                DescriptorSet().write(
                         DownDescriptorLayout::InColor,
                         vk::DescriptorImageInfo{
                             .sampler = *mDownSampler, .imageView = in_image.view(), .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
                         }
                 ),
-                descriptor_set.write(
+                DescriptorSet().write(
                         DownDescriptorLayout::OutColor,
                         vk::DescriptorImageInfo{.imageView = out_image.view(), .imageLayout = vk::ImageLayout::eGeneral}
                 ),
-            },
-            {}
+            }
     );
-    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *mDownPipeline.layout, 0, {descriptor_set}, {});
+    allocator.bind(cmd_buf, vk::PipelineBindPoint::eCompute, *mDownPipeline.layout, 0, descriptor_set);
 
     DownPushConstants push_constants = {
         .thresholdCurve = glm::vec3(threshold - knee, knee * 2.0, 0.25 / knee), .threshold = threshold, .firstPass = level == 0
@@ -120,34 +123,34 @@ void BloomRenderer::upPass(
 ) {
     util::ScopedCommandLabel dbg_cmd_label_region_culling(cmd_buf, "Up-Pass " + std::to_string(level));
 
-    auto descriptor_set = allocator.allocate(mUpDescriptorLayout);
-
     // The first "previous" image is the last down sampled image
     auto &prev_tracker = level == LEVELS - 1 ? mDownImageAccess : mUpImageAccess;
-    barrier(in_prev_image, prev_tracker, cmd_buf, ImageResourceAccess::ComputeShaderReadOptimal);
-    barrier(in_curr_image, mDownImageAccess, cmd_buf, ImageResourceAccess::ComputeShaderReadOptimal);
-    barrier(out_image, mUpImageAccess, cmd_buf, ImageResourceAccess::ComputeShaderWriteGeneral);
-
-    device.updateDescriptorSets(
+    BarrierBatch barriers(cmd_buf);
+    barrier(in_prev_image, prev_tracker, barriers, ImageResourceAccess::ComputeShaderReadOptimal);
+    barrier(in_curr_image, mDownImageAccess, barriers, ImageResourceAccess::ComputeShaderReadOptimal);
+    barrier(out_image, mUpImageAccess, barriers, ImageResourceAccess::ComputeShaderWriteGeneral);
+    barriers.flush();
+
+    auto descriptor_set = allocator.allocateCached(
+            mUpDescriptorLayout,
             {
-                descriptor_set.write(
+                DescriptorSet().write(
                         UpDescriptorLayout::InCurrColor,
                         vk::DescriptorImageInfo{.imageView = in_curr_image.view(), .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal}
                 ),
-                descriptor_set.write(
+                DescriptorSet().write(
                         UpDescriptorLayout::InPrevColor,
                         vk::DescriptorImageInfo{
                             .sampler = *mUpSampler, .imageView = in_prev_image.view(), .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
                         }
                 ),
-                descriptor_set.write(
+                DescriptorSet().write(
                         UpDescriptorLayout::OutColor,
                         vk::DescriptorImageInfo{.imageView = out_image.view(), .imageLayout = vk::ImageLayout::eGeneral}
                 ),
-            },
-            {}
+            }
     );
-    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *mUpPipeline.layout, 0, {descriptor_set}, {});
+    allocator.bind(cmd_buf, vk::PipelineBindPoint::eCompute, *mUpPipeline.layout, 0, descriptor_set);
 
     UpPushConstants push_constants = {.prevFactor = prev_factor, .currFactor = curr_factor, .lastPass = level == 0};
 
@@ -158,7 +161,7 @@ void BloomRenderer::upPass(
 void BloomRenderer::barrier(
         const ImageViewPairBase &image,
         std::span<ImageResourceAccess> tracker,
-        const vk::CommandBuffer &cmd_buf,
+        BarrierBatch &barriers,
         const ImageResourceAccess &current
 ) {
     auto range = image.view().info.resourceRange;
@@ -175,11 +178,7 @@ void BloomRenderer::barrier(
         .image = image,
         .subresourceRange = range,
     };
-
-    cmd_buf.pipelineBarrier2({
-        .imageMemoryBarrierCount = 1,
-        .pImageMemoryBarriers = &barrier,
-    });
+    barriers.add(barrier);
 
     prev = current;
 }
@@ -189,6 +188,7 @@ void BloomRenderer::createPipeline(const vk::Device &device, const ShaderLoader
         auto comp_sh = shader_loader.loadFromSource(device, "resources/shaders/bloom_up.comp");
 
         ComputePipelineConfig pipeline_config = {
+            .flags = perFrameDescriptorPipelineFlags(),
             .descriptorSetLayouts =
                     {
                         mUpDescriptorLayout,
@@ -206,6 +206,7 @@ void BloomRenderer::createPipeline(const vk::Device &device, const ShaderLoader
         auto comp_sh = shader_loader.loadFromSource(device, "resources/shaders/bloom_down.comp");
 
         ComputePipelineConfig pipeline_config = {
+            .flags = perFrameDescriptorPipelineFlags(),
             .descriptorSetLayouts =
                     {
                         mDownDescriptorLayout,
@@ -6,6 +6,7 @@
 
 
 struct ImageResourceAccess;
+class BarrierBatch;
 class ImageViewPair;
 class TransientImageViewPair;
 struct ImageViewBase;
@@ -29,7 +30,7 @@ public:
         UpDescriptorLayout() = default;
 
         explicit UpDescriptorLayout(const vk::Device &device) {
-            create(device, {}, InCurrColor, InPrevColor, OutColor);
+            create(device, perFrameDescriptorSetLayoutFlags(), InCurrColor, InPrevColor, OutColor);
             util::setDebugName(device, vk::DescriptorSetLayout(*this), "bloom_up_descriptor_layout");
         }
     };
@@ -41,7 +42,7 @@ public:
         DownDescriptorLayout() = default;
 
         explicit DownDescriptorLayout(const vk::Device &device) {
-            create(device, {}, InColor, OutColor);
+            create(device, perFrameDescriptorSetLayoutFlags(), InColor, OutColor);
             util::setDebugName(device, vk::DescriptorSetLayout(*this), "bloom_down_descriptor_layout");
         }
     };
@@ -105,7 +106,7 @@ private:
     static void barrier(
             const ImageViewPairBase &image,
             std::span<ImageResourceAccess> tracker,
-            const vk::CommandBuffer &cmd_buf,
+            BarrierBatch &barriers,
             const ImageResourceAccess &current
     );
 
@@ -8,17 +8,20 @@
 #include "../debug/Annotation.h"
 #include "../entity/Camera.h"
 #include "../scene/Scene.h"
+#include "DepthPyramid.h"
 #include "FrustumCuller.h"
 
 DepthPrePassRenderer::~DepthPrePassRenderer() = default;
 
-DepthPrePassRenderer::DepthPrePassRenderer() = default;
+DepthPrePassRenderer::DepthPrePassRenderer(const vk::Device &device) {
+    mVelocityDescriptorLayout = VelocityDescriptorLayout(device);
+}
 
 void DepthPrePassRenderer::recreate(const vk::Device &device, const ShaderLoader &shader_loader, const Framebuffer &fb) {
     createPipeline(device, shader_loader, fb);
 }
 
-void DepthPrePassRenderer::execute(
+FrustumCuller::CulledDrawCommands DepthPrePassRenderer::execute(
         const vk::Device &device,
         const DescriptorAllocator &desc_alloc,
         const TransientBufferAllocator &buf_alloc,
@@ -26,12 +29,16 @@ void DepthPrePassRenderer::execute(
         const Framebuffer &fb,
         const ImageViewPairBase &depth_copy,
         const Camera &camera,
+        const glm::mat4 &previous_view_projection,
         const scene::GpuData &gpu_data,
-        const FrustumCuller &frustum_culler
+        const FrustumCuller &frustum_culler,
+        DepthPyramid *depth_pyramid,
+        const BufferBase *stats
 ) {
     util::ScopedCommandLabel dbg_cmd_label_region_culling(cmd_buf, "Culling");
 
-    glm::mat4 frustum_matrix = camera.projectionMatrix() * camera.viewMatrix();
+    glm::mat4 view_projection = camera.projectionMatrix() * camera.viewMatrix();
+    glm::mat4 frustum_matrix = view_projection;
     if (pauseCulling) {
         if (!mCapturedFrustum.has_value()) {
             mCapturedFrustum = std::make_optional<glm::mat4>(frustum_matrix);
@@ -41,35 +48,112 @@ void DepthPrePassRenderer::execute(
         mCapturedFrustum.reset();
     }
 
-    UnmanagedBuffer culled_commands = {};
-    if (enableCulling) {
-        culled_commands = frustum_culler.execute(device, desc_alloc, buf_alloc, cmd_buf, gpu_data, frustum_matrix);
-        culled_commands.barrier(cmd_buf, BufferResourceAccess::IndirectCommandRead);
+    bool occlusion = enableCulling && enableOcclusionCulling && depth_pyramid != nullptr;
+
+    FrustumCuller::CulledDrawCommands culled_commands;
+    UnmanagedBuffer rejected_commands = {};
+    if (occlusion) {
+        FrustumCuller::OcclusionCulling first_phase = {.pyramid = depth_pyramid, .rejected = &rejected_commands};
+        culled_commands.add(frustum_culler.execute(
+                device, desc_alloc, buf_alloc, cmd_buf, gpu_data, frustum_matrix, nullptr, 0.0f, &first_phase
+        ));
+        culled_commands.barrier(cmd_buf);
+    } else if (enableCulling) {
+        culled_commands.add(frustum_culler.execute(device, desc_alloc, buf_alloc, cmd_buf, gpu_data, frustum_matrix));
+        culled_commands.barrier(cmd_buf);
     }
 
     dbg_cmd_label_region_culling.swap("Rendering");
 
+    draw(device, desc_alloc, cmd_buf, fb, depth_copy, camera, previous_view_projection, gpu_data,
+         enableCulling ? &culled_commands.lists[0] : nullptr, true, !occlusion);
+
+    if (occlusion) {
+        // The pyramid only contains the occluders of the first pass, so the second phase is conservative.
+        // It is kept for the next frame, which saves building it again from the complete depth.
+        dbg_cmd_label_region_culling.swap("Depth Pyramid");
+        depth_pyramid->execute(device, desc_alloc, cmd_buf, fb.depthAttachment, view_projection);
+
+        dbg_cmd_label_region_culling.swap("Occlusion Culling");
+        FrustumCuller::OcclusionCulling second_phase = {.pyramid = depth_pyramid, .candidates = &rejected_commands};
+        culled_commands.add(frustum_culler.execute(
+                device, desc_alloc, buf_alloc, cmd_buf, gpu_data, frustum_matrix, nullptr, 0.0f, &second_phase
+        ));
+        const UnmanagedBuffer &second_phase_commands = culled_commands.lists[1];
+        second_phase_commands.barrier(cmd_buf, BufferResourceAccess::IndirectCommandRead);
+
+        dbg_cmd_label_region_culling.swap("Rendering Disoccluded");
+        draw(device, desc_alloc, cmd_buf, fb, depth_copy, camera, previous_view_projection, gpu_data,
+             &second_phase_commands, false, true);
+
+        if (stats) {
+            FrustumCuller::copyStats(
+                    cmd_buf, culled_commands.lists[0], rejected_commands, second_phase_commands, *stats
+            );
+        }
+    }
+
+    // Simply copy if msaa is disabled
+    if (fb.depthAttachment.image().info.samples == vk::SampleCountFlagBits::e1) {
+        fb.depthAttachment.image().barrier(cmd_buf, ImageResourceAccess::TransferRead);
+        depth_copy.image().barrier(cmd_buf, ImageResourceAccess::TransferWrite);
+        cmd_buf.copyImage(
+                fb.depthAttachment.image(), ImageResourceAccess::TransferRead.layout,
+                depth_copy.image(), ImageResourceAccess::TransferWrite.layout,
+                vk::ImageCopy{
+                    .srcSubresource = {.aspectMask = vk::ImageAspectFlagBits::eDepth, .layerCount = 1},
+                    .dstSubresource = {.aspectMask = vk::ImageAspectFlagBits::eDepth, .layerCount = 1},
+                    .extent = {.width = fb.extent().width, .height = fb.extent().height, .depth = 1}
+                }
+        );
+    }
+
+    return culled_commands;
+}
+
+void DepthPrePassRenderer::draw(
+        const vk::Device &device,
+        const DescriptorAllocator &desc_alloc,
+        const vk::CommandBuffer &cmd_buf,
+        const Framebuffer &fb,
+        const ImageViewPairBase &depth_copy,
+        const Camera &camera,
+        const glm::mat4 &previous_view_projection,
+        const scene::GpuData &gpu_data,
+        const UnmanagedBuffer *culled_commands,
+        bool first_pass,
+        bool resolve
+) {
     fb.depthAttachment.image().barrier(
             cmd_buf, ImageResourceAccess::DepthAttachmentEarlyOps, ImageResourceAccess::DepthAttachmentLateOps
     );
 
-    bool msaa = fb.depthAttachment.image().info.samples != vk::SampleCountFlagBits::e1;
+    if (mVelocity) {
+        fb.colorAttachments[0].image().barrier(cmd_buf, ImageResourceAccess::ColorAttachmentWrite);
+    }
+
+    // The multisampled depth is resolved by the last pass
+    bool msaa = resolve && fb.depthAttachment.image().info.samples != vk::SampleCountFlagBits::e1;
 
     if (msaa) {
         depth_copy.image().barrier(cmd_buf, ImageResourceAccess::MultisampleResolve);
     }
 
+    vk::AttachmentLoadOp load_op = first_pass ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad;
     auto render_info = fb.renderingInfo({
-        .enableColorAttachments = false,
+        .enableColorAttachments = mVelocity,
         .enableDepthAttachment = true,
         .enableStencilAttachment = false,
-        .depthLoadOp = vk::AttachmentLoadOp::eClear,
+        .colorLoadOps = {load_op},
+        .colorStoreOps = {vk::AttachmentStoreOp::eStore},
+        .depthLoadOp = load_op,
         .depthStoreOp = vk::AttachmentStoreOp::eStore,
         .depthResolve = {
             .mode = msaa ? vk::ResolveModeFlagBits::eMax : vk::ResolveModeFlagBits::eNone,
             .view = msaa ? static_cast<vk::ImageView>(depth_copy.view()) : VK_NULL_HANDLE,
             .layout = ImageResourceAccess::MultisampleResolve.layout,
         },
+        .clearColors = {vk::ClearColorValue{VelocityNone, VelocityNone, 0.0f, 0.0f}},
     });
     cmd_buf.beginRendering(render_info);
 
@@ -79,7 +163,22 @@ void DepthPrePassRenderer::execute(
 
     cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, *mPipeline.pipeline);
 
-    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *mPipeline.layout, 0, {gpu_data.sceneDescriptor}, {});
+    if (mVelocity) {
+        VelocityUniformBlock uniform_block = {.previousViewProjection = previous_view_projection};
+        auto descriptor_set = desc_alloc.allocate(mVelocityDescriptorLayout);
+        device.updateDescriptorSets(
+                descriptor_set.write(
+                        VelocityDescriptorLayout::VelocityUniforms,
+                        {.dataSize = sizeof(uniform_block), .pData = &uniform_block}
+                ),
+                {}
+        );
+        cmd_buf.bindDescriptorSets(
+                vk::PipelineBindPoint::eGraphics, *mPipeline.layout, 0, {gpu_data.sceneDescriptor, descriptor_set}, {}
+        );
+    } else {
+        cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *mPipeline.layout, 0, {gpu_data.sceneDescriptor}, {});
+    }
 
     cmd_buf.bindIndexBuffer(*gpu_data.indices, 0, vk::IndexType::eUint32);
     cmd_buf.bindVertexBuffers(0, {*gpu_data.positions}, {0});
@@ -87,36 +186,17 @@ void DepthPrePassRenderer::execute(
     ShaderPushConstants push_constants = {.view = camera.viewMatrix(), .projection = camera.projectionMatrix()};
     cmd_buf.pushConstants(*mPipeline.layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(push_constants), &push_constants);
 
-    if (enableCulling) {
-        cmd_buf.drawIndexedIndirectCount(
-                culled_commands, 0, culled_commands, culled_commands.size - 32, gpu_data.drawCommandCount,
-                sizeof(vk::DrawIndexedIndirectCommand)
-        );
-    } else {
-        cmd_buf.drawIndexedIndirect(
-                *gpu_data.drawCommands, 0, gpu_data.drawCommandCount, sizeof(vk::DrawIndexedIndirectCommand)
-        );
-    }
+    FrustumCuller::CulledDrawCommands::draw(cmd_buf, gpu_data, culled_commands);
     cmd_buf.endRendering();
-
-    // Simply copy if msaa is disabled
-    if (!msaa) {
-        fb.depthAttachment.image().barrier(cmd_buf, ImageResourceAccess::TransferRead);
-        depth_copy.image().barrier(cmd_buf, ImageResourceAccess::TransferWrite);
-        cmd_buf.copyImage(
-                fb.depthAttachment.image(), ImageResourceAccess::TransferRead.layout,
-                depth_copy.image(), ImageResourceAccess::TransferWrite.layout,
-                vk::ImageCopy{
-                    .srcSubresource = {.aspectMask = vk::ImageAspectFlagBits::eDepth, .layerCount = 1},
-                    .dstSubresource = {.aspectMask = vk::ImageAspectFlagBits::eDepth, .layerCount = 1},
-                    .extent = {.width = fb.extent().width, .height = fb.extent().height, .depth = 1}
-                }
-        );
-    }
 }
 
 void DepthPrePassRenderer::createPipeline(const vk::Device &device, const ShaderLoader &shader_loader, const Framebuffer &fb) {
-    auto vert_sh = shader_loader.loadFromSource(device, "resources/shaders/depth_prepass.vert");
+    mVelocity = !fb.colorAttachments.empty();
+
+    std::vector<std::string> macros;
+    if (mVelocity)
+        macros.emplace_back("VELOCITY");
+    auto vert_sh = shader_loader.loadFromSource(device, "resources/shaders/depth_prepass.vert", macros);
 
     auto scene_descriptor_layout = scene::SceneDescriptorLayout(device);
     GraphicsPipelineConfig pipeline_config = {
@@ -125,16 +205,21 @@ void DepthPrePassRenderer::createPipeline(const vk::Device &device, const Shader
                     .bindings = {{.binding = 0, .stride = sizeof(glm::vec3), .inputRate = vk::VertexInputRate::eVertex}},
                     .attributes = {{.location = 0, .binding = 0, .format = vk::Format::eR32G32B32Sfloat, .offset = 0}},
                 },
-        .descriptorSetLayouts = {scene_descriptor_layout},
+        .descriptorSetLayouts = {scene_descriptor_layout, mVelocityDescriptorLayout},
         .pushConstants = {{.stageFlags = vk::ShaderStageFlagBits::eVertex, .offset = 0, .size = sizeof(ShaderPushConstants)}},
         .attachments =
                 {
-                    .colorFormats = {},
+                    .colorFormats = fb.colorFormats(),
                     .depthFormat = fb.depthFormat(),
                 },
     };
     pipeline_config.rasterizer.samples = fb.depthAttachment.image().info.samples;
 
-    mPipeline = createGraphicsPipeline(device, pipeline_config, {*vert_sh});
+    if (mVelocity) {
+        auto frag_sh = shader_loader.loadFromSource(device, "resources/shaders/depth_prepass.frag");
+        mPipeline = createGraphicsPipeline(device, pipeline_config, {*vert_sh, *frag_sh});
+    } else {
+        mPipeline = createGraphicsPipeline(device, pipeline_config, {*vert_sh});
+    }
     util::setDebugName(device, *mPipeline.pipeline, "depth_prepass");
 }
@@ -3,12 +3,14 @@
 #include <optional>
 
 #include "../backend/Buffer.h"
+#include "../backend/Descriptors.h"
 #include "../backend/Pipeline.h"
 #include "FrustumCuller.h"
 
 
 struct ImageViewPairBase;
 class Camera;
+class DepthPyramid;
 class Framebuffer;
 class ShaderLoader;
 namespace scene {
@@ -22,15 +24,48 @@ public:
         glm::mat4 projection;
     };
 
+    struct alignas(16) VelocityUniformBlock {
+        glm::mat4 previousViewProjection;
+    };
+
+    struct VelocityDescriptorLayout : DescriptorSetLayout {
+        static constexpr InlineUniformBlockBinding VelocityUniforms{
+            0, vk::ShaderStageFlagBits::eVertex, sizeof(VelocityUniformBlock)
+        };
+
+        VelocityDescriptorLayout() = default;
+
+        explicit VelocityDescriptorLayout(const vk::Device &device) {
+            create(device, {}, VelocityUniforms);
+            util::setDebugName(device, vk::DescriptorSetLayout(*this), "depth_prepass_velocity_descriptor_layout");
+        }
+    };
+
+    // Written where no geometry was rendered, the sky and blobs reproject the depth instead
+    static constexpr float VelocityNone = 1000.0f;
+
     bool pauseCulling = false;
     bool enableCulling = true;
+    // Only used together with frustum culling and if a depth pyramid is passed to execute
+    bool enableOcclusionCulling = true;
 
     ~DepthPrePassRenderer();
-    DepthPrePassRenderer();
+    explicit DepthPrePassRenderer(const vk::Device &device);
 
+    /// <summary>
+    /// If the framebuffer has a color attachment, the prepass also writes screen space velocities to it.
+    /// </summary>
     void recreate(const vk::Device &device, const ShaderLoader &shader_loader, const Framebuffer &fb);
 
-    void execute(
+    /// <summary>
+    /// Renders the depth of the scene. Velocities are relative to the previous view projection,
+    /// which has to be jittered like the camera for the jitter to cancel out.
+    /// With occlusion culling, the sections visible in the pyramid of the previous frame are rendered first.
+    /// The pyramid is then rebuilt from that depth, and the sections it no longer occludes are rendered in a second pass.
+    /// The culling statistics are copied into `stats` if given, see FrustumCuller::Stats.
+    /// </summary>
+    /// <returns>The culled draw commands, for other passes rendering the camera's view.</returns>
+    FrustumCuller::CulledDrawCommands execute(
             const vk::Device &device,
             const DescriptorAllocator &desc_alloc,
             const TransientBufferAllocator &buf_alloc,
@@ -38,13 +73,32 @@ public:
             const Framebuffer &fb,
             const ImageViewPairBase& depth_copy,
             const Camera &camera,
+            const glm::mat4 &previous_view_projection,
             const scene::GpuData &gpu_data,
-            const FrustumCuller &frustum_culler
+            const FrustumCuller &frustum_culler,
+            DepthPyramid *depth_pyramid = nullptr,
+            const BufferBase *stats = nullptr
     );
 
 private:
+    void draw(
+            const vk::Device &device,
+            const DescriptorAllocator &desc_alloc,
+            const vk::CommandBuffer &cmd_buf,
+            const Framebuffer &fb,
+            const ImageViewPairBase &depth_copy,
+            const Camera &camera,
+            const glm::mat4 &previous_view_projection,
+            const scene::GpuData &gpu_data,
+            const UnmanagedBuffer *culled_commands,
+            bool first_pass,
+            bool resolve
+    );
+
     void createPipeline(const vk::Device &device, const ShaderLoader &shader_loader, const Framebuffer &fb);
 
+    VelocityDescriptorLayout mVelocityDescriptorLayout;
     ConfiguredGraphicsPipeline mPipeline;
+    bool mVelocity = false;
     std::optional<glm::mat4> mCapturedFrustum;
 };
\ No newline at end of file
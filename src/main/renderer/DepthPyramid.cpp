@@ -0,0 +1,154 @@
+#include "DepthPyramid.h"
+
+#include <algorithm>
+#include <bit>
+#include <string>
+
+#include "../backend/DeletionQueue.h"
+#include "../backend/ShaderCompiler.h"
+#include "../util/math.h"
+
+DepthPyramid::~DepthPyramid() = default;
+
+DepthPyramid::DepthPyramid(const vk::Device &device) {
+    mShaderParamsDescriptorLayout = ShaderParamsDescriptorLayout(device);
+    mSampler = device.createSamplerUnique({
+        .magFilter = vk::Filter::eNearest,
+        .minFilter = vk::Filter::eNearest,
+        .mipmapMode = vk::SamplerMipmapMode::eNearest,
+        .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+        .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+        .maxLod = vk::LodClampNone,
+    });
+}
+
+void DepthPyramid::recreate(const vk::Device &device, const ShaderLoader &shader_loader, vk::SampleCountFlagBits depth_samples) {
+    createPipeline(device, shader_loader, depth_samples);
+}
+
+void DepthPyramid::createPipeline(
+        const vk::Device &device, const ShaderLoader &shader_loader, vk::SampleCountFlagBits depth_samples
+) {
+    ComputePipelineConfig pipeline_config = {
+        .flags = perFrameDescriptorPipelineFlags(),
+        .descriptorSetLayouts = {mShaderParamsDescriptorLayout},
+        .pushConstants = {vk::PushConstantRange{
+            .stageFlags = vk::ShaderStageFlagBits::eCompute, .offset = 0, .size = sizeof(PushConstants)
+        }}
+    };
+
+    auto comp_sh = shader_loader.loadFromSource(device, "resources/shaders/depth_pyramid.comp");
+    mPipeline = createComputePipeline(device, pipeline_config, *comp_sh);
+    util::setDebugName(device, *mPipeline.pipeline, "depth_pyramid");
+
+    // The first level reads all samples of a multisampled depth buffer
+    if (depth_samples != vk::SampleCountFlagBits::e1) {
+        std::vector<std::string> macros = {"MULTISAMPLE"};
+        auto ms_comp_sh = shader_loader.loadFromSource(device, "resources/shaders/depth_pyramid.comp", macros);
+        mMultisamplePipeline = createComputePipeline(device, pipeline_config, *ms_comp_sh);
+        util::setDebugName(device, *mMultisamplePipeline.pipeline, "depth_pyramid_multisample");
+    } else {
+        mMultisamplePipeline = {};
+    }
+}
+
+void DepthPyramid::resize(
+        const vk::Device &device, const vma::Allocator &allocator, vk::Extent2D depth_extent, DeletionQueue &deletion_queue
+) {
+    vk::Extent2D extent = {util::nextLowestPowerOfTwo(depth_extent.width), util::nextLowestPowerOfTwo(depth_extent.height)};
+    auto levels = static_cast<uint32_t>(std::bit_width(std::max(extent.width, extent.height)));
+
+    deletion_queue.release(std::move(mImage));
+    deletion_queue.release(std::move(mView.view));
+    for (auto &view: mLevelViews)
+        deletion_queue.release(std::move(view.view));
+
+    mImage = Image::create(
+            allocator,
+            {
+                .format = vk::Format::eR32Sfloat,
+                .aspects = vk::ImageAspectFlagBits::eColor,
+                .width = extent.width,
+                .height = extent.height,
+                .levels = levels,
+                .usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+                .device = vma::MemoryUsage::eGpuOnly,
+            }
+    );
+    util::setDebugName(device, *mImage.image, "depth_pyramid");
+
+    mView = ImageView::create(device, mImage);
+    util::setDebugName(device, *mView.view, "depth_pyramid_view");
+
+    mLevelViews.resize(levels);
+    for (uint32_t i = 0; i < levels; i++) {
+        mLevelViews[i] = ImageView::create(
+                device, mImage,
+                ImageViewInfo{
+                    .format = vk::Format::eR32Sfloat,
+                    .width = std::max(extent.width >> i, 1u),
+                    .height = std::max(extent.height >> i, 1u),
+                    .resourceRange = {.aspectMask = vk::ImageAspectFlagBits::eColor, .baseMipLevel = i, .levelCount = 1, .layerCount = 1}
+                }
+        );
+        util::setDebugName(device, *mLevelViews[i].view, "depth_pyramid_view[" + std::to_string(i) + "]");
+    }
+
+    mValid = false;
+}
+
+void DepthPyramid::execute(
+        const vk::Device &device,
+        const DescriptorAllocator &allocator,
+        const vk::CommandBuffer &cmd_buf,
+        const ImageViewPairBase &depth,
+        const glm::mat4 &view_projection
+) {
+    depth.image().barrier(cmd_buf, ImageResourceAccess::ComputeShaderReadOptimal);
+    mImage.barrier(cmd_buf, ImageResourceAccess::ComputeShaderReadWriteGeneral);
+
+    bool multisample = depth.image().info.samples != vk::SampleCountFlagBits::e1;
+    vk::Extent2D in_extent = {depth.view().info.width, depth.view().info.height};
+    for (uint32_t i = 0; i < mLevelViews.size(); i++) {
+        const auto &pipeline = i == 0 && multisample ? mMultisamplePipeline : mPipeline;
+        cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline.pipeline);
+
+        vk::DescriptorImageInfo in_info = {.sampler = *mSampler, .imageView = depth.view(), .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal};
+        if (i > 0) {
+            in_info = {.sampler = *mSampler, .imageView = mLevelViews[i - 1], .imageLayout = vk::ImageLayout::eGeneral};
+        }
+        auto descriptor_set = allocator.allocateCached(
+                mShaderParamsDescriptorLayout,
+                {
+                    DescriptorSet().write(ShaderParamsDescriptorLayout::InDepth, in_info),
+                    DescriptorSet().write(
+                            ShaderParamsDescriptorLayout::OutDepth,
+                            vk::DescriptorImageInfo{.imageView = mLevelViews[i], .imageLayout = vk::ImageLayout::eGeneral}
+                    ),
+                }
+        );
+        allocator.bind(cmd_buf, vk::PipelineBindPoint::eCompute, *pipeline.layout, 0, descriptor_set);
+
+        vk::Extent2D out_extent = {mLevelViews[i].info.width, mLevelViews[i].info.height};
+        PushConstants push_constants = {
+            .inSize = {in_extent.width, in_extent.height},
+            .outSize = {out_extent.width, out_extent.height},
+        };
+        cmd_buf.pushConstants(*pipeline.layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(push_constants), &push_constants);
+        cmd_buf.dispatch(util::divCeil(out_extent.width, 8u), util::divCeil(out_extent.height, 8u), 1);
+
+        // Each level reads the previous one
+        vk::MemoryBarrier2 level_barrier = {
+            .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+            .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+            .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+            .dstAccessMask = vk::AccessFlagBits2::eShaderRead,
+        };
+        cmd_buf.pipelineBarrier2(vk::DependencyInfo().setMemoryBarriers(level_barrier));
+        in_extent = out_extent;
+    }
+
+    mImage.barrier(cmd_buf, ImageResourceAccess::ComputeShaderReadGeneral);
+    mViewProjection = view_projection;
+    mValid = true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "../backend/Descriptors.h"
+#include "../backend/Image.h"
+#include "../backend/Pipeline.h"
+#include "../debug/Annotation.h"
+
+
+class DeletionQueue;
+class ShaderLoader;
+namespace vma {
+    class Allocator;
+}
+
+/// <summary>
+/// Hierarchical depth buffer for occlusion culling. Every texel holds the farthest depth of the texels it covers,
+/// which is the minimum with reverse z. Level 0 is the largest power of two that fits into the depth buffer.
+/// </summary>
+class DepthPyramid {
+public:
+    struct ShaderParamsDescriptorLayout : DescriptorSetLayout {
+        static constexpr CombinedImageSamplerBinding InDepth{0, vk::ShaderStageFlagBits::eCompute};
+        static constexpr StorageImageBinding OutDepth{1, vk::ShaderStageFlagBits::eCompute};
+
+        ShaderParamsDescriptorLayout() = default;
+
+        explicit ShaderParamsDescriptorLayout(const vk::Device &device) {
+            create(device, perFrameDescriptorSetLayoutFlags(), InDepth, OutDepth);
+            util::setDebugName(device, vk::DescriptorSetLayout(*this), "depth_pyramid_descriptor_layout");
+        }
+    };
+
+    struct PushConstants {
+        glm::uvec2 inSize;
+        glm::uvec2 outSize;
+    };
+
+    ~DepthPyramid();
+    explicit DepthPyramid(const vk::Device &device);
+
+    /// <summary>Creates the pipelines for depth buffers with the given sample count.</summary>
+    void recreate(const vk::Device &device, const ShaderLoader &shader_loader, vk::SampleCountFlagBits depth_samples);
+
+    /// <summary>
+    /// Allocates the pyramid for a depth buffer of the given extent. The old pyramid is released to the queue
+    /// and the pyramid is invalid until it is built again.
+    /// </summary>
+    void resize(const vk::Device &device, const vma::Allocator &allocator, vk::Extent2D depth_extent, DeletionQueue &deletion_queue);
+
+    /// <summary>Builds the pyramid from the depth buffer, which was rendered with the view projection.</summary>
+    void execute(
+            const vk::Device &device,
+            const DescriptorAllocator &descriptor_allocator,
+            const vk::CommandBuffer &cmd_buf,
+            const ImageViewPairBase &depth,
+            const glm::mat4 &view_projection
+    );
+
+    /// <summary>Whether the pyramid holds depth since the last resize.</summary>
+    [[nodiscard]] bool valid() const { return mValid; }
+    [[nodiscard]] const glm::mat4 &viewProjection() const { return mViewProjection; }
+    [[nodiscard]] const Image &image() const { return mImage; }
+    /// <summary>A view of all levels.</summary>
+    [[nodiscard]] const ImageView &view() const { return mView; }
+    [[nodiscard]] vk::Sampler sampler() const { return *mSampler; }
+    [[nodiscard]] uint32_t levels() const { return static_cast<uint32_t>(mLevelViews.size()); }
+
+private:
+    void createPipeline(const vk::Device &device, const ShaderLoader &shader_loader, vk::SampleCountFlagBits depth_samples);
+
+    ShaderParamsDescriptorLayout mShaderParamsDescriptorLayout;
+    ConfiguredComputePipeline mPipeline;
+    ConfiguredComputePipeline mMultisamplePipeline;
+    vk::UniqueSampler mSampler;
+
+    Image mImage;
+    ImageView mView;
+    std::vector<ImageView> mLevelViews;
+    glm::mat4 mViewProjection = glm::mat4(1.0f);
+    bool mValid = false;
+};
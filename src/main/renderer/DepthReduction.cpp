@@ -0,0 +1,95 @@
+#include "DepthReduction.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "../backend/ShaderCompiler.h"
+#include "../util/globals.h"
+#include "../util/math.h"
+
+DepthReduction::~DepthReduction() = default;
+
+DepthReduction::DepthReduction(const vk::Device &device) {
+    mShaderParamsDescriptorLayout = ShaderParamsDescriptorLayout(device);
+    mSampler = device.createSamplerUnique({
+        .magFilter = vk::Filter::eNearest,
+        .minFilter = vk::Filter::eNearest,
+        .mipmapMode = vk::SamplerMipmapMode::eNearest,
+        .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+        .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+        .maxLod = vk::LodClampNone,
+    });
+}
+
+void DepthReduction::recreate(const vk::Device &device, const ShaderLoader &shader_loader) {
+    createPipeline(device, shader_loader);
+}
+
+void DepthReduction::createPipeline(const vk::Device &device, const ShaderLoader &shader_loader) {
+    ComputePipelineConfig pipeline_config = {
+        .descriptorSetLayouts = {mShaderParamsDescriptorLayout},
+        .pushConstants = {vk::PushConstantRange{
+            .stageFlags = vk::ShaderStageFlagBits::eCompute, .offset = 0, .size = sizeof(PushConstants)
+        }}
+    };
+
+    std::vector<std::string> macros;
+    if (globals::SubgroupArithmetic)
+        macros.emplace_back("SUBGROUP_ARITHMETIC");
+    auto comp_sh = shader_loader.loadFromSource(device, "resources/shaders/depth_reduce.comp", macros);
+    mPipeline = createComputePipeline(device, pipeline_config, *comp_sh);
+    util::setDebugName(device, *mPipeline.pipeline, "depth_reduction");
+}
+
+void DepthReduction::execute(
+        const vk::Device &device,
+        const DescriptorAllocator &descriptor_allocator,
+        const TransientBufferAllocator &buf_alloc,
+        const vk::CommandBuffer &cmd_buf,
+        const ImageViewPairBase &depth,
+        float near_plane,
+        const BufferBase &dst
+) {
+    // The atomics of all workgroups stay in device memory, only the result is copied to the destination
+    auto range = buf_alloc.allocate(
+            sizeof(Result), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst |
+                                    vk::BufferUsageFlagBits::eTransferSrc
+    );
+    range.barrier(cmd_buf, BufferResourceAccess::TransferWrite);
+    cmd_buf.fillBuffer(range, range.offset + offsetof(Result, minViewDepth), sizeof(float), 0xffffffffu);
+    cmd_buf.fillBuffer(range, range.offset + offsetof(Result, maxViewDepth), sizeof(float), 0);
+    range.barrier(cmd_buf, BufferResourceAccess::ComputeShaderStorageReadWrite);
+
+    depth.image().barrier(cmd_buf, ImageResourceAccess::ComputeShaderReadOptimal);
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, *mPipeline.pipeline);
+
+    DescriptorSet descriptor_set = descriptor_allocator.allocate(mShaderParamsDescriptorLayout);
+    device.updateDescriptorSets(
+            {descriptor_set.write(
+                     ShaderParamsDescriptorLayout::InDepth,
+                     vk::DescriptorImageInfo{
+                         .sampler = *mSampler,
+                         .imageView = depth.view(),
+                         .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+                     }
+             ),
+             descriptor_set.write(ShaderParamsDescriptorLayout::OutDepthRange, range.descriptorInfo())},
+            {}
+    );
+    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *mPipeline.layout, 0, {descriptor_set}, {});
+
+    vk::Extent2D extent = {depth.view().info.width, depth.view().info.height};
+    PushConstants push_constants = {
+        .size = {extent.width, extent.height},
+        .zNear = near_plane,
+    };
+    cmd_buf.pushConstants(*mPipeline.layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(push_constants), &push_constants);
+    // A workgroup of 16x16 invocations covers 32x32 texels
+    cmd_buf.dispatch(util::divCeil(extent.width, 32u), util::divCeil(extent.height, 32u), 1);
+
+    range.barrier(cmd_buf, BufferResourceAccess::TransferRead);
+    dst.barrier(cmd_buf, BufferResourceAccess::TransferWrite);
+    cmd_buf.copyBuffer(range, dst, vk::BufferCopy{.srcOffset = range.offset, .dstOffset = 0, .size = sizeof(Result)});
+}
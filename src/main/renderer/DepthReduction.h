@@ -0,0 +1,70 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include "../backend/Buffer.h"
+#include "../backend/Descriptors.h"
+#include "../backend/Image.h"
+#include "../backend/Pipeline.h"
+
+
+class ShaderLoader;
+
+/// <summary>
+/// Reduces a depth buffer to the nearest and farthest view depth of the geometry it covers.
+/// The sky, which is cleared to the far plane at infinity, is ignored.
+/// The result is small enough to be read back every frame, which lets the shadow cascades fit the visible range.
+/// </summary>
+class DepthReduction {
+public:
+    struct ShaderParamsDescriptorLayout : DescriptorSetLayout {
+        static constexpr CombinedImageSamplerBinding InDepth{0, vk::ShaderStageFlagBits::eCompute};
+        static constexpr StorageBufferBinding OutDepthRange{1, vk::ShaderStageFlagBits::eCompute};
+
+        ShaderParamsDescriptorLayout() = default;
+
+        explicit ShaderParamsDescriptorLayout(const vk::Device &device) {
+            create(device, {}, InDepth, OutDepthRange);
+            util::setDebugName(device, vk::DescriptorSetLayout(*this), "depth_reduction_descriptor_layout");
+        }
+    };
+
+    struct PushConstants {
+        glm::uvec2 size;
+        float zNear;
+    };
+
+    /// <summary>
+    /// Minimum and maximum view depth, as written to the destination buffer.
+    /// If nothing but sky was visible, the minimum is NaN and the maximum is 0.
+    /// </summary>
+    struct Result {
+        float minViewDepth;
+        float maxViewDepth;
+    };
+
+    ~DepthReduction();
+    explicit DepthReduction(const vk::Device &device);
+
+    void recreate(const vk::Device &device, const ShaderLoader &shader_loader);
+
+    /// <summary>
+    /// Reduces the single-sampled depth buffer, which was rendered with a reverse z projection with the near plane,
+    /// and copies the Result into `dst`, which needs transfer destination usage.
+    /// </summary>
+    void execute(
+            const vk::Device &device,
+            const DescriptorAllocator &descriptor_allocator,
+            const TransientBufferAllocator &buf_alloc,
+            const vk::CommandBuffer &cmd_buf,
+            const ImageViewPairBase &depth,
+            float near_plane,
+            const BufferBase &dst
+    );
+
+private:
+    void createPipeline(const vk::Device &device, const ShaderLoader &shader_loader);
+
+    ShaderParamsDescriptorLayout mShaderParamsDescriptorLayout;
+    ConfiguredComputePipeline mPipeline;
+    vk::UniqueSampler mSampler;
+};
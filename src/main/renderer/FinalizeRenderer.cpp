@@ -14,6 +14,8 @@ FinalizeRenderer::FinalizeRenderer(const vk::Device &device) {
     mSampler = device.createSamplerUnique({
         .magFilter = vk::Filter::eLinear,
         .minFilter = vk::Filter::eLinear,
+        .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+        .addressModeV = vk::SamplerAddressMode::eClampToEdge,
     });
 }
 
@@ -21,6 +23,7 @@ void FinalizeRenderer::createPipeline(const vk::Device &device, const ShaderLoad
     auto comp_sh = shader_loader.loadFromSource(device, "resources/shaders/finalize.comp");
 
     ComputePipelineConfig pipeline_config = {
+        .flags = perFrameDescriptorPipelineFlags(),
         .descriptorSetLayouts = {mShaderParamsDescriptorLayout},
         .pushConstants = {vk::PushConstantRange{
             .stageFlags = vk::ShaderStageFlagBits::eCompute, .offset = 0, .size = sizeof(PushConstants)
@@ -38,37 +41,39 @@ void FinalizeRenderer::execute(
         const ImageViewPairBase &hdr_attachment,
         const ImageViewPairBase &sdr_attachment,
         const ImageViewBase &bloom_image_view,
-        const Settings::AgXParams &agx_params
+        const Settings::AgXParams &agx_params,
+        float sharpness
 ) {
     hdr_attachment.image().barrier(cmd_buf, ImageResourceAccess::ComputeShaderReadOptimal);
     sdr_attachment.image().barrier(cmd_buf, ImageResourceAccess::ComputeShaderWriteGeneral);
 
-    auto descriptor_set = allocator.allocate(mShaderParamsDescriptorLayout);
-    device.updateDescriptorSets(
+    // One set per swapchain image, reused across frames
+    auto descriptor_set = allocator.allocateCached(
+            mShaderParamsDescriptorLayout,
             {
-                descriptor_set.write(
+                DescriptorSet().write(
                         ShaderParamsDescriptorLayout::InColor,
                         vk::DescriptorImageInfo{
                             .sampler = *mSampler, .imageView = hdr_attachment.view(), .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
                         }
                 ),
-                descriptor_set.write(
+                DescriptorSet().write(
                         ShaderParamsDescriptorLayout::OutColor,
                         vk::DescriptorImageInfo{.imageView = sdr_attachment.view(), .imageLayout = vk::ImageLayout::eGeneral}
                 ),
-                descriptor_set.write(
+                DescriptorSet().write(
                         ShaderParamsDescriptorLayout::InBloom,
                         vk::DescriptorImageInfo{
                             .sampler = *mSampler, .imageView = bloom_image_view, .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
                         }
                 ),
-            },
-            {}
+            }
     );
-    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *mPipeline.layout, 0, {descriptor_set}, {});
+    allocator.bind(cmd_buf, vk::PipelineBindPoint::eCompute, *mPipeline.layout, 0, descriptor_set);
 
     PushConstants push_constants = {
         .agx = agx_params,
+        .sharpness = sharpness,
     };
 
     cmd_buf.pushConstants(*mPipeline.layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(push_constants), &push_constants);
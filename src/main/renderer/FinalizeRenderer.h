@@ -23,7 +23,7 @@ public:
         ShaderParamsDescriptorLayout() = default;
 
         explicit ShaderParamsDescriptorLayout(const vk::Device &device) {
-            create(device, {}, InColor, OutColor, InBloom);
+            create(device, perFrameDescriptorSetLayoutFlags(), InColor, OutColor, InBloom);
             util::setDebugName(device, vk::DescriptorSetLayout(*this), "finalize_renderer_descriptor_layout");
         }
     };
@@ -31,6 +31,7 @@ public:
     struct PushConstants {
         alignas(16) Settings::AgXParams agx;
         alignas(16) glm::vec4 fogColor;
+        float sharpness;
     };
 
     ~FinalizeRenderer();
@@ -40,6 +41,10 @@ public:
         createPipeline(device, shader_loader);
     }
 
+    /// <summary>
+    /// Tonemaps the HDR image into the SDR image. If the HDR image is smaller, because of dynamic resolution,
+    /// it is upscaled with a contrast adaptive sharpening filter of the given strength in [0, 1].
+    /// </summary>
     void execute(
             const vk::Device &device,
             const DescriptorAllocator &descriptor_allocator,
@@ -47,7 +52,8 @@ public:
             const ImageViewPairBase &hdr_attachment,
             const ImageViewPairBase &sdr_attachment,
             const ImageViewBase &bloom_image_view,
-            const Settings::AgXParams &agx_params
+            const Settings::AgXParams &agx_params,
+            float sharpness
     );
 
 private:
@@ -1,5 +1,6 @@
 #include "FogRenderer.h"
 
+#include "../backend/BarrierBatch.h"
 #include "../backend/Buffer.h"
 #include "../backend/Framebuffer.h"
 #include "../backend/Image.h"
@@ -41,7 +42,7 @@ void FogRenderer::recreate(
 ) {
     createPipeline(device, shader_loader);
 
-    mResultImage = std::make_unique<ImageWithView>(std::move(ImageWithView::create(
+    mResultImage = std::make_unique<ResizableImage>(ResizableImage::create(
             device, alloc,
             {
                 .format = vk::Format::eR16G16B16A16Sfloat,
@@ -50,10 +51,15 @@ void FogRenderer::recreate(
                 .height = result_extent.height,
                 .usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
                 .device = vma::MemoryUsage::eGpuOnly,
-            }
-    )));
-    util::setDebugName(device, *mResultImage->image, "fog_result_image");
-    util::setDebugName(device, *mResultImage->view, "fog_result_image_view");
+            },
+            "fog_result"
+    ));
+}
+
+void FogRenderer::resize(
+        const vk::Device &device, const vma::Allocator &alloc, vk::Extent2D result_extent, DeletionQueue &deletion_queue
+) {
+    mResultImage->resize(device, alloc, result_extent, deletion_queue);
 }
 
 void FogRenderer::createPipeline(const vk::Device &device, const ShaderLoader &shader_loader) {
@@ -75,6 +81,7 @@ void FogRenderer::createPipeline(const vk::Device &device, const ShaderLoader &s
         auto comp_sh = shader_loader.loadFromSource(device, "resources/shaders/fog_filter.comp");
 
         ComputePipelineConfig pipeline_config = {
+            .flags = perFrameDescriptorPipelineFlags(),
             .descriptorSetLayouts = {mFilterShaderParamsDescriptorLayout},
             .pushConstants = {vk::PushConstantRange{
                 .stageFlags = vk::ShaderStageFlagBits::eCompute, .offset = 0, .size = sizeof(FilterPushConstants)
@@ -89,14 +96,14 @@ void FogRenderer::createPipeline(const vk::Device &device, const ShaderLoader &s
 void FogRenderer::execute(
         const vk::Device &device,
         const DescriptorAllocator &descriptor_allocator,
-        const TransientBufferAllocator &buffer_allocator,
+        const UploadHeap &upload_heap,
         const vk::CommandBuffer &cmd_buf,
         const ImageViewPairBase &depth_attachment,
         const ImageViewPairBase &hdr_result_image,
         const DirectionalLight &sun_light,
         const glm::vec3 &ambient_light,
         const glm::vec3 &fog_color,
-        std::span<const CascadedShadowCaster> sun_shadow_cascades,
+        const ShadowCascade &sun_shadow_cascade,
         const glm::mat4 &view_mat,
         const glm::mat4 &projection_mat,
         float z_near,
@@ -110,10 +117,14 @@ void FogRenderer::execute(
 
     util::ScopedCommandLabel dbg_cmd_label_region(cmd_buf, "Setup");
 
-    depth_attachment.image().barrier(cmd_buf, ImageResourceAccess::ComputeShaderReadOptimal);
-    mResultImage->barrier(cmd_buf, ImageResourceAccess::ComputeShaderWriteGeneral);
-    // light_buffer.barrier(cmd_buf, BufferResourceAccess::ComputeShaderRead);
-    cluster_buffer.barrier(cmd_buf, BufferResourceAccess::ComputeShaderRead);
+    // All sampling inputs, including the shadow cascades below, are transitioned in one batch
+    BarrierBatch barriers(cmd_buf);
+    barriers.add(depth_attachment.image(), ImageResourceAccess::ComputeShaderReadOptimal);
+    barriers.add(*mResultImage, ImageResourceAccess::ComputeShaderWriteGeneral);
+    // barriers.add(light_buffer, BufferResourceAccess::ComputeShaderRead);
+    barriers.add(cluster_buffer, BufferResourceAccess::ComputeShaderRead);
+    sun_shadow_cascade.barrier(barriers, ImageResourceAccess::ComputeShaderReadOptimal);
+    auto sun_shadow_cascades = sun_shadow_cascade.cascades();
 
     glm::mat4 inverse_view = glm::inverse(view_mat);
     glm::vec3 camera_pos_ws = inverse_view[3];
@@ -138,16 +149,8 @@ void FogRenderer::execute(
         };
     }
 
-    UnmanagedBuffer shadow_cascade_uniform_buffer = buffer_allocator.allocate(
-            sun_shadow_cascades.size_bytes(), vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst
-    );
-    util::setDebugName(device, shadow_cascade_uniform_buffer.buffer, "shadow_cascades_uniform_buffer");
-    shadow_cascade_uniform_buffer.barrier(cmd_buf, BufferResourceAccess::TransferWrite);
-    cmd_buf.updateBuffer(
-            shadow_cascade_uniform_buffer.buffer, 0, sizeof(shadow_cascade_uniform_blocks),
-            shadow_cascade_uniform_blocks.data()
-    );
-    shadow_cascade_uniform_buffer.barrier(cmd_buf, BufferResourceAccess::ComputeShaderUniformRead);
+    // Written by the host before submission, so no barrier is needed
+    UnmanagedBuffer shadow_cascade_uniform_buffer = upload_heap.write(shadow_cascade_uniform_blocks);
 
     auto sample_descriptor_set = descriptor_allocator.allocate(mSampleShaderParamsDescriptorLayout);
     device.updateDescriptorSets(
@@ -164,7 +167,7 @@ void FogRenderer::execute(
                 ),
                 sample_descriptor_set.write(
                         SampleShaderParamsDescriptorLayout::ShadowCascadeUniforms,
-                        {.buffer = shadow_cascade_uniform_buffer, .offset = 0, .range = vk::WholeSize}
+                        shadow_cascade_uniform_buffer.descriptorInfo()
                 ),
                 sample_descriptor_set.write(
                         SampleShaderParamsDescriptorLayout::UberLights,
@@ -179,9 +182,6 @@ void FogRenderer::execute(
     );
 
     for (uint32_t i = 0; i < sun_shadow_cascades.size(); i++) {
-        sun_shadow_cascades[i].framebuffer().depthAttachment.image().barrier(
-                cmd_buf, ImageResourceAccess::ComputeShaderReadOptimal
-        );
         device.updateDescriptorSets(
                 sample_descriptor_set.write(
                         SampleShaderParamsDescriptorLayout::SunShadowMap,
@@ -227,6 +227,7 @@ void FogRenderer::execute(
             projection_mat, static_cast<float>(width), static_cast<float>(height),
             sample_push_consts.inverseProjectionScale, sample_push_consts.inverseProjectionOffset
     );
+    barriers.flush();
 
     dbg_cmd_label_region.swap("Draw");
 
@@ -239,11 +240,13 @@ void FogRenderer::execute(
 
     dbg_cmd_label_region.swap("Filter");
 
-    mResultImage->barrier(cmd_buf, ImageResourceAccess::ComputeShaderReadOptimal);
-    hdr_result_image.image().barrier(cmd_buf, ImageResourceAccess::ComputeShaderReadWriteGeneral);
+    barriers.add(*mResultImage, ImageResourceAccess::ComputeShaderReadOptimal);
+    barriers.add(hdr_result_image.image(), ImageResourceAccess::ComputeShaderReadWriteGeneral);
+    barriers.flush();
 
     auto filter_descriptor_set = descriptor_allocator.allocate(mFilterShaderParamsDescriptorLayout);
-    device.updateDescriptorSets(
+    descriptor_allocator.update(
+            filter_descriptor_set,
             {
                 filter_descriptor_set.write(
                         FilterShaderParamsDescriptorLayout::InDepth,
@@ -259,15 +262,14 @@ void FogRenderer::execute(
                         FilterShaderParamsDescriptorLayout::OutColor,
                         vk::DescriptorImageInfo{.imageView = hdr_result_image, .imageLayout = vk::ImageLayout::eGeneral}
                 ),
-            },
-            {}
+            }
     );
     FilterPushConstants filter_push_constants = {
         .zNear = z_near,
         .sharpness = 10.0f,
     };
 
-    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *mFilterPipeline.layout, 0, {filter_descriptor_set}, {});
+    descriptor_allocator.bind(cmd_buf, vk::PipelineBindPoint::eCompute, *mFilterPipeline.layout, 0, filter_descriptor_set);
     cmd_buf.pushConstants(
             *mFilterPipeline.layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(filter_push_constants), &filter_push_constants
     );
@@ -8,10 +8,11 @@
 namespace vma {
     class Allocator;
 }
-struct ImageWithView;
 struct BufferBase;
-class TransientBufferAllocator;
-class CascadedShadowCaster;
+class DeletionQueue;
+struct ResizableImage;
+class UploadHeap;
+class ShadowCascade;
 struct ImageViewPairBase;
 class ShaderLoader;
 namespace vk {
@@ -47,7 +48,7 @@ public:
         FilterShaderParamsDescriptorLayout() = default;
 
         explicit FilterShaderParamsDescriptorLayout(const vk::Device &device) {
-            create(device, {}, InDepth, InSource, OutColor);
+            create(device, perFrameDescriptorSetLayoutFlags(), InDepth, InSource, OutColor);
             util::setDebugName(device, vk::DescriptorSetLayout(*this), "fog_filter_descriptor_layout");
         }
     };
@@ -94,19 +95,23 @@ public:
     ~FogRenderer();
     explicit FogRenderer(const vk::Device &device);
 
+    /// <summary>Creates the pipelines and allocates the result image for the maximum result extent.</summary>
     void recreate(const vk::Device &device, const ShaderLoader &shader_loader, const vma::Allocator& alloc, vk::Extent2D result_extent);
 
+    /// <summary>Changes the result extent for dynamic resolution, without allocating.</summary>
+    void resize(const vk::Device &device, const vma::Allocator &alloc, vk::Extent2D result_extent, DeletionQueue &deletion_queue);
+
     void execute(
             const vk::Device &device,
             const DescriptorAllocator &descriptor_allocator,
-            const TransientBufferAllocator &buffer_allocator,
+            const UploadHeap &upload_heap,
             const vk::CommandBuffer &cmd_buf,
             const ImageViewPairBase &depth_attachment,
             const ImageViewPairBase &hdr_result_image,
             const DirectionalLight &sun_light,
             const glm::vec3 &ambient_light,
             const glm::vec3 &fog_color,
-            std::span<const CascadedShadowCaster> sun_shadow_cascades,
+            const ShadowCascade &sun_shadow_cascade,
             const glm::mat4 &view_mat,
             const glm::mat4 &projection_mat,
             float z_near,
@@ -122,7 +127,7 @@ private:
             const glm::mat4 &projectionMatrix, float textureWidth, float textureHeight, glm::vec2 &viewScale, glm::vec2 &viewOffset
     );
 
-    std::unique_ptr<ImageWithView> mResultImage;
+    std::unique_ptr<ResizableImage> mResultImage;
 
     vk::UniqueSampler mDepthSampler;
     vk::UniqueSampler mShadowSampler;
@@ -1,15 +1,49 @@
 #include "FrustumCuller.h"
 
+#include <algorithm>
+
 #include "../backend/Buffer.h"
+#include "../util/Logger.h"
 #include "../backend/ShaderCompiler.h"
 #include "../debug/Annotation.h"
 #include "../scene/Scene.h"
 #include "../util/math.h"
+#include "DepthPyramid.h"
+
+namespace {
+    // Draw commands followed by the count at the end, aligned to 32 bytes
+    UnmanagedBuffer allocateCommandBuffer(
+            const TransientBufferAllocator &buf_alloc, const vk::CommandBuffer &cmd_buf, uint32_t draw_command_count
+    ) {
+        size_t draw_command_buffer_size = draw_command_count * sizeof(vk::DrawIndexedIndirectCommand);
+        size_t draw_command_buffer_final_size = util::alignOffset(draw_command_buffer_size, 32) + 32;
+        auto buffer = buf_alloc.allocate(
+                draw_command_buffer_final_size, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst |
+                                                        vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eIndirectBuffer
+        );
+        buffer.barrier(cmd_buf, BufferResourceAccess::IndirectCommandRead, BufferResourceAccess::TransferWrite);
+        // Count is placed at the end of the buffer
+        cmd_buf.fillBuffer(buffer, buffer.offset + draw_command_buffer_final_size - 32, sizeof(uint32_t), 0);
+        buffer.barrier(cmd_buf, BufferResourceAccess::ComputeShaderStorageReadWrite);
+        return buffer;
+    }
+
+    vk::DescriptorBufferInfo commandsInfo(const UnmanagedBuffer &buffer) {
+        return {.buffer = buffer, .offset = buffer.offset, .range = buffer.size - 32};
+    }
+
+    vk::DescriptorBufferInfo countInfo(const UnmanagedBuffer &buffer) {
+        return {.buffer = buffer, .offset = buffer.offset + buffer.size - 32, .range = sizeof(uint32_t)};
+    }
+}
 
 FrustumCuller::~FrustumCuller() = default;
 
 FrustumCuller::FrustumCuller(const vk::Device &device) {
     mShaderParamsDescriptorLayout = ShaderParamsDescriptorLayout(device);
+    mOcclusionDescriptorLayout = OcclusionDescriptorLayout(device);
+    mMultiViewDescriptorLayout = MultiViewDescriptorLayout(device);
+    mClusterDescriptorLayout = ClusterDescriptorLayout(device);
 }
 
 UnmanagedBuffer FrustumCuller::execute(
@@ -20,21 +54,17 @@ UnmanagedBuffer FrustumCuller::execute(
         const scene::GpuData &gpu_data,
         const glm::mat4 &view_projection_matrix,
         const glm::mat4 *exclude_frustum,
-        float min_world_radius
+        float min_world_radius,
+        const OcclusionCulling *occlusion
 ) const {
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, *mPipeline.pipeline);
+    // The second phase only tests the candidates of the first
+    bool clustered = hierarchical && gpu_data.clusterCount > 0 && !(occlusion && occlusion->candidates);
+    const auto &pipeline = clustered ? (occlusion ? mOcclusionClusterPipeline : mClusterPipeline)
+                                     : (occlusion ? mOcclusionPipeline : mPipeline);
 
     size_t draw_command_buffer_size = gpu_data.drawCommandCount * sizeof(vk::DrawIndexedIndirectCommand);
     size_t draw_command_buffer_final_size = util::alignOffset(draw_command_buffer_size, 32) + 32;
-    auto output_draw_command_buffer = buf_alloc.allocate(
-            draw_command_buffer_final_size, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst |
-                                                    vk::BufferUsageFlagBits::eIndirectBuffer
-    );
-    util::setDebugName(device, output_draw_command_buffer.buffer, "culled_draw_commands");
-    output_draw_command_buffer.barrier(cmd_buf, BufferResourceAccess::IndirectCommandRead, BufferResourceAccess::TransferWrite);
-    // Count is placed at the end of the buffer
-    cmd_buf.fillBuffer(output_draw_command_buffer, draw_command_buffer_final_size - 32, sizeof(uint32_t), 0);
-    output_draw_command_buffer.barrier(cmd_buf, BufferResourceAccess::ComputeShaderStorageReadWrite);
+    auto output_draw_command_buffer = allocateCommandBuffer(buf_alloc, cmd_buf, gpu_data.drawCommandCount);
 
     gpu_data.instances.barrier(cmd_buf, BufferResourceAccess::ComputeShaderStorageRead);
 
@@ -47,20 +77,30 @@ UnmanagedBuffer FrustumCuller::execute(
         shader_params.enableExcludePlanes = true;
     }
 
+    // The second phase reads the commands rejected by the first
+    vk::DescriptorBufferInfo input_info = {.buffer = *gpu_data.drawCommands, .offset = 0, .range = vk::WholeSize};
+    if (occlusion && occlusion->candidates) {
+        occlusion->candidates->barrier(cmd_buf, BufferResourceAccess::ComputeShaderStorageRead);
+        input_info = commandsInfo(*occlusion->candidates);
+    }
+
     DescriptorSet descriptor_set = desc_alloc.allocate(mShaderParamsDescriptorLayout);
     device.updateDescriptorSets(
-            {descriptor_set.write(
-                     ShaderParamsDescriptorLayout::InputDrawCommandBuffer,
-                     vk::DescriptorBufferInfo{.buffer = *gpu_data.drawCommands, .offset = 0, .range = vk::WholeSize}
-             ),
+            {descriptor_set.write(ShaderParamsDescriptorLayout::InputDrawCommandBuffer, input_info),
              descriptor_set.write(
                      ShaderParamsDescriptorLayout::OutputDrawCommandBuffer,
-                     vk::DescriptorBufferInfo{.buffer = output_draw_command_buffer, .offset = 0, .range = draw_command_buffer_size}
+                     vk::DescriptorBufferInfo{
+                         .buffer = output_draw_command_buffer,
+                         .offset = output_draw_command_buffer.offset,
+                         .range = draw_command_buffer_size
+                     }
              ),
              descriptor_set.write(
                      ShaderParamsDescriptorLayout::DrawCommandCountBuffer,
                      vk::DescriptorBufferInfo{
-                         .buffer = output_draw_command_buffer, .offset = draw_command_buffer_final_size - 32, .range = sizeof(uint32_t)
+                         .buffer = output_draw_command_buffer,
+                         .offset = output_draw_command_buffer.offset + draw_command_buffer_final_size - 32,
+                         .range = sizeof(uint32_t)
                      }
              ),
              descriptor_set.write(
@@ -72,15 +112,303 @@ UnmanagedBuffer FrustumCuller::execute(
              )},
             {}
     );
+
+    std::optional<ClusterExpansion> clusters;
+    if (clustered) {
+        clusters = cullClusters(
+                device, desc_alloc, buf_alloc, cmd_buf, gpu_data, mClusterCullPipeline, descriptor_set,
+                gpu_data.clusterCount, nullptr
+        );
+    }
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline.pipeline);
     cmd_buf.bindDescriptorSets(
-            vk::PipelineBindPoint::eCompute, *mPipeline.layout, 0, {gpu_data.sceneDescriptor, descriptor_set}, {}
+            vk::PipelineBindPoint::eCompute, *pipeline.layout, 0, {gpu_data.sceneDescriptor, descriptor_set}, {}
     );
 
-    cmd_buf.dispatch(util::divCeil(gpu_data.drawCommandCount, 64u), 1u, 1u);
+    if (occlusion) {
+        const DepthPyramid &pyramid = *occlusion->pyramid;
+        pyramid.image().barrier(cmd_buf, ImageResourceAccess::ComputeShaderReadGeneral);
+
+        OcclusionInlineUniformBlock occlusion_params = {
+            .viewProjection = pyramid.viewProjection(),
+            .pyramidSize = glm::vec2(pyramid.image().info.width, pyramid.image().info.height),
+            .pyramidLevels = pyramid.levels(),
+            .enableOcclusion = pyramid.valid(),
+            .secondPhase = occlusion->candidates != nullptr,
+        };
+
+        // Unused bindings of a phase alias the output, they are never accessed
+        const UnmanagedBuffer *rejected = &output_draw_command_buffer;
+        if (occlusion->rejected) {
+            *occlusion->rejected = allocateCommandBuffer(buf_alloc, cmd_buf, gpu_data.drawCommandCount);
+            rejected = occlusion->rejected;
+        }
+        const UnmanagedBuffer &input_count = occlusion->candidates ? *occlusion->candidates : output_draw_command_buffer;
+
+        DescriptorSet occlusion_set = desc_alloc.allocate(mOcclusionDescriptorLayout);
+        device.updateDescriptorSets(
+                {occlusion_set.write(
+                         OcclusionDescriptorLayout::DepthPyramid,
+                         vk::DescriptorImageInfo{
+                             .sampler = pyramid.sampler(), .imageView = pyramid.view(), .imageLayout = vk::ImageLayout::eGeneral
+                         }
+                 ),
+                 occlusion_set.write(OcclusionDescriptorLayout::InputCountBuffer, countInfo(input_count)),
+                 occlusion_set.write(OcclusionDescriptorLayout::RejectedDrawCommandBuffer, commandsInfo(*rejected)),
+                 occlusion_set.write(OcclusionDescriptorLayout::RejectedCountBuffer, countInfo(*rejected)),
+                 occlusion_set.write(
+                         OcclusionDescriptorLayout::OcclusionParams,
+                         vk::WriteDescriptorSetInlineUniformBlock{
+                             .dataSize = sizeof(occlusion_params),
+                             .pData = &occlusion_params,
+                         }
+                 )},
+                {}
+        );
+        cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipeline.layout, 2, {occlusion_set}, {});
+    }
+
+    if (clusters) {
+        uint32_t cluster_set_index = occlusion ? 3 : 2;
+        cmd_buf.bindDescriptorSets(
+                vk::PipelineBindPoint::eCompute, *pipeline.layout, cluster_set_index, {clusters->descriptorSet}, {}
+        );
+        cmd_buf.dispatchIndirect(clusters->dispatch, clusters->dispatch.offset);
+    } else {
+        cmd_buf.dispatch(util::divCeil(gpu_data.drawCommandCount, 64u), 1u, 1u);
+    }
 
     return output_draw_command_buffer;
 }
 
+std::vector<UnmanagedBuffer> FrustumCuller::execute(
+        const vk::Device &device,
+        const DescriptorAllocator &desc_alloc,
+        const TransientBufferAllocator &buf_alloc,
+        const UploadHeap &upload_heap,
+        const vk::CommandBuffer &cmd_buf,
+        const scene::GpuData &gpu_data,
+        std::span<const View> views,
+        CommandRange range
+) const {
+    Logger::check(views.size() <= MaxViews, "Too many views for multi view culling");
+    auto view_count = static_cast<uint32_t>(views.size());
+
+    uint32_t first_command = range == CommandRange::Animated ? gpu_data.staticDrawCommandCount : 0;
+    uint32_t command_count = range == CommandRange::Static ? gpu_data.staticDrawCommandCount : gpu_data.drawCommandCount;
+    command_count -= first_command;
+    // Static clusters come first like the static draw commands
+    uint32_t first_cluster = range == CommandRange::Animated ? gpu_data.staticClusterCount : 0;
+    uint32_t cluster_count = range == CommandRange::Static ? gpu_data.staticClusterCount : gpu_data.clusterCount;
+    cluster_count -= first_cluster;
+    bool clustered = hierarchical && cluster_count > 0;
+    const auto &pipeline = clustered ? mMultiViewClusterPipeline : mMultiViewPipeline;
+
+    // The lists of all views share one buffer. Their size is a multiple of the draw command size and 32 bytes,
+    // so the shader can address every list and count by index.
+    constexpr size_t list_alignment = sizeof(vk::DrawIndexedIndirectCommand) * 8;
+    size_t list_size = util::alignOffset(command_count * sizeof(vk::DrawIndexedIndirectCommand), list_alignment) +
+                       list_alignment;
+    auto output = buf_alloc.allocate(
+            list_size * view_count, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst |
+                                            vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eIndirectBuffer
+    );
+    output.barrier(cmd_buf, BufferResourceAccess::IndirectCommandRead, BufferResourceAccess::TransferWrite);
+    cmd_buf.fillBuffer(output, output.offset, output.size, 0);
+    output.barrier(cmd_buf, BufferResourceAccess::ComputeShaderStorageReadWrite);
+
+    gpu_data.instances.barrier(cmd_buf, BufferResourceAccess::ComputeShaderStorageRead);
+
+    std::vector<ShaderParamsInlineUniformBlock> view_params(view_count);
+    for (uint32_t i = 0; i < view_count; i++) {
+        view_params[i] = {
+            .planes = util::extractFrustumPlanes(views[i].viewProjection),
+            .minWorldRadius = views[i].minWorldRadius,
+        };
+        if (views[i].excludeFrustum) {
+            view_params[i].excludePlanes = util::extractFrustumPlanes(*views[i].excludeFrustum);
+            view_params[i].enableExcludePlanes = true;
+        }
+    }
+    UnmanagedBuffer view_buffer = upload_heap.write(view_params);
+
+    std::vector<CasterVolumeBlock> caster_volumes(view_count);
+    for (uint32_t i = 0; i < view_count; i++) {
+        Logger::check(views[i].casterVolume.size() <= MaxCasterVolumePlanes, "Too many caster volume planes");
+        std::ranges::copy(views[i].casterVolume, caster_volumes[i].planes.begin());
+        caster_volumes[i].planeCount = static_cast<glm::uint>(views[i].casterVolume.size());
+    }
+    UnmanagedBuffer caster_volume_buffer = upload_heap.write(caster_volumes);
+
+    DescriptorSet descriptor_set = desc_alloc.allocate(mMultiViewDescriptorLayout);
+    device.updateDescriptorSets(
+            {descriptor_set.write(
+                     MultiViewDescriptorLayout::InputDrawCommandBuffer,
+                     vk::DescriptorBufferInfo{.buffer = *gpu_data.drawCommands, .offset = 0, .range = vk::WholeSize}
+             ),
+             descriptor_set.write(MultiViewDescriptorLayout::OutputDrawCommandBuffer, output.descriptorInfo()),
+             descriptor_set.write(MultiViewDescriptorLayout::DrawCommandCountBuffer, output.descriptorInfo()),
+             descriptor_set.write(MultiViewDescriptorLayout::ViewBuffer, view_buffer.descriptorInfo()),
+             descriptor_set.write(MultiViewDescriptorLayout::CasterVolumeBuffer, caster_volume_buffer.descriptorInfo())},
+            {}
+    );
+
+    MultiViewPushConstants push_constants = {
+        .viewCount = view_count,
+        .firstCommand = first_command,
+        .commandCount = command_count,
+        .commandStride = static_cast<uint32_t>(list_size / sizeof(vk::DrawIndexedIndirectCommand)),
+        .countStride = static_cast<uint32_t>(list_size / sizeof(uint32_t)),
+        .countOffset = static_cast<uint32_t>((list_size - 32) / sizeof(uint32_t)),
+        .firstCluster = first_cluster,
+        .clusterCount = cluster_count,
+    };
+
+    // A cluster is expanded if any view may see one of its sections
+    std::optional<ClusterExpansion> clusters;
+    if (clustered) {
+        clusters = cullClusters(
+                device, desc_alloc, buf_alloc, cmd_buf, gpu_data, mMultiViewClusterCullPipeline, descriptor_set,
+                cluster_count, &push_constants
+        );
+    }
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline.pipeline);
+    cmd_buf.bindDescriptorSets(
+            vk::PipelineBindPoint::eCompute, *pipeline.layout, 0, {gpu_data.sceneDescriptor, descriptor_set}, {}
+    );
+    cmd_buf.pushConstants(*pipeline.layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(push_constants), &push_constants);
+
+    if (clusters) {
+        cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipeline.layout, 2, {clusters->descriptorSet}, {});
+        cmd_buf.dispatchIndirect(clusters->dispatch, clusters->dispatch.offset);
+    } else {
+        cmd_buf.dispatch(util::divCeil(command_count, 64u), 1u, 1u);
+    }
+    // The per view ranges do not know about the dispatch, so the whole buffer is made readable here
+    output.barrier(cmd_buf, BufferResourceAccess::IndirectCommandRead);
+
+    std::vector<UnmanagedBuffer> result;
+    result.reserve(view_count);
+    for (uint32_t i = 0; i < view_count; i++)
+        result.emplace_back(output.buffer, list_size, output.offset + i * list_size);
+    return result;
+}
+
+FrustumCuller::ClusterExpansion FrustumCuller::cullClusters(
+        const vk::Device &device,
+        const DescriptorAllocator &desc_alloc,
+        const TransientBufferAllocator &buf_alloc,
+        const vk::CommandBuffer &cmd_buf,
+        const scene::GpuData &gpu_data,
+        const ConfiguredComputePipeline &pipeline,
+        const DescriptorSet &params_set,
+        uint32_t cluster_count,
+        const MultiViewPushConstants *push_constants
+) const {
+    auto dispatch = buf_alloc.allocate(
+            sizeof(vk::DispatchIndirectCommand), vk::BufferUsageFlagBits::eStorageBuffer |
+                                                         vk::BufferUsageFlagBits::eTransferDst |
+                                                         vk::BufferUsageFlagBits::eIndirectBuffer
+    );
+    dispatch.barrier(cmd_buf, BufferResourceAccess::IndirectCommandRead, BufferResourceAccess::TransferWrite);
+    // No workgroups in x, one in y and z
+    cmd_buf.fillBuffer(dispatch, dispatch.offset, sizeof(uint32_t), 0);
+    cmd_buf.fillBuffer(dispatch, dispatch.offset + sizeof(uint32_t), 2 * sizeof(uint32_t), 1);
+    dispatch.barrier(cmd_buf, BufferResourceAccess::ComputeShaderStorageReadWrite);
+
+    auto visible = buf_alloc.allocate(cluster_count * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer);
+    visible.barrier(cmd_buf, BufferResourceAccess::ComputeShaderStorageWrite);
+
+    DescriptorSet cluster_set = desc_alloc.allocate(mClusterDescriptorLayout);
+    device.updateDescriptorSets(
+            {cluster_set.write(
+                     ClusterDescriptorLayout::ClusterBuffer,
+                     vk::DescriptorBufferInfo{.buffer = *gpu_data.clusters, .offset = 0, .range = vk::WholeSize}
+             ),
+             cluster_set.write(
+                     ClusterDescriptorLayout::ClusterSectionBuffer,
+                     vk::DescriptorBufferInfo{.buffer = *gpu_data.clusterSections, .offset = 0, .range = vk::WholeSize}
+             ),
+             cluster_set.write(ClusterDescriptorLayout::VisibleClusterBuffer, visible.descriptorInfo()),
+             cluster_set.write(ClusterDescriptorLayout::DispatchCommandBuffer, dispatch.descriptorInfo())},
+            {}
+    );
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline.pipeline);
+    cmd_buf.bindDescriptorSets(
+            vk::PipelineBindPoint::eCompute, *pipeline.layout, 0, {gpu_data.sceneDescriptor, params_set, cluster_set}, {}
+    );
+    if (push_constants) {
+        cmd_buf.pushConstants(
+                *pipeline.layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(*push_constants), push_constants
+        );
+    }
+    cmd_buf.dispatch(util::divCeil(cluster_count, 64u), 1u, 1u);
+
+    visible.barrier(cmd_buf, BufferResourceAccess::ComputeShaderStorageRead);
+    dispatch.barrier(cmd_buf, BufferResourceAccess::IndirectCommandRead);
+    return {.descriptorSet = cluster_set, .dispatch = std::move(dispatch)};
+}
+
+void FrustumCuller::CulledDrawCommands::barrier(const vk::CommandBuffer &cmd_buf) const {
+    for (uint32_t i = 0; i < listCount; i++)
+        lists[i].barrier(cmd_buf, BufferResourceAccess::IndirectCommandRead);
+}
+
+void FrustumCuller::CulledDrawCommands::draw(const vk::CommandBuffer &cmd_buf, const scene::GpuData &gpu_data) const {
+    if (listCount == 0) {
+        draw(cmd_buf, gpu_data, nullptr);
+        return;
+    }
+    for (uint32_t i = 0; i < listCount; i++)
+        draw(cmd_buf, gpu_data, &lists[i]);
+}
+
+void FrustumCuller::CulledDrawCommands::draw(
+        const vk::CommandBuffer &cmd_buf, const scene::GpuData &gpu_data, const UnmanagedBuffer *list
+) {
+    if (list) {
+        // Lists of a range of the draw commands may hold fewer than all of them
+        auto capacity = static_cast<uint32_t>((list->size - 32) / sizeof(vk::DrawIndexedIndirectCommand));
+        cmd_buf.drawIndexedIndirectCount(
+                *list, list->offset, *list, list->offset + list->size - 32, capacity,
+                sizeof(vk::DrawIndexedIndirectCommand)
+        );
+    } else {
+        cmd_buf.drawIndexedIndirect(
+                *gpu_data.drawCommands, 0, gpu_data.drawCommandCount, sizeof(vk::DrawIndexedIndirectCommand)
+        );
+    }
+}
+
+void FrustumCuller::copyStats(
+        const vk::CommandBuffer &cmd_buf,
+        const UnmanagedBuffer &first_phase,
+        const UnmanagedBuffer &rejected,
+        const UnmanagedBuffer &second_phase,
+        const BufferBase &dst
+) {
+    first_phase.barrier(cmd_buf, BufferResourceAccess::TransferRead);
+    rejected.barrier(cmd_buf, BufferResourceAccess::TransferRead);
+    second_phase.barrier(cmd_buf, BufferResourceAccess::TransferRead);
+    dst.barrier(cmd_buf, BufferResourceAccess::TransferWrite);
+
+    const UnmanagedBuffer *sources[] = {&first_phase, &rejected, &second_phase};
+    for (size_t i = 0; i < std::size(sources); i++) {
+        const UnmanagedBuffer &src = *sources[i];
+        cmd_buf.copyBuffer(
+                src, dst,
+                vk::BufferCopy{
+                    .srcOffset = src.offset + src.size - 32,
+                    .dstOffset = i * sizeof(uint32_t),
+                    .size = sizeof(uint32_t),
+                }
+        );
+    }
+}
+
 void FrustumCuller::createPipeline(const vk::Device &device, const ShaderLoader &shader_loader) {
     auto comp_sh = shader_loader.loadFromSource(device, "resources/shaders/frustum_cull.comp");
 
@@ -92,4 +420,58 @@ void FrustumCuller::createPipeline(const vk::Device &device, const ShaderLoader
 
     mPipeline = createComputePipeline(device, pipeline_config, *comp_sh);
     util::setDebugName(device, *mPipeline.pipeline, "frustum_cull");
+
+    std::vector<std::string> macros = {"OCCLUSION"};
+    auto occlusion_comp_sh = shader_loader.loadFromSource(device, "resources/shaders/frustum_cull.comp", macros);
+    pipeline_config.descriptorSetLayouts.push_back(mOcclusionDescriptorLayout);
+
+    mOcclusionPipeline = createComputePipeline(device, pipeline_config, *occlusion_comp_sh);
+    util::setDebugName(device, *mOcclusionPipeline.pipeline, "frustum_cull_occlusion");
+
+    macros = {"MULTI_VIEW"};
+    auto multi_view_comp_sh = shader_loader.loadFromSource(device, "resources/shaders/frustum_cull.comp", macros);
+    ComputePipelineConfig multi_view_pipeline_config = {
+        .descriptorSetLayouts = {scene_descriptor_layout, mMultiViewDescriptorLayout},
+        .pushConstants = {vk::PushConstantRange{
+            .stageFlags = vk::ShaderStageFlagBits::eCompute, .offset = 0, .size = sizeof(MultiViewPushConstants)
+        }}
+    };
+    mMultiViewPipeline = createComputePipeline(device, multi_view_pipeline_config, *multi_view_comp_sh);
+    util::setDebugName(device, *mMultiViewPipeline.pipeline, "frustum_cull_multi_view");
+
+    // The cluster set follows the sets of the section test, the cluster test shares its layout
+    ComputePipelineConfig cluster_pipeline_config = {
+        .descriptorSetLayouts = {scene_descriptor_layout, mShaderParamsDescriptorLayout, mClusterDescriptorLayout},
+        .pushConstants = {}
+    };
+    macros = {"CLUSTER_CULL"};
+    auto cluster_cull_comp_sh = shader_loader.loadFromSource(device, "resources/shaders/frustum_cull.comp", macros);
+    mClusterCullPipeline = createComputePipeline(device, cluster_pipeline_config, *cluster_cull_comp_sh);
+    util::setDebugName(device, *mClusterCullPipeline.pipeline, "frustum_cull_clusters");
+
+    macros = {"CLUSTERS"};
+    auto cluster_comp_sh = shader_loader.loadFromSource(device, "resources/shaders/frustum_cull.comp", macros);
+    mClusterPipeline = createComputePipeline(device, cluster_pipeline_config, *cluster_comp_sh);
+    util::setDebugName(device, *mClusterPipeline.pipeline, "frustum_cull_cluster_sections");
+
+    macros = {"OCCLUSION", "CLUSTERS"};
+    auto occlusion_cluster_comp_sh = shader_loader.loadFromSource(device, "resources/shaders/frustum_cull.comp", macros);
+    ComputePipelineConfig occlusion_cluster_pipeline_config = {
+        .descriptorSetLayouts = {scene_descriptor_layout, mShaderParamsDescriptorLayout, mOcclusionDescriptorLayout,
+                                 mClusterDescriptorLayout},
+        .pushConstants = {}
+    };
+    mOcclusionClusterPipeline = createComputePipeline(device, occlusion_cluster_pipeline_config, *occlusion_cluster_comp_sh);
+    util::setDebugName(device, *mOcclusionClusterPipeline.pipeline, "frustum_cull_occlusion_cluster_sections");
+
+    multi_view_pipeline_config.descriptorSetLayouts.push_back(mClusterDescriptorLayout);
+    macros = {"MULTI_VIEW", "CLUSTER_CULL"};
+    auto multi_view_cluster_cull_comp_sh = shader_loader.loadFromSource(device, "resources/shaders/frustum_cull.comp", macros);
+    mMultiViewClusterCullPipeline = createComputePipeline(device, multi_view_pipeline_config, *multi_view_cluster_cull_comp_sh);
+    util::setDebugName(device, *mMultiViewClusterCullPipeline.pipeline, "frustum_cull_multi_view_clusters");
+
+    macros = {"MULTI_VIEW", "CLUSTERS"};
+    auto multi_view_cluster_comp_sh = shader_loader.loadFromSource(device, "resources/shaders/frustum_cull.comp", macros);
+    mMultiViewClusterPipeline = createComputePipeline(device, multi_view_pipeline_config, *multi_view_cluster_comp_sh);
+    util::setDebugName(device, *mMultiViewClusterPipeline.pipeline, "frustum_cull_multi_view_cluster_sections");
 }
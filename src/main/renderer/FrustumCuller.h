@@ -1,6 +1,9 @@
 #pragma once
 
 #include <array>
+#include <optional>
+#include <span>
+#include <vector>
 #include <glm/glm.hpp>
 
 #include "../backend/Buffer.h"
@@ -8,7 +11,9 @@
 #include "../backend/Pipeline.h"
 #include "../debug/Annotation.h"
 
+class DepthPyramid;
 class TransientBufferAllocator;
+class UploadHeap;
 namespace scene {
     struct GpuData;
 }
@@ -42,6 +47,162 @@ public:
         }
     };
 
+    // Must match MAX_VIEWS of the shader
+    static constexpr uint32_t MaxViews = 8;
+    // Must match MAX_CASTER_VOLUME_PLANES of the shader
+    static constexpr uint32_t MaxCasterVolumePlanes = 16;
+
+    struct alignas(16) CasterVolumeBlock {
+        std::array<glm::vec4, MaxCasterVolumePlanes> planes = {};
+        glm::uint planeCount = 0;
+    };
+
+    struct MultiViewDescriptorLayout : DescriptorSetLayout {
+        static constexpr StorageBufferBinding InputDrawCommandBuffer{0, vk::ShaderStageFlagBits::eCompute};
+        static constexpr StorageBufferBinding OutputDrawCommandBuffer{1, vk::ShaderStageFlagBits::eCompute};
+        static constexpr StorageBufferBinding DrawCommandCountBuffer{2, vk::ShaderStageFlagBits::eCompute};
+        // One ShaderParamsInlineUniformBlock per view
+        static constexpr StorageBufferBinding ViewBuffer{3, vk::ShaderStageFlagBits::eCompute};
+        // One CasterVolumeBlock per view
+        static constexpr StorageBufferBinding CasterVolumeBuffer{4, vk::ShaderStageFlagBits::eCompute};
+
+        MultiViewDescriptorLayout() = default;
+
+        explicit MultiViewDescriptorLayout(const vk::Device &device) {
+            create(device, {}, InputDrawCommandBuffer, OutputDrawCommandBuffer, DrawCommandCountBuffer, ViewBuffer, CasterVolumeBuffer);
+            util::setDebugName(device, vk::DescriptorSetLayout(*this), "frustum_culler_multi_view_descriptor_layout");
+        }
+    };
+
+    struct MultiViewPushConstants {
+        uint32_t viewCount;
+        // Range of the input draw commands
+        uint32_t firstCommand;
+        uint32_t commandCount;
+        // In draw commands
+        uint32_t commandStride;
+        // In uints
+        uint32_t countStride;
+        uint32_t countOffset;
+        // Range of the clusters, only used by hierarchical culling
+        uint32_t firstCluster;
+        uint32_t clusterCount;
+    };
+
+    /// <summary>
+    /// Clusters of the scene and the ones that passed the cluster test, see hierarchical.
+    /// Bound after the other sets of a pipeline.
+    /// </summary>
+    struct ClusterDescriptorLayout : DescriptorSetLayout {
+        static constexpr StorageBufferBinding ClusterBuffer{0, vk::ShaderStageFlagBits::eCompute};
+        static constexpr StorageBufferBinding ClusterSectionBuffer{1, vk::ShaderStageFlagBits::eCompute};
+        static constexpr StorageBufferBinding VisibleClusterBuffer{2, vk::ShaderStageFlagBits::eCompute};
+        static constexpr StorageBufferBinding DispatchCommandBuffer{3, vk::ShaderStageFlagBits::eCompute};
+
+        ClusterDescriptorLayout() = default;
+
+        explicit ClusterDescriptorLayout(const vk::Device &device) {
+            create(device, {}, ClusterBuffer, ClusterSectionBuffer, VisibleClusterBuffer, DispatchCommandBuffer);
+            util::setDebugName(device, vk::DescriptorSetLayout(*this), "frustum_culler_cluster_descriptor_layout");
+        }
+    };
+
+    /// <summary>
+    /// The draw commands to cull, see scene::GpuData::staticDrawCommandCount.
+    /// </summary>
+    enum class CommandRange {
+        All,
+        Static,
+        Animated,
+    };
+
+    /// <summary>
+    /// A view of the multi view culling, with the same parameters as execute.
+    /// </summary>
+    struct View {
+        glm::mat4 viewProjection;
+        std::optional<glm::mat4> excludeFrustum;
+        float minWorldRadius = 0.0f;
+        // Planes of a convex volume that sections must intersect, facing inwards. Empty to disable the test.
+        std::span<const glm::vec4> casterVolume;
+    };
+
+    struct alignas(16) OcclusionInlineUniformBlock {
+        glm::mat4 viewProjection;
+        glm::vec2 pyramidSize;
+        glm::uint pyramidLevels = 0;
+        glm::uint enableOcclusion = 0;
+        glm::uint secondPhase = 0;
+    };
+
+    struct OcclusionDescriptorLayout : DescriptorSetLayout {
+        static constexpr CombinedImageSamplerBinding DepthPyramid{0, vk::ShaderStageFlagBits::eCompute};
+        static constexpr StorageBufferBinding InputCountBuffer{1, vk::ShaderStageFlagBits::eCompute};
+        static constexpr StorageBufferBinding RejectedDrawCommandBuffer{2, vk::ShaderStageFlagBits::eCompute};
+        static constexpr StorageBufferBinding RejectedCountBuffer{3, vk::ShaderStageFlagBits::eCompute};
+        static constexpr InlineUniformBlockBinding OcclusionParams{4, vk::ShaderStageFlagBits::eCompute, sizeof(OcclusionInlineUniformBlock)};
+
+        OcclusionDescriptorLayout() = default;
+
+        explicit OcclusionDescriptorLayout(const vk::Device &device) {
+            create(device, {}, DepthPyramid, InputCountBuffer, RejectedDrawCommandBuffer, RejectedCountBuffer, OcclusionParams);
+            util::setDebugName(device, vk::DescriptorSetLayout(*this), "frustum_culler_occlusion_descriptor_layout");
+        }
+    };
+
+    /// <summary>
+    /// Occlusion culling against a depth pyramid, in two phases.
+    /// The first phase tests all sections against the pyramid of the previous frame and outputs the occluded ones
+    /// in `rejected`. After the visible sections were rendered and the pyramid rebuilt, the second phase re-tests
+    /// the `candidates`, the rejected sections of the first phase, to find the ones that were wrongly occluded.
+    /// </summary>
+    struct OcclusionCulling {
+        const DepthPyramid *pyramid = nullptr;
+        // Second phase only
+        const UnmanagedBuffer *candidates = nullptr;
+        // First phase only, in the same layout as the result
+        UnmanagedBuffer *rejected = nullptr;
+    };
+
+    /// <summary>
+    /// Culled draw commands of one view, drawn list after list. Passes rendering the same view share them,
+    /// so that the view is culled only once per frame. Without any list, all draw commands of the scene are drawn.
+    /// </summary>
+    struct CulledDrawCommands {
+        std::array<UnmanagedBuffer, 2> lists;
+        uint32_t listCount = 0;
+
+        void add(UnmanagedBuffer &&list) { lists[listCount++] = std::move(list); }
+
+        /// <summary>Makes the lists available to indirect draws, also in later command buffers.</summary>
+        void barrier(const vk::CommandBuffer &cmd_buf) const;
+
+        /// <summary>Records the draws of all lists. The index and vertex buffers must be bound.</summary>
+        void draw(const vk::CommandBuffer &cmd_buf, const scene::GpuData &gpu_data) const;
+
+        /// <summary>Records the draws of one list, or of all draw commands of the scene if it is null.</summary>
+        static void draw(const vk::CommandBuffer &cmd_buf, const scene::GpuData &gpu_data, const UnmanagedBuffer *list);
+    };
+
+    /// <summary>
+    /// Section counts of the two phase occlusion culling of one frame.
+    /// </summary>
+    struct Stats {
+        // Drawn in the first phase
+        uint32_t firstPhase = 0;
+        // Inside the frustum, but occluded by the previous frame's depth
+        uint32_t occluded = 0;
+        // Of the occluded ones, drawn in the second phase
+        uint32_t secondPhase = 0;
+        uint32_t total = 0;
+    };
+
+    /// <summary>
+    /// Whether the clusters of the scene are culled first and only the sections of visible ones are tested,
+    /// with an indirect dispatch. Does not apply to the second occlusion phase, which only tests few candidates.
+    /// </summary>
+    bool hierarchical = true;
+
     ~FrustumCuller();
     explicit FrustumCuller(const vk::Device &device);
 
@@ -64,7 +225,8 @@ public:
     /// <param name="view_projection_matrix">The view-projection matrix of the camera, used to extract frustum planes.</param>
     /// <param name="exclude_frustum">An optional frustum to exclude objects from. Objects inside this frustum will be culled.</param>
     /// <param name="min_world_radius">Minimum world radius of objects to be culled. Objects smaller than this will always be culled.</param>
-    /// <returns>A buffer containing the culled draw commands. The draw command count is at offset `buffer_size - 32`.</returns>
+    /// <param name="occlusion">Optional occlusion culling, see OcclusionCulling.</param>
+    /// <returns>A buffer containing the culled draw commands. The draw command count is at offset `buffer.offset + buffer.size - 32`.</returns>
     UnmanagedBuffer execute(
             const vk::Device &device,
             const DescriptorAllocator &desc_alloc,
@@ -73,12 +235,75 @@ public:
             const scene::GpuData &gpu_data,
             const glm::mat4 &view_projection_matrix,
             const glm::mat4 *exclude_frustum = nullptr,
-            float min_world_radius = 0.0
+            float min_world_radius = 0.0,
+            const OcclusionCulling *occlusion = nullptr
     ) const;
 
+    /// <summary>
+    /// Culls the draw commands for multiple views in a single dispatch. Each section is read once
+    /// and tested against all views.
+    /// </summary>
+    /// <returns>
+    /// One buffer of culled draw commands per view, in the same layout as the result of execute.
+    /// They are ready to be read by indirect draws.
+    /// </returns>
+    std::vector<UnmanagedBuffer> execute(
+            const vk::Device &device,
+            const DescriptorAllocator &desc_alloc,
+            const TransientBufferAllocator &buf_alloc,
+            const UploadHeap &upload_heap,
+            const vk::CommandBuffer &cmd_buf,
+            const scene::GpuData &gpu_data,
+            std::span<const View> views,
+            CommandRange range = CommandRange::All
+    ) const;
+
+    /// <summary>
+    /// Copies the draw command counts of both phases into the first three values of a Stats struct in `dst`.
+    /// </summary>
+    static void copyStats(
+            const vk::CommandBuffer &cmd_buf,
+            const UnmanagedBuffer &first_phase,
+            const UnmanagedBuffer &rejected,
+            const UnmanagedBuffer &second_phase,
+            const BufferBase &dst
+    );
+
 private:
+    struct ClusterExpansion {
+        DescriptorSet descriptorSet;
+        // Launches one workgroup per visible cluster
+        UnmanagedBuffer dispatch;
+    };
+
     void createPipeline(const vk::Device &device, const ShaderLoader &shader_loader);
 
+    /// <summary>
+    /// Records the cluster test with the scene and parameter sets of the section test that follows.
+    /// </summary>
+    ClusterExpansion cullClusters(
+            const vk::Device &device,
+            const DescriptorAllocator &desc_alloc,
+            const TransientBufferAllocator &buf_alloc,
+            const vk::CommandBuffer &cmd_buf,
+            const scene::GpuData &gpu_data,
+            const ConfiguredComputePipeline &pipeline,
+            const DescriptorSet &params_set,
+            uint32_t cluster_count,
+            const MultiViewPushConstants *push_constants
+    ) const;
+
     ConfiguredComputePipeline mPipeline;
+    ConfiguredComputePipeline mOcclusionPipeline;
+    ConfiguredComputePipeline mMultiViewPipeline;
+    // Hierarchical culling, a cluster test followed by the section test of the visible clusters
+    ConfiguredComputePipeline mClusterCullPipeline;
+    ConfiguredComputePipeline mClusterPipeline;
+    ConfiguredComputePipeline mOcclusionClusterPipeline;
+    ConfiguredComputePipeline mMultiViewClusterCullPipeline;
+    ConfiguredComputePipeline mMultiViewClusterPipeline;
     ShaderParamsDescriptorLayout mShaderParamsDescriptorLayout;
+    OcclusionDescriptorLayout mOcclusionDescriptorLayout;
+    MultiViewDescriptorLayout mMultiViewDescriptorLayout;
+    ClusterDescriptorLayout mClusterDescriptorLayout;
 };
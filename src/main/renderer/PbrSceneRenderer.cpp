@@ -2,6 +2,7 @@
 
 #include <glm/ext/matrix_clip_space.hpp>
 
+#include "../backend/BarrierBatch.h"
 #include "../backend/Framebuffer.h"
 #include "../backend/ShaderCompiler.h"
 #include "../debug/Annotation.h"
@@ -39,41 +40,26 @@ void PbrSceneRenderer::recreate(const vk::Device &device, const ShaderLoader &sh
 void PbrSceneRenderer::execute(
         const vk::Device &device,
         const DescriptorAllocator &desc_alloc,
-        const TransientBufferAllocator &buf_alloc,
+        const UploadHeap &upload_heap,
         const vk::CommandBuffer &cmd_buf,
         const Framebuffer &fb,
         const Camera &camera,
         const scene::GpuData &gpu_data,
-        const FrustumCuller &frustum_culler,
+        const FrustumCuller::CulledDrawCommands &culled_commands,
         const DirectionalLight &sun_light,
-        std::span<const CascadedShadowCaster> sun_shadow_cascades,
+        const ShadowCascade &sun_shadow_cascade,
         const ImageViewPairBase &ao_result,
         const BufferBase &tile_light_indices_buffer,
         const Settings &settings
 ) {
+    auto sun_shadow_cascades = sun_shadow_cascade.cascades();
     Logger::check(sun_shadow_cascades.size() == Settings::SHADOW_CASCADE_COUNT, "Shadow cascade size doesn't match");
 
-    // Culling
-    util::ScopedCommandLabel dbg_cmd_label_region(cmd_buf, "Culling");
-
-    glm::mat4 frustum_matrix = camera.projectionMatrix() * camera.viewMatrix();
-    if (pauseCulling) {
-        if (!mCapturedFrustum.has_value()) {
-            mCapturedFrustum = std::make_optional<glm::mat4>(frustum_matrix);
-        }
-        frustum_matrix = mCapturedFrustum.value();
-    } else if (mCapturedFrustum.has_value()) {
-        mCapturedFrustum.reset();
-    }
-
-    UnmanagedBuffer culled_commands = {};
-    if (enableCulling) {
-        culled_commands = frustum_culler.execute(device, desc_alloc, buf_alloc, cmd_buf, gpu_data, frustum_matrix);
-        culled_commands.barrier(cmd_buf, BufferResourceAccess::IndirectCommandRead);
-    }
+    // The main view was culled by the depth prepass
+    culled_commands.barrier(cmd_buf);
 
     // Descriptor Update
-    dbg_cmd_label_region.swap("Descriptor Update");
+    util::ScopedCommandLabel dbg_cmd_label_region(cmd_buf, "Descriptor Update");
 
     glm::mat3 sun_rotation = sun_light.rotation();
     std::array<ShadowCascadeUniformBlock, Settings::SHADOW_CASCADE_COUNT> shadow_cascade_uniform_blocks = {};
@@ -98,16 +84,8 @@ void PbrSceneRenderer::execute(
         };
     }
 
-    UnmanagedBuffer shadow_cascade_uniform_buffer = buf_alloc.allocate(
-            sun_shadow_cascades.size_bytes(), vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst
-    );
-    util::setDebugName(device, shadow_cascade_uniform_buffer.buffer, "shadow_cascades_uniform_buffer");
-    shadow_cascade_uniform_buffer.barrier(cmd_buf, BufferResourceAccess::TransferWrite);
-    cmd_buf.updateBuffer(
-            shadow_cascade_uniform_buffer.buffer, 0, sizeof(shadow_cascade_uniform_blocks),
-            shadow_cascade_uniform_blocks.data()
-    );
-    shadow_cascade_uniform_buffer.barrier(cmd_buf, BufferResourceAccess::GraphicsShaderUniformRead);
+    // Written by the host before submission, so no barrier is needed
+    UnmanagedBuffer shadow_cascade_uniform_buffer = upload_heap.write(shadow_cascade_uniform_blocks);
 
     glm::vec2 viewport_size = glm::vec2(fb.extent().width, fb.extent().height);
     ShaderParamsInlineUniformBlock uniform_block = {
@@ -135,7 +113,7 @@ void PbrSceneRenderer::execute(
              ),
              descriptor_set.write(
                      ShaderParamsDescriptorLayout::ShadowCascadeUniforms,
-                     {.buffer = shadow_cascade_uniform_buffer, .offset = 0, .range = vk::WholeSize}
+                     shadow_cascade_uniform_buffer.descriptorInfo()
              ),
              descriptor_set.write(
                      ShaderParamsDescriptorLayout::AmbientOcclusion,
@@ -147,10 +125,10 @@ void PbrSceneRenderer::execute(
              )},
             {}
     );
+    BarrierBatch shadow_barriers(cmd_buf);
+    sun_shadow_cascade.barrier(shadow_barriers, ImageResourceAccess::FragmentShaderReadOptimal);
+    shadow_barriers.flush();
     for (uint32_t i = 0; i < sun_shadow_cascades.size(); i++) {
-        sun_shadow_cascades[i].framebuffer().depthAttachment.image().barrier(
-                cmd_buf, ImageResourceAccess::FragmentShaderReadOptimal
-        );
         device.updateDescriptorSets(
                 descriptor_set.write(
                         ShaderParamsDescriptorLayout::SunShadowMap,
@@ -205,16 +183,7 @@ void PbrSceneRenderer::execute(
                       }}};
     cmd_buf.pushConstants(*mPipeline.layout, vk::ShaderStageFlagBits::eAllGraphics, 0, sizeof(push_constants), &push_constants);
 
-    if (enableCulling) {
-        cmd_buf.drawIndexedIndirectCount(
-                culled_commands, 0, culled_commands, culled_commands.size - 32, gpu_data.drawCommandCount,
-                sizeof(vk::DrawIndexedIndirectCommand)
-        );
-    } else {
-        cmd_buf.drawIndexedIndirect(
-                *gpu_data.drawCommands, 0, gpu_data.drawCommandCount, sizeof(vk::DrawIndexedIndirectCommand)
-        );
-    }
+    culled_commands.draw(cmd_buf, gpu_data);
     cmd_buf.endRendering();
 }
 
@@ -9,8 +9,7 @@
 
 
 struct ImageViewPairBase;
-class CascadedShadowCaster;
-class FrustumCuller;
+class ShadowCascade;
 class ShadowCaster;
 class Camera;
 namespace scene {
@@ -81,9 +80,6 @@ public:
         }
     };
 
-    bool pauseCulling = false;
-    bool enableCulling = true;
-
     ~PbrSceneRenderer();
     explicit PbrSceneRenderer(const vk::Device &device);
 
@@ -92,14 +88,14 @@ public:
     void execute(
             const vk::Device &device,
             const DescriptorAllocator &desc_alloc,
-            const TransientBufferAllocator &buf_alloc,
+            const UploadHeap &upload_heap,
             const vk::CommandBuffer &cmd_buf,
             const Framebuffer &fb,
             const Camera &camera,
             const scene::GpuData &gpu_data,
-            const FrustumCuller &frustum_culler,
+            const FrustumCuller::CulledDrawCommands &culled_commands,
             const DirectionalLight &sun_light,
-            std::span<const CascadedShadowCaster> sun_shadow_cascades,
+            const ShadowCascade &sun_shadow_cascade,
             const ImageViewPairBase &ao_result,
             const BufferBase &tile_light_indices_buffer,
             const Settings &settings
@@ -113,6 +109,4 @@ private:
     ConfiguredGraphicsPipeline mPipeline;
     vk::UniqueSampler mShadowSampler;
     vk::UniqueSampler mAoSampler;
-
-    std::optional<glm::mat4> mCapturedFrustum;
 };
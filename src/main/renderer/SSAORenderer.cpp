@@ -1,5 +1,6 @@
 #include "SSAORenderer.h"
 
+#include "../backend/BarrierBatch.h"
 #include "../backend/DeviceQueue.h"
 #include "../backend/ImageResource.h"
 #include "../backend/ShaderCompiler.h"
@@ -63,8 +64,9 @@ void SSAORenderer::execute(
 ) {
     util::ScopedCommandLabel dbg_cmd_label_region(cmd_buf, "Sampling");
 
-    depth_attachment.image().barrier(cmd_buf, ImageResourceAccess::ComputeShaderReadOptimal);
-    ao_result.image().barrier(cmd_buf, ImageResourceAccess::ComputeShaderWriteGeneral);
+    BarrierBatch(cmd_buf)
+            .add(depth_attachment.image(), ImageResourceAccess::ComputeShaderReadOptimal)
+            .add(ao_result.image(), ImageResourceAccess::ComputeShaderWriteGeneral);
 
     ShaderParamsInlineUniformBlock shader_params = {
         .projection = projection_mat,
@@ -145,8 +147,9 @@ void SSAORenderer::filterPass(
     uint32_t ao_height = ao_input.image().info.height;
 
     auto descriptor_set = allocator.allocate(mFilterShaderParamsDescriptorLayout);
-    ao_input.image().barrier(cmd_buf, ImageResourceAccess::ComputeShaderReadOptimal);
-    ao_output.image().barrier(cmd_buf, ImageResourceAccess::ComputeShaderWriteGeneral);
+    BarrierBatch(cmd_buf)
+            .add(ao_input.image(), ImageResourceAccess::ComputeShaderReadOptimal)
+            .add(ao_output.image(), ImageResourceAccess::ComputeShaderWriteGeneral);
     device.updateDescriptorSets(
             {
                 descriptor_set.write(
@@ -1,5 +1,6 @@
 #include "ShadowRenderer.h"
 
+#include <format>
 #include <glm/ext/matrix_clip_space.hpp>
 #include <glm/ext/matrix_transform.hpp>
 
@@ -7,6 +8,7 @@
 #include "../debug/Annotation.h"
 #include "../entity/ShadowCaster.h"
 #include "../scene/Scene.h"
+#include "../util/globals.h"
 
 
 ShadowRenderer::~ShadowRenderer() = default;
@@ -16,48 +18,181 @@ void ShadowRenderer::execute(
         const vk::Device &device,
         const DescriptorAllocator &desc_alloc,
         const TransientBufferAllocator &buf_alloc,
+        const UploadHeap &upload_heap,
         const vk::CommandBuffer &cmd_buf,
         const scene::GpuData &gpu_data,
         const FrustumCuller &frustum_culler,
-        const ShadowCaster &shadow_caster,
-        const ShadowCaster *inner_shadow_caster
+        const ShadowCascade &cascade
 ) {
+    auto cascades = cascade.cascades();
+
+    // Cascades that are not due keep their shadow map of an earlier frame
+    std::vector<size_t> due;
+    for (size_t i = 0; i < cascades.size(); i++) {
+        if (cascades[i].due)
+            due.push_back(i);
+    }
+    if (due.empty())
+        return;
+
+    // Static casters come from the caches, only the animated ones are culled and drawn every frame
+    bool cached = cascade.cacheStatic();
+    if (cached) {
+        updateStaticCaches(device, desc_alloc, buf_alloc, upload_heap, cmd_buf, gpu_data, frustum_culler, cascade, due);
+    } else {
+        cascade.invalidateStaticCaches();
+    }
+
     // Culling
     util::ScopedCommandLabel dbg_cmd_label_region(cmd_buf, "Culling");
 
-    glm::mat4 frustum_matrix = shadow_caster.projectionMatrix * shadow_caster.viewMatrix;
-    glm::mat4 *exclude_matrix = nullptr;
-    if (inner_shadow_caster) {
-        glm::mat4 inner_frustum_matrix = inner_shadow_caster->projectionMatrix * inner_shadow_caster->viewMatrix;
-        exclude_matrix = &inner_frustum_matrix;
+    std::vector<FrustumCuller::View> views;
+    views.reserve(due.size());
+    for (size_t i: due) {
+        const CascadedShadowCaster &caster = cascades[i];
+        FrustumCuller::View view = {
+            .viewProjection = caster.projectionMatrix * caster.viewMatrix,
+            .minWorldRadius = minWorldRadius(caster),
+            .casterVolume = std::span(caster.casterVolume.data(), caster.casterVolume.size()),
+        };
+        // A cascade that is kept for several frames would miss the casters of areas the inner cascade moved away from
+        if (i > 0 && caster.updateInterval <= 1) {
+            view.excludeFrustum = cascades[i - 1].projectionMatrix * cascades[i - 1].viewMatrix;
+        }
+        views.push_back(view);
     }
 
-    // Cull objects smaller than ~1 texel
-    float scale_x = shadow_caster.projectionMatrix[0][0];
-    float scale_y = shadow_caster.projectionMatrix[1][1];
-    float half_extent = std::max(1.0f / scale_x, 1.0f / scale_y);
-    float min_world_radius = half_extent / shadow_caster.resolution();
+    auto range = cached ? FrustumCuller::CommandRange::Animated : FrustumCuller::CommandRange::All;
+    auto culled_commands =
+            frustum_culler.execute(device, desc_alloc, buf_alloc, upload_heap, cmd_buf, gpu_data, views, range);
 
-    UnmanagedBuffer culled_commands = frustum_culler.execute(
-            device, desc_alloc, buf_alloc, cmd_buf, gpu_data, frustum_matrix, exclude_matrix, min_world_radius
-    );
-    culled_commands.barrier(cmd_buf, BufferResourceAccess::IndirectCommandRead);
+    auto load_op = vk::AttachmentLoadOp::eClear;
+    if (cached) {
+        dbg_cmd_label_region.swap("Copy Static Caches");
+        copyStaticCaches(cmd_buf, cascade, due);
+        load_op = vk::AttachmentLoadOp::eLoad;
+    }
 
     // Rendering
-    dbg_cmd_label_region.swap("Rendering");
+    if (cascade.layered() && mLayeredPipeline.pipeline) {
+        dbg_cmd_label_region.swap("Rendering");
+        renderLayered(cmd_buf, gpu_data, cascade, due, culled_commands, load_op);
+        return;
+    }
+    for (size_t j = 0; j < due.size(); j++) {
+        size_t i = due[j];
+        dbg_cmd_label_region.swap(std::format("Rendering Cascade {}", i));
+        render(cmd_buf, gpu_data, cascades[i], culled_commands[j], cascades[i].framebuffer(), load_op);
+    }
+}
+
+void ShadowRenderer::updateStaticCaches(
+        const vk::Device &device,
+        const DescriptorAllocator &desc_alloc,
+        const TransientBufferAllocator &buf_alloc,
+        const UploadHeap &upload_heap,
+        const vk::CommandBuffer &cmd_buf,
+        const scene::GpuData &gpu_data,
+        const FrustumCuller &frustum_culler,
+        const ShadowCascade &cascade,
+        std::span<const size_t> due
+) {
+    auto cascades = cascade.cascades();
+
+    // The inner cascade exclusion and the caster volume move with the camera,
+    // so a cache holds all static casters of its cascade
+    std::vector<size_t> stale;
+    std::vector<FrustumCuller::View> views;
+    for (size_t i: due) {
+        if (!cascade.staticCacheStale(i))
+            continue;
+        stale.push_back(i);
+        views.push_back({
+            .viewProjection = cascades[i].projectionMatrix * cascades[i].viewMatrix,
+            .minWorldRadius = minWorldRadius(cascades[i]),
+        });
+    }
+    if (stale.empty())
+        return;
+
+    util::ScopedCommandLabel dbg_cmd_label_region(cmd_buf, "Static Cache Culling");
+    auto culled_commands = frustum_culler.execute(
+            device, desc_alloc, buf_alloc, upload_heap, cmd_buf, gpu_data, views, FrustumCuller::CommandRange::Static
+    );
+
+    for (size_t j = 0; j < stale.size(); j++) {
+        size_t i = stale[j];
+        dbg_cmd_label_region.swap(std::format("Rendering Static Cache {}", i));
+        render(cmd_buf, gpu_data, cascades[i], culled_commands[j], cascade.staticCache(i).framebuffer(),
+               vk::AttachmentLoadOp::eClear);
+        cascade.markStaticCacheRendered(i);
+    }
+}
+
+void ShadowRenderer::copyStaticCaches(
+        const vk::CommandBuffer &cmd_buf, const ShadowCascade &cascade, std::span<const size_t> due
+) {
+    const Image &cache = cascade.staticCacheImage();
+    auto cascades = cascade.cascades();
+    cache.barrier(cmd_buf, ImageResourceAccess::TransferRead);
+
+    vk::Extent3D extent = {cache.info.width, cache.info.height, 1};
+    auto layer = [](size_t i) {
+        return vk::ImageSubresourceLayers{
+            .aspectMask = vk::ImageAspectFlagBits::eDepth, .baseArrayLayer = static_cast<uint32_t>(i), .layerCount = 1
+        };
+    };
+
+    if (cascade.layered()) {
+        // The layers of the cache match the layers of the shadow maps
+        const ImageBase &target = cascade.layeredFramebuffer().depthAttachment.image();
+        target.barrier(cmd_buf, ImageResourceAccess::TransferWrite);
+        std::vector<vk::ImageCopy> regions;
+        for (size_t i: due)
+            regions.push_back({.srcSubresource = layer(i), .dstSubresource = layer(i), .extent = extent});
+        cmd_buf.copyImage(
+                cache, ImageResourceAccess::TransferRead.layout, target, ImageResourceAccess::TransferWrite.layout,
+                regions
+        );
+        return;
+    }
 
-    shadow_caster.framebuffer().depthAttachment.image().barrier(
+    for (size_t i: due) {
+        const ImageBase &target = cascades[i].framebuffer().depthAttachment.image();
+        target.barrier(cmd_buf, ImageResourceAccess::TransferWrite);
+        cmd_buf.copyImage(
+                cache, ImageResourceAccess::TransferRead.layout, target, ImageResourceAccess::TransferWrite.layout,
+                vk::ImageCopy{.srcSubresource = layer(i), .dstSubresource = layer(0), .extent = extent}
+        );
+    }
+}
+
+float ShadowRenderer::minWorldRadius(const ShadowCaster &shadow_caster) {
+    float scale_x = shadow_caster.projectionMatrix[0][0];
+    float scale_y = shadow_caster.projectionMatrix[1][1];
+    float half_extent = std::max(1.0f / scale_x, 1.0f / scale_y);
+    return half_extent / static_cast<float>(shadow_caster.resolution());
+}
+
+void ShadowRenderer::render(
+        const vk::CommandBuffer &cmd_buf,
+        const scene::GpuData &gpu_data,
+        const ShadowCaster &shadow_caster,
+        const UnmanagedBuffer &culled_commands,
+        const Framebuffer &fb,
+        vk::AttachmentLoadOp load_op
+) {
+    fb.depthAttachment.image().barrier(
             cmd_buf, ImageResourceAccess::DepthAttachmentEarlyOps, ImageResourceAccess::DepthAttachmentLateOps
     );
 
-    const Framebuffer &fb = shadow_caster.framebuffer();
     cmd_buf.beginRendering(fb.renderingInfo({
         .enableColorAttachments = false,
         .enableDepthAttachment = true,
         .enableStencilAttachment = false,
         .colorLoadOps = {vk::AttachmentLoadOp::eDontCare},
         .colorStoreOps = {vk::AttachmentStoreOp::eDontCare},
-        .depthLoadOp = vk::AttachmentLoadOp::eClear,
+        .depthLoadOp = load_op,
     }));
 
     mPipeline.config.viewports = {{fb.viewport(false)}};
@@ -72,20 +207,82 @@ void ShadowRenderer::execute(
     cmd_buf.bindIndexBuffer(*gpu_data.indices, 0, vk::IndexType::eUint32);
     cmd_buf.bindVertexBuffers(0, {*gpu_data.positions, *gpu_data.normals}, {0, 0});
 
-    ShaderParamsPushConstants shader_params = {
-        .projectionViewMatrix = frustum_matrix,
-        .sizeBias = shadow_caster.extrusionBias / static_cast<float>(shadow_caster.resolution()),
-    };
+    ShaderParamsPushConstants shader_params = pushConstants(shadow_caster);
     cmd_buf.pushConstants(*mPipeline.layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(shader_params), &shader_params);
 
-    cmd_buf.drawIndexedIndirectCount(
-            culled_commands, 0, culled_commands, culled_commands.size - 32, gpu_data.drawCommandCount,
-            sizeof(vk::DrawIndexedIndirectCommand)
+    FrustumCuller::CulledDrawCommands::draw(cmd_buf, gpu_data, &culled_commands);
+
+    cmd_buf.endRendering();
+}
+
+void ShadowRenderer::renderLayered(
+        const vk::CommandBuffer &cmd_buf,
+        const scene::GpuData &gpu_data,
+        const ShadowCascade &cascade,
+        std::span<const size_t> due,
+        std::span<const UnmanagedBuffer> culled_commands,
+        vk::AttachmentLoadOp load_op
+) {
+    const Framebuffer &fb = cascade.layeredFramebuffer();
+    auto cascades = cascade.cascades();
+    fb.depthAttachment.image().barrier(
+            cmd_buf, ImageResourceAccess::DepthAttachmentEarlyOps, ImageResourceAccess::DepthAttachmentLateOps
     );
 
+    // Clears or loads all layers at once, unless the layers of cascades that are not due have to be kept
+    bool clear_layers = load_op == vk::AttachmentLoadOp::eClear && due.size() < cascades.size();
+    cmd_buf.beginRendering(fb.renderingInfo({
+        .layerCount = static_cast<uint32_t>(cascades.size()),
+        .enableColorAttachments = false,
+        .enableDepthAttachment = true,
+        .enableStencilAttachment = false,
+        .colorLoadOps = {vk::AttachmentLoadOp::eDontCare},
+        .colorStoreOps = {vk::AttachmentStoreOp::eDontCare},
+        .depthLoadOp = clear_layers ? vk::AttachmentLoadOp::eLoad : load_op,
+    }));
+
+    if (clear_layers) {
+        vk::ClearAttachment clear = {
+            .aspectMask = vk::ImageAspectFlagBits::eDepth,
+            // Reverse z, like the clear of the load op
+            .clearValue = vk::ClearDepthStencilValue{.depth = 0.0f},
+        };
+        std::vector<vk::ClearRect> rects;
+        for (size_t i: due)
+            rects.push_back({.rect = fb.area(), .baseArrayLayer = static_cast<uint32_t>(i), .layerCount = 1});
+        cmd_buf.clearAttachments(clear, rects);
+    }
+
+    mLayeredPipeline.config.viewports = {{fb.viewport(false)}};
+    mLayeredPipeline.config.scissors = {{fb.area()}};
+    mLayeredPipeline.config.apply(cmd_buf);
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, *mLayeredPipeline.pipeline);
+    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *mLayeredPipeline.layout, 0, {gpu_data.sceneDescriptor}, {});
+    cmd_buf.bindIndexBuffer(*gpu_data.indices, 0, vk::IndexType::eUint32);
+    cmd_buf.bindVertexBuffers(0, {*gpu_data.positions, *gpu_data.normals}, {0, 0});
+
+    for (size_t j = 0; j < due.size(); j++) {
+        const ShadowCaster &caster = cascades[due[j]];
+        cmd_buf.setDepthBias(caster.depthBiasConstant, caster.depthBiasClamp, caster.depthBiasSlope);
+        ShaderParamsPushConstants shader_params = pushConstants(caster, static_cast<uint32_t>(due[j]));
+        cmd_buf.pushConstants(
+                *mLayeredPipeline.layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(shader_params), &shader_params
+        );
+        FrustumCuller::CulledDrawCommands::draw(cmd_buf, gpu_data, &culled_commands[j]);
+    }
+
     cmd_buf.endRendering();
 }
 
+ShadowRenderer::ShaderParamsPushConstants ShadowRenderer::pushConstants(const ShadowCaster &shadow_caster, uint32_t layer) {
+    return {
+        .projectionViewMatrix = shadow_caster.projectionMatrix * shadow_caster.viewMatrix,
+        .sizeBias = shadow_caster.extrusionBias / static_cast<float>(shadow_caster.resolution()),
+        .layer = layer,
+    };
+}
+
 void ShadowRenderer::createPipeline(const vk::Device &device, const ShaderLoader &shader_loader) {
     auto vert_sh = shader_loader.loadFromSource(device, "resources/shaders/shadow.vert");
 
@@ -114,4 +311,13 @@ void ShadowRenderer::createPipeline(const vk::Device &device, const ShaderLoader
 
     mPipeline = createGraphicsPipeline(device, pipeline_config, {*vert_sh});
     util::setDebugName(device, *mPipeline.pipeline, "shadow");
+
+    if (globals::ShaderOutputLayer) {
+        std::vector<std::string> macros = {"LAYERED"};
+        auto layered_vert_sh = shader_loader.loadFromSource(device, "resources/shaders/shadow.vert", macros);
+        mLayeredPipeline = createGraphicsPipeline(device, pipeline_config, {*layered_vert_sh});
+        util::setDebugName(device, *mLayeredPipeline.pipeline, "shadow_layered");
+    } else {
+        mLayeredPipeline = {};
+    }
 }
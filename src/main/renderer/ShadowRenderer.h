@@ -6,6 +6,7 @@
 #include "FrustumCuller.h"
 
 
+class ShadowCascade;
 class ShadowCaster;
 namespace scene {
     struct GpuData;
@@ -19,7 +20,8 @@ public:
     struct alignas(16) ShaderParamsPushConstants {
         glm::mat4 projectionViewMatrix;
         float sizeBias;
-        float pad0;
+        // Array layer to render to, layered pipeline only
+        uint32_t layer;
         float pad1;
         float pad2;
     };
@@ -31,19 +33,67 @@ public:
         createPipeline(device, shader_loader);
     }
 
+    /// <summary>
+    /// Renders the cascades that are due this frame, culled together in a single dispatch.
+    /// Objects contained in a cascade are culled from the next one.
+    /// Layered cascades are rendered in a single pass, each list of draws selecting its layer.
+    /// If the cascade caches static casters, stale caches are re-rendered and copied into the shadow maps,
+    /// so that only the animated casters are drawn.
+    /// </summary>
     void execute(
             const vk::Device &device,
             const DescriptorAllocator &desc_alloc,
             const TransientBufferAllocator &buf_alloc,
+            const UploadHeap &upload_heap,
             const vk::CommandBuffer &cmd_buf,
             const scene::GpuData &gpu_data,
             const FrustumCuller &frustum_culler,
-            const ShadowCaster &shadow_caster,
-            const ShadowCaster* inner_shadow_caster = nullptr
+            const ShadowCascade &cascade
     );
 
 private:
     void createPipeline(const vk::Device &device, const ShaderLoader &shader_loader);
 
+    /// <summary>Culls objects smaller than ~1 texel.</summary>
+    static float minWorldRadius(const ShadowCaster &shadow_caster);
+
+    /// <summary>Renders the static casters of the due cascades whose cache is stale into the caches.</summary>
+    void updateStaticCaches(
+            const vk::Device &device,
+            const DescriptorAllocator &desc_alloc,
+            const TransientBufferAllocator &buf_alloc,
+            const UploadHeap &upload_heap,
+            const vk::CommandBuffer &cmd_buf,
+            const scene::GpuData &gpu_data,
+            const FrustumCuller &frustum_culler,
+            const ShadowCascade &cascade,
+            std::span<const size_t> due
+    );
+
+    static void copyStaticCaches(const vk::CommandBuffer &cmd_buf, const ShadowCascade &cascade, std::span<const size_t> due);
+
+    /// <summary>Renders with the caster's matrices and biases into the framebuffer.</summary>
+    void render(
+            const vk::CommandBuffer &cmd_buf,
+            const scene::GpuData &gpu_data,
+            const ShadowCaster &shadow_caster,
+            const UnmanagedBuffer &culled_commands,
+            const Framebuffer &fb,
+            vk::AttachmentLoadOp load_op
+    );
+
+    void renderLayered(
+            const vk::CommandBuffer &cmd_buf,
+            const scene::GpuData &gpu_data,
+            const ShadowCascade &cascade,
+            std::span<const size_t> due,
+            std::span<const UnmanagedBuffer> culled_commands,
+            vk::AttachmentLoadOp load_op
+    );
+
+    static ShaderParamsPushConstants pushConstants(const ShadowCaster &shadow_caster, uint32_t layer = 0);
+
     ConfiguredGraphicsPipeline mPipeline;
+    // Only created if vertex shaders can output the layer
+    ConfiguredGraphicsPipeline mLayeredPipeline;
 };
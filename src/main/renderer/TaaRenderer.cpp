@@ -0,0 +1,108 @@
+#include "TaaRenderer.h"
+
+#include "../backend/BarrierBatch.h"
+#include "../backend/Framebuffer.h"
+#include "../backend/Pipeline.h"
+#include "../backend/ShaderCompiler.h"
+#include "../debug/Annotation.h"
+#include "../util/math.h"
+
+TaaRenderer::~TaaRenderer() = default;
+
+TaaRenderer::TaaRenderer(const vk::Device &device) {
+    mShaderParamsDescriptorLayout = ShaderParamsDescriptorLayout(device);
+    mSampler = device.createSamplerUnique({
+        .magFilter = vk::Filter::eLinear,
+        .minFilter = vk::Filter::eLinear,
+        .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+        .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+    });
+    // Velocities and depths must not be interpolated across edges
+    mPointSampler = device.createSamplerUnique({
+        .magFilter = vk::Filter::eNearest,
+        .minFilter = vk::Filter::eNearest,
+        .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+        .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+    });
+}
+
+void TaaRenderer::createPipeline(const vk::Device &device, const ShaderLoader &shader_loader) {
+    auto comp_sh = shader_loader.loadFromSource(device, "resources/shaders/taa.comp");
+
+    ComputePipelineConfig pipeline_config = {
+        .flags = perFrameDescriptorPipelineFlags(),
+        .descriptorSetLayouts = {mShaderParamsDescriptorLayout},
+        .pushConstants = {vk::PushConstantRange{
+            .stageFlags = vk::ShaderStageFlagBits::eCompute, .offset = 0, .size = sizeof(PushConstants)
+        }}
+    };
+
+    mPipeline = createComputePipeline(device, pipeline_config, *comp_sh);
+    util::setDebugName(device, *mPipeline.pipeline, "taa");
+}
+
+void TaaRenderer::execute(
+        const vk::Device &device,
+        const DescriptorAllocator &allocator,
+        const vk::CommandBuffer &cmd_buf,
+        const ImageViewPairBase &color,
+        const ImageViewPairBase &history,
+        const ImageViewPairBase &velocity,
+        const ImageViewPairBase &depth,
+        const ImageViewPairBase &output,
+        const glm::mat4 &reprojection,
+        float feedback,
+        bool history_valid
+) {
+    BarrierBatch barriers(cmd_buf);
+    barriers.add(color.image(), ImageResourceAccess::ComputeShaderReadOptimal);
+    barriers.add(history.image(), ImageResourceAccess::ComputeShaderReadOptimal);
+    barriers.add(velocity.image(), ImageResourceAccess::ComputeShaderReadOptimal);
+    barriers.add(depth.image(), ImageResourceAccess::ComputeShaderReadOptimal);
+    barriers.add(output.image(), ImageResourceAccess::ComputeShaderWriteGeneral);
+    barriers.flush();
+
+    auto descriptor_set = allocator.allocateCached(
+            mShaderParamsDescriptorLayout,
+            {
+                DescriptorSet().write(
+                        ShaderParamsDescriptorLayout::InColor,
+                        vk::DescriptorImageInfo{
+                            .sampler = *mPointSampler, .imageView = color.view(), .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+                        }
+                ),
+                DescriptorSet().write(
+                        ShaderParamsDescriptorLayout::InHistory,
+                        vk::DescriptorImageInfo{
+                            .sampler = *mSampler, .imageView = history.view(), .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+                        }
+                ),
+                DescriptorSet().write(
+                        ShaderParamsDescriptorLayout::InVelocity,
+                        vk::DescriptorImageInfo{
+                            .sampler = *mPointSampler, .imageView = velocity.view(), .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+                        }
+                ),
+                DescriptorSet().write(
+                        ShaderParamsDescriptorLayout::InDepth,
+                        vk::DescriptorImageInfo{
+                            .sampler = *mPointSampler, .imageView = depth.view(), .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+                        }
+                ),
+                DescriptorSet().write(
+                        ShaderParamsDescriptorLayout::OutColor,
+                        vk::DescriptorImageInfo{.imageView = output.view(), .imageLayout = vk::ImageLayout::eGeneral}
+                ),
+            }
+    );
+    allocator.bind(cmd_buf, vk::PipelineBindPoint::eCompute, *mPipeline.layout, 0, descriptor_set);
+
+    PushConstants push_constants = {
+        .reprojection = reprojection,
+        .historyWeight = history_valid ? feedback : 0.0f,
+    };
+
+    cmd_buf.pushConstants(*mPipeline.layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(push_constants), &push_constants);
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, *mPipeline.pipeline);
+    cmd_buf.dispatch(util::divCeil(output.image().info.width, 8u), util::divCeil(output.image().info.height, 8u), 1);
+}
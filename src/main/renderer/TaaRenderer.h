@@ -0,0 +1,75 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include "../backend/Descriptors.h"
+#include "../backend/Pipeline.h"
+#include "../debug/Annotation.h"
+
+
+struct ImageViewPairBase;
+class ShaderLoader;
+namespace vk {
+    class Device;
+}
+
+/// <summary>
+/// Resolves the jittered scene color against the reprojected history of previous frames.
+/// The history is clipped to the color distribution of the current neighborhood to reject stale samples.
+/// </summary>
+class TaaRenderer {
+
+public:
+    struct ShaderParamsDescriptorLayout : DescriptorSetLayout {
+        static constexpr CombinedImageSamplerBinding InColor{0, vk::ShaderStageFlagBits::eCompute};
+        static constexpr CombinedImageSamplerBinding InHistory{1, vk::ShaderStageFlagBits::eCompute};
+        static constexpr CombinedImageSamplerBinding InVelocity{2, vk::ShaderStageFlagBits::eCompute};
+        static constexpr CombinedImageSamplerBinding InDepth{3, vk::ShaderStageFlagBits::eCompute};
+        static constexpr StorageImageBinding OutColor{4, vk::ShaderStageFlagBits::eCompute};
+
+        ShaderParamsDescriptorLayout() = default;
+
+        explicit ShaderParamsDescriptorLayout(const vk::Device &device) {
+            create(device, perFrameDescriptorSetLayoutFlags(), InColor, InHistory, InVelocity, InDepth, OutColor);
+            util::setDebugName(device, vk::DescriptorSetLayout(*this), "taa_renderer_descriptor_layout");
+        }
+    };
+
+    struct PushConstants {
+        // Maps the current jittered clip space to the previous frame's uv, for pixels without a velocity
+        glm::mat4 reprojection;
+        float historyWeight;
+    };
+
+    ~TaaRenderer();
+    explicit TaaRenderer(const vk::Device &device);
+
+    void recreate(const vk::Device &device, const ShaderLoader &shader_loader) {
+        createPipeline(device, shader_loader);
+    }
+
+    /// <summary>
+    /// Blends the color with the history into the output, which becomes the history of the next frame.
+    /// An invalid history, e.g. after a resize, is ignored.
+    /// </summary>
+    void execute(
+            const vk::Device &device,
+            const DescriptorAllocator &descriptor_allocator,
+            const vk::CommandBuffer &cmd_buf,
+            const ImageViewPairBase &color,
+            const ImageViewPairBase &history,
+            const ImageViewPairBase &velocity,
+            const ImageViewPairBase &depth,
+            const ImageViewPairBase &output,
+            const glm::mat4 &reprojection,
+            float feedback,
+            bool history_valid
+    );
+
+private:
+    void createPipeline(const vk::Device &device, const ShaderLoader &shader_loader);
+
+    vk::UniqueSampler mSampler;
+    vk::UniqueSampler mPointSampler;
+    ConfiguredComputePipeline mPipeline;
+    ShaderParamsDescriptorLayout mShaderParamsDescriptorLayout;
+};
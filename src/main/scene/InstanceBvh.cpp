@@ -0,0 +1,313 @@
+#include "InstanceBvh.h"
+
+#include <algorithm>
+#include <limits>
+#include <tracy/Tracy.hpp>
+
+namespace {
+    bool isEmpty(const util::BoundingBox &bounds) { return bounds.min.x > bounds.max.x; }
+
+    util::BoundingBox transformBounds(const util::BoundingBox &local, const glm::mat4 &transform) {
+        util::BoundingBox world;
+        if (isEmpty(local))
+            return world;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 p = {
+                (corner & 1) != 0 ? local.max.x : local.min.x,
+                (corner & 2) != 0 ? local.max.y : local.min.y,
+                (corner & 4) != 0 ? local.max.z : local.min.z,
+            };
+            world.extend(glm::vec3(transform * glm::vec4(p, 1.0f)));
+        }
+        return world;
+    }
+
+    // Partitions the instances at the median of their centers along the longest axis and returns the split position
+    size_t splitMedian(std::span<uint32_t> instances, const std::vector<util::BoundingBox> &bounds) {
+        util::BoundingBox centers;
+        for (uint32_t instance: instances)
+            centers.extend((bounds[instance].min + bounds[instance].max) * 0.5f);
+        glm::vec3 size = centers.max - centers.min;
+        int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+        size_t mid = instances.size() / 2;
+        std::ranges::nth_element(instances, instances.begin() + static_cast<std::ptrdiff_t>(mid), {}, [&](uint32_t instance) {
+            return bounds[instance].min[axis] + bounds[instance].max[axis];
+        });
+        return mid;
+    }
+
+    // Distance at which the ray enters the box, or infinity if it misses it within [0, max_t]
+    float rayEntry(const glm::vec3 &origin, const glm::vec3 &inv_direction, float max_t, const util::BoundingBox &bounds) {
+        glm::vec3 t0 = (bounds.min - origin) * inv_direction;
+        glm::vec3 t1 = (bounds.max - origin) * inv_direction;
+        glm::vec3 t_near = glm::min(t0, t1);
+        glm::vec3 t_far = glm::max(t0, t1);
+        float t_enter = std::max({t_near.x, t_near.y, t_near.z, 0.0f});
+        float t_exit = std::min({t_far.x, t_far.y, t_far.z, max_t});
+        return t_enter <= t_exit ? t_enter : std::numeric_limits<float>::infinity();
+    }
+}
+
+namespace scene {
+    InstanceBvh::InstanceBvh(
+            std::span<const util::BoundingBox> local_bounds, std::span<const glm::mat4> transforms, size_t animated_count
+    ) {
+        ZoneScoped;
+        mFirstAnimatedInstance = local_bounds.size() - animated_count;
+        mAnimatedLocalBounds.assign(local_bounds.begin() + static_cast<std::ptrdiff_t>(mFirstAnimatedInstance), local_bounds.end());
+
+        mWorldBounds.resize(local_bounds.size());
+        std::vector<uint32_t> static_instances;
+        std::vector<uint32_t> animated_instances;
+        for (uint32_t i = 0; i < local_bounds.size(); i++) {
+            if (isEmpty(local_bounds[i]))
+                continue;
+            mWorldBounds[i] = transformBounds(local_bounds[i], transforms[i]);
+            (i < mFirstAnimatedInstance ? static_instances : animated_instances).push_back(i);
+        }
+
+        mNodes.reserve(util::divCeil(static_cast<uint32_t>(local_bounds.size()), MaxLeafSize));
+        mLeafInstances.reserve(static_instances.size() + animated_instances.size());
+
+        // The root refers to the static subtree in its first slot and to the animated subtree in its second
+        mNodes.push_back(emptyNode());
+        if (!static_instances.empty())
+            build(0, 0, static_instances);
+        mFirstAnimatedNode = mNodes.size();
+        if (!animated_instances.empty())
+            build(0, 1, animated_instances);
+    }
+
+    InstanceBvh::Node InstanceBvh::emptyNode() {
+        Node node{};
+        node.minX.fill(std::numeric_limits<float>::infinity());
+        node.minY.fill(std::numeric_limits<float>::infinity());
+        node.minZ.fill(std::numeric_limits<float>::infinity());
+        node.maxX.fill(-std::numeric_limits<float>::infinity());
+        node.maxY.fill(-std::numeric_limits<float>::infinity());
+        node.maxZ.fill(-std::numeric_limits<float>::infinity());
+        node.child.fill(EmptySlot);
+        node.count.fill(0);
+        return node;
+    }
+
+    void InstanceBvh::build(uint32_t node, uint32_t slot, std::span<uint32_t> instances) {
+        util::BoundingBox bounds;
+        for (uint32_t instance: instances)
+            bounds.extend(mWorldBounds[instance]);
+        setSlotBounds(mNodes[node], slot, bounds);
+
+        if (instances.size() <= MaxLeafSize) {
+            mNodes[node].child[slot] = LeafBit | static_cast<uint32_t>(mLeafInstances.size());
+            mNodes[node].count[slot] = static_cast<uint32_t>(instances.size());
+            mLeafInstances.insert(mLeafInstances.end(), instances.begin(), instances.end());
+            return;
+        }
+
+        // Children are stored after their parent, so refitting in reverse order visits them first
+        auto child = static_cast<uint32_t>(mNodes.size());
+        mNodes.push_back(emptyNode());
+        mNodes[node].child[slot] = child;
+
+        // Two median splits give four non-empty groups of about equal size, the tree stays balanced
+        size_t mid = splitMedian(instances, mWorldBounds);
+        std::span<uint32_t> lower = instances.first(mid);
+        std::span<uint32_t> upper = instances.subspan(mid);
+        size_t lower_mid = splitMedian(lower, mWorldBounds);
+        size_t upper_mid = splitMedian(upper, mWorldBounds);
+        build(child, 0, lower.first(lower_mid));
+        build(child, 1, lower.subspan(lower_mid));
+        build(child, 2, upper.first(upper_mid));
+        build(child, 3, upper.subspan(upper_mid));
+    }
+
+    void InstanceBvh::setSlotBounds(Node &node, uint32_t slot, const util::BoundingBox &bounds) {
+        node.minX[slot] = bounds.min.x;
+        node.minY[slot] = bounds.min.y;
+        node.minZ[slot] = bounds.min.z;
+        node.maxX[slot] = bounds.max.x;
+        node.maxY[slot] = bounds.max.y;
+        node.maxZ[slot] = bounds.max.z;
+    }
+
+    void InstanceBvh::refitSlot(Node &node, uint32_t slot) const {
+        uint32_t child = node.child[slot];
+        if (child == EmptySlot)
+            return;
+
+        util::BoundingBox bounds;
+        if ((child & LeafBit) != 0) {
+            uint32_t first = child & ~LeafBit;
+            for (uint32_t i = first; i < first + node.count[slot]; i++)
+                bounds.extend(mWorldBounds[mLeafInstances[i]]);
+        } else {
+            const Node &child_node = mNodes[child];
+            for (uint32_t i = 0; i < Width; i++) {
+                if (child_node.child[i] == EmptySlot)
+                    continue;
+                bounds.extend({
+                    .min = {child_node.minX[i], child_node.minY[i], child_node.minZ[i]},
+                    .max = {child_node.maxX[i], child_node.maxY[i], child_node.maxZ[i]},
+                });
+            }
+        }
+        setSlotBounds(node, slot, bounds);
+    }
+
+    void InstanceBvh::refit(std::span<const glm::mat4> animated_transforms) {
+        ZoneScoped;
+        if (mNodes.empty())
+            return;
+
+        size_t count = std::min(animated_transforms.size(), mAnimatedLocalBounds.size());
+        for (size_t i = 0; i < count; i++)
+            mWorldBounds[mFirstAnimatedInstance + i] = transformBounds(mAnimatedLocalBounds[i], animated_transforms[i]);
+
+        for (size_t node = mNodes.size(); node > mFirstAnimatedNode; node--) {
+            for (uint32_t slot = 0; slot < Width; slot++)
+                refitSlot(mNodes[node - 1], slot);
+        }
+        refitSlot(mNodes[0], 1);
+    }
+
+    template<typename NodeTest, typename Visit>
+    void InstanceBvh::traverse(NodeTest &&node_test, Visit &&visit) const {
+        if (mNodes.empty())
+            return;
+
+        // The tree is balanced, so its depth is at most 16 and each level leaves at most three siblings on the stack
+        std::array<uint32_t, 64> stack;
+        size_t stack_size = 0;
+        stack[stack_size++] = 0;
+
+        while (stack_size > 0) {
+            const Node &node = mNodes[stack[--stack_size]];
+            std::array<bool, Width> hit = node_test(node);
+            for (uint32_t slot = 0; slot < Width; slot++) {
+                uint32_t child = node.child[slot];
+                if (child == EmptySlot || !hit[slot])
+                    continue;
+                if ((child & LeafBit) != 0) {
+                    uint32_t first = child & ~LeafBit;
+                    for (uint32_t i = first; i < first + node.count[slot]; i++)
+                        visit(mLeafInstances[i]);
+                } else
+                    stack[stack_size++] = child;
+            }
+        }
+    }
+
+    void InstanceBvh::queryFrustum(const std::array<glm::vec4, 6> &planes, std::vector<uint32_t> &out) const {
+        auto outside = [&](const glm::vec3 &min, const glm::vec3 &max) {
+            for (const glm::vec4 &plane: planes) {
+                glm::vec3 p = glm::mix(min, max, glm::greaterThan(glm::vec3(plane), glm::vec3(0.0f)));
+                if (glm::dot(glm::vec3(plane), p) + plane.w < 0.0f)
+                    return true;
+            }
+            return false;
+        };
+
+        traverse(
+                [&](const Node &node) {
+                    std::array<bool, Width> hit;
+                    hit.fill(true);
+                    for (const glm::vec4 &plane: planes) {
+                        // The corner furthest along the plane normal is the same for all lanes
+                        const auto &px = plane.x > 0.0f ? node.maxX : node.minX;
+                        const auto &py = plane.y > 0.0f ? node.maxY : node.minY;
+                        const auto &pz = plane.z > 0.0f ? node.maxZ : node.minZ;
+                        for (uint32_t i = 0; i < Width; i++)
+                            hit[i] = hit[i] && !(plane.x * px[i] + plane.y * py[i] + plane.z * pz[i] + plane.w < 0.0f);
+                    }
+                    return hit;
+                },
+                [&](uint32_t instance) {
+                    if (!outside(mWorldBounds[instance].min, mWorldBounds[instance].max))
+                        out.push_back(instance);
+                }
+        );
+    }
+
+    void InstanceBvh::querySphere(const glm::vec3 &center, float radius, std::vector<uint32_t> &out) const {
+        float radius_sq = radius * radius;
+        traverse(
+                [&](const Node &node) {
+                    std::array<bool, Width> hit;
+                    for (uint32_t i = 0; i < Width; i++) {
+                        float dx = std::max({node.minX[i] - center.x, 0.0f, center.x - node.maxX[i]});
+                        float dy = std::max({node.minY[i] - center.y, 0.0f, center.y - node.maxY[i]});
+                        float dz = std::max({node.minZ[i] - center.z, 0.0f, center.z - node.maxZ[i]});
+                        hit[i] = dx * dx + dy * dy + dz * dz <= radius_sq;
+                    }
+                    return hit;
+                },
+                [&](uint32_t instance) {
+                    const util::BoundingBox &bounds = mWorldBounds[instance];
+                    glm::vec3 d = glm::max(glm::max(bounds.min - center, glm::vec3(0.0f)), center - bounds.max);
+                    if (glm::dot(d, d) <= radius_sq)
+                        out.push_back(instance);
+                }
+        );
+    }
+
+    std::array<float, InstanceBvh::Width> InstanceBvh::rayEntries(
+            const Node &node, const glm::vec3 &origin, const glm::vec3 &inv_direction, float max_t
+    ) {
+        std::array<float, Width> entries;
+        for (uint32_t i = 0; i < Width; i++) {
+            float tx0 = (node.minX[i] - origin.x) * inv_direction.x;
+            float tx1 = (node.maxX[i] - origin.x) * inv_direction.x;
+            float ty0 = (node.minY[i] - origin.y) * inv_direction.y;
+            float ty1 = (node.maxY[i] - origin.y) * inv_direction.y;
+            float tz0 = (node.minZ[i] - origin.z) * inv_direction.z;
+            float tz1 = (node.maxZ[i] - origin.z) * inv_direction.z;
+            float t_enter = std::max({std::min(tx0, tx1), std::min(ty0, ty1), std::min(tz0, tz1), 0.0f});
+            float t_exit = std::min({std::max(tx0, tx1), std::max(ty0, ty1), std::max(tz0, tz1), max_t});
+            entries[i] = t_enter <= t_exit ? t_enter : std::numeric_limits<float>::infinity();
+        }
+        return entries;
+    }
+
+    void InstanceBvh::queryRay(
+            const glm::vec3 &origin, const glm::vec3 &direction, float max_t, std::vector<uint32_t> &out
+    ) const {
+        glm::vec3 inv_direction = 1.0f / direction;
+        traverse(
+                [&](const Node &node) {
+                    std::array<float, Width> entries = rayEntries(node, origin, inv_direction, max_t);
+                    std::array<bool, Width> hit;
+                    for (uint32_t i = 0; i < Width; i++)
+                        hit[i] = entries[i] <= max_t;
+                    return hit;
+                },
+                [&](uint32_t instance) {
+                    if (rayEntry(origin, inv_direction, max_t, mWorldBounds[instance]) <= max_t)
+                        out.push_back(instance);
+                }
+        );
+    }
+
+    std::optional<InstanceBvh::RayHit> InstanceBvh::raycast(
+            const glm::vec3 &origin, const glm::vec3 &direction, float max_t
+    ) const {
+        glm::vec3 inv_direction = 1.0f / direction;
+        std::optional<RayHit> closest;
+        traverse(
+                [&](const Node &node) {
+                    std::array<float, Width> entries = rayEntries(node, origin, inv_direction, max_t);
+                    float closest_t = closest ? closest->t : max_t;
+                    std::array<bool, Width> hit;
+                    for (uint32_t i = 0; i < Width; i++)
+                        hit[i] = entries[i] <= closest_t;
+                    return hit;
+                },
+                [&](uint32_t instance) {
+                    float t = rayEntry(origin, inv_direction, max_t, mWorldBounds[instance]);
+                    if (t <= max_t && (!closest || t < closest->t))
+                        closest = RayHit{.instance = instance, .t = t};
+                }
+        );
+        return closest;
+    }
+} // namespace scene
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "../util/math.h"
+
+namespace scene {
+    /// <summary>
+    /// Bounding volume hierarchy over the world space bounds of the scene instances, for spatial queries on the CPU.
+    /// Every node stores the bounds of its four children as separate arrays per coordinate,
+    /// so a query tests all children of a node in one pass over a few contiguous lanes.
+    /// Static and animated instances are built into separate subtrees below the root,
+    /// the animated one is refit every frame while its topology is kept.
+    /// </summary>
+    class InstanceBvh {
+    public:
+        static constexpr uint32_t Width = 4;
+        // Instances that are stored in a leaf instead of being split further
+        static constexpr uint32_t MaxLeafSize = 4;
+
+        struct RayHit {
+            uint32_t instance;
+            // Distance along the ray at which it enters the instance bounds
+            float t;
+        };
+
+        InstanceBvh() = default;
+
+        /// <summary>
+        /// Builds the hierarchy over the instances, whose last `animated_count` ones are animated.
+        /// Instances with empty local bounds, which have no mesh, are left out.
+        /// </summary>
+        InstanceBvh(
+                std::span<const util::BoundingBox> local_bounds, std::span<const glm::mat4> transforms, size_t animated_count
+        );
+
+        /// <summary>
+        /// Updates the bounds of the animated instances to their new transforms, in the order of the instances.
+        /// </summary>
+        void refit(std::span<const glm::mat4> animated_transforms);
+
+        /// <summary>
+        /// Appends the instances whose bounds are not entirely outside of any of the planes, which point inwards.
+        /// </summary>
+        void queryFrustum(const std::array<glm::vec4, 6> &planes, std::vector<uint32_t> &out) const;
+
+        /// <summary>Appends the instances whose bounds overlap the sphere.</summary>
+        void querySphere(const glm::vec3 &center, float radius, std::vector<uint32_t> &out) const;
+
+        /// <summary>Appends the instances whose bounds the ray enters within `max_t`, in no particular order.</summary>
+        void queryRay(const glm::vec3 &origin, const glm::vec3 &direction, float max_t, std::vector<uint32_t> &out) const;
+
+        /// <summary>
+        /// The instance whose bounds the ray enters first within `max_t`.
+        /// Subtrees behind the closest hit so far are skipped.
+        /// </summary>
+        [[nodiscard]] std::optional<RayHit> raycast(const glm::vec3 &origin, const glm::vec3 &direction, float max_t) const;
+
+        /// <summary>World space bounds per instance, empty for instances without a mesh.</summary>
+        [[nodiscard]] const std::vector<util::BoundingBox> &worldBounds() const { return mWorldBounds; }
+
+        [[nodiscard]] size_t nodeCount() const { return mNodes.size(); }
+
+    private:
+        // Child slots refer to a node, to a range of mLeafInstances if the leaf bit is set, or to nothing
+        static constexpr uint32_t LeafBit = 0x80000000u;
+        static constexpr uint32_t EmptySlot = 0xffffffffu;
+
+        struct Node {
+            // Bounds of the children, one lane per child. Empty slots have inverted infinite bounds
+            std::array<float, Width> minX;
+            std::array<float, Width> minY;
+            std::array<float, Width> minZ;
+            std::array<float, Width> maxX;
+            std::array<float, Width> maxY;
+            std::array<float, Width> maxZ;
+            std::array<uint32_t, Width> child;
+            // Number of instances of leaf slots
+            std::array<uint32_t, Width> count;
+        };
+
+        static Node emptyNode();
+
+        void build(uint32_t node, uint32_t slot, std::span<uint32_t> instances);
+        static void setSlotBounds(Node &node, uint32_t slot, const util::BoundingBox &bounds);
+        // Recomputes the bounds of a slot from the instances or the node it refers to
+        void refitSlot(Node &node, uint32_t slot) const;
+        // Distance at which the ray enters the bounds of each slot, or infinity if it misses them
+        static std::array<float, Width> rayEntries(
+                const Node &node, const glm::vec3 &origin, const glm::vec3 &inv_direction, float max_t
+        );
+
+        // Descends into the slots for which node_test(node) returns true and calls visit(instance) for their instances
+        template<typename NodeTest, typename Visit>
+        void traverse(NodeTest &&node_test, Visit &&visit) const;
+
+        std::vector<Node> mNodes;
+        // Instance indices, contiguous per leaf
+        std::vector<uint32_t> mLeafInstances;
+        std::vector<util::BoundingBox> mWorldBounds;
+        // Local bounds of the animated instances, which are transformed again on refit
+        std::vector<util::BoundingBox> mAnimatedLocalBounds;
+        size_t mFirstAnimatedInstance = 0;
+        // Nodes of the animated subtree are stored after all nodes of the static one
+        size_t mFirstAnimatedNode = 0;
+    };
+} // namespace scene
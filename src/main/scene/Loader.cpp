@@ -2,15 +2,59 @@
 
 #include <algorithm>
 #include <array>
+#include <numeric>
+#include <span>
+#include <tracy/Tracy.hpp>
 #include <utility>
 
 #include "../backend/StagingBuffer.h"
+#include "../backend/TimelineSemaphore.h"
 #include "../debug/Annotation.h"
 #include "../entity/Light.h"
 #include "../util/Logger.h"
 #include "Gltf.h"
 #include "gpu_types.h"
 
+namespace {
+    // Splits the sections at the median of their centers along the longest axis, until they fit into a cluster
+    void splitClusters(
+            std::span<glm::uint> sections,
+            const std::vector<util::BoundingBox> &bounds,
+            std::vector<ClusterBlock> &clusters,
+            std::vector<glm::uint> &cluster_sections
+    ) {
+        if (sections.size() <= ClusterBlock::MaxSections) {
+            util::BoundingBox cluster_bounds;
+            for (glm::uint section: sections)
+                cluster_bounds.extend(bounds[section]);
+            clusters.push_back({
+                .min = glm::vec4(cluster_bounds.min, 0.0f),
+                .max = glm::vec4(cluster_bounds.max, 0.0f),
+                .firstSection = static_cast<glm::uint>(cluster_sections.size()),
+                .sectionCount = static_cast<glm::uint>(sections.size()),
+                .dynamic = 0,
+            });
+            cluster_sections.insert(cluster_sections.end(), sections.begin(), sections.end());
+            return;
+        }
+
+        util::BoundingBox centers;
+        for (glm::uint section: sections)
+            centers.extend((bounds[section].min + bounds[section].max) * 0.5f);
+        glm::vec3 size = centers.max - centers.min;
+        int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+        // The first half is rounded up to full clusters, so only few clusters are partially filled
+        size_t mid = util::divCeil(static_cast<uint32_t>(sections.size() / 2), ClusterBlock::MaxSections) *
+                     ClusterBlock::MaxSections;
+        std::ranges::nth_element(sections, sections.begin() + static_cast<std::ptrdiff_t>(mid), {}, [&](glm::uint section) {
+            return bounds[section].min[axis] + bounds[section].max[axis];
+        });
+        splitClusters(sections.first(mid), bounds, clusters, cluster_sections);
+        splitClusters(sections.subspan(mid), bounds, clusters, cluster_sections);
+    }
+}
+
 namespace scene {
     Loader::Loader(
             const vma::Allocator &allocator,
@@ -26,6 +70,7 @@ namespace scene {
           mGraphicsQueue(graphicsQueue) {}
 
     Scene Loader::load(const std::filesystem::path &path) const {
+        ZoneScoped;
         gltf::Loader gltf_loader;
         gltf::Scene gltf_scene = gltf_loader.load(path);
         CpuData cpu_data = createCpuData(gltf_scene);
@@ -34,7 +79,14 @@ namespace scene {
         return {std::move(cpu_data), std::move(gpu_data)};
     }
 
-    CpuData Loader::createCpuData(const gltf::Scene &scene_data) const {
+    CpuData Loader::loadCpuData(const std::filesystem::path &path) {
+        ZoneScoped;
+        gltf::Loader gltf_loader;
+        return createCpuData(gltf_loader.load(path));
+    }
+
+    CpuData Loader::createCpuData(const gltf::Scene &scene_data) {
+        ZoneScoped;
         CpuData cpu_data{};
 
         const std::size_t node_count = scene_data.nodes.size();
@@ -82,6 +134,14 @@ namespace scene {
         cpu_data.lights = createLights(scene_data);
         createCpuDataInitNamedLightAnimations(scene_data, cpu_data);
 
+        std::vector<util::BoundingBox> local_bounds(cpu_data.instances.size());
+        std::vector<glm::mat4> transforms(cpu_data.instances.size());
+        for (size_t i = 0; i < cpu_data.instances.size(); i++) {
+            local_bounds[i] = cpu_data.instances[i].bounds;
+            transforms[i] = cpu_data.instances[i].transform;
+        }
+        cpu_data.instance_bvh = InstanceBvh(local_bounds, transforms, cpu_data.instance_animations.size());
+
         return cpu_data;
     }
 
@@ -103,7 +163,7 @@ namespace scene {
     }
 
     // Note Felix 16.01.26: See note in header
-    void Loader::createCpuDataInitNamedLightAnimations(const gltf::Scene &scene_data, scene::CpuData &cpuData) const {
+    void Loader::createCpuDataInitNamedLightAnimations(const gltf::Scene &scene_data, scene::CpuData &cpuData) {
         std::size_t light_index{0};
 
         for (const PointLight &light: scene_data.pointLights) {
@@ -123,6 +183,7 @@ namespace scene {
     }
 
     GpuData Loader::createGpuData(const gltf::Scene &scene_data) const {
+        ZoneScoped;
         vk::CommandPoolCreateInfo graphics_cmd_pool_create_info{};
         graphics_cmd_pool_create_info.setFlags(vk::CommandPoolCreateFlagBits::eTransient).setQueueFamilyIndex(mGraphicsQueue);
         vk::UniqueCommandPool graphics_cmd_pool = mDevice.createCommandPoolUnique(graphics_cmd_pool_create_info);
@@ -143,15 +204,20 @@ namespace scene {
         createGpuDataInitSampler(gpu_data);
         const auto image_indices = createGpuDataInitImages(scene_data, graphics_cmds, staging, gpu_data);
 
-        vk::UniqueSemaphore image_transfer_semaphore = mDevice.createSemaphoreUnique({});
-        vk::UniqueFence fence = mDevice.createFenceUnique({});
-        staging.submit(mTransferQueue, vk::SubmitInfo().setSignalSemaphores(*image_transfer_semaphore));
-        vk::PipelineStageFlags semaphore_stage_mask = vk::PipelineStageFlagBits::eTopOfPipe;
-        vk::SubmitInfo submitInfo{};
-        submitInfo.setWaitSemaphores(*image_transfer_semaphore)
-                .setCommandBuffers(graphics_cmds)
-                .setWaitDstStageMask(semaphore_stage_mask);
-        mGraphicsQueue.queue.submit(submitInfo, *fence);
+        uint64_t image_transfer_value = staging.submit(mTransferQueue);
+
+        // The graphics commands acquire the images released by the transfer queue
+        TimelineSemaphore graphics_timeline = TimelineSemaphore(mDevice);
+        vk::CommandBufferSubmitInfo graphics_cmds_info = {.commandBuffer = graphics_cmds};
+        vk::SemaphoreSubmitInfo wait_info =
+                staging.timeline().waitInfo(image_transfer_value, vk::PipelineStageFlagBits2::eAllCommands);
+        vk::SemaphoreSubmitInfo signal_info = graphics_timeline.signalInfo(graphics_timeline.next());
+        mGraphicsQueue.queue.submit2(
+                vk::SubmitInfo2()
+                        .setWaitSemaphoreInfos(wait_info)
+                        .setCommandBufferInfos(graphics_cmds_info)
+                        .setSignalSemaphoreInfos(signal_info)
+        );
 
         createGpuDataInitVertices(scene_data, staging, gpu_data);
         const auto node_instance_map = createGpuDataInitInstances(scene_data, staging, gpu_data);
@@ -162,10 +228,7 @@ namespace scene {
 
         staging.submit(mTransferQueue);
 
-        const vk::Result waitRes = mDevice.waitForFences(*fence, vk::True, UINT64_MAX);
-
-        if (waitRes != vk::Result::eSuccess)
-            Logger::fatal(std::format("waitForFences failed: {}", vk::to_string(waitRes)));
+        graphics_timeline.wait(graphics_timeline.value());
 
         return gpu_data;
     }
@@ -215,6 +278,7 @@ namespace scene {
     std::vector<uint32_t> Loader::createGpuDataInitImages(
             const gltf::Scene &scene_data, const vk::CommandBuffer &graphics_cmds, StagingBuffer &staging, GpuData &gpu_data
     ) const {
+        ZoneScoped;
         std::vector<uint32_t> image_indices;
         gpu_data.images.reserve(scene_data.images.size());
         gpu_data.views.reserve(scene_data.images.size());
@@ -271,6 +335,7 @@ namespace scene {
     }
 
     void Loader::createGpuDataInitVertices(const gltf::Scene &scene_data, StagingBuffer &staging, GpuData &gpu_data) const {
+        ZoneScoped;
         uploadBufferWithDebugName(
                 staging, scene_data.vertex_position_data, vk::BufferUsageFlagBits::eVertexBuffer, "vertex_positions",
                 gpu_data.positions, gpu_data.positionsAlloc
@@ -296,6 +361,7 @@ namespace scene {
     std::vector<glm::uint> Loader::createGpuDataInitInstances(
             const gltf::Scene &scene_data, StagingBuffer &staging, GpuData &gpu_data
     ) const {
+        ZoneScoped;
         const std::vector<gltf::Node> &nodes = scene_data.nodes;
 
         const std::size_t instance_count = std::ranges::count_if(nodes, [](const gltf::Node &node) {
@@ -341,19 +407,29 @@ namespace scene {
                 instance_blocks.end(), anim_inst_blocks_to_insert_last.begin(), anim_inst_blocks_to_insert_last.end()
         );
 
-        auto [raw_instance_buffer,
-              instance_alloc] = staging.upload(instance_blocks, vk::BufferUsageFlagBits::eStorageBuffer);
+        auto [raw_instance_buffer, instance_alloc] = staging.upload(
+                instance_blocks, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc
+        );
         gpu_data.instances = Buffer(
                 std::move(raw_instance_buffer), std::move(instance_alloc), instance_blocks.size() * sizeof(InstanceBlock)
         );
         util::setDebugName(mDevice, static_cast<vk::Buffer>(gpu_data.instances), "instances");
 
+        auto [raw_previous_instance_buffer,
+              previous_instance_alloc] = staging.upload(instance_blocks, vk::BufferUsageFlagBits::eStorageBuffer);
+        gpu_data.previousInstances = Buffer(
+                std::move(raw_previous_instance_buffer), std::move(previous_instance_alloc),
+                instance_blocks.size() * sizeof(InstanceBlock)
+        );
+        util::setDebugName(mDevice, static_cast<vk::Buffer>(gpu_data.previousInstances), "previous_instances");
+
         return node_instance_map;
     }
 
     void Loader::createGpuDataInitSections(
             const gltf::Scene &scene_data, StagingBuffer &staging, const std::vector<glm::uint> &node_instance_map, GpuData &gpu_data
     ) const {
+        ZoneScoped;
         std::vector<SectionBlock> section_blocks;
         section_blocks.reserve(scene_data.sections.size());
 
@@ -363,8 +439,17 @@ namespace scene {
         std::vector<BoundingBoxBlock> bounding_box_blocks;
         bounding_box_blocks.reserve(scene_data.bounds.size());
 
-        for (size_t i = 0; i < scene_data.sections.size(); i++) {
-            const auto &section = scene_data.sections[i];
+        // Sections of animated instances go last, like their instances, so the draw commands of static
+        // and animated sections are contiguous ranges
+        std::vector<size_t> section_order(scene_data.sections.size());
+        std::iota(section_order.begin(), section_order.end(), 0);
+        auto animated_sections = std::ranges::stable_partition(section_order, [&](size_t i) {
+            return scene_data.nodes[scene_data.sections[i].node].animation == UINT32_MAX;
+        });
+        gpu_data.staticDrawCommandCount = static_cast<uint32_t>(section_order.size() - animated_sections.size());
+
+        for (size_t i = 0; i < section_order.size(); i++) {
+            const auto &section = scene_data.sections[section_order[i]];
             draw_commands.emplace_back() = vk::DrawIndexedIndirectCommand{
                 .indexCount = section.indexCount,
                 .instanceCount = 1,
@@ -393,11 +478,68 @@ namespace scene {
                 staging, bounding_box_blocks, vk::BufferUsageFlagBits::eStorageBuffer, "bounding_boxes",
                 gpu_data.boundingBoxes, gpu_data.boundingBoxesAlloc
         );
+
+        createGpuDataInitClusters(scene_data, staging, section_order, gpu_data);
+    }
+
+    void Loader::createGpuDataInitClusters(
+            const gltf::Scene &scene_data, StagingBuffer &staging, const std::vector<size_t> &section_order, GpuData &gpu_data
+    ) const {
+        ZoneScoped;
+        // World space bounds of the static sections, indexed like the draw commands
+        std::vector<util::BoundingBox> bounds(gpu_data.staticDrawCommandCount);
+        std::vector<glm::uint> static_sections(gpu_data.staticDrawCommandCount);
+        for (glm::uint i = 0; i < gpu_data.staticDrawCommandCount; i++) {
+            const auto &section = scene_data.sections[section_order[i]];
+            const glm::mat4 &transform = scene_data.nodes[section.node].transform;
+            const util::BoundingBox &local = scene_data.bounds[section.bounds];
+            for (int corner = 0; corner < 8; corner++) {
+                glm::vec3 p = {
+                    (corner & 1) != 0 ? local.max.x : local.min.x,
+                    (corner & 2) != 0 ? local.max.y : local.min.y,
+                    (corner & 4) != 0 ? local.max.z : local.min.z,
+                };
+                bounds[i].extend(glm::vec3(transform * glm::vec4(p, 1.0f)));
+            }
+            static_sections[i] = i;
+        }
+
+        std::vector<ClusterBlock> clusters;
+        std::vector<glm::uint> cluster_sections;
+        cluster_sections.reserve(section_order.size());
+        if (!static_sections.empty())
+            splitClusters(static_sections, bounds, clusters, cluster_sections);
+        gpu_data.staticClusterCount = static_cast<uint32_t>(clusters.size());
+
+        // Animated sections move, so they are grouped in order and always expanded
+        for (size_t first = gpu_data.staticDrawCommandCount; first < section_order.size(); first += ClusterBlock::MaxSections) {
+            size_t count = std::min<size_t>(ClusterBlock::MaxSections, section_order.size() - first);
+            clusters.push_back({
+                .firstSection = static_cast<glm::uint>(cluster_sections.size()),
+                .sectionCount = static_cast<glm::uint>(count),
+                .dynamic = 1,
+            });
+            for (size_t i = first; i < first + count; i++)
+                cluster_sections.push_back(static_cast<glm::uint>(i));
+        }
+        gpu_data.clusterCount = static_cast<uint32_t>(clusters.size());
+        if (clusters.empty())
+            return;
+
+        uploadBufferWithDebugName(
+                staging, clusters, vk::BufferUsageFlagBits::eStorageBuffer, "clusters", gpu_data.clusters,
+                gpu_data.clustersAlloc
+        );
+        uploadBufferWithDebugName(
+                staging, cluster_sections, vk::BufferUsageFlagBits::eStorageBuffer, "cluster_sections",
+                gpu_data.clusterSections, gpu_data.clusterSectionsAlloc
+        );
     }
 
     void Loader::createGpuDataInitMaterials(
             const gltf::Scene &scene_data, StagingBuffer &staging, const std::vector<uint32_t> &image_indices, GpuData &gpu_data
     ) const {
+        ZoneScoped;
         std::vector<MaterialBlock> material_blocks;
         material_blocks.reserve(scene_data.materials.size());
         for (const auto &material: scene_data.materials) {
@@ -421,7 +563,7 @@ namespace scene {
         );
     }
 
-    std::vector<UberLightBlock> Loader::createLights(const gltf::Scene &scene_data) const {
+    std::vector<UberLightBlock> Loader::createLights(const gltf::Scene &scene_data) {
         // Note by Felix: Many magic numbers. I won't touch them because I do not understand them
 
         float light_range_epsilon = 1.0f / 128.0f;
@@ -462,6 +604,7 @@ namespace scene {
     }
 
     void Loader::createGpuDataInitLights(const gltf::Scene &scene_data, StagingBuffer &staging, GpuData &gpu_data) const {
+        ZoneScoped;
         auto uber_light_blocks = createLights(scene_data);
 
         vma::UniqueBuffer out_buffer;
@@ -474,6 +617,7 @@ namespace scene {
     }
 
     void Loader::createGpuDataUpdateDescriptorSet(GpuData &gpu_data) const {
+        ZoneScoped;
         mDevice.updateDescriptorSets(
                 {
                     gpu_data.sceneDescriptor.write(
@@ -484,6 +628,10 @@ namespace scene {
                             SceneDescriptorLayout::InstanceBuffer,
                             vk::DescriptorBufferInfo{.buffer = gpu_data.instances, .offset = 0, .range = vk::WholeSize}
                     ),
+                    gpu_data.sceneDescriptor.write(
+                            SceneDescriptorLayout::PreviousInstanceBuffer,
+                            vk::DescriptorBufferInfo{.buffer = gpu_data.previousInstances, .offset = 0, .range = vk::WholeSize}
+                    ),
                     gpu_data.sceneDescriptor.write(
                             SceneDescriptorLayout::MaterialBuffer,
                             vk::DescriptorBufferInfo{.buffer = *gpu_data.materials, .offset = 0, .range = vk::WholeSize}
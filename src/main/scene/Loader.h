@@ -45,8 +45,14 @@ namespace scene {
         /// <param name="path">The path to the glTF file.</param>
         [[nodiscard]] Scene load(const std::filesystem::path &path) const;
 
+        /// <summary>
+        /// Loads only the CPU side of a scene, which does not need a device.
+        /// </summary>
+        /// <param name="path">The path to the glTF file.</param>
+        [[nodiscard]] static CpuData loadCpuData(const std::filesystem::path &path);
+
     private:
-        [[nodiscard]] CpuData createCpuData(const gltf::Scene &scene_data) const;
+        [[nodiscard]] static CpuData createCpuData(const gltf::Scene &scene_data);
         [[nodiscard]] GpuData createGpuData(const gltf::Scene &scene_data) const;
 
         [[nodiscard]] static InstanceAnimation createInstanceAnimation(const gltf::Animation &animation_data);
@@ -61,7 +67,7 @@ namespace scene {
         // 2. Create the UberLightBlocks not by itering over the pointLight and spotLight vectors
         // directly but while iterating over the nodes such that relevant data like instance id and
         // instance name are available.
-        void createCpuDataInitNamedLightAnimations(const gltf::Scene &scene_data, scene::CpuData &cpuData) const;
+        static void createCpuDataInitNamedLightAnimations(const gltf::Scene &scene_data, scene::CpuData &cpuData);
 
         void createGpuDataInitDescriptorPool(GpuData &gpu_data) const;
 
@@ -87,11 +93,19 @@ namespace scene {
                 GpuData &gpu_data
         ) const;
 
+        // Groups the sections in the given order into clusters, static sections by their world space bounds
+        void createGpuDataInitClusters(
+                const gltf::Scene &scene_data,
+                StagingBuffer &staging,
+                const std::vector<size_t> &section_order,
+                GpuData &gpu_data
+        ) const;
+
         void createGpuDataInitMaterials(
                 const gltf::Scene &scene_data, StagingBuffer &staging, const std::vector<uint32_t> &image_indices, GpuData &gpu_data
         ) const;
 
-        std::vector<UberLightBlock> createLights(const gltf::Scene &scene_data) const;
+        static std::vector<UberLightBlock> createLights(const gltf::Scene &scene_data);
         void createGpuDataInitLights(const gltf::Scene &scene_data, StagingBuffer &staging, GpuData &gpu_data) const;
 
         void createGpuDataUpdateDescriptorSet(GpuData &gpu_data) const;
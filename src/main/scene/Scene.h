@@ -10,6 +10,7 @@
 #include "../backend/Descriptors.h"
 #include "../backend/Image.h"
 #include "../util/math.h"
+#include "InstanceBvh.h"
 #include "gpu_types.h"
 
 namespace scene {
@@ -41,6 +42,8 @@ namespace scene {
         vma::UniqueBuffer sections;
         vma::UniqueAllocation sectionsAlloc;
         Buffer instances;
+        // Transforms of the previous frame, for motion vectors
+        Buffer previousInstances;
         vma::UniqueBuffer boundingBoxes;
         vma::UniqueAllocation boundingBoxesAlloc;
 
@@ -54,8 +57,19 @@ namespace scene {
         DescriptorSet sceneDescriptor = {};
 
         uint32_t drawCommandCount = 0;
+        // Draw commands of static instances come first, followed by the ones of animated instances
+        uint32_t staticDrawCommandCount = 0;
         vma::UniqueBuffer drawCommands;
         vma::UniqueAllocation drawCommandsAlloc;
+
+        // Spatial clusters of sections for hierarchical culling, the static ones first
+        uint32_t clusterCount = 0;
+        uint32_t staticClusterCount = 0;
+        vma::UniqueBuffer clusters;
+        vma::UniqueAllocation clustersAlloc;
+        // Section indices, contiguous per cluster
+        vma::UniqueBuffer clusterSections;
+        vma::UniqueAllocation clusterSectionsAlloc;
     };
 
     struct Instance {
@@ -113,6 +127,12 @@ namespace scene {
         /// Stores the instance and animation index for each node name
         /// </summary>
         std::unordered_map<std::string, std::pair<size_t, size_t>> non_mesh_instance_animation_map;
+
+        /// <summary>
+        /// Spatial index over the world space bounds of the mesh instances, for queries on the CPU.
+        /// Has to be refit with the transforms of the animated instances whenever they move.
+        /// </summary>
+        InstanceBvh instance_bvh;
     };
 
     class Scene {
@@ -28,6 +28,22 @@ struct alignas(16) BoundingBoxBlock {
     glm::vec4 max;
 };
 
+// A range of sections close to each other, culled as a whole before its sections are tested
+struct alignas(16) ClusterBlock {
+    // Must not exceed LOCAL_SIZE of frustum_cull.comp, a workgroup expands one cluster
+    static constexpr glm::uint MaxSections = 64;
+
+    // World space, unused for dynamic clusters
+    glm::vec4 min;
+    glm::vec4 max;
+    // Into the cluster section indices
+    glm::uint firstSection;
+    glm::uint sectionCount;
+    // Sections of animated instances, whose bounds are not known up front
+    glm::uint dynamic;
+    glm::uint pad0;
+};
+
 struct alignas(16) MaterialBlock {
     glm::vec4 albedoFactors;
     // roughness, metalness, normal strength, emissive strength factors
@@ -78,6 +94,7 @@ namespace scene {
             3, vk::ShaderStageFlagBits::eAllGraphics, 4096, vk::DescriptorBindingFlagBits::ePartiallyBound
         };
         static constexpr StorageBufferBinding UberLightBuffer{4, vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eCompute};
+        static constexpr StorageBufferBinding PreviousInstanceBuffer{5, vk::ShaderStageFlagBits::eAllGraphics};
         static constexpr StorageBufferBinding BoundingBoxBuffer{
             6, vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eCompute
         };
@@ -85,7 +102,8 @@ namespace scene {
         SceneDescriptorLayout() = default;
 
         explicit SceneDescriptorLayout(const vk::Device &device) {
-            create(device, {}, SectionBuffer, InstanceBuffer, MaterialBuffer, ImageSamplers, UberLightBuffer, BoundingBoxBuffer);
+            create(device, {}, SectionBuffer, InstanceBuffer, MaterialBuffer, ImageSamplers, UberLightBuffer,
+                   PreviousInstanceBuffer, BoundingBoxBuffer);
             util::setDebugName(device, vk::DescriptorSetLayout(*this), "scene_descriptor_layout");
         }
     };
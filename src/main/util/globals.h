@@ -7,4 +7,12 @@ namespace globals {
 #else
     inline bool Debug = true;
 #endif
+    // Requested via the DESCRIPTOR_BUFFER env var. Reset by VulkanContext if VK_EXT_descriptor_buffer is unavailable.
+    inline bool DescriptorBuffer = false;
+    // Whether vertex shaders can select the layer to render to. Set by VulkanContext.
+    inline bool ShaderOutputLayer = false;
+    // Whether compute shaders support subgroup arithmetic operations. Set by VulkanContext.
+    inline bool SubgroupArithmetic = false;
+    // Frames to render offscreen before exiting, requested via the HEADLESS env var. Zero renders to a window.
+    inline int HeadlessFrames = 0;
 }
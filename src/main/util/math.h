@@ -72,6 +72,18 @@ namespace util {
 
     inline size_t alignOffset(size_t offset, size_t alignment) { return (offset + alignment - 1) & ~(alignment - 1); }
 
+    // Element of the Halton low-discrepancy sequence in [0, 1), index starts at 1
+    inline float halton(uint32_t index, uint32_t base) {
+        float result = 0.0f;
+        float fraction = 1.0f;
+        while (index > 0) {
+            fraction /= static_cast<float>(base);
+            result += fraction * static_cast<float>(index % base);
+            index /= base;
+        }
+        return result;
+    }
+
     inline glm::mat4 createReverseZInfiniteProjectionMatrix(float aspect_ratio, float fov, float near_plane) {
         float f = 1.0f / std::tan(fov / 2.0f);
         // This is a reversed projection matrix with an infinite far plane.